@@ -177,6 +177,12 @@ void WalletModel::onAllUtxoChanged(const std::vector<beam::Coin>& utxosVec)
     env->DeleteLocalRef(utxos);
 }
 
+void WalletModel::onUtxoChanged(beam::ChangeAction, const std::vector<beam::Coin>&)
+{
+    // the listener takes the whole list only, it's taken from the cache
+    onAllUtxoChanged(getUtxos());
+}
+
 void WalletModel::onAddresses(bool own, const std::vector<beam::WalletAddress>& addresses)
 {
     LOG_DEBUG() << "onAddresses(" << own << ")";
@@ -186,6 +186,7 @@ int main_impl(int argc, char* argv[])
 				if (stratumPort > 0) {
 					IExternalPOW::Options powOptions;
                     find_certificates(powOptions, vm[cli::STRATUM_SECRETS_PATH].as<string>(), vm[cli::STRATUM_USE_TLS].as<bool>());
+                    powOptions.shareInterval_s = vm[cli::STRATUM_SHARE_INTERVAL].as<unsigned>();
 					stratumServer = IExternalPOW::create(powOptions, *reactor, io::Address().port(stratumPort));
 				}
 
@@ -218,6 +219,7 @@ int main_impl(int argc, char* argv[])
 					node.m_Cfg.m_MiningThreads = vm[cli::MINING_THREADS].as<uint32_t>();
 #endif
 					node.m_Cfg.m_VerificationThreads = vm[cli::VERIFICATION_THREADS].as<int>();
+					node.m_Cfg.m_IoThreads = vm[cli::IO_THREADS].as<uint32_t>();
 
 					node.m_Cfg.m_LogUtxos = vm[cli::LOG_UTXOS].as<bool>();
 
@@ -314,6 +316,18 @@ int main_impl(int argc, char* argv[])
 					if (vm.count(cli::RESYNC))
 						node.m_Cfg.m_Sync.m_ForceResync = vm[cli::RESYNC].as<bool>();
 
+					{
+						const string& sCheck = vm[cli::DB_CHECK].as<string>();
+						if (sCheck == "full")
+							node.m_Cfg.m_IntegrityCheck = NodeDB::IntegrityCheck::Full;
+						else if (sCheck == "quick")
+							node.m_Cfg.m_IntegrityCheck = NodeDB::IntegrityCheck::Quick;
+						else if (sCheck == "none")
+							node.m_Cfg.m_IntegrityCheck = NodeDB::IntegrityCheck::None;
+						else if (sCheck != "auto")
+							LOG_WARNING() << "unknown " << cli::DB_CHECK << " mode: " << sCheck << ", using auto";
+					}
+
 					node.m_Cfg.m_Bbs = vm[cli::BBS_ENABLE].as<bool>();
 
 					node.Initialize(stratumServer.get());
@@ -801,7 +801,7 @@ namespace beam
 		void Create(ISource&, const SystemState::Full& sRoot);
 		bool IsValid(SystemState::Full* pTip = NULL) const;
 		bool Crop(); // according to current bound
-		bool Crop(const ChainWorkProof& src);
+		bool Crop(const ChainWorkProof& src, bool bSrcTrusted = false); // for the trusted (self-generated) src the states aren't re-verified
 		bool IsEmpty() const { return m_Heading.m_vElements.empty(); }
 
 		template <typename Archive>
@@ -818,7 +818,8 @@ namespace beam
 
 	private:
 		struct Sampler;
-		bool IsValidInternal(size_t& iState, size_t& iHash, const Difficulty::Raw& lowerBound, SystemState::Full* pTip) const;
+		bool IsValidInternal(size_t& iState, size_t& iHash, const Difficulty::Raw& lowerBound, SystemState::Full* pTip, bool bVerifyStates = true) const;
+		struct StatesVerifier;
 		void ZeroInit();
 	};
 
@@ -13,6 +13,8 @@
 // limitations under the License.
 
 #include "block_crypt.h"
+#include "../utility/thread_pool.h"
+#include <atomic>
 
 namespace beam
 {
@@ -202,10 +204,10 @@ namespace beam
 		std::copy(src.cbegin(), src.cbegin() + dst.size(), dst.begin());
 	}
 
-	bool Block::ChainWorkProof::Crop(const ChainWorkProof& src)
+	bool Block::ChainWorkProof::Crop(const ChainWorkProof& src, bool bSrcTrusted /* = false */)
 	{
 		size_t iState, iHash;
-		if (!src.IsValidInternal(iState, iHash, m_LowerBound, NULL))
+		if (!src.IsValidInternal(iState, iHash, m_LowerBound, NULL, !bSrcTrusted))
 			return false;
 
 		bool bInPlace = (&src == this);
@@ -258,19 +260,63 @@ namespace beam
 		return Crop(*this);
 	}
 
-	bool Block::ChainWorkProof::IsValidInternal(size_t& iState, size_t& iHash, const Difficulty::Raw& lowerBound, Block::SystemState::Full* pTip) const
+	struct Block::ChainWorkProof::StatesVerifier
+	{
+		// The states (PoW and sanity) are independent, verified in parallel
+		static const size_t s_MinPerThread = 8;
+
+		std::vector<const SystemState::Full*> m_vStates;
+		std::atomic<size_t> m_iNext;
+		volatile bool m_bValid;
+
+		void Thread()
+		{
+			while (m_bValid)
+			{
+				size_t i = m_iNext++;
+				if (i >= m_vStates.size())
+					break;
+
+				if (!m_vStates[i]->IsValid())
+					m_bValid = false; // sync isn't required
+			}
+		}
+
+		bool Verify()
+		{
+			m_iNext = 0;
+			m_bValid = true;
+
+			ThreadPool& tp = ThreadPool::get();
+			size_t nThreads = std::min<size_t>(tp.get_threads() + 1, m_vStates.size() / s_MinPerThread);
+
+			ThreadPool::Job::Ptr pJob = ThreadPool::Job::create(ThreadPool::Priority::Verification);
+			for (size_t i = 1; i < nThreads; i++)
+				tp.push(pJob, [this]() { Thread(); });
+
+			Thread(); // this thread participates as well
+
+			pJob->wait();
+
+			return m_bValid;
+		}
+	};
+
+	bool Block::ChainWorkProof::IsValidInternal(size_t& iState, size_t& iHash, const Difficulty::Raw& lowerBound, Block::SystemState::Full* pTip, bool bVerifyStates /* = true */) const
 	{
 		if (m_Heading.m_vElements.empty())
 			return false;
 
+		// Derive the heading states first (cheap), then verify all the states at once
+		std::vector<SystemState::Full> vHeading(m_Heading.m_vElements.size());
+
 		SystemState::Full s;
 		Cast::Down<SystemState::Sequence::Prefix>(s) = m_Heading.m_Prefix;
 		Cast::Down<SystemState::Sequence::Element>(s) = m_Heading.m_vElements.back();
 
 		for (size_t i = m_Heading.m_vElements.size() - 1; ; )
 		{
-			if (!(s.IsValid()))
-				return false;
+			vHeading[i] = s;
 
 			if (!i--)
 				break;
@@ -280,10 +326,17 @@ namespace beam
 			s.m_ChainWork += s.m_PoW.m_Difficulty;
 		}
 
-		for (size_t i = 0; i < m_vArbitraryStates.size(); i++)
+		if (bVerifyStates)
 		{
-			const Block::SystemState::Full& s2 = m_vArbitraryStates[i];
-			if (!(s2.IsValid()))
+			StatesVerifier sv;
+			sv.m_vStates.reserve(vHeading.size() + m_vArbitraryStates.size());
+
+			for (size_t i = vHeading.size(); i--; )
+				sv.m_vStates.push_back(&vHeading[i]);
+			for (size_t i = 0; i < m_vArbitraryStates.size(); i++)
+				sv.m_vStates.push_back(&m_vArbitraryStates[i]);
+
+			if (!sv.Verify())
 				return false;
 		}
 
@@ -82,6 +82,7 @@ void FlyClient::NetworkStd::Connection::ResetVars()
     ZeroObject(m_Tip);
     m_LoginFlags = 0;
     m_Flags = 0;
+    m_nUtxoBatch = 0;
     m_NodeID = Zero;
 }
 
@@ -607,6 +608,8 @@ void FlyClient::NetworkStd::Connection::AssignRequests()
     for (RequestList::iterator it = m_This.m_lst.begin(); m_This.m_lst.end() != it; )
         AssignRequest(*it++);
 
+    SendUtxoBatch();
+
     if (m_lst.empty() && m_This.m_Cfg.m_PollPeriod_ms)
         SetTimer(0);
     else
@@ -622,6 +625,9 @@ void FlyClient::NetworkStd::Connection::AssignRequest(RequestNode& n)
         return;
     }
 
+    if ((Request::Type::Utxo == n.m_pRequest->get_Type()) && ShouldBatchUtxo())
+        return; // will be sent within a batch
+
     switch (n.m_pRequest->get_Type())
     {
 #define THE_MACRO(type, msgOut, msgIn) \
@@ -705,6 +711,69 @@ void FlyClient::NetworkStd::Connection::OnRequestData(RequestUtxo& req)
             ThrowUnexpected();
 }
 
+bool FlyClient::NetworkStd::Connection::ShouldBatchUtxo() const
+{
+    return (LoginFlags::UtxoMulti & m_LoginFlags) != 0;
+}
+
+void FlyClient::NetworkStd::Connection::SendUtxoBatch()
+{
+    if (m_nUtxoBatch || !ShouldBatchUtxo())
+        return;
+
+    GetProofUtxoMulti msg;
+
+    for (RequestList::iterator it = m_This.m_lst.begin(); m_This.m_lst.end() != it; )
+    {
+        RequestNode& n = *it++;
+        assert(n.m_pRequest);
+
+        if ((Request::Type::Utxo != n.m_pRequest->get_Type()) || !n.m_pRequest->m_pTrg)
+            continue;
+
+        RequestUtxo& req = Cast::Up<RequestUtxo>(*n.m_pRequest);
+        if (!IsSupported(req))
+            break;
+
+        if (msg.m_Utxos.empty())
+            msg.m_MaturityMin = req.m_Msg.m_MaturityMin;
+        else
+            if (msg.m_MaturityMin != req.m_Msg.m_MaturityMin)
+                continue; // will go within the next batch
+
+        msg.m_Utxos.push_back(req.m_Msg.m_Utxo);
+
+        m_This.m_lst.erase(RequestList::s_iterator_to(n));
+        m_lst.push_back(n);
+
+        if (msg.m_Utxos.size() == g_UtxoMultiMaxSize)
+            break;
+    }
+
+    if (!msg.m_Utxos.empty())
+    {
+        m_nUtxoBatch = static_cast<uint32_t>(msg.m_Utxos.size());
+        Send(msg);
+    }
+}
+
+void FlyClient::NetworkStd::Connection::OnMsg(ProofUtxoMulti&& msg)
+{
+    if (msg.m_Proofs.size() != m_nUtxoBatch)
+        ThrowUnexpected();
+
+    for (size_t i = 0; i < msg.m_Proofs.size(); i++)
+    {
+        RequestUtxo& req = Cast::Up<RequestUtxo>(get_FirstRequestStrict(Request::Type::Utxo));
+        req.m_Res.m_Proofs.swap(msg.m_Proofs[i]);
+        OnRequestData(req);
+        OnFirstRequestDone(IsSupported(req));
+    }
+
+    m_nUtxoBatch = 0;
+    AssignRequests();
+}
+
 bool FlyClient::NetworkStd::Connection::IsSupported(RequestKernel& req)
 {
     return (Flags::Node & m_Flags) && IsAtTip();
@@ -159,6 +159,12 @@ namespace proto {
 				Request& get_FirstRequestStrict(Request::Type);
 				void OnFirstRequestDone(bool bStillSupported);
 
+				// Utxo requests are coalesced into GetProofUtxoMulti if the node supports it.
+				// Only one batch is in flight, requests posted meanwhile are accumulated for the next one.
+				uint32_t m_nUtxoBatch; // in flight
+				bool ShouldBatchUtxo() const;
+				void SendUtxoBatch();
+
 				io::Timer::Ptr m_pTimer;
 				void OnTimer();
 				void SetTimer(uint32_t);
@@ -206,6 +212,7 @@ namespace proto {
 				virtual void OnMsg(proto::ProofChainWork&& msg) override;
 				virtual void OnMsg(proto::BbsMsg&& msg) override;
 				virtual void OnMsg(proto::BbsMsgV0&& msg) override;
+				virtual void OnMsg(proto::ProofUtxoMulti&& msg) override;
 #define THE_MACRO(type, msgOut, msgIn) \
 				virtual void OnMsg(proto::msgIn&&) override; \
 				bool IsSupported(Request##type&); \
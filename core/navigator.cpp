@@ -244,6 +244,29 @@ namespace beam
 		m_nBanks = d.m_nBanks;
 	}
 
+	void MappedFile::Reserve(Offset n)
+	{
+		if (n <= m_nMapping)
+			return;
+
+		CloseMapping();
+		Resize(AlignUp(n, s_PageSize));
+		OpenMapping();
+	}
+
+	void MappedFile::Flush()
+	{
+		if (!m_pMapping)
+			return;
+
+#ifdef WIN32
+		test_SysRet(!FlushViewOfFile(m_pMapping, 0), "FlushViewOfFile");
+		test_SysRet(!FlushFileBuffers(m_hFile), "FlushFileBuffers");
+#else // WIN32
+		test_SysRet(msync(m_pMapping, m_nMapping, MS_SYNC) != 0, "msync");
+#endif // WIN32
+	}
+
 	void* MappedFile::get_FixedHdr() const
 	{
 		return m_pMapping + m_nBank0 + m_nBanks * sizeof(Bank);
@@ -69,6 +69,10 @@ namespace beam
 		void Open(const char* sz, const Defs&);
 		void Close();
 
+		Offset get_Size() const { return m_nMapping; }
+		void Reserve(Offset); // grows the file if it's smaller. The mapping is moved, all the pointers are invalidated
+		void Flush(); // writes the modified pages to the disk
+
 		void* get_FixedHdr() const;
 
 		template <typename T> T& get_At(Offset n) const
@@ -17,6 +17,8 @@
 #include "core/ecc_native.h"
 #include "proto.h"
 #include "../utility/logger.h"
+#include <atomic>
+#include <thread>
 
 namespace beam {
 namespace proto {
@@ -76,66 +78,76 @@ void ProtocolPlus::get_HMac(ECC::Hash::Mac& hm, MacValue& res)
 
 void ProtocolPlus::Encrypt(SerializedMsg& sm, MsgSerializer& ser)
 {
-    MacValue hmac;
+    bool bSeal = (Mode::Plaintext != m_Mode);
+
+    Finalize(sm, ser, bSeal);
 
-    if (Mode::Plaintext != m_Mode)
+    if (bSeal)
+        Seal(sm);
+}
+
+void ProtocolPlus::Finalize(SerializedMsg& sm, MsgSerializer& ser, bool bSeal)
+{
+    if (bSeal)
     {
         // 1. append dummy of the needed size
-        hmac = Zero;
+        MacValue hmac = Zero;
         ser & hmac;
     }
 
     ser.finalize(sm);
+}
 
-    if (Mode::Plaintext != m_Mode)
-    {
-        // 2. get size
-        size_t n = 0;
+void ProtocolPlus::Seal(SerializedMsg& sm)
+{
+    MacValue hmac;
 
-        for (size_t i = 0; i < sm.size(); i++)
-            n += sm[i].size;
+    // 2. get size
+    size_t n = 0;
 
-        // 3. Calculate
-        ECC::Hash::Mac hm = m_HMac;
-        size_t n2 = n - MacValue::nBytes;
+    for (size_t i = 0; i < sm.size(); i++)
+        n += sm[i].size;
 
-        for (size_t i = 0; ; i++)
-        {
-            assert(i < sm.size());
-            io::IOVec& iov = sm[i];
-            if (iov.size >= n2)
-            {
-                hm.Write(iov.data, (uint32_t) n2);
-                break;
-            }
+    // 3. Calculate
+    ECC::Hash::Mac hm = m_HMac;
+    size_t n2 = n - MacValue::nBytes;
 
-            hm.Write(iov.data, (uint32_t)iov.size);
-            n2 -= iov.size;
+    for (size_t i = 0; ; i++)
+    {
+        assert(i < sm.size());
+        io::IOVec& iov = sm[i];
+        if (iov.size >= n2)
+        {
+            hm.Write(iov.data, (uint32_t) n2);
+            break;
         }
 
-        get_HMac(hm, hmac);
-
-        // 4. Overwrite the hmac, encrypt
-        n2 = n;
+        hm.Write(iov.data, (uint32_t)iov.size);
+        n2 -= iov.size;
+    }
 
-        for (size_t i = 0; i < sm.size(); i++)
-        {
-            io::IOVec& iov = sm[i];
-            uint8_t* dst = (uint8_t*) iov.data;
+    get_HMac(hm, hmac);
 
-            if (n2 <= hmac.nBytes)
-                memcpy(dst, hmac.m_pData + hmac.nBytes - n2, iov.size);
-            else
-            {
-                size_t offs = n2 - hmac.nBytes;
-                if (offs < iov.size)
-                    memcpy(dst + offs, hmac.m_pData, iov.size - offs);
-            }
+    // 4. Overwrite the hmac, encrypt
+    n2 = n;
 
-            n2 -= iov.size;
+    for (size_t i = 0; i < sm.size(); i++)
+    {
+        io::IOVec& iov = sm[i];
+        uint8_t* dst = (uint8_t*) iov.data;
 
-            m_CipherOut.XCrypt(m_Enc, dst, (uint32_t) iov.size);
+        if (n2 <= hmac.nBytes)
+            memcpy(dst, hmac.m_pData + hmac.nBytes - n2, iov.size);
+        else
+        {
+            size_t offs = n2 - hmac.nBytes;
+            if (offs < iov.size)
+                memcpy(dst + offs, hmac.m_pData, iov.size - offs);
         }
+
+        n2 -= iov.size;
+
+        m_CipherOut.XCrypt(m_Enc, dst, (uint32_t) iov.size);
     }
 }
 
@@ -261,6 +273,56 @@ bool Bbs::Decrypt(uint8_t*& p, uint32_t& n, const ECC::Scalar::Native& privateAd
     return (hvMac == hvMac2);
 }
 
+bool Bbs::Decryptor::Init(const void* p, uint32_t n)
+{
+    PeerID remotePublic;
+    if (n < remotePublic.nBytes + ECC::Hash::Value::nBytes)
+        return false;
+
+    m_p = reinterpret_cast<const uint8_t*>(p);
+    m_n = n;
+
+    memcpy(remotePublic.m_pData, m_p, remotePublic.nBytes);
+    return ImportPeerID(m_ptRemote, remotePublic);
+}
+
+bool Bbs::Decryptor::Decrypt(ByteBuffer& res, const ECC::Scalar::Native& privateAddr, const PeerID& publicAddr) const
+{
+    // same as InitViaDiffieHellman, except the remote point is already imported, and the own public key is known
+    ECC::Point::Native ptSecret = m_ptRemote * privateAddr;
+
+    ECC::NoLeak<ECC::Hash::Value> hvSecret;
+    ECC::Hash::Processor() << ptSecret >> hvSecret.V;
+
+    AES::Encoder enc;
+    enc.Init(hvSecret.V.m_pData);
+
+    ECC::Hash::Mac hmac;
+    hmac.Reset(hvSecret.V.m_pData, hvSecret.V.nBytes);
+
+    AES::StreamCipher cIn;
+    InitCipherIV(cIn, hvSecret.V, publicAddr);
+
+    const uint8_t* p = m_p + PeerID::nBytes;
+    uint32_t n = m_n - PeerID::nBytes;
+
+    ECC::Hash::Value hvMac, hvMac2;
+    memcpy(hvMac.m_pData, p, hvMac.nBytes);
+    cIn.XCrypt(enc, hvMac.m_pData, hvMac.nBytes);
+
+    p += hvMac.nBytes;
+    n -= hvMac.nBytes;
+
+    res.assign(p, p + n);
+    if (n)
+        cIn.XCrypt(enc, &res.front(), n);
+
+    hmac.Write(res.data(), n);
+    hmac >> hvMac2;
+
+    return (hvMac == hvMac2);
+}
+
 void Bbs::get_HashPartial(ECC::Hash::Processor& hp, const BbsMsg& msg)
 {
 	hp
@@ -308,6 +370,421 @@ bool NotCalled_VerifyNoDuplicatedIDs(uint32_t id)
     return false;
 }
 
+/////////////////////////
+// NodeConnection::IoShards
+struct NodeConnection::IoShards::Task
+{
+    Task* m_pNext = nullptr;
+
+    virtual ~Task() {}
+    virtual void Execute() = 0;
+
+    template <typename TFunc>
+    static Task* Create(TFunc func)
+    {
+        struct Impl :public Task
+        {
+            TFunc m_Func;
+            Impl(TFunc&& func) :m_Func(std::move(func)) {}
+            void Execute() override { m_Func(); }
+        };
+
+        return new Impl(std::move(func));
+    }
+};
+
+// Lock-free, multiple producers, single consumer. The consumer takes all the pending tasks at once
+struct NodeConnection::IoShards::TaskQueue
+{
+    std::atomic<Task*> m_pHead;
+    io::AsyncEvent::Ptr m_pEvt; // consumer wake-up
+
+    TaskQueue() :m_pHead(nullptr) {}
+
+    ~TaskQueue()
+    {
+        for (Task* pTask = PopAll(); pTask; )
+        {
+            Task* pNext = pTask->m_pNext;
+            delete pTask;
+            pTask = pNext;
+        }
+    }
+
+    void Push(Task* pTask)
+    {
+        Task* pHead = m_pHead.load(std::memory_order_relaxed);
+        do
+            pTask->m_pNext = pHead;
+        while (!m_pHead.compare_exchange_weak(pHead, pTask, std::memory_order_release, std::memory_order_relaxed));
+
+        if (!pHead)
+            m_pEvt->post(); // otherwise it's already posted and not consumed yet
+    }
+
+    Task* PopAll()
+    {
+        Task* pTask = m_pHead.exchange(nullptr, std::memory_order_acquire);
+
+        // reverse, to restore the order of the Push
+        Task* pRes = nullptr;
+        while (pTask)
+        {
+            Task* pNext = pTask->m_pNext;
+            pTask->m_pNext = pRes;
+            pRes = pTask;
+            pTask = pNext;
+        }
+
+        return pRes;
+    }
+
+    void Execute()
+    {
+        for (Task* pTask = PopAll(); pTask; )
+        {
+            std::unique_ptr<Task> pGuard(pTask);
+            pTask = pTask->m_pNext;
+            pGuard->Execute();
+        }
+    }
+};
+
+struct NodeConnection::IoShards::Shard
+{
+    io::Reactor::Ptr m_pReactor;
+    TaskQueue m_Queue;
+    std::thread m_Thread;
+    uint32_t m_nLinks = 0; // owner thread only
+};
+
+NodeConnection::IoShards::IoShards(uint32_t nThreads)
+    :m_pOwnerQueue(std::make_unique<TaskQueue>())
+{
+    TaskQueue& q = *m_pOwnerQueue;
+    q.m_pEvt = io::AsyncEvent::create(io::Reactor::get_Current(), [&q]() { q.Execute(); });
+
+    m_vShards.resize(std::max(nThreads, 1U));
+
+    for (auto& pShard : m_vShards)
+    {
+        pShard = std::make_unique<Shard>();
+        Shard& s = *pShard;
+
+        s.m_pReactor = io::Reactor::create();
+        s.m_Queue.m_pEvt = io::AsyncEvent::create(*s.m_pReactor, [&s]() { s.m_Queue.Execute(); });
+
+        s.m_Thread = std::thread([&s]() {
+            io::Reactor::Scope scope(*s.m_pReactor);
+            s.m_pReactor->run();
+        });
+    }
+}
+
+NodeConnection::IoShards::~IoShards()
+{
+    for (auto& pShard : m_vShards)
+    {
+        Shard& s = *pShard;
+        assert(!s.m_nLinks);
+
+        // after the pending tasks, i.e. the connections being closed
+        s.m_Queue.Push(Task::Create([&s]() { s.m_pReactor->stop(); }));
+    }
+
+    for (auto& pShard : m_vShards)
+        if (pShard->m_Thread.joinable())
+            pShard->m_Thread.join();
+}
+
+NodeConnection::IoShards::Shard& NodeConnection::IoShards::SelectShard()
+{
+    Shard* pRes = m_vShards.front().get();
+
+    for (auto& pShard : m_vShards)
+        if (pRes->m_nLinks > pShard->m_nLinks)
+            pRes = pShard.get();
+
+    return *pRes;
+}
+
+/////////////////////////
+// NodeConnection::Link
+// The shard-side part of the NodeConnection. Owns the socket and the incoming cipher, decodes the messages and passes them to the owner.
+// The secure channel handshake is tracked here as well: the incoming cipher must be switched exactly after the SChannelReady is decoded.
+struct NodeConnection::Link
+    :public IErrorHandler
+    ,public std::enable_shared_from_this<Link>
+{
+    typedef std::shared_ptr<Link> Ptr;
+
+    IoShards& m_Shards;
+    IoShards::Shard& m_Shard;
+
+    // owner thread
+    NodeConnection* m_pOwner;
+
+    // shard thread
+    ProtocolPlus m_Protocol;
+    std::unique_ptr<Connection> m_Connection;
+    bool m_ConnectPending = false;
+    bool m_CipherReady = false;
+
+    std::atomic<size_t> m_nQueued; // frames on the way to the shard
+    std::atomic<size_t> m_nUnsent; // stream write buffer, as last seen by the shard
+
+    Link(NodeConnection& owner, IoShards& shards, IoShards::Shard& s)
+        :m_Shards(shards)
+        ,m_Shard(s)
+        ,m_pOwner(&owner)
+        ,m_Protocol('B', 'm', 10, sizeof(HighestMsgCode), *this, 20000)
+        ,m_nQueued(0)
+        ,m_nUnsent(0)
+    {
+#define THE_MACRO(code, msg) \
+        m_Protocol.add_message_handler<Link, msg##_NoInit, &Link::OnMsgInternal>(uint8_t(code), this, 0, 1024*1024*10);
+
+        BeamNodeMsgsAll(THE_MACRO)
+#undef THE_MACRO
+    }
+
+    static Ptr Create(NodeConnection& owner)
+    {
+        assert(owner.m_pIoShards);
+        IoShards& shards = *owner.m_pIoShards;
+
+        IoShards::Shard& s = shards.SelectShard();
+        s.m_nLinks++;
+
+        return std::make_shared<Link>(owner, shards, s);
+    }
+
+    size_t get_Unsent() const
+    {
+        return m_nQueued + m_nUnsent;
+    }
+
+    template <typename TFunc>
+    void PostToShard(TFunc func)
+    {
+        m_Shard.m_Queue.Push(IoShards::Task::Create(std::move(func)));
+    }
+
+    template <typename TFunc>
+    void PostToOwner(TFunc func)
+    {
+        Ptr pThis = shared_from_this();
+        m_Shards.m_pOwnerQueue->Push(IoShards::Task::Create([pThis, func = std::move(func)]() mutable {
+            NodeConnection* pOwner = pThis->m_pOwner;
+            if (pOwner)
+                func(*pOwner); // otherwise it's already reset
+        }));
+    }
+
+    // owner thread
+    void Connect(const io::Address& addr)
+    {
+        Ptr pThis = shared_from_this();
+        PostToShard([pThis, addr]() {
+            io::Result res = io::Reactor::get_Current().tcp_connect(addr, uint64_t(pThis.get()), OnConnectInternal);
+            if (res)
+                pThis->m_ConnectPending = true;
+            else
+                pThis->on_connection_error(0, res.error());
+        });
+    }
+
+    void Accept(uv_os_sock_t sock)
+    {
+        Ptr pThis = shared_from_this();
+        PostToShard([pThis, sock]() {
+            io::TcpStream::Ptr newStream;
+            io::Result res = io::Reactor::get_Current().tcp_adopt(sock, newStream);
+            if (res)
+                pThis->Attach(std::move(newStream));
+            else
+                pThis->on_connection_error(0, res.error());
+        });
+    }
+
+    void SetNonce(const ECC::Scalar::Native& sk)
+    {
+        Ptr pThis = shared_from_this();
+        PostToShard([pThis, sk]() {
+            pThis->m_Protocol.m_MyNonce = sk;
+            pThis->TryInitCipher();
+        });
+    }
+
+    void Write(SerializedMsg&& sm, bool bSeal)
+    {
+        size_t nSize = 0;
+        for (const auto& x : sm)
+            nSize += x.size;
+
+        m_nQueued += nSize;
+
+        // the fragments are not shared with other messages, they can be sealed in-place by the shard
+        Ptr pThis = shared_from_this();
+        PostToShard([pThis, sm = std::move(sm), bSeal, nSize]() mutable {
+            pThis->m_nQueued -= nSize;
+            pThis->OnWrite(sm, bSeal);
+        });
+    }
+
+    void Close()
+    {
+        assert(m_pOwner && m_Shard.m_nLinks);
+        m_pOwner = nullptr;
+        m_Shard.m_nLinks--;
+
+        Ptr pThis = shared_from_this();
+        PostToShard([pThis]() { pThis->Shutdown(); });
+    }
+
+    // shard thread
+    static void OnConnectInternal(uint64_t tag, io::TcpStream::Ptr&& newStream, io::ErrorCode status)
+    {
+        Link* pThis = (Link*) tag;
+        assert(pThis && pThis->m_ConnectPending);
+        pThis->m_ConnectPending = false;
+
+        if (newStream)
+        {
+            pThis->Attach(std::move(newStream));
+            pThis->PostToOwner([](NodeConnection& c) {
+                c.m_ConnectPending = false;
+                c.OnConnectedInternal();
+            });
+        }
+        else
+            pThis->on_connection_error(0, status);
+    }
+
+    void Attach(io::TcpStream::Ptr&& newStream)
+    {
+        m_Connection = std::make_unique<Connection>(
+            m_Protocol,
+            uint64_t(this),
+            Connection::inbound,
+            100,
+            std::move(newStream)
+            );
+    }
+
+    void Shutdown()
+    {
+        if (m_ConnectPending)
+        {
+            io::Reactor::get_Current().cancel_tcp_connect(uint64_t(this));
+            m_ConnectPending = false;
+        }
+
+        m_Connection = NULL;
+        m_nUnsent = 0;
+    }
+
+    void UpdateUnsent()
+    {
+        m_nUnsent = m_Connection ? m_Connection->get_Unsent() : 0;
+    }
+
+    void TryInitCipher()
+    {
+        if (m_CipherReady || (m_Protocol.m_MyNonce == Zero) || (m_Protocol.m_RemoteNonce == Zero))
+            return;
+
+        m_Protocol.InitCipher();
+        m_CipherReady = true;
+    }
+
+    void OnWrite(SerializedMsg& sm, bool bSeal)
+    {
+        if (!m_Connection)
+            return;
+
+        if (bSeal)
+        {
+            if (!m_CipherReady)
+            {
+                // the owner can't switch to the secure mode before we see the remote nonce
+                assert(false);
+                on_protocol_error(0, unexpected_msg_type);
+                return;
+            }
+
+            m_Protocol.Seal(sm);
+        }
+
+        io::Result res = m_Connection->write_msg(sm);
+        if (!res)
+        {
+            on_connection_error(0, res.error());
+            return;
+        }
+
+        UpdateUnsent();
+    }
+
+    template <typename T>
+    bool OnHandshake(const T&)
+    {
+        return true;
+    }
+
+    bool OnHandshake(const SChannelInitiate& msg)
+    {
+        // the validation is up to the owner
+        if (m_Protocol.m_RemoteNonce == Zero)
+        {
+            m_Protocol.m_RemoteNonce = msg.m_NoncePub;
+            TryInitCipher();
+        }
+        return true;
+    }
+
+    bool OnHandshake(const SChannelReady&)
+    {
+        // The remote sends it only after it gets our nonce, i.e. after we have both nonces.
+        if (!m_CipherReady)
+        {
+            on_protocol_error(0, unexpected_msg_type);
+            return false;
+        }
+
+        m_Protocol.m_Mode = ProtocolPlus::Mode::Duplex; // the next message is encrypted
+        return true;
+    }
+
+#define THE_MACRO(code, msg) \
+    bool OnMsgInternal(uint64_t, msg##_NoInit&& v) \
+    { \
+        if (!OnHandshake(static_cast<const msg&>(v))) \
+            return false; \
+        UpdateUnsent(); \
+        PostToOwner([v = std::move(v)](NodeConnection& c) mutable { \
+            c.OnMsgInternal(0, std::move(v)); \
+        }); \
+        return true; \
+    }
+
+    BeamNodeMsgsAll(THE_MACRO)
+#undef THE_MACRO
+
+    // IErrorHandler
+    virtual void on_protocol_error(uint64_t, ProtocolError error) override
+    {
+        Shutdown();
+        PostToOwner([error](NodeConnection& c) { c.on_protocol_error(0, error); });
+    }
+
+    virtual void on_connection_error(uint64_t, io::ErrorCode errorCode) override
+    {
+        Shutdown();
+        PostToOwner([errorCode](NodeConnection& c) { c.on_connection_error(0, errorCode); });
+    }
+};
+
 /////////////////////////
 // NodeConnection
 NodeConnection::NodeConnection()
@@ -328,12 +805,16 @@ NodeConnection::~NodeConnection()
 
 void NodeConnection::Reset()
 {
-    if (m_ConnectPending)
+    if (m_pLink)
     {
-        io::Reactor::get_Current().cancel_tcp_connect(uint64_t(this));
-        m_ConnectPending = false;
+        m_pLink->Close();
+        m_pLink = NULL;
     }
+    else
+        if (m_ConnectPending)
+            io::Reactor::get_Current().cancel_tcp_connect(uint64_t(this));
 
+    m_ConnectPending = false;
     m_Connection = NULL;
     m_pAsyncFail = NULL;
 
@@ -390,21 +871,25 @@ void NodeConnection::OnConnectInternal2(io::TcpStream::Ptr&& newStream, io::Erro
     if (newStream)
     {
         Accept(std::move(newStream));
-
-        try {
-            SecureConnect();
-        }
-        catch (const NodeProcessingException& e) {
-            OnProcessingExc(e);
-        }
-        catch (const std::exception& e) {
-            OnExc(e);
-        }
+        OnConnectedInternal();
     }
     else
         OnIoErr(status);
 }
 
+void NodeConnection::OnConnectedInternal()
+{
+    try {
+        SecureConnect();
+    }
+    catch (const NodeProcessingException& e) {
+        OnProcessingExc(e);
+    }
+    catch (const std::exception& e) {
+        OnExc(e);
+    }
+}
+
 void NodeConnection::OnExc(const std::exception& e)
 {
     DisconnectReason r;
@@ -433,6 +918,9 @@ void NodeConnection::OnIoErr(io::ErrorCode err)
 
 size_t NodeConnection::get_Unsent() const
 {
+	if (m_pLink)
+		return m_pLink->get_Unsent();
+
 	return m_Connection ? m_Connection->get_Unsent() : 0;
 }
 
@@ -489,7 +977,15 @@ void NodeConnection::ThrowUnexpected(const char* sz, NodeProcessingException::Ty
 
 void NodeConnection::Connect(const io::Address& addr)
 {
-    assert(!m_Connection && !m_ConnectPending);
+    assert(!m_Connection && !m_ConnectPending && !m_pLink);
+
+    if (m_pIoShards)
+    {
+        m_pLink = Link::Create(*this);
+        m_pLink->Connect(addr);
+        m_ConnectPending = true;
+        return;
+    }
 
     io::Result res = io::Reactor::get_Current().tcp_connect(
         addr,
@@ -502,10 +998,22 @@ void NodeConnection::Connect(const io::Address& addr)
 
 void NodeConnection::Accept(io::TcpStream::Ptr&& newStream)
 {
-    assert(!m_Connection && !m_ConnectPending);
+    assert(!m_Connection && !m_ConnectPending && !m_pLink);
 
     newStream->enable_keepalive(Rules::get().DA.Target_s); // it should be comparable to the block rate
 
+    if (m_pIoShards)
+    {
+        uv_os_sock_t sock;
+        if (newStream->detach(sock))
+        {
+            m_pLink = Link::Create(*this);
+            m_pLink->Accept(sock);
+            return;
+        }
+        // can't be handed over, serve it here
+    }
+
     m_Connection = std::make_unique<Connection>(
         m_Protocol,
         uint64_t(this),
@@ -517,7 +1025,29 @@ void NodeConnection::Accept(io::TcpStream::Ptr&& newStream)
 
 bool NodeConnection::IsLive() const
 {
-    return m_Connection && !m_pAsyncFail;
+    return (m_Connection || m_pLink) && !m_pAsyncFail;
+}
+
+void NodeConnection::SendInternal(MsgSerializer& ser)
+{
+    if (m_pLink)
+    {
+        // hmac and cipher are applied in the shard
+        bool bSeal = IsSecureOut();
+        ProtocolPlus::Finalize(m_SerializeCache, ser, bSeal);
+        m_pLink->Write(std::move(m_SerializeCache), bSeal);
+        m_SerializeCache.clear();
+    }
+    else
+    {
+        m_Protocol.Encrypt(m_SerializeCache, ser);
+        io::Result res = m_Connection->write_msg(m_SerializeCache);
+        m_SerializeCache.clear();
+
+        TestIoResultAsync(res);
+    }
+
+    TestNotDrown();
 }
 
 #define THE_MACRO(code, msg) \
@@ -527,12 +1057,7 @@ void NodeConnection::Send(const msg& v) \
         return; \
     m_SerializeCache.clear(); \
     MsgSerializer& ser = m_Protocol.serializeNoFinalize(m_SerializeCache, uint8_t(code), v); \
-    m_Protocol.Encrypt(m_SerializeCache, ser); \
-    io::Result res = m_Connection->write_msg(m_SerializeCache); \
-    m_SerializeCache.clear(); \
-\
-    TestIoResultAsync(res); \
-    TestNotDrown(); \
+    SendInternal(ser); \
 } \
 \
 bool NodeConnection::OnMsgInternal(uint64_t, msg##_NoInit&& v) \
@@ -586,7 +1111,11 @@ void NodeConnection::SecureConnect()
         ThrowUnexpected("SChannel not supported");
 
     SChannelInitiate msg;
-    Sk2Pk(msg.m_NoncePub, m_Protocol.m_MyNonce);
+    Sk2Pk(msg.m_NoncePub, m_Protocol.m_MyNonce); // normalizes the nonce
+
+    if (m_pLink)
+        m_pLink->SetNonce(m_Protocol.m_MyNonce); // before the msg is sent
+
     Send(msg);
 }
 
@@ -601,7 +1130,8 @@ void NodeConnection::OnMsg(SChannelInitiate&& msg)
     Send(msgOut); // activating new cipher.
 
     m_Protocol.m_RemoteNonce = msg.m_NoncePub;
-    m_Protocol.InitCipher();
+    if (!m_pLink)
+        m_Protocol.InitCipher(); // otherwise it's initialized in the shard
 
     m_Protocol.m_Mode = ProtocolPlus::Mode::Outgoing;
 
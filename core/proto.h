@@ -73,6 +73,10 @@ namespace proto {
     macro(ECC::Point, Utxo) \
     macro(Height, MaturityMin) /* set to non-zero in case the result is too big, and should be retrieved within multiple queries */
 
+#define BeamNodeMsg_GetProofUtxoMulti(macro) \
+    macro(std::vector<ECC::Point>, Utxos) /* up to g_UtxoMultiMaxSize, answered in the same order */ \
+    macro(Height, MaturityMin)
+
 #define BeamNodeMsg_GetProofChainWork(macro) \
     macro(Difficulty::Raw, LowerBound)
 
@@ -87,6 +91,9 @@ namespace proto {
 #define BeamNodeMsg_ProofUtxo(macro) \
     macro(std::vector<Input::Proof>, Proofs)
 
+#define BeamNodeMsg_ProofUtxoMulti(macro) \
+    macro(std::vector<std::vector<Input::Proof> >, Proofs)
+
 #define BeamNodeMsg_ProofState(macro) \
     macro(Merkle::HardProof, Proof)
 
@@ -236,6 +243,8 @@ namespace proto {
     macro(0x23, ProofCommonState) \
     macro(0x24, GetProofKernel2) \
     macro(0x25, ProofKernel2) \
+    macro(0x26, GetProofUtxoMulti) \
+    macro(0x27, ProofUtxoMulti) \
     /* onwer-relevant */ \
     macro(0x2c, GetUtxoEvents) \
     macro(0x2d, UtxoEvents) \
@@ -262,7 +271,8 @@ namespace proto {
         static const uint8_t SendPeers              = 0x4; // Please send me periodically peers recommendations
         static const uint8_t MiningFinalization     = 0x8; // I want to finalize block construction for my owned node
         static const uint8_t Extension1             = 0x10; // Supports Bbs with POW, more advanced proof/disproof scheme for SPV clients (?)
-	    static const uint8_t Recognized             = 0x1f;
+        static const uint8_t UtxoMulti              = 0x20; // Supports batched utxo proof requests
+	    static const uint8_t Recognized             = 0x3f;
     };
 
     struct IDType
@@ -273,6 +283,7 @@ namespace proto {
     };
 
     static const uint32_t g_HdrPackMaxSize = 128;
+    static const uint32_t g_UtxoMultiMaxSize = 128;
 
     struct UtxoEvent
     {
@@ -347,6 +358,19 @@ namespace proto {
 
 		bool Encrypt(ByteBuffer& res, const PeerID& publicAddr, ECC::Scalar::Native& nonce, const void*, uint32_t); // will fail iff addr is invalid
 		bool Decrypt(uint8_t*& p, uint32_t& n, const ECC::Scalar::Native& privateAddr);
+
+		// Trial decryption of a single message by many own addresses. The sender's key is imported once per message,
+		// the own public key is supplied by the caller, so that each candidate costs a single DH.
+		// The message buffer must stay valid and intact while in use. Decrypt() is thread-safe.
+		class Decryptor
+		{
+			const uint8_t* m_p;
+			uint32_t m_n;
+			ECC::Point::Native m_ptRemote;
+		public:
+			bool Init(const void* p, uint32_t n); // false if malformed
+			bool Decrypt(ByteBuffer& res, const ECC::Scalar::Native& privateAddr, const PeerID& publicAddr) const; // res receives the plaintext
+		};
 	};
 
 
@@ -419,6 +443,10 @@ namespace proto {
         virtual bool VerifyMsg(const uint8_t*, uint32_t nSize) override;
 
         void Encrypt(SerializedMsg&, MsgSerializer&);
+
+        // Encrypt() split in 2 stages, may be performed in different threads
+        static void Finalize(SerializedMsg&, MsgSerializer&, bool bSeal); // reserves the space for hmac if bSeal
+        void Seal(SerializedMsg&); // hmac + cipher, the outgoing cipher must be initialized
     };
 
     void Sk2Pk(PeerID&, ECC::Scalar::Native&); // will negate the scalar iff necessary
@@ -470,11 +498,16 @@ namespace proto {
 
         SerializedMsg m_SerializeCache;
 
+        struct Link;
+        std::shared_ptr<Link> m_pLink; // the connection served by IoShards
+
+        void SendInternal(MsgSerializer&);
         void TestIoResultAsync(const io::Result& res);
         void TestInputMsgContext(uint8_t);
 
         static void OnConnectInternal(uint64_t tag, io::TcpStream::Ptr&& newStream, io::ErrorCode);
         void OnConnectInternal2(io::TcpStream::Ptr&& newStream, io::ErrorCode);
+        void OnConnectedInternal();
 
         virtual void on_protocol_error(uint64_t, ProtocolError error) override;
         virtual void on_connection_error(uint64_t, io::ErrorCode errorCode) override;
@@ -487,6 +520,9 @@ namespace proto {
 
     public:
 
+        class IoShards;
+        IoShards* m_pIoShards = nullptr; // if set - the I/O, cipher and (de)serialization of the new connections are performed there
+
         NodeConnection();
         virtual ~NodeConnection();
         void Reset();
@@ -586,6 +622,31 @@ namespace proto {
         };
     };
 
+    // Serves the NodeConnections on several reactors, each in its own thread. The framing, cipher, hmac and
+    // (de)serialization are performed there. Decoded messages are passed to the owner reactor via a lock-free queue,
+    // the outgoing frames go back the same way.
+    // Must be created and destroyed on the owner reactor thread, after all its connections are reset.
+    class NodeConnection::IoShards
+    {
+    public:
+        struct Task;
+        struct TaskQueue;
+        struct Shard;
+
+        IoShards(uint32_t nThreads);
+        ~IoShards();
+
+        uint32_t get_Threads() const { return static_cast<uint32_t>(m_vShards.size()); }
+
+    private:
+        friend struct NodeConnection::Link;
+
+        std::unique_ptr<TaskQueue> m_pOwnerQueue;
+        std::vector<std::unique_ptr<Shard> > m_vShards;
+
+        Shard& SelectShard();
+    };
+
     std::ostream& operator << (std::ostream& s, const NodeConnection::DisconnectReason&);
 
 } // namespace proto
@@ -587,6 +587,263 @@ void UtxoTree::LoadIntenral(ISerializer& s)
 	}
 }
 
+/////////////////////////////
+// UtxoTree::Overlay
+Input::Count UtxoTree::Overlay::get_Count(const Key& key) const
+{
+	Map::const_iterator it = m_Map.find(key);
+	if (m_Map.end() != it)
+		return it->second;
+
+	Cursor cu;
+	if (!m_Tree.Goto(cu, key.m_pArr, Key::s_Bits))
+		return 0;
+
+	return Cast::Up<MyLeaf>(cu.get_Leaf()).m_Value.m_Count;
+}
+
+void UtxoTree::Overlay::set_Count(const Key& key, Input::Count n)
+{
+	m_vUndo.emplace_back();
+	Undo& u = m_vUndo.back();
+	u.m_Key = key;
+
+	Map::iterator it = m_Map.find(key);
+	u.m_bPresent = (m_Map.end() != it);
+
+	if (u.m_bPresent)
+	{
+		u.m_Count = it->second;
+		it->second = n;
+	}
+	else
+	{
+		u.m_Count = 0;
+		m_Map[key] = n;
+	}
+}
+
+void UtxoTree::Overlay::Rollback(size_t nCheckpoint)
+{
+	assert(nCheckpoint <= m_vUndo.size());
+
+	while (m_vUndo.size() > nCheckpoint)
+	{
+		const Undo& u = m_vUndo.back();
+		if (u.m_bPresent)
+			m_Map[u.m_Key] = u.m_Count;
+		else
+			m_Map.erase(u.m_Key);
+
+		m_vUndo.pop_back();
+	}
+}
+
+UtxoTree::Overlay& UtxoTree::Overlay::operator = (const Overlay& x)
+{
+	assert(&m_Tree == &x.m_Tree);
+
+	m_Map = x.m_Map;
+	m_vUndo.clear();
+	return *this;
+}
+
+void UtxoTree::Overlay::Clear()
+{
+	m_Map.clear();
+	m_vUndo.clear();
+}
+
+bool UtxoTree::Overlay::Enum(IWalker& w, const Key& kMin, const Key& kMax) const
+{
+	// merge the tree elements with the modified ones
+	struct Traveler :public ITraveler
+	{
+		IWalker* m_pWalker;
+		const Map* m_pMap;
+		Map::const_iterator m_it;
+
+		virtual bool OnLeaf(const Leaf& x) override
+		{
+			const MyLeaf& n = Cast::Up<MyLeaf>(x);
+
+			for ( ; (m_pMap->end() != m_it) && (m_it->first < n.m_Key); m_it++)
+				if (m_it->second && !m_pWalker->OnUtxo(m_it->first, m_it->second))
+					return false;
+
+			Input::Count nCount = n.m_Value.m_Count;
+			if ((m_pMap->end() != m_it) && (m_it->first == n.m_Key))
+			{
+				nCount = m_it->second;
+				m_it++;
+			}
+
+			return !nCount || m_pWalker->OnUtxo(n.m_Key, nCount);
+		}
+	} t;
+
+	t.m_pWalker = &w;
+	t.m_pMap = &m_Map;
+	t.m_it = m_Map.lower_bound(kMin);
+	t.m_pBound[0] = kMin.m_pArr;
+	t.m_pBound[1] = kMax.m_pArr;
+
+	if (!m_Tree.Traverse(t))
+		return false;
+
+	for ( ; (m_Map.end() != t.m_it) && !(kMax < t.m_it->first); t.m_it++)
+		if (t.m_it->second && !w.OnUtxo(t.m_it->first, t.m_it->second))
+			return false;
+
+	return true;
+}
+
+uint8_t UtxoTree::Overlay::get_Bit(const uint8_t* p, uint16_t nBit)
+{
+	return 1 & (p[nBit >> 3] >> (7 ^ (7 & nBit)));
+}
+
+uint16_t UtxoTree::Overlay::get_DiffBit(const uint8_t* p0, const uint8_t* p1, uint16_t nPos, uint16_t nEnd)
+{
+	for ( ; nPos < nEnd; nPos++)
+		if (get_Bit(p0, nPos) != get_Bit(p1, nPos))
+			break;
+
+	return nPos;
+}
+
+UtxoTree::Overlay::Map::const_iterator UtxoTree::Overlay::SplitAt(Map::const_iterator itB, Map::const_iterator itE, uint16_t nBit)
+{
+	// all the elements share the prefix up to this bit, hence they're ordered by it
+	for ( ; itE != itB; itB++)
+		if (get_Bit(itB->first.m_pArr, nBit))
+			break;
+
+	return itB;
+}
+
+void UtxoTree::Overlay::get_Hash(Merkle::Hash& hv)
+{
+	if (!get_HashInternal(hv, m_Tree.get_Root(), 0, 0, m_Map.begin(), m_Map.end()))
+		hv = Zero;
+}
+
+bool UtxoTree::Overlay::get_HashInternal(Merkle::Hash& hv, Node* pNode, uint16_t nNodePos, uint16_t nPos, Map::const_iterator itB, Map::const_iterator itE)
+{
+	// Evaluate the hash of the node (starting at the given position), modified by the given elements. Returns false if nothing remains.
+	if (!pNode)
+		return get_HashDelta(hv, nPos, itB, itE);
+
+	if (itE == itB)
+	{
+		hv = m_Tree.get_Hash(*pNode, hv); // unmodified
+		return true;
+	}
+
+	const uint8_t* pK = m_Tree.get_NodeKey(*pNode);
+	uint16_t nEnd = nNodePos + pNode->get_Bits();
+
+	// the elements are sorted, hence their common prefix is determined by the first and the last ones
+	Map::const_iterator itLast = itE;
+	itLast--;
+
+	uint16_t nDiff = std::min(
+		get_DiffBit(itB->first.m_pArr, pK, nPos, nEnd),
+		get_DiffBit(itLast->first.m_pArr, pK, nPos, nEnd));
+
+	if (nDiff < nEnd)
+	{
+		// some new elements diverge within this node
+		uint8_t iSide = get_Bit(pK, nDiff);
+
+		Node* ppN[2];
+		ppN[iSide] = pNode;
+		ppN[!iSide] = NULL;
+
+		uint16_t pNodePos[2] = { nNodePos, nNodePos };
+
+		return get_HashSplit(hv, ppN, pNodePos, nDiff, itB, itE);
+	}
+
+	if (Node::s_Leaf & pNode->m_Bits)
+	{
+		// the same element
+		assert(itB == itLast);
+		if (!itB->second)
+			return false;
+
+		Value val;
+		val.m_Count = itB->second;
+		val.get_Hash(hv, itB->first);
+		return true;
+	}
+
+	Joint& x = Cast::Up<Joint>(*pNode);
+	uint16_t pNodePos[2] = { uint16_t(nEnd + 1), uint16_t(nEnd + 1) };
+
+	return get_HashSplit(hv, x.m_ppC, pNodePos, nEnd, itB, itE);
+}
+
+bool UtxoTree::Overlay::get_HashSplit(Merkle::Hash& hv, Node** ppN, const uint16_t* pNodePos, uint16_t nBit, Map::const_iterator itB, Map::const_iterator itE)
+{
+	Map::const_iterator itMid = SplitAt(itB, itE, nBit);
+
+	Merkle::Hash pHv[2];
+	bool pPresent[2];
+	pPresent[0] = get_HashInternal(pHv[0], ppN[0], pNodePos[0], nBit + 1, itB, itMid);
+	pPresent[1] = get_HashInternal(pHv[1], ppN[1], pNodePos[1], nBit + 1, itMid, itE);
+
+	if (pPresent[0] && pPresent[1])
+	{
+		ECC::Hash::Processor() << pHv[0] << pHv[1] >> hv;
+		return true;
+	}
+
+	// if one of the branches vanished - the other one takes its place
+	for (size_t i = 0; i < _countof(pPresent); i++)
+		if (pPresent[i])
+		{
+			hv = pHv[i];
+			return true;
+		}
+
+	return false;
+}
+
+bool UtxoTree::Overlay::get_HashDelta(Merkle::Hash& hv, uint16_t nPos, Map::const_iterator itB, Map::const_iterator itE) const
+{
+	// new elements only, skip the deleted
+	for ( ; (itE != itB) && !itB->second; itB++)
+		;
+	if (itE == itB)
+		return false;
+
+	Map::const_iterator itLast = itE;
+	for (itLast--; !itLast->second; itLast--)
+		;
+
+	if (itB == itLast)
+	{
+		Value val;
+		val.m_Count = itB->second;
+		val.get_Hash(hv, itB->first);
+		return true;
+	}
+
+	uint16_t nBit = get_DiffBit(itB->first.m_pArr, itLast->first.m_pArr, nPos, Key::s_Bits);
+	assert(nBit < Key::s_Bits);
+
+	itE = ++itLast;
+	Map::const_iterator itMid = SplitAt(itB, itE, nBit);
+
+	Merkle::Hash hv1;
+	verify(get_HashDelta(hv, nBit + 1, itB, itMid));
+	verify(get_HashDelta(hv1, nBit + 1, itMid, itE));
+
+	ECC::Hash::Processor() << hv << hv1 >> hv;
+	return true;
+}
+
 int UtxoTree::Key::cmp(const Key& k) const
 {
 	return memcmp(m_pArr, k.m_pArr, sizeof(m_pArr));
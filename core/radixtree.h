@@ -235,6 +235,58 @@ public:
 
 	~UtxoTree() { Clear(); }
 
+	// Copy-on-write view over the tree. Records the resulting counts of the modified elements, without touching the tree itself.
+	// The resulting hash is evaluated from the cached hashes of the unmodified subtrees.
+	// The underlying tree must not be modified while the overlay is in use.
+	class Overlay
+	{
+	public:
+
+		Overlay(UtxoTree& t) :m_Tree(t) {}
+		Overlay& operator = (const Overlay&); // must be over the same tree. The undo info isn't copied
+
+		Input::Count get_Count(const Key&) const;
+		void set_Count(const Key&, Input::Count);
+
+		struct IWalker {
+			virtual bool OnUtxo(const Key&, Input::Count) = 0; // return false to stop iteration
+		};
+
+		bool Enum(IWalker&, const Key& kMin, const Key& kMax) const; // present elements only, ascending order. Same semantics as Traverse (returns false if stopped)
+
+		void get_Hash(Merkle::Hash&);
+
+		// undo support, for partially applied transactions
+		size_t get_Checkpoint() const { return m_vUndo.size(); }
+		void Rollback(size_t nCheckpoint);
+		void DropUndo() { m_vUndo.clear(); }
+
+		bool IsEmpty() const { return m_Map.empty(); }
+		void Clear();
+
+	private:
+
+		typedef std::map<Key, Input::Count> Map; // 0 = deleted
+
+		struct Undo {
+			Key m_Key;
+			Input::Count m_Count;
+			bool m_bPresent;
+		};
+
+		UtxoTree& m_Tree;
+		Map m_Map;
+		std::vector<Undo> m_vUndo;
+
+		static uint8_t get_Bit(const uint8_t*, uint16_t nBit);
+		static uint16_t get_DiffBit(const uint8_t* p0, const uint8_t* p1, uint16_t nPos, uint16_t nEnd);
+		static Map::const_iterator SplitAt(Map::const_iterator, Map::const_iterator, uint16_t nBit);
+
+		bool get_HashInternal(Merkle::Hash&, Node*, uint16_t nNodePos, uint16_t nPos, Map::const_iterator, Map::const_iterator);
+		bool get_HashSplit(Merkle::Hash&, Node** ppN, const uint16_t* pNodePos, uint16_t nBit, Map::const_iterator, Map::const_iterator);
+		bool get_HashDelta(Merkle::Hash&, uint16_t nPos, Map::const_iterator, Map::const_iterator) const;
+	};
+
     template<typename Archive>
     Archive& save(Archive& ar) const
 	{
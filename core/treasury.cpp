@@ -14,6 +14,7 @@
 
 #include "treasury.h"
 #include "proto.h"
+#include "../utility/thread_pool.h"
 
 namespace beam
 {
@@ -73,7 +74,7 @@ namespace beam
 
 	class Treasury::ThreadPool
 	{
-		std::vector<std::thread> m_vThreads;
+		beam::ThreadPool::Job::Ptr m_pJob;
 	public:
 
 		struct Context
@@ -116,21 +117,21 @@ namespace beam
 
 		ThreadPool(Context& ctx, size_t nTasks)
 		{
-			size_t numCores = std::thread::hardware_concurrency();
-			if (!numCores)
-				numCores = 1; //?
-			if (numCores > nTasks)
-				numCores = nTasks;
+			beam::ThreadPool& tp = beam::ThreadPool::get();
+			m_pJob = beam::ThreadPool::Job::create(beam::ThreadPool::Priority::Verification);
+
+			size_t nParts = tp.get_threads() + 1; // the calling thread participates as well
+			if (nParts > nTasks)
+				nParts = nTasks;
 
-			m_vThreads.resize(numCores);
 			size_t iTask0 = 0;
 
-			for (size_t i = 0; i < m_vThreads.size(); i++)
+			for (size_t i = 0; i < nParts; i++)
 			{
-				size_t iTask1 = nTasks * (i + 1) / numCores;
-				assert(iTask1 > iTask0); // otherwise it means that redundant threads were created
+				size_t iTask1 = nTasks * (i + 1) / nParts;
+				assert(iTask1 > iTask0); // otherwise it means that redundant parts were created
 
-				m_vThreads[i] = std::thread(&Context::DoRange, &ctx, iTask0, iTask1);
+				tp.push(m_pJob, [&ctx, iTask0, iTask1]() { ctx.DoRange(iTask0, iTask1); });
 
 				iTask0 = iTask1;
 			}
@@ -140,9 +141,7 @@ namespace beam
 
 		~ThreadPool()
 		{
-			for (size_t i = 0; i < m_vThreads.size(); i++)
-				if (m_vThreads[i].joinable())
-					m_vThreads[i].join();
+			m_pJob->wait();
 		}
 	};
 
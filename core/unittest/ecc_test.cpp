@@ -1124,6 +1124,24 @@ void TestBbs()
 	n = (uint32_t) buf.size();
 
 	verify_test(!beam::proto::Bbs::Decrypt(p, n, privateAddr));
+
+	// trial decryption
+	beam::proto::Bbs::Decryptor dec;
+	verify_test(dec.Init(&buf.at(0), (uint32_t) buf.size()));
+
+	beam::ByteBuffer res;
+	verify_test(!dec.Decrypt(res, privateAddr, publicAddr));
+
+	SetRandom(privateAddr);
+	beam::proto::Sk2Pk(publicAddr, privateAddr);
+
+	verify_test(beam::proto::Bbs::Encrypt(buf, publicAddr, nonce, szMsg, sizeof(szMsg)));
+	verify_test(dec.Init(&buf.at(0), (uint32_t) buf.size()));
+	verify_test(dec.Decrypt(res, privateAddr, publicAddr));
+	verify_test(res.size() == sizeof(szMsg));
+	verify_test(!memcmp(&res.front(), szMsg, sizeof(szMsg)));
+
+	verify_test(!dec.Init(&buf.at(0), 10));
 }
 
 void TestRatio(const beam::Difficulty& d0, const beam::Difficulty& d1, double k)
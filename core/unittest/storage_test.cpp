@@ -357,6 +357,121 @@ namespace beam
 		t.Traverse(t2);
 	}
 
+	void SetUtxoCount(UtxoTree& t, const UtxoTree::Key& key, Input::Count n)
+	{
+		UtxoTree::Cursor cu;
+		bool bCreate = (n > 0);
+		UtxoTree::MyLeaf* p = t.Find(cu, key, bCreate);
+
+		if (!p)
+			return;
+
+		if (n)
+		{
+			p->m_Value.m_Count = n;
+			cu.InvalidateElement();
+		}
+		else
+			t.Delete(cu);
+	}
+
+	void TestUtxoTreeOverlay()
+	{
+		UtxoTree t;
+		std::vector<UtxoTree::Key> vKeys;
+
+		for (uint32_t i = 0; i < 2000; i++)
+		{
+			UtxoTree::Key::Data d;
+			SetRandomUtxoKey(d);
+
+			vKeys.emplace_back();
+			vKeys.back() = d;
+
+			d.m_Maturity++; // same commitment, neighbor key
+			vKeys.emplace_back();
+			vKeys.back() = d;
+		}
+
+		for (size_t i = 0; i < vKeys.size(); i += 3)
+			SetUtxoCount(t, vKeys[i], 1 + (i & 3));
+
+		for (uint32_t iCycle = 0; iCycle < 20; iCycle++)
+		{
+			Merkle::Hash hvBase, hv0, hv1;
+			t.get_Hash(hvBase);
+
+			UtxoTree::Overlay ovl(t);
+			verify_test(ovl.IsEmpty());
+			ovl.get_Hash(hv0);
+			verify_test(hv0 == hvBase);
+
+			// modifications, including deleting everything in some subtrees
+			uint32_t nOps = (iCycle < 2) ? (uint32_t) vKeys.size() : (1 + rand() % 300);
+			for (uint32_t i = 0; i < nOps; i++)
+			{
+				const UtxoTree::Key& key = vKeys[(iCycle < 2) ? i : (rand() % vKeys.size())];
+				Input::Count n = iCycle ? (rand() % 3) : 0;
+				ovl.set_Count(key, n);
+				verify_test(ovl.get_Count(key) == n);
+			}
+
+			// partial undo
+			size_t nCheckpoint = ovl.get_Checkpoint();
+			ovl.get_Hash(hv0);
+
+			for (uint32_t i = 0; i < 10; i++)
+				ovl.set_Count(vKeys[rand() % vKeys.size()], 7);
+
+			ovl.Rollback(nCheckpoint);
+			ovl.get_Hash(hv1);
+			verify_test(hv0 == hv1);
+
+			t.get_Hash(hv1);
+			verify_test(hv1 == hvBase); // untouched
+
+			// enum should see the effective counts
+			struct Walker :public UtxoTree::Overlay::IWalker
+			{
+				const UtxoTree::Overlay* m_pOvl;
+				UtxoTree::Key m_Last;
+				uint32_t m_Count = 0;
+
+				virtual bool OnUtxo(const UtxoTree::Key& key, Input::Count n) override
+				{
+					verify_test(n && (m_pOvl->get_Count(key) == n));
+					verify_test(!m_Count || (m_Last < key));
+					m_Last = key;
+					m_Count++;
+					return true;
+				}
+			} w;
+			w.m_pOvl = &ovl;
+
+			UtxoTree::Key kMin, kMax;
+			ZeroObject(kMin);
+			memset(kMax.m_pArr, 0xff, sizeof(kMax.m_pArr));
+			verify_test(ovl.Enum(w, kMin, kMax));
+
+			// apply the same to the tree
+			uint32_t nCount = 0;
+			for (size_t i = 0; i < vKeys.size(); i++)
+			{
+				Input::Count n = ovl.get_Count(vKeys[i]);
+				SetUtxoCount(t, vKeys[i], n);
+				if (n)
+					nCount++;
+			}
+
+			verify_test(w.m_Count == nCount);
+
+			t.get_Hash(hv1);
+			verify_test(hv0 == hv1);
+		}
+
+		t.Clear();
+	}
+
 	struct MyMmr
 		:public Merkle::Mmr
 	{
@@ -593,6 +708,7 @@ int main()
 {
 	beam::TestNavigator();
 	beam::TestUtxoTree();
+	beam::TestUtxoTreeOverlay();
 	beam::TestMmr();
 
 	return g_TestsFailed ? -1 : 0;
@@ -16,8 +16,7 @@
 #include "node/node.h"
 #include "core/serialization_adapters.h"
 #include "http/http_msg_creator.h"
-#include "http/http_json_serializer.h"
-#include "nlohmann/json.hpp"
+#include "utility/io/json_writer.h"
 #include "utility/helpers.h"
 #include "utility/logger.h"
 
@@ -28,23 +27,12 @@ namespace {
 static const size_t PACKER_FRAGMENTS_SIZE = 4096;
 static const size_t CACHE_DEPTH = 100000;
 
-const char* hash_to_hex(char* buf, const Merkle::Hash& hash) {
-    return to_hex(buf, hash.m_pData, 32);
+void write_hash(JsonWriter& w, const char* key, const Merkle::Hash& hash) {
+    w.key(key).hex(hash.m_pData, hash.nBytes);
 }
 
-const char* uint256_to_hex(char* buf, const ECC::uintBig& n) {
-    char* p = to_hex(buf + 2, n.m_pData, 32);
-    while (p && *p == '0') ++p;
-    if (*p == '\0') --p;
-    *--p = 'x';
-    *--p = '0';
-    return p;
-}
-
-const char* difficulty_to_hex(char* buf, const Difficulty& d) {
-    ECC::uintBig raw;
-    d.Unpack(raw);
-    return uint256_to_hex(buf, raw);
+void write_uint256(JsonWriter& w, const char* key, const ECC::uintBig& n) {
+    w.key(key).hex_number(n.m_pData, n.nBytes);
 }
 
 struct ResponseCache {
@@ -89,8 +77,6 @@ private:
     size_t _depth;
 };
 
-using nlohmann::json;
-
 } //namespace
 
 /// Explorer server backend, gets callback on status update and returns json messages for server
@@ -154,22 +140,17 @@ private:
             _cache.currentHeight = cursor.m_Sid.m_Height;
             _cache.lowHorizon = cursor.m_LoHorizon;
 
-            char buf[80];
-
             _sm.clear();
-            if (!serialize_json_msg(
-                _sm,
-                _packer,
-                json{
-                    { "timestamp", cursor.m_Full.m_TimeStamp },
-                    { "height", _cache.currentHeight },
-                    { "low_horizon", cursor.m_LoHorizon },
-                    { "hash", hash_to_hex(buf, cursor.m_ID.m_Hash) },
-                    { "chainwork",  uint256_to_hex(buf, cursor.m_Full.m_ChainWork) }
-                }
-            )) {
-                return false;
-            }
+            JsonWriter w(_packer.acquire_writer(_sm));
+            w.begin_object()
+                .field("timestamp", cursor.m_Full.m_TimeStamp)
+                .field("height", _cache.currentHeight)
+                .field("low_horizon", cursor.m_LoHorizon);
+            write_hash(w, "hash", cursor.m_ID.m_Hash);
+            write_uint256(w, "chainwork", cursor.m_Full.m_ChainWork);
+            w.end_object();
+            w.finish();
+            _packer.release_writer();
 
             _cache.status = io::normalize(_sm, false);
             _statusDirty = false;
@@ -201,13 +182,12 @@ private:
         return true;
     }
 
-    bool extract_block_from_row(json& out, uint64_t row) {
+    bool extract_block_from_row(JsonWriter& w, uint64_t row) {
         NodeDB& db = _nodeBackend.get_DB();
 
         Block::SystemState::Full blockState;
 		Block::SystemState::ID id;
 		Block::Body block;
-		bool ok = true;
 
         try {
             db.get_State(row, blockState);
@@ -219,70 +199,59 @@ private:
 			_nodeBackend.ExtractBlockWithExtra(block, sid);
 
 		} catch (...) {
-            ok = false;
+            return false;
         }
 
-
-        if (ok) {
-            char buf[80];
-
-            json inputs = json::array();
-            for (const auto &v : block.m_vInputs) {
-                inputs.push_back(
-                json{
-                    {"commitment", uint256_to_hex(buf, v->m_Commitment.m_X)},
-                    {"maturity",   v->m_Maturity}
-                }
-                );
-            }
-
-            json outputs = json::array();
-            for (const auto &v : block.m_vOutputs) {
-                outputs.push_back(
-                json{
-                    {"commitment", uint256_to_hex(buf, v->m_Commitment.m_X)},
-                    {"maturity",   v->m_Maturity},
-                    {"coinbase",   v->m_Coinbase},
-                    {"incubation", v->m_Incubation}
-                }
-                );
-            }
-
-            json kernels = json::array();
-            for (const auto &v : block.m_vKernels) {
-                Merkle::Hash kernelID;
-                v->get_ID(kernelID);
-                kernels.push_back(
-                    json{
-                        {"id", hash_to_hex(buf, kernelID)},
-                        {"excess", uint256_to_hex(buf, v->m_Commitment.m_X)},
-                        {"minHeight", v->m_Height.m_Min},
-                        {"maxHeight", v->m_Height.m_Max},
-                        {"fee", v->m_Fee}
-                    }
-                );
-            }
-
-            out = json{
-                {"found",      true},
-                {"timestamp",  blockState.m_TimeStamp},
-                {"height",     blockState.m_Height},
-                {"hash",       hash_to_hex(buf, id.m_Hash)},
-                {"prev",       hash_to_hex(buf, blockState.m_Prev)},
-                {"difficulty", blockState.m_PoW.m_Difficulty.ToFloat()},
-                {"chainwork",  uint256_to_hex(buf, blockState.m_ChainWork)},
-                {"subsidy",    Rules::get_Emission(blockState.m_Height)},
-                {"inputs",     inputs},
-                {"outputs",    outputs},
-                {"kernels",    kernels}
-            };
-
-            LOG_DEBUG() << out;
+        // written straight into the fragments, no intermediate DOM
+        w.begin_object()
+            .field("found", true)
+            .field("timestamp", blockState.m_TimeStamp)
+            .field("height", blockState.m_Height);
+        write_hash(w, "hash", id.m_Hash);
+        write_hash(w, "prev", blockState.m_Prev);
+        w.field("difficulty", blockState.m_PoW.m_Difficulty.ToFloat());
+        write_uint256(w, "chainwork", blockState.m_ChainWork);
+        w.field("subsidy", Rules::get_Emission(blockState.m_Height));
+
+        w.key("inputs").begin_array();
+        for (const auto &v : block.m_vInputs) {
+            w.begin_object();
+            write_uint256(w, "commitment", v->m_Commitment.m_X);
+            w.field("maturity", v->m_Maturity);
+            w.end_object();
+        }
+        w.end_array();
+
+        w.key("outputs").begin_array();
+        for (const auto &v : block.m_vOutputs) {
+            w.begin_object();
+            write_uint256(w, "commitment", v->m_Commitment.m_X);
+            w.field("maturity", v->m_Maturity)
+                .field("coinbase", v->m_Coinbase)
+                .field("incubation", v->m_Incubation);
+            w.end_object();
         }
-        return ok;
+        w.end_array();
+
+        w.key("kernels").begin_array();
+        for (const auto &v : block.m_vKernels) {
+            Merkle::Hash kernelID;
+            v->get_ID(kernelID);
+            w.begin_object();
+            write_hash(w, "id", kernelID);
+            write_uint256(w, "excess", v->m_Commitment.m_X);
+            w.field("minHeight", v->m_Height.m_Min)
+                .field("maxHeight", v->m_Height.m_Max)
+                .field("fee", v->m_Fee);
+            w.end_object();
+        }
+        w.end_array();
+
+        w.end_object();
+        return true;
     }
 
-    bool extract_block(json& out, Height height, uint64_t& row, uint64_t* prevRow) {
+    bool extract_block(JsonWriter& w, Height height, uint64_t& row, uint64_t* prevRow) {
         bool ok = true;
         if (row == 0) {
             ok = extract_row(height, row, prevRow);
@@ -292,7 +261,7 @@ private:
                 *prevRow = 0;
             }
         }
-        return ok && extract_block_from_row(out, row);
+        return ok && extract_block_from_row(w, row);
     }
 
     bool get_block_impl(io::SerializedMsg& out, uint64_t height, uint64_t& row, uint64_t* prevRow) {
@@ -303,30 +272,31 @@ private:
             return true;
         }
 
-        io::SharedBuffer body;
         bool blockAvailable = (/*height >= _cache.lowHorizon && */height <= _cache.currentHeight);
         if (blockAvailable) {
-            json j;
-            if (!extract_block(j, height, row, prevRow)) {
-                blockAvailable = false;
-            } else {
-                _sm.clear();
-                if (serialize_json_msg(_sm, _packer, j)) {
-                    body = io::normalize(_sm, false);
-                    _cache.put_block(height, body);
-                } else {
-                    return false;
-                }
-                _sm.clear();
+            _sm.clear();
+            JsonWriter w(_packer.acquire_writer(_sm));
+            blockAvailable = extract_block(w, height, row, prevRow);
+            if (blockAvailable) {
+                w.finish();
+                io::SharedBuffer body = io::normalize(_sm, false);
+                _cache.put_block(height, body);
+                out.push_back(body);
             }
-        }
+            _packer.release_writer();
+            _sm.clear();
 
-        if (blockAvailable) {
-            out.push_back(body);
-            return true;
+            if (blockAvailable) return true;
         }
 
-        return serialize_json_msg(out, _packer, json{ { "found", false}, {"height", height } });
+        JsonWriter w(_packer.acquire_writer(out));
+        w.begin_object()
+            .field("found", false)
+            .field("height", height)
+            .end_object();
+        w.finish();
+        _packer.release_writer();
+        return true;
     }
 
     bool get_block(io::SerializedMsg& out, uint64_t height) override {
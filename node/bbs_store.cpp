@@ -0,0 +1,148 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bbs_store.h"
+
+namespace beam {
+
+void BbsStore::Element::Export(NodeDB::WalkerBbs::Data& d) const
+{
+	d.m_Key = m_Key.m_Value;
+	d.m_Channel = m_Channel.m_Value;
+	d.m_TimePosted = m_Time.m_Value;
+	d.m_Message = Blob(m_Message);
+	d.m_Nonce = m_Nonce;
+	d.m_bNonce = m_bNonce;
+}
+
+size_t BbsStore::Element::get_Size() const
+{
+	return sizeof(*this) + m_Message.size();
+}
+
+BbsStore::Element* BbsStore::Find(const Key& key)
+{
+	Element::InKey k;
+	k.m_Value = key;
+
+	KeySet::iterator it = m_setKey.find(k);
+	return (m_setKey.end() == it) ? NULL : &it->get_ParentObj();
+}
+
+BbsStore::Element& BbsStore::Insert(const NodeDB::WalkerBbs::Data& d)
+{
+	if (m_SizeMax)
+	{
+		// make room in advance, so that the new one is not evicted
+		size_t nSize = sizeof(Element) + d.m_Message.n;
+		while (!m_setTime.empty() && (m_TotalSize + nSize > m_SizeMax))
+			Delete(m_setTime.begin()->get_ParentObj());
+	}
+
+	Element* p = new Element;
+	d.m_Message.Export(p->m_Message);
+	p->m_Nonce = d.m_Nonce;
+	p->m_bNonce = d.m_bNonce;
+
+	p->m_Seq.m_ID = ++m_LastID;
+	p->m_Key.m_Value = d.m_Key;
+	p->m_Channel.m_Value = d.m_Channel;
+	p->m_Channel.m_ID = m_LastID;
+	p->m_Time.m_Value = d.m_TimePosted;
+
+	m_setSeq.insert(p->m_Seq);
+	m_setKey.insert(p->m_Key);
+	m_setChannel.insert(p->m_Channel);
+	m_setTime.insert(p->m_Time);
+
+	m_TotalSize += p->get_Size();
+
+	return *p;
+}
+
+void BbsStore::Delete(Element& x)
+{
+	assert(m_TotalSize >= x.get_Size());
+	m_TotalSize -= x.get_Size();
+
+	m_setSeq.erase(SeqSet::s_iterator_to(x.m_Seq));
+	m_setKey.erase(KeySet::s_iterator_to(x.m_Key));
+	m_setChannel.erase(ChannelSet::s_iterator_to(x.m_Channel));
+	m_setTime.erase(TimeSet::s_iterator_to(x.m_Time));
+
+	delete &x;
+}
+
+void BbsStore::DeleteOld(Timestamp tMinToRemain)
+{
+	while (!m_setTime.empty())
+	{
+		Element& x = m_setTime.begin()->get_ParentObj();
+		if (x.m_Time.m_Value >= tMinToRemain)
+			break;
+
+		Delete(x);
+	}
+}
+
+void BbsStore::Clear()
+{
+	while (!m_setSeq.empty())
+		Delete(m_setSeq.begin()->get_ParentObj());
+}
+
+uint64_t BbsStore::FindCursor(Timestamp t) const
+{
+	// Time order is not the same as the arrival order. Visit all the messages that satisfy the time, they are about to be sent anyway
+	Element::Time key;
+	key.m_Value = t;
+
+	uint64_t id = m_LastID + 1;
+	for (TimeSet::const_iterator it = m_setTime.lower_bound(key); m_setTime.end() != it; it++)
+		id = std::min(id, it->get_ParentObj().get_ID());
+
+	return id;
+}
+
+Timestamp BbsStore::get_MaxTime() const
+{
+	return m_setTime.empty() ? 0 : m_setTime.rbegin()->m_Value;
+}
+
+void BbsStore::Load(NodeDB& db)
+{
+	NodeDB::WalkerBbs wlk(db);
+	wlk.m_ID = 0;
+	for (db.EnumAllBbs(wlk); wlk.MoveNext(); )
+		Insert(wlk.m_Data);
+
+	m_FlushedID = m_LastID;
+}
+
+void BbsStore::Flush(NodeDB& db)
+{
+	Element::Seq key;
+	key.m_ID = m_FlushedID;
+
+	for (SeqSet::iterator it = m_setSeq.upper_bound(key); m_setSeq.end() != it; it++)
+	{
+		NodeDB::WalkerBbs::Data d;
+		it->get_ParentObj().Export(d);
+		db.BbsIns(d);
+	}
+
+	m_FlushedID = m_LastID;
+}
+
+} // namespace beam
@@ -0,0 +1,107 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <boost/intrusive/set.hpp>
+#include "db.h"
+
+namespace beam {
+
+// Memory-resident storage of the bbs messages.
+// The messages are numbered in the arrival order. The DB is used only to keep them across restarts (if needed).
+struct BbsStore
+{
+	typedef NodeDB::WalkerBbs::Key Key;
+
+	struct Element
+	{
+		ByteBuffer m_Message;
+		uint32_t m_Nonce;
+		bool m_bNonce;
+
+		struct Seq
+			:public boost::intrusive::set_base_hook<>
+		{
+			uint64_t m_ID;
+
+			bool operator < (const Seq& x) const { return m_ID < x.m_ID; }
+			IMPLEMENT_GET_PARENT_OBJ(Element, m_Seq)
+		} m_Seq;
+
+		struct InKey
+			:public boost::intrusive::set_base_hook<>
+		{
+			Key m_Value;
+
+			bool operator < (const InKey& x) const { return m_Value < x.m_Value; }
+			IMPLEMENT_GET_PARENT_OBJ(Element, m_Key)
+		} m_Key;
+
+		struct Channel
+			:public boost::intrusive::set_base_hook<>
+		{
+			BbsChannel m_Value;
+			uint64_t m_ID;
+
+			bool operator < (const Channel& x) const { return (m_Value < x.m_Value) || ((m_Value == x.m_Value) && (m_ID < x.m_ID)); }
+			IMPLEMENT_GET_PARENT_OBJ(Element, m_Channel)
+		} m_Channel;
+
+		struct Time
+			:public boost::intrusive::set_base_hook<>
+		{
+			Timestamp m_Value;
+
+			bool operator < (const Time& x) const { return m_Value < x.m_Value; }
+			IMPLEMENT_GET_PARENT_OBJ(Element, m_Time)
+		} m_Time;
+
+		uint64_t get_ID() const { return m_Seq.m_ID; }
+		void Export(NodeDB::WalkerBbs::Data&) const;
+		size_t get_Size() const;
+	};
+
+	typedef boost::intrusive::multiset<Element::Seq> SeqSet;
+	typedef boost::intrusive::multiset<Element::InKey> KeySet;
+	typedef boost::intrusive::multiset<Element::Channel> ChannelSet;
+	typedef boost::intrusive::multiset<Element::Time> TimeSet;
+
+	SeqSet m_setSeq;
+	KeySet m_setKey;
+	ChannelSet m_setChannel;
+	TimeSet m_setTime;
+
+	uint64_t m_LastID = 0;
+	uint64_t m_FlushedID = 0; // all the messages up to this one are saved (or already deleted)
+	uint64_t m_TotalSize = 0;
+	uint64_t m_SizeMax = 0; // when exceeded - the oldest messages are dropped. 0 = unlimited
+
+	Element* Find(const Key&);
+	Element& Insert(const NodeDB::WalkerBbs::Data&); // must be unique (check with Find first)
+	void Delete(Element&);
+	void DeleteOld(Timestamp tMinToRemain);
+	void Clear();
+
+	uint64_t FindCursor(Timestamp) const; // the lowest ID of the messages posted at or after the given time
+	Timestamp get_MaxTime() const;
+
+	// persistence
+	void Load(NodeDB&);
+	void Flush(NodeDB&); // save the messages that are not in the DB yet
+
+	~BbsStore() { Clear(); }
+};
+
+} // namespace beam
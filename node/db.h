@@ -16,6 +16,7 @@
 
 #include "core/common.h"
 #include "core/block_crypt.h"
+#include "core/navigator.h"
 #include "sqlite/sqlite3.h"
 
 namespace beam {
@@ -41,7 +42,18 @@ public:
 			SyncTarget,
 			LoHorizon,
 			Treasury,
-			DummyID
+			DummyID,
+			CleanShutdown, // set on close, reset on open
+			IntegrityChecked, // timestamp of the last successful full check, 0 if it's due
+		};
+	};
+
+	struct IntegrityCheck {
+		enum Enum {
+			None,
+			Quick, // PRAGMA quick_check: pages and records, no index consistency. Much faster on big DBs
+			Auto, // full check if the last shutdown wasn't clean or it's due, quick otherwise
+			Full, // PRAGMA integrity_check
 		};
 	};
 
@@ -93,6 +105,7 @@ public:
 			MmrGet,
 			MmrSet,
 			HashForHist,
+			StatesMmrEnum,
 			StateGetBlock,
 			StateSetBlock,
 			//StateDelBlock,
@@ -110,6 +123,7 @@ public:
 			BbsEnumCSeq,
 			BbsHistogram,
 			BbsEnumAllSeq,
+			BbsEnumAll,
 			BbsFindRaw,
 			BbsFind,
 			BbsFindCursor,
@@ -141,7 +155,13 @@ public:
 	virtual ~NodeDB();
 
 	void Close();
-	void Open(const char* szPath);
+	void Open(const char* szPath, IntegrityCheck::Enum = IntegrityCheck::Auto);
+
+	// Throws on failure. The successful full check is recorded
+	void CheckIntegrity(bool bFull);
+
+	// whether the DB was closed cleanly before this Open
+	bool get_PrevShutdownClean() const { return m_bPrevShutdownClean; }
 
 	virtual void OnModified() {}
 
@@ -357,6 +377,7 @@ public:
 	};
 
 	void EnumAllBbsSeq(WalkerBbsLite&); // ordered by m_ID. Must be initialized to specify the lower bound
+	void EnumAllBbs(WalkerBbs&); // same, with the data
 
 	struct IBbsHistogram {
 		virtual bool OnChannel(BbsChannel, uint64_t nCount) = 0;
@@ -382,6 +403,8 @@ public:
 private:
 
 	sqlite3* m_pDb;
+	bool m_bPrevShutdownClean;
+	bool m_bOpen; // mark the clean shutdown on close
 
 	struct Statement
 	{
@@ -424,6 +447,14 @@ private:
 	void TestChanged1Row();
 
 	struct Dmmr;
+
+	// flat-file copy of the active chain MMR, used for the proofs when possible
+	struct StatesMmr;
+	std::unique_ptr<StatesMmr> m_pStatesMmr;
+
+	void StatesMmrOpen(const char* szPath);
+	void StatesMmrSync(bool bRebuild);
+	StatesMmr* get_StatesMmr(const StateID&);
 };
 
 
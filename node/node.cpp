@@ -488,10 +488,11 @@ void Node::Processor::OnNewState()
 
     LOG_INFO() << "My Tip: " << m_Cursor.m_ID << ", Work = " << Difficulty::ToFloat(m_Cursor.m_Full.m_ChainWork);
 
-    //get_ParentObj().m_TxPool.DeleteOutOfBound(m_Cursor.m_Sid.m_Height + 1);
     get_ParentObj().m_Processor.DeleteOutdated(get_ParentObj().m_TxPool); // Better to delete all irrelevant txs explicitly, even if the node is supposed to mine
     // because in practice mining could be OFF (for instance, if miner key isn't defined, and owner wallet is offline).
 
+    get_ParentObj().m_Decoys.ClaimInputs();
+
     if (get_ParentObj().m_Miner.IsEnabled())
     {
         get_ParentObj().m_Miner.HardAbortSafe();
@@ -533,6 +534,7 @@ void Node::Processor::OnNewState()
 void Node::Processor::OnRolledBack()
 {
     LOG_INFO() << "Rolled back to: " << m_Cursor.m_ID;
+    m_CwpStates.clear();
     get_ParentObj().m_Compressor.OnRolledBack();
 }
 
@@ -555,28 +557,18 @@ bool Node::Processor::Verifier::ValidateAndSummarize(TxBase::Context& ctx, const
             m_pBc->Flush();
     }
 
-    std::unique_lock<std::mutex> scope(m_Mutex);
-
-    if (m_vThreads.empty())
-    {
-        m_iTask = 1;
-
-        m_vThreads.resize(nThreads);
-        for (uint32_t i = 0; i < nThreads; i++)
-            m_vThreads[i] = std::thread(&Verifier::Thread, this, i);
-    }
-
-    m_iTask ^= 2;
     m_pTx = &txb;
     m_pR = &r;
     m_pCtx = &ctx;
     m_bFail = false;
-    m_Remaining = nThreads;
 
-    m_TaskNew.notify_all();
+    ThreadPool& tp = ThreadPool::get();
+    ThreadPool::Job::Ptr pJob = ThreadPool::Job::create(ThreadPool::Priority::Verification);
+
+    for (uint32_t i = 0; i < nThreads; i++)
+        tp.push(pJob, [this, i, nThreads]() { Verify(i, nThreads); });
 
-    while (m_Remaining)
-        m_TaskFinished.wait(scope);
+    pJob->wait(); // this thread participates as well
 
     return !m_bFail;
 }
@@ -595,57 +587,39 @@ bool Node::Processor::VerifyBlock(const Block::BodyBase& block, TxBase::IReader&
         ctx.IsValidBlock(block);
 }
 
-void Node::Processor::Verifier::Thread(uint32_t iVerifier)
+void Node::Processor::Verifier::Verify(uint32_t iVerifier, uint32_t nVerifiers)
 {
-    uint32_t nThreads = get_ParentObj().get_ParentObj().m_Cfg.m_VerificationThreads;
-
-    std::unique_ptr<Verifier::MyBatch> p(new Verifier::MyBatch);
-    p->m_bEnableBatch = true;
-    Verifier::MyBatch::Scope scope(*p);
-
-    for (uint32_t iTask = 1; ; )
-    {
-        {
-            std::unique_lock<std::mutex> scope2(m_Mutex);
-
-            while (m_iTask == iTask)
-                m_TaskNew.wait(scope2);
-
-            if (!m_iTask)
-                return;
-
-            iTask = m_iTask;
-        }
-
+    // the batch is big, keep one per pool thread
+    thread_local std::unique_ptr<Verifier::MyBatch> p;
+    if (p)
         p->Reset();
+    else
+    {
+        p.reset(new Verifier::MyBatch);
+        p->m_bEnableBatch = true;
+    }
 
-        assert(m_Remaining);
-
-        TxBase::Context ctx;
-        ctx.m_bBlockMode = m_pCtx->m_bBlockMode;
-        ctx.m_Height = m_pCtx->m_Height;
-        ctx.m_nVerifiers = nThreads;
-        ctx.m_iVerifier = iVerifier;
-        ctx.m_pAbort = &m_bFail; // obsolete actually
-
-        TxBase::IReader::Ptr pR;
-        m_pR->Clone(pR);
+    Verifier::MyBatch::Scope scope(*p);
 
-        bool bValid = ctx.ValidateAndSummarize(*m_pTx, std::move(*pR)) && p->Flush();
+    TxBase::Context ctx;
+    ctx.m_bBlockMode = m_pCtx->m_bBlockMode;
+    ctx.m_Height = m_pCtx->m_Height;
+    ctx.m_nVerifiers = nVerifiers;
+    ctx.m_iVerifier = iVerifier;
+    ctx.m_pAbort = &m_bFail; // obsolete actually
 
-        std::unique_lock<std::mutex> scope2(m_Mutex);
+    TxBase::IReader::Ptr pR;
+    m_pR->Clone(pR);
 
-        verify(m_Remaining--);
+    bool bValid = ctx.ValidateAndSummarize(*m_pTx, std::move(*pR)) && p->Flush();
 
-        if (bValid && !m_bFail)
-            bValid = m_pCtx->Merge(ctx);
+    std::unique_lock<std::mutex> scope2(m_Mutex);
 
-        if (!bValid)
-            m_bFail = true;
+    if (bValid && !m_bFail)
+        bValid = m_pCtx->Merge(ctx);
 
-        if (!m_Remaining)
-            m_TaskFinished.notify_one();
-    }
+    if (!bValid)
+        m_bFail = true;
 }
 
 void Node::Processor::AdjustFossilEnd(Height& h)
@@ -671,6 +645,13 @@ bool Node::Processor::OpenMacroblock(Block::BodyBase::RW& rw, const NodeDB::Stat
     return true;
 }
 
+void Node::Processor::OnStartupProgress(const StartupProfiler::Progress& p)
+{
+	IObserver* pObserver = get_ParentObj().m_Cfg.m_Observer;
+	if (pObserver)
+		pObserver->OnStartupProgress(p);
+}
+
 void Node::Processor::OnModified()
 {
     if (!m_bFlushPending)
@@ -745,6 +726,7 @@ Node::Peer* Node::AllocPeer(const beam::io::Address& addr)
     m_lstPeers.push_back(*pPeer);
 
 	pPeer->m_UnsentHiMark = m_Cfg.m_BandwidthCtl.m_Drown;
+	pPeer->m_pIoShards = m_pIoShards.get();
     pPeer->m_pInfo = NULL;
     pPeer->m_Flags = 0;
     pPeer->m_Port = 0;
@@ -778,7 +760,7 @@ void Node::Keys::SetSingleKey(const Key::IKdf::Ptr& pKdf)
 void Node::Initialize(IExternalPOW* externalPOW)
 {
     m_Processor.m_Horizon = m_Cfg.m_Horizon;
-    m_Processor.Initialize(m_Cfg.m_sPathLocal.c_str(), m_Cfg.m_Sync.m_ForceResync);
+    m_Processor.Initialize(m_Cfg.m_sPathLocal.c_str(), m_Cfg.m_Sync.m_ForceResync, m_Cfg.m_IntegrityCheck);
 
     if (m_Cfg.m_Sync.m_ForceResync)
         m_Processor.get_DB().ParamSet(NodeDB::ParamID::SyncTarget, NULL, NULL);
@@ -787,6 +769,9 @@ void Node::Initialize(IExternalPOW* externalPOW)
         // use all the cores, don't subtract 'mining threads'. Verification has higher priority
         m_Cfg.m_VerificationThreads = std::thread::hardware_concurrency();
 
+    if (m_Cfg.m_IoThreads)
+        m_pIoShards = std::make_unique<proto::NodeConnection::IoShards>(m_Cfg.m_IoThreads);
+
     InitKeys();
     InitIDs();
 
@@ -795,11 +780,15 @@ void Node::Initialize(IExternalPOW* externalPOW)
 	LOG_INFO() << "Tx replication is OFF";
 
 	if (!m_Cfg.m_Treasury.empty() && !m_Processor.m_Extra.m_TreasuryHandled) {
+		m_Processor.m_Startup.Begin(NodeProcessor::StartupProfiler::Phase::Treasury);
 		// stupid compiler insists on parentheses here!
 		m_Processor.OnTreasury(Blob(m_Cfg.m_Treasury));
+		m_Processor.m_Startup.End(m_Cfg.m_Treasury.size());
 	}
 
 	RefreshDecoys();
+	m_Decoys.ClaimInputs();
+	m_Decoys.RefillOutputs();
     InitMode();
 
 	ZeroObject(m_SyncStatus);
@@ -812,11 +801,22 @@ void Node::Initialize(IExternalPOW* externalPOW)
             m_Beacon.Start();
     }
 
+    m_Processor.m_Startup.Begin(NodeProcessor::StartupProfiler::Phase::Peers);
     m_PeerMan.Initialize();
+    m_Processor.m_Startup.End(m_PeerMan.get_Ratings().size());
+
     m_Miner.Initialize(externalPOW);
     m_Compressor.Init();
+    m_Bbs.m_Store.m_SizeMax = uint64_t(m_Cfg.m_BbsMaxSize_MB) << 20;
+    if (m_Cfg.m_BbsPersistent)
+    {
+        m_Processor.m_Startup.Begin(NodeProcessor::StartupProfiler::Phase::Bbs);
+        m_Bbs.m_Store.Load(m_Processor.get_DB());
+        m_Processor.m_Startup.End(m_Bbs.m_Store.m_setSeq.size());
+    }
+
     m_Bbs.Cleanup();
-	m_Bbs.m_HighestPosted_s = m_Processor.get_DB().get_BbsMaxTime();
+	m_Bbs.m_HighestPosted_s = m_Bbs.m_Store.get_MaxTime();
 }
 
 void Node::InitKeys()
@@ -973,7 +973,16 @@ void Node::InitMode()
 
 void Node::Bbs::Cleanup()
 {
-    get_ParentObj().m_Processor.get_DB().BbsDelOld(getTimestamp() - get_ParentObj().m_Cfg.m_Timeout.m_BbsMessageTimeout_s);
+    NodeDB& db = get_ParentObj().m_Processor.get_DB();
+    Timestamp t = getTimestamp() - get_ParentObj().m_Cfg.m_Timeout.m_BbsMessageTimeout_s;
+
+    m_Store.DeleteOld(t);
+    db.BbsDelOld(t);
+
+    if (get_ParentObj().m_Cfg.m_BbsPersistent)
+        m_Store.Flush(db);
+
+    m_LastCleanup_ms = GetTime_ms();
 }
 
 void Node::Bbs::MaybeCleanup()
@@ -1004,17 +1013,15 @@ Node::~Node()
 	if (m_Miner.m_External.m_pSolver)
 		m_Miner.m_External.m_pSolver->stop();
 
-    for (size_t i = 0; i < m_Miner.m_vThreads.size(); i++)
+    if (m_Miner.m_pJob)
     {
-        PerThread& pt = m_Miner.m_vThreads[i];
-        if (pt.m_pReactor)
-            pt.m_pReactor->stop();
-
-        if (pt.m_Thread.joinable())
-            pt.m_Thread.join();
+        m_Miner.m_pJob->cancel();
+        m_Miner.m_pJob->wait();
+        m_Miner.m_pJob.reset();
     }
-    m_Miner.m_vThreads.clear();
+    m_Miner.m_vSlots.clear();
 
+    m_Decoys.Stop();
     m_Compressor.StopCurrent();
 
     for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
@@ -1025,28 +1032,21 @@ Node::~Node()
     while (!m_lstPeers.empty())
         m_lstPeers.front().DeleteSelf(false, proto::NodeConnection::ByeReason::Stopping);
 
+    m_pIoShards.reset();
+
     while (!m_lstTasksUnassigned.empty())
         DeleteUnassignedTask(m_lstTasksUnassigned.front());
 
     assert(m_setTasks.empty());
 
-    Processor::Verifier& v = m_Processor.m_Verifier; // alias
-    if (!v.m_vThreads.empty())
-    {
-        {
-            std::unique_lock<std::mutex> scope(v.m_Mutex);
-            v.m_iTask = 0;
-            v.m_TaskNew.notify_all();
-        }
-
-        for (size_t i = 0; i < v.m_vThreads.size(); i++)
-            if (v.m_vThreads[i].joinable())
-                v.m_vThreads[i].join();
-    }
-
 	if (!std::uncaught_exceptions())
+	{
 		m_PeerMan.OnFlush();
 
+		if (m_Cfg.m_BbsPersistent)
+			m_Bbs.m_Store.Flush(m_Processor.get_DB());
+	}
+
     LOG_INFO() << "Node stopped";
 }
 
@@ -1147,6 +1147,7 @@ void Node::Peer::SendLogin()
 
 	msgLogin.m_Flags =
 		proto::LoginFlags::Extension1 |
+		proto::LoginFlags::UtxoMulti |
 		proto::LoginFlags::SendPeers; // request a another node to periodically send a list of recommended peers
 
 	if (m_This.m_PostStartSynced)
@@ -2247,23 +2248,15 @@ void Node::AddDummyInputs(Transaction& tx)
 
     while (tx.m_vInputs.size() < m_Cfg.m_Dandelion.m_OutputsMax)
     {
-		Key::IDV kidv;
-        Height h = m_Processor.get_DB().GetLowestDummy(kidv);
-        if (h > m_Processor.m_Cursor.m_ID.m_Height)
+        Decoys::ReadyInput x;
+        if (!m_Decoys.PopInput(x))
             break;
 
-		kidv.m_Value = 0;
-        bModified = true;
-
-        // ECC::Mode::Scope scope(ECC::Mode::Fast);
-
-        ECC::Scalar::Native sk;
-
         // bounds
         UtxoTree::Key kMin, kMax;
 
         UtxoTree::Key::Data d;
-        SwitchCommitment().Create(sk, d.m_Commitment, *m_Keys.m_pDummy, kidv);
+        d.m_Commitment = x.m_Commitment;
         d.m_Maturity = 0;
         kMin = d;
 
@@ -2285,7 +2278,7 @@ void Node::AddDummyInputs(Transaction& tx)
         if (m_Processor.get_Utxos().Traverse(t))
         {
             // spent
-            m_Processor.get_DB().DeleteDummy(kidv);
+            m_Processor.get_DB().DeleteDummy(x.m_Kidv);
         }
         else
         {
@@ -2294,19 +2287,17 @@ void Node::AddDummyInputs(Transaction& tx)
             pInp->m_Commitment = d.m_Commitment;
 
             tx.m_vInputs.push_back(std::move(pInp));
-            tx.m_Offset = ECC::Scalar::Native(tx.m_Offset) + ECC::Scalar::Native(sk);
+            tx.m_Offset = ECC::Scalar::Native(tx.m_Offset) + x.m_sk;
+            bModified = true;
 
             /// in the (unlikely) case the tx will be lost - we'll retry spending this UTXO after the following num of blocks
-            m_Processor.get_DB().SetDummyHeight(kidv, m_Processor.m_Cursor.m_ID.m_Height + m_Cfg.m_Dandelion.m_DummyLifetimeLo + 1);
+            m_Processor.get_DB().SetDummyHeight(x.m_Kidv, m_Processor.m_Cursor.m_ID.m_Height + m_Cfg.m_Dandelion.m_DummyLifetimeLo + 1);
         }
 
     }
 
     if (bModified)
-    {
-        m_Processor.FlushDB(); // make sure they're not lost
         tx.Normalize();
-    }
 }
 
 void Node::AddDummyOutputs(Transaction& tx)
@@ -2321,38 +2312,175 @@ void Node::AddDummyOutputs(Transaction& tx)
 
     while (tx.m_vOutputs.size() < m_Cfg.m_Dandelion.m_OutputsMin)
     {
-		Key::IDV kidv(Zero);
-		kidv.m_Type = Key::Type::Decoy;
-
-		while (true)
-		{
-			NextNonce().ExportWord<0>(kidv.m_Idx);
-			if (MaxHeight == db.GetDummyHeight(kidv))
-				break;
-		}
+        Decoys::ReadyOutput x;
+        if (!m_Decoys.PopOutput(x))
+        {
+            // none prepared yet
+            m_Decoys.SelectKidv(x.m_Kidv);
+            Decoys::Create(x, *m_Keys.m_pDummy);
+        }
 
         bModified = true;
 
-        Output::Ptr pOutput(new Output);
-        ECC::Scalar::Native sk;
-        pOutput->Create(sk, *m_Keys.m_pDummy, kidv, *m_Keys.m_pDummy);
-
+        // no need to flush, the decoys are recognized anyway when they get into a block
 		Height h = SampleDummySpentHeight();
-        db.InsertDummy(h, kidv);
+        db.InsertDummy(h, x.m_Kidv);
 
-        tx.m_vOutputs.push_back(std::move(pOutput));
+        tx.m_vOutputs.push_back(std::move(x.m_pOutput));
 
-        sk = -sk;
-        tx.m_Offset = ECC::Scalar::Native(tx.m_Offset) + sk;
+        x.m_sk = -x.m_sk;
+        tx.m_Offset = ECC::Scalar::Native(tx.m_Offset) + x.m_sk;
     }
 
     if (bModified)
     {
-        m_Processor.FlushDB();
         tx.Normalize();
+        m_Decoys.RefillOutputs();
     }
 }
 
+void Node::Decoys::SelectKidv(Key::IDV& kidv)
+{
+	NodeDB& db = get_ParentObj().m_Processor.get_DB();
+
+	kidv = Key::IDV(Zero);
+	kidv.m_Type = Key::Type::Decoy;
+
+	while (true)
+	{
+		get_ParentObj().NextNonce().ExportWord<0>(kidv.m_Idx);
+		if (MaxHeight == db.GetDummyHeight(kidv))
+			break;
+	}
+}
+
+void Node::Decoys::Create(ReadyOutput& x, Key::IKdf& kdf)
+{
+	x.m_pOutput.reset(new Output);
+	x.m_pOutput->Create(x.m_sk, kdf, x.m_Kidv, kdf);
+}
+
+void Node::Decoys::RefillOutputs()
+{
+	const Config::Dandelion& d = get_ParentObj().m_Cfg.m_Dandelion; // alias
+	if (!d.m_DummyLifetimeHi)
+		return;
+
+	uint32_t nNeeded;
+	{
+		std::scoped_lock<std::mutex> scope(m_Mutex);
+
+		uint32_t nHave = static_cast<uint32_t>(m_qOutputs.size()) + m_OutputsPending;
+		if (nHave >= d.m_DummyOutputsReady)
+			return;
+
+		nNeeded = d.m_DummyOutputsReady - nHave;
+		m_OutputsPending += nNeeded;
+	}
+
+	if (!m_pJob)
+		m_pJob = ThreadPool::Job::create(ThreadPool::Priority::Compression);
+
+	Key::IKdf::Ptr pKdf = get_ParentObj().m_Keys.m_pDummy;
+
+	for (uint32_t i = 0; i < nNeeded; i++)
+	{
+		Key::IDV kidv;
+		SelectKidv(kidv); // DB and nonce generator are accessed from this thread only
+
+		ThreadPool::get().push(m_pJob, [this, pKdf, kidv]() {
+			ReadyOutput x;
+			x.m_Kidv = kidv;
+			Create(x, *pKdf);
+
+			std::scoped_lock<std::mutex> scope(m_Mutex);
+			m_qOutputs.push_back(std::move(x));
+			m_OutputsPending--;
+		});
+	}
+}
+
+void Node::Decoys::ClaimInputs()
+{
+	Node& n = get_ParentObj();
+	NodeDB& db = n.m_Processor.get_DB();
+	Height hTip = n.m_Processor.m_Cursor.m_ID.m_Height;
+
+	std::vector<Key::IDV> vKidv;
+
+	while (m_setClaimed.size() < n.m_Cfg.m_Dandelion.m_OutputsMax)
+	{
+		Key::IDV kidv;
+		Height h = db.GetLowestDummy(kidv);
+		if (h > hTip)
+			break;
+
+		kidv.m_Value = 0;
+
+		// move it out of the way, so that the next one is found. If not attached by then - it'll be claimed again
+		db.SetDummyHeight(kidv, hTip + n.m_Cfg.m_Dandelion.m_DummyLifetimeLo + 1);
+
+		if (m_setClaimed.insert(kidv).second)
+			vKidv.push_back(kidv);
+	}
+
+	if (vKidv.empty())
+		return;
+
+	if (!m_pJob)
+		m_pJob = ThreadPool::Job::create(ThreadPool::Priority::Compression);
+
+	Key::IKdf::Ptr pKdf = n.m_Keys.m_pDummy;
+
+	ThreadPool::get().push(m_pJob, [this, pKdf, vKidv]() {
+		for (size_t i = 0; i < vKidv.size(); i++)
+		{
+			ReadyInput x;
+			x.m_Kidv = vKidv[i];
+			SwitchCommitment().Create(x.m_sk, x.m_Commitment, *pKdf, x.m_Kidv);
+
+			std::scoped_lock<std::mutex> scope(m_Mutex);
+			m_qInputs.push_back(std::move(x));
+		}
+	});
+}
+
+bool Node::Decoys::PopOutput(ReadyOutput& x)
+{
+	std::scoped_lock<std::mutex> scope(m_Mutex);
+	if (m_qOutputs.empty())
+		return false;
+
+	x = std::move(m_qOutputs.front());
+	m_qOutputs.pop_front();
+	return true;
+}
+
+bool Node::Decoys::PopInput(ReadyInput& x)
+{
+	{
+		std::scoped_lock<std::mutex> scope(m_Mutex);
+		if (m_qInputs.empty())
+			return false;
+
+		x = std::move(m_qInputs.front());
+		m_qInputs.pop_front();
+	}
+
+	m_setClaimed.erase(x.m_Kidv);
+	return true;
+}
+
+void Node::Decoys::Stop()
+{
+	if (m_pJob)
+	{
+		m_pJob->cancel();
+		m_pJob->wait();
+		m_pJob.reset();
+	}
+}
+
 Height Node::SampleDummySpentHeight()
 {
 	const Config::Dandelion& d = m_Cfg.m_Dandelion; // alias
@@ -2583,22 +2711,23 @@ void Node::Peer::BroadcastBbs()
 
 	size_t nExtra = 0;
 
-	NodeDB& db = m_This.m_Processor.get_DB();
-	NodeDB::WalkerBbsLite wlk(db);
+	BbsStore::SeqSet& s = m_This.m_Bbs.m_Store.m_setSeq;
+	BbsStore::Element::Seq key;
+	key.m_ID = m_CursorBbs;
 
-	wlk.m_ID = m_CursorBbs;
-	for (db.EnumAllBbsSeq(wlk); wlk.MoveNext(); )
+	for (BbsStore::SeqSet::iterator it = s.upper_bound(key); s.end() != it; it++)
 	{
+		const BbsStore::Element& x = it->get_ParentObj();
+		m_CursorBbs = x.get_ID();
+
 		proto::BbsHaveMsg msgOut;
-		msgOut.m_Key = wlk.m_Key;
+		msgOut.m_Key = x.m_Key.m_Value;
 		Send(msgOut);
 
-		nExtra += wlk.m_Size;
+		nExtra += x.m_Message.size();
 		if (IsChocking(nExtra))
 			break;
 	}
-
-	m_CursorBbs = wlk.m_ID;
 }
 
 void Node::Peer::OnMsg(proto::HaveTransaction&& msg)
@@ -2722,57 +2851,100 @@ void Node::Peer::OnMsg(proto::GetProofKernel2&& msg)
     Send(msgOut);
 }
 
-void Node::Peer::OnMsg(proto::GetProofUtxo&& msg)
+struct Node::Peer::UtxoProofBuilder
+    :public UtxoTree::ITraveler
 {
-    struct Traveler :public UtxoTree::ITraveler
+    std::vector<Input::Proof>* m_pRes;
+    UtxoTree& m_Tree;
+    Merkle::Hash m_hvHistory;
+    UtxoTree::Cursor m_Cu;
+
+    UtxoProofBuilder(NodeProcessor& p)
+        :m_Tree(p.get_Utxos())
+        ,m_hvHistory(p.m_Cursor.m_History)
     {
-        proto::ProofUtxo m_Msg;
-        UtxoTree* m_pTree;
-        Merkle::Hash m_hvHistory;
+        m_pCu = &m_Cu;
+    }
 
-        virtual bool OnLeaf(const RadixTree::Leaf& x) override {
+    void Build(std::vector<Input::Proof>& res, const ECC::Point& comm, Height hMaturityMin)
+    {
+        // bounds
+        UtxoTree::Key kMin, kMax;
 
-            const UtxoTree::MyLeaf& v = Cast::Up<UtxoTree::MyLeaf>(x);
-            UtxoTree::Key::Data d;
-            d = v.m_Key;
+        UtxoTree::Key::Data d;
+        d.m_Commitment = comm;
+        d.m_Maturity = hMaturityMin;
+        kMin = d;
+        d.m_Maturity = Height(-1);
+        kMax = d;
 
-            m_Msg.m_Proofs.resize(m_Msg.m_Proofs.size() + 1);
-            Input::Proof& ret = m_Msg.m_Proofs.back();
+        m_pBound[0] = kMin.m_pArr;
+        m_pBound[1] = kMax.m_pArr;
+        m_pRes = &res;
 
-            ret.m_State.m_Count = v.m_Value.m_Count;
-            ret.m_State.m_Maturity = d.m_Maturity;
-            m_pTree->get_Proof(ret.m_Proof, *m_pCu);
+        m_Tree.Traverse(*this);
+    }
 
-            ret.m_Proof.resize(ret.m_Proof.size() + 1);
-            ret.m_Proof.back().first = false;
-            ret.m_Proof.back().second = m_hvHistory;
+    virtual bool OnLeaf(const RadixTree::Leaf& x) override {
 
-            return m_Msg.m_Proofs.size() < Input::Proof::s_EntriesMax;
-        }
-    } t;
+        const UtxoTree::MyLeaf& v = Cast::Up<UtxoTree::MyLeaf>(x);
+        UtxoTree::Key::Data d;
+        d = v.m_Key;
 
-    t.m_pTree = &m_This.m_Processor.get_Utxos();
-    t.m_hvHistory = m_This.m_Processor.m_Cursor.m_History;
+        m_pRes->resize(m_pRes->size() + 1);
+        Input::Proof& ret = m_pRes->back();
 
-    UtxoTree::Cursor cu;
-    t.m_pCu = &cu;
+        ret.m_State.m_Count = v.m_Value.m_Count;
+        ret.m_State.m_Maturity = d.m_Maturity;
+        m_Tree.get_Proof(ret.m_Proof, *m_pCu);
 
-    // bounds
-    UtxoTree::Key kMin, kMax;
+        ret.m_Proof.resize(ret.m_Proof.size() + 1);
+        ret.m_Proof.back().first = false;
+        ret.m_Proof.back().second = m_hvHistory;
 
-    UtxoTree::Key::Data d;
-    d.m_Commitment = msg.m_Utxo;
-    d.m_Maturity = msg.m_MaturityMin;
-    kMin = d;
-    d.m_Maturity = Height(-1);
-    kMax = d;
+        return m_pRes->size() < Input::Proof::s_EntriesMax;
+    }
+};
 
-    t.m_pBound[0] = kMin.m_pArr;
-    t.m_pBound[1] = kMax.m_pArr;
+void Node::Peer::OnMsg(proto::GetProofUtxo&& msg)
+{
+    proto::ProofUtxo msgOut;
 
-    t.m_pTree->Traverse(t);
+    UtxoProofBuilder t(m_This.m_Processor);
+    t.Build(msgOut.m_Proofs, msg.m_Utxo, msg.m_MaturityMin);
 
-    Send(t.m_Msg);
+    Send(msgOut);
+}
+
+void Node::Peer::OnMsg(proto::GetProofUtxoMulti&& msg)
+{
+    if (msg.m_Utxos.size() > proto::g_UtxoMultiMaxSize)
+        ThrowUnexpected();
+
+    proto::ProofUtxoMulti msgOut;
+    msgOut.m_Proofs.resize(msg.m_Utxos.size());
+
+    // Walk the tree in key order, so that consecutive proofs descend through the same (already hashed) upper joints.
+    std::vector<uint32_t> vOrder(msg.m_Utxos.size());
+    for (uint32_t i = 0; i < vOrder.size(); i++)
+        vOrder[i] = i;
+
+    std::sort(vOrder.begin(), vOrder.end(), [&msg](uint32_t a, uint32_t b) {
+        return msg.m_Utxos[a] < msg.m_Utxos[b];
+    });
+
+    UtxoProofBuilder t(m_This.m_Processor);
+
+    for (uint32_t i = 0; i < vOrder.size(); i++)
+    {
+        uint32_t iIdx = vOrder[i];
+        if (i && (msg.m_Utxos[iIdx] == msg.m_Utxos[vOrder[i - 1]]))
+            msgOut.m_Proofs[iIdx] = msgOut.m_Proofs[vOrder[i - 1]]; // duplicate
+        else
+            t.Build(msgOut.m_Proofs[iIdx], msg.m_Utxos[iIdx], msg.m_MaturityMin);
+    }
+
+    Send(msgOut);
 }
 
 bool Node::Processor::BuildCwp()
@@ -2787,12 +2959,22 @@ bool Node::Processor::BuildCwp()
         :public Block::ChainWorkProof::ISource
     {
         Processor& m_Proc;
+        CwpStates m_States; // used for this proof
         Source(Processor& proc) :m_Proc(proc) {}
 
         virtual void get_StateAt(Block::SystemState::Full& s, const Difficulty::Raw& d) override
         {
-            uint64_t rowid = m_Proc.get_DB().FindStateWorkGreater(d);
-            m_Proc.get_DB().get_State(rowid, s);
+            // the states of the active branch cover contiguous chainwork ranges, find the one that covers d
+            CwpStates::iterator it = m_Proc.m_CwpStates.upper_bound(d);
+            if ((m_Proc.m_CwpStates.end() != it) && (it->second.m_ChainWork - it->second.m_PoW.m_Difficulty <= d))
+                s = it->second;
+            else
+            {
+                uint64_t rowid = m_Proc.get_DB().FindStateWorkGreater(d);
+                m_Proc.get_DB().get_State(rowid, s);
+            }
+
+            m_States[s.m_ChainWork] = s;
         }
 
         virtual void get_Proof(Merkle::IProofBuilder& bld, Height h) override
@@ -2807,6 +2989,9 @@ bool Node::Processor::BuildCwp()
     m_Cwp.Create(src, m_Cursor.m_Full);
     get_Utxos().get_Hash(m_Cwp.m_hvRootLive);
 
+    src.m_States[m_Cursor.m_Full.m_ChainWork] = m_Cursor.m_Full;
+    m_CwpStates.swap(src.m_States);
+
     return true;
 }
 
@@ -2818,7 +3003,7 @@ void Node::Peer::OnMsg(proto::GetProofChainWork&& msg)
     if (p.BuildCwp())
     {
         msgOut.m_Proof.m_LowerBound = msg.m_LowerBound;
-        verify(msgOut.m_Proof.Crop(p.m_Cwp));
+        verify(msgOut.m_Proof.Crop(p.m_Cwp, true));
     }
 
     Send(msgOut);
@@ -2889,31 +3074,31 @@ void Node::Peer::OnMsg(const proto::BbsMsg& msg, bool bNonceValid)
 	if (msg.m_TimePosted + Rules::get().DA.MaxAhead_s < m_This.m_Bbs.m_HighestPosted_s)
 		return; // don't allow too much out-of-order messages
 
-    NodeDB& db = m_This.m_Processor.get_DB();
-    NodeDB::WalkerBbs wlk(db);
+    NodeDB::WalkerBbs::Data d;
 
-    wlk.m_Data.m_Channel = msg.m_Channel;
-    wlk.m_Data.m_TimePosted = msg.m_TimePosted;
-    wlk.m_Data.m_Message = Blob(msg.m_Message);
-	wlk.m_Data.m_bNonce = bNonceValid;
-	msg.m_Nonce.Export(wlk.m_Data.m_Nonce);
+    d.m_Channel = msg.m_Channel;
+    d.m_TimePosted = msg.m_TimePosted;
+    d.m_Message = Blob(msg.m_Message);
+	d.m_bNonce = bNonceValid;
+	msg.m_Nonce.Export(d.m_Nonce);
 
-    Bbs::CalcMsgKey(wlk.m_Data);
+    Bbs::CalcMsgKey(d);
 
-    if (db.BbsFind(wlk.m_Data.m_Key))
+    if (m_This.m_Bbs.m_Store.Find(d.m_Key))
         return; // already have it
 
     m_This.m_Bbs.MaybeCleanup();
 
-    uint64_t id = db.BbsIns(wlk.m_Data);
-    m_This.m_Bbs.m_W.Delete(wlk.m_Data.m_Key);
+    const BbsStore::Element& x = m_This.m_Bbs.m_Store.Insert(d);
+    uint64_t id = x.get_ID();
+    m_This.m_Bbs.m_W.Delete(d.m_Key);
 
 	m_This.m_Bbs.m_HighestPosted_s = std::max(m_This.m_Bbs.m_HighestPosted_s, msg.m_TimePosted);
 
     // 1. Send to other BBS-es
 
     proto::BbsHaveMsg msgOut;
-    msgOut.m_Key = wlk.m_Data.m_Key;
+    msgOut.m_Key = d.m_Key;
 
     for (PeerList::iterator it = m_This.m_lstPeers.begin(); m_This.m_lstPeers.end() != it; it++)
     {
@@ -2941,7 +3126,7 @@ void Node::Peer::OnMsg(const proto::BbsMsg& msg, bool bNonceValid)
         if ((this == s.m_pPeer) || s.m_pPeer->IsChocking())
             continue;
 
-        s.m_pPeer->SendBbsMsg(wlk.m_Data);
+        s.m_pPeer->SendBbsMsg(x);
 		s.m_Cursor = id;
 
 		s.m_pPeer->IsChocking(); // in case it's chocking - for faster recovery recheck it ASAP
@@ -2953,8 +3138,7 @@ void Node::Peer::OnMsg(proto::BbsHaveMsg&& msg)
 	if (!m_This.m_Cfg.m_Bbs)
 		ThrowUnexpected();
 
-    NodeDB& db = m_This.m_Processor.get_DB();
-	if (db.BbsFind(msg.m_Key)) {
+	if (m_This.m_Bbs.m_Store.Find(msg.m_Key)) {
 		// stupid compiler insists on parentheses here!
 		return; // already have it
 	}
@@ -2964,9 +3148,6 @@ void Node::Peer::OnMsg(proto::BbsHaveMsg&& msg)
 		return; // already waiting for it
 	}
 
-	NodeDB::WalkerBbs wlk(db);
-	wlk.m_Data.m_Key = msg.m_Key;
-
     proto::BbsGetMsg msgOut;
     msgOut.m_Key = msg.m_Key;
     Send(msgOut);
@@ -2977,33 +3158,30 @@ void Node::Peer::OnMsg(proto::BbsGetMsg&& msg)
 	if (!m_This.m_Cfg.m_Bbs)
 		ThrowUnexpected();
 
-	NodeDB& db = m_This.m_Processor.get_DB();
-    NodeDB::WalkerBbs wlk(db);
-
-    wlk.m_Data.m_Key = msg.m_Key;
-    if (!db.BbsFind(wlk))
-        return; // don't have it
+	const BbsStore::Element* p = m_This.m_Bbs.m_Store.Find(msg.m_Key);
+	if (!p)
+		return; // don't have it
 
-    SendBbsMsg(wlk.m_Data);
+	SendBbsMsg(*p);
 }
 
-void Node::Peer::SendBbsMsg(const NodeDB::WalkerBbs::Data& d)
+void Node::Peer::SendBbsMsg(const BbsStore::Element& x)
 {
-	if (d.m_bNonce && (proto::LoginFlags::Extension1 & m_LoginFlags))
+	if (x.m_bNonce && (proto::LoginFlags::Extension1 & m_LoginFlags))
 	{
 		proto::BbsMsg msgOut;
-		msgOut.m_Channel = d.m_Channel;
-		msgOut.m_TimePosted = d.m_TimePosted;
-		d.m_Message.Export(msgOut.m_Message);
-		msgOut.m_Nonce = d.m_Nonce;
+		msgOut.m_Channel = x.m_Channel.m_Value;
+		msgOut.m_TimePosted = x.m_Time.m_Value;
+		msgOut.m_Message = x.m_Message;
+		msgOut.m_Nonce = x.m_Nonce;
 		Send(msgOut);
 	}
 	else
 	{
 		proto::BbsMsgV0 msgOut;
-		msgOut.m_Channel = d.m_Channel;
-		msgOut.m_TimePosted = d.m_TimePosted;
-		d.m_Message.Export(msgOut.m_Message);
+		msgOut.m_Channel = x.m_Channel.m_Value;
+		msgOut.m_TimePosted = x.m_Time.m_Value;
+		msgOut.m_Message = x.m_Message;
 		Send(msgOut);
 	}
 
@@ -3031,7 +3209,7 @@ void Node::Peer::OnMsg(proto::BbsSubscribe&& msg)
         m_This.m_Bbs.m_Subscribed.insert(pS->m_Bbs);
         m_Subscriptions.insert(pS->m_Peer);
 
-		pS->m_Cursor = m_This.m_Processor.get_DB().BbsFindCursor(msg.m_TimeFrom) - 1;
+		pS->m_Cursor = m_This.m_Bbs.m_Store.FindCursor(msg.m_TimeFrom) - 1;
 
 		BroadcastBbs(*pS);
     }
@@ -3044,20 +3222,20 @@ void Node::Peer::BroadcastBbs(Bbs::Subscription& s)
 	if (IsChocking())
 		return;
 
-	NodeDB& db = m_This.m_Processor.get_DB();
-	NodeDB::WalkerBbs wlk(db);
-
-	wlk.m_Data.m_Channel = s.m_Peer.m_Channel;
-	wlk.m_ID = s.m_Cursor;
+	BbsStore::ChannelSet& cs = m_This.m_Bbs.m_Store.m_setChannel;
+	BbsStore::Element::Channel key;
+	key.m_Value = s.m_Peer.m_Channel;
+	key.m_ID = s.m_Cursor;
 
-	for (db.EnumBbsCSeq(wlk); wlk.MoveNext(); )
+	for (BbsStore::ChannelSet::iterator it = cs.upper_bound(key); (cs.end() != it) && (it->m_Value == key.m_Value); it++)
 	{
-		SendBbsMsg(wlk.m_Data);
+		const BbsStore::Element& x = it->get_ParentObj();
+		s.m_Cursor = x.get_ID();
+
+		SendBbsMsg(x);
 		if (IsChocking())
 			break;
 	}
-
-	s.m_Cursor = wlk.m_ID;
 }
 
 void Node::Peer::OnMsg(proto::BbsResetSync&& msg)
@@ -3065,7 +3243,7 @@ void Node::Peer::OnMsg(proto::BbsResetSync&& msg)
 	if (!m_This.m_Cfg.m_Bbs)
 		ThrowUnexpected();
 
-	m_CursorBbs = m_This.m_Processor.get_DB().BbsFindCursor(msg.m_TimeFrom) - 1;
+	m_CursorBbs = m_This.m_Bbs.m_Store.FindCursor(msg.m_TimeFrom) - 1;
 	BroadcastBbs();
 }
 
@@ -3282,13 +3460,8 @@ void Node::Miner::Initialize(IExternalPOW* externalPOW)
     m_pEvtMined = io::AsyncEvent::create(io::Reactor::get_Current(), [this]() { OnMined(); });
 
     if (cfg.m_MiningThreads) {
-        m_vThreads.resize(cfg.m_MiningThreads);
-        for (uint32_t i = 0; i < cfg.m_MiningThreads; i++) {
-            PerThread &pt = m_vThreads[i];
-            pt.m_pReactor = io::Reactor::create();
-            pt.m_pEvt = io::AsyncEvent::create(*pt.m_pReactor, [this, i]() { OnRefresh(i); });
-            pt.m_Thread = std::thread(&io::Reactor::run, pt.m_pReactor);
-        }
+        m_vSlots.resize(cfg.m_MiningThreads);
+        m_pJob = ThreadPool::Job::create(ThreadPool::Priority::Mining);
     }
 
 	m_External.m_pSolver = externalPOW;
@@ -3314,38 +3487,78 @@ void Node::Miner::OnFinalizerChanged(Peer* p)
     Restart();
 }
 
+void Node::Miner::StartSlots()
+{
+    for (uint32_t i = 0; i < m_vSlots.size(); i++)
+    {
+        Slot& x = m_vSlots[i];
+        if (x.m_bRunning)
+            continue; // will notice the new task by itself
+
+        x.m_bRunning = true;
+        ThreadPool::get().push(m_pJob, [this, i]() { OnRefresh(i); });
+    }
+}
+
 void Node::Miner::OnRefresh(uint32_t iIdx)
 {
     while (true)
     {
         Task::Ptr pTask;
         Block::SystemState::Full s;
+        uint32_t nRestarts;
+        uint32_t nFakeElapsed_ms = 0;
 
         {
             std::scoped_lock<std::mutex> scope(m_Mutex);
-            if (!m_pTask || *m_pTask->m_pStop)
+            Slot& x = m_vSlots[iIdx];
+
+            if (!m_pTask || *m_pTask->m_pStop || m_pJob->is_cancelled())
+            {
+                x.m_bRunning = false;
+                x.m_pFakeTask.reset();
                 break;
+            }
 
             pTask = m_pTask;
             s = pTask->m_Hdr; // local copy
+            nRestarts = x.m_nRestarts;
+
+            if (x.m_pFakeTask && (x.m_pFakeTask->m_pStop == pTask->m_pStop)) // same round, maybe soft-restarted
+                nFakeElapsed_ms = x.m_FakeElapsed_ms;
         }
 
         ECC::Hash::Value hv; // pick pseudo-random initial nonce for mining.
-        ECC::Hash::Processor()
+        ECC::Hash::Processor hp;
+        hp
             << pTask->m_hvNonceSeed
-            << iIdx
-            >> hv;
+            << iIdx;
+
+        if (nRestarts)
+            hp << nRestarts;
+
+        hp >> hv;
 
         static_assert(s.m_PoW.m_Nonce.nBytes <= hv.nBytes);
         s.m_PoW.m_Nonce = hv;
 
-        LOG_INFO() << "Mining nonce = " << s.m_PoW.m_Nonce;
+        if (!nFakeElapsed_ms)
+            LOG_INFO() << "Mining nonce = " << s.m_PoW.m_Nonce;
+
+        // Yield the pool thread to more important tasks anytime, and to other miners between the attempts
+        bool bYield = false;
 
-        Block::PoW::Cancel fnCancel = [this, pTask](bool bRetrying)
+        Block::PoW::Cancel fnCancel = [this, pTask, &bYield](bool bRetrying)
         {
-            if (*pTask->m_pStop)
+            if (*pTask->m_pStop || m_pJob->is_cancelled())
                 return true;
 
+            if (ThreadPool::get().should_yield(ThreadPool::Priority::Mining, bRetrying))
+            {
+                bYield = true;
+                return true;
+            }
+
             if (bRetrying)
             {
                 std::scoped_lock<std::mutex> scope(m_Mutex);
@@ -3361,14 +3574,22 @@ void Node::Miner::OnRefresh(uint32_t iIdx)
             uint32_t timeout_ms = get_ParentObj().m_Cfg.m_TestMode.m_FakePowSolveTime_ms;
 
             bool bSolved = false;
+            uint32_t dt_ms = nFakeElapsed_ms;
 
-            for (uint32_t t0_ms = GetTime_ms(); ; )
+            for (uint32_t t0_ms = GetTime_ms() - nFakeElapsed_ms; ; )
             {
                 if (fnCancel(false))
                     break;
+
+                if (ThreadPool::get().should_yield(ThreadPool::Priority::Mining, true))
+                {
+                    bYield = true;
+                    break;
+                }
+
                 std::this_thread::sleep_for(std::chrono::milliseconds(50));
 
-                uint32_t dt_ms = GetTime_ms() - t0_ms;
+                dt_ms = GetTime_ms() - t0_ms;
 
                 if (dt_ms >= timeout_ms)
                 {
@@ -3377,25 +3598,50 @@ void Node::Miner::OnRefresh(uint32_t iIdx)
                 }
             }
 
-            if (!bSolved)
-                continue;
+            if (bYield)
+            {
+                std::scoped_lock<std::mutex> scope(m_Mutex);
+                Slot& x = m_vSlots[iIdx];
+                x.m_pFakeTask = pTask;
+                x.m_FakeElapsed_ms = dt_ms;
+            }
+            else
+            {
+                if (!bSolved)
+                    continue;
 
-            ZeroObject(s.m_PoW.m_Indices); // keep the difficulty intact
+                ZeroObject(s.m_PoW.m_Indices); // keep the difficulty intact
+            }
         }
         else
         {
             try
             {
                 if (!s.GeneratePoW(fnCancel))
-                    continue;
+                {
+                    if (!bYield)
+                        continue;
+
+                    std::scoped_lock<std::mutex> scope(m_Mutex);
+                    m_vSlots[iIdx].m_nRestarts++;
+                }
             }
             catch (const std::exception& ex)
             {
                 LOG_DEBUG() << ex.what();
+
+                std::scoped_lock<std::mutex> scope(m_Mutex);
+                m_vSlots[iIdx].m_bRunning = false;
                 break;
             }
         }
 
+        if (bYield)
+        {
+            ThreadPool::get().yield(m_pJob, [this, iIdx]() { OnRefresh(iIdx); });
+            return;
+        }
+
         std::scoped_lock<std::mutex> scope(m_Mutex);
 
         if (*pTask->m_pStop)
@@ -3405,6 +3651,10 @@ void Node::Miner::OnRefresh(uint32_t iIdx)
         *pTask->m_pStop = true;
         m_pTask = pTask; // In case there was a soft restart we restore the one that we mined.
 
+        Slot& x = m_vSlots[iIdx];
+        x.m_bRunning = false;
+        x.m_pFakeTask.reset();
+
         m_pEvtMined->post();
         break;
     }
@@ -3551,8 +3801,7 @@ void Node::Miner::StartMining(Task::Ptr&& pTask)
 
     m_pTask = std::move(pTask);
 
-    for (size_t i = 0; i < m_vThreads.size(); i++)
-        m_vThreads[i].m_pEvt->post();
+    StartSlots();
 
     OnRefreshExternal();
 }
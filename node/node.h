@@ -15,13 +15,17 @@
 #pragma once
 
 #include "processor.h"
+#include "bbs_store.h"
 #include "utility/io/timer.h"
+#include "utility/thread_pool.h"
 #include "core/proto.h"
 #include "core/block_crypt.h"
 #include "core/peer_manager.h"
 #include <boost/intrusive/list.hpp>
 #include <boost/intrusive/set.hpp>
 #include <condition_variable>
+#include <deque>
+#include <set>
 
 namespace beam
 {
@@ -34,6 +38,7 @@ struct Node
 	{
 		virtual void OnSyncProgress() = 0;
 		virtual void OnStateChanged() {}
+		virtual void OnStartupProgress(const NodeProcessor::StartupProfiler::Progress&) {}
 	};
 
 	struct Config
@@ -67,13 +72,22 @@ struct Node
 
 		bool m_LogUtxos = false; // may be insecure. Off by default.
 
+		// DB check on startup. By default the full (slow) check is performed only after an unclean shutdown
+		NodeDB::IntegrityCheck::Enum m_IntegrityCheck = NodeDB::IntegrityCheck::Auto;
+
 		// Number of verification threads for CPU-hungry cryptography. Currently used for block validation only.
 		// 0: single threaded
 		// negative: number of cores minus number of mining threads.
 		int m_VerificationThreads = 0;
 
+		// Number of network I/O threads. The peer connections are spread across them, the cipher and (de)serialization are performed there.
+		// 0: the peers are served by the node reactor
+		uint32_t m_IoThreads = 0;
+
 		bool m_Bbs = true;
 		bool m_BbsAllowV0 = true; // allow older format, without pow
+		bool m_BbsPersistent = true; // keep the messages in the DB across restarts. They are written in batches, during the cleanup and on exit
+		uint32_t m_BbsMaxSize_MB = 1024; // memory limit for the messages, the oldest are dropped when exceeded
 
 		struct BandwidthCtl
 		{
@@ -126,6 +140,7 @@ struct Node
 			// dummy creation strategy
 			uint32_t m_DummyLifetimeLo = 720;
 			uint32_t m_DummyLifetimeHi = 1440 * 7; // set to 0 to disable
+			uint32_t m_DummyOutputsReady = 10; // decoy outputs generated in advance
 
 		} m_Dandelion;
 
@@ -185,6 +200,7 @@ private:
 		void AdjustFossilEnd(Height&) override;
 		bool OpenMacroblock(Block::BodyBase::RW&, const NodeDB::StateID&) override;
 		void OnModified() override;
+		void OnStartupProgress(const StartupProfiler::Progress&) override;
 		bool EnumViewerKeys(IKeyWalker&) override;
 		void OnUtxoEvent(const UtxoEvent::Key&, const UtxoEvent::Value&) override;
 		void OnDummy(const Key::ID&, Height) override;
@@ -198,25 +214,24 @@ private:
 			TxBase::Context* m_pCtx;
 
 			bool m_bFail;
-			uint32_t m_iTask;
-			uint32_t m_Remaining;
 
 			std::mutex m_Mutex;
-			std::condition_variable m_TaskNew;
-			std::condition_variable m_TaskFinished;
-
-			std::vector<std::thread> m_vThreads;
 			std::unique_ptr<MyBatch> m_pBc;
 
 			bool ValidateAndSummarize(TxBase::Context&, const TxBase&, TxBase::IReader&&);
-			void Thread(uint32_t);
+			void Verify(uint32_t iVerifier, uint32_t nVerifiers);
 
 			IMPLEMENT_GET_PARENT_OBJ(Processor, m_Verifier)
 		} m_Verifier;
 
-		Block::ChainWorkProof m_Cwp; // cached
+		Block::ChainWorkProof m_Cwp; // cached, shared by all the requesters of the current tip
 		bool BuildCwp();
 
+		// The states sampled for the last proof, by chainwork. As the tip advances most of them (all the heading) are sampled again.
+		// Valid as long as there's no rollback
+		typedef std::map<Difficulty::Raw, Block::SystemState::Full> CwpStates;
+		CwpStates m_CwpStates;
+
 		void GenerateProofStateStrict(Merkle::HardProof&, Height);
 
 		bool m_bFlushPending = false;
@@ -357,6 +372,43 @@ private:
 	void AddDummyInputs(Transaction&);
 	void AddDummyOutputs(Transaction&);
 	Height SampleDummySpentHeight();
+
+	// Decoy outputs (with rangeproofs) and the commitments of the dummy UTXOs due to be spent are prepared
+	// in the shared thread pool in advance, the stem path only attaches them
+	struct Decoys
+	{
+		struct ReadyOutput
+		{
+			Key::IDV m_Kidv;
+			Output::Ptr m_pOutput;
+			ECC::Scalar::Native m_sk;
+		};
+
+		struct ReadyInput
+		{
+			Key::IDV m_Kidv;
+			ECC::Point m_Commitment;
+			ECC::Scalar::Native m_sk;
+		};
+
+		std::mutex m_Mutex;
+		std::deque<ReadyOutput> m_qOutputs; // protected by m_Mutex
+		std::deque<ReadyInput> m_qInputs; // protected by m_Mutex
+		uint32_t m_OutputsPending = 0; // protected by m_Mutex
+
+		std::set<Key::ID> m_setClaimed; // dummy UTXOs taken from the DB, not attached yet
+		ThreadPool::Job::Ptr m_pJob;
+
+		void RefillOutputs();
+		void ClaimInputs();
+		void SelectKidv(Key::IDV&);
+		static void Create(ReadyOutput&, Key::IKdf&);
+		bool PopOutput(ReadyOutput&);
+		bool PopInput(ReadyInput&);
+		void Stop();
+
+		IMPLEMENT_GET_PARENT_OBJ(Node, m_Decoys)
+	} m_Decoys;
 	bool OnTransactionFluff(Transaction::Ptr&&, const Peer*, Dandelion::Element*);
 
 	bool ValidateTx(Transaction::Context&, const Transaction&); // complete validation
@@ -373,6 +425,7 @@ private:
 		} m_W;
 
 		static void CalcMsgKey(NodeDB::WalkerBbs::Data&);
+		BbsStore m_Store;
 		uint32_t m_LastCleanup_ms = 0;
 		void Cleanup();
 		void MaybeCleanup();
@@ -483,7 +536,7 @@ private:
 		void KillTimer();
 		void OnResendPeers();
 		void SyncQuery();
-		void SendBbsMsg(const NodeDB::WalkerBbs::Data&);
+		void SendBbsMsg(const BbsStore::Element&);
 		void DeleteSelf(bool bIsError, uint8_t nByeReason);
 		void BroadcastTxs();
 		void BroadcastBbs();
@@ -503,6 +556,8 @@ private:
 
 		void SendTx(Transaction::Ptr& ptx, bool bFluff);
 
+		struct UtxoProofBuilder;
+
 		// proto::NodeConnection
 		virtual void OnConnectedSecure() override;
 		virtual void OnDisconnect(const DisconnectReason&) override;
@@ -528,6 +583,7 @@ private:
 		virtual void OnMsg(proto::GetProofKernel&&) override;
 		virtual void OnMsg(proto::GetProofKernel2&&) override;
 		virtual void OnMsg(proto::GetProofUtxo&&) override;
+		virtual void OnMsg(proto::GetProofUtxoMulti&&) override;
 		virtual void OnMsg(proto::GetProofChainWork&&) override;
 		virtual void OnMsg(proto::PeerInfoSelf&&) override;
 		virtual void OnMsg(proto::PeerInfo&&) override;
@@ -549,6 +605,8 @@ private:
 	typedef boost::intrusive::list<Peer> PeerList;
 	PeerList m_lstPeers;
 
+	std::unique_ptr<proto::NodeConnection::IoShards> m_pIoShards; // must outlive the peers
+
 	ECC::NoLeak<ECC::uintBig> m_NonceLast;
 	const ECC::uintBig& NextNonce();
 	void NextNonce(ECC::Scalar::Native&);
@@ -595,16 +653,8 @@ private:
 		IMPLEMENT_GET_PARENT_OBJ(Node, m_Beacon)
 	} m_Beacon;
 
-	struct PerThread
-	{
-		io::Reactor::Ptr m_pReactor;
-		io::AsyncEvent::Ptr m_pEvt;
-		std::thread m_Thread;
-	};
-
 	struct Miner
 	{
-		std::vector<PerThread> m_vThreads;
 		io::AsyncEvent::Ptr m_pEvtMined;
 
 		struct Task
@@ -619,11 +669,24 @@ private:
 			ECC::Hash::Value m_hvNonceSeed; // immutable
 		};
 
-		bool IsEnabled() { return m_External.m_pSolver || !m_vThreads.empty(); }
+		// Mining runs in the shared thread pool at the lowest priority, one pool task per mining "thread"
+		struct Slot
+		{
+			bool m_bRunning = false; // scheduled or running
+			uint32_t m_nRestarts = 0; // to pick a fresh nonce after yielding
+			Task::Ptr m_pFakeTask; // fake PoW: the task and the time already spent on it before yielding
+			uint32_t m_FakeElapsed_ms = 0;
+		};
+
+		std::vector<Slot> m_vSlots; // protected by m_Mutex
+		ThreadPool::Job::Ptr m_pJob;
+
+		bool IsEnabled() { return m_External.m_pSolver || !m_vSlots.empty(); }
 
 		void Initialize(IExternalPOW* externalPOW=nullptr);
 
 		void OnRefresh(uint32_t iIdx);
+		void StartSlots(); // m_Mutex must be locked
 		void OnRefreshExternal();
 		void OnMined();
 		void OnMinedExternal();
@@ -675,7 +738,8 @@ private:
 		bool SquashOnce(Block::BodyBase::RW&, Block::BodyBase::RW& rwSrc0, Block::BodyBase::RW& rwSrc1);
 		uint64_t get_SizeTotal(Height);
 
-		PerThread m_Link;
+		io::AsyncEvent::Ptr m_pEvt;
+		ThreadPool::Job::Ptr m_pJob;
 		std::mutex m_Mutex;
 		std::condition_variable m_Cond;
 
@@ -135,9 +135,10 @@ void Node::Compressor::OnNewState()
 	ZeroObject(m_hrInplaceRequest);
 	get_ParentObj().m_Processor.get_DB().get_StateHash(get_ParentObj().m_Processor.FindActiveAtStrict(hr.m_Max), m_hvTag);
 
-	m_Link.m_pReactor = io::Reactor::get_Current().shared_from_this();
-	m_Link.m_pEvt = io::AsyncEvent::create(*m_Link.m_pReactor, [this]() { OnNotify(); });;
-	m_Link.m_Thread = std::thread(&Compressor::Proceed, this);
+	// the same event is used for the in-place requests and the completion
+	m_pEvt = io::AsyncEvent::create(io::Reactor::get_Current(), [this]() { OnNotify(); });
+	m_pJob = ThreadPool::Job::create(ThreadPool::Priority::Compression, m_pEvt);
+	ThreadPool::get().push(m_pJob, [this]() { Proceed(); });
 }
 
 void Node::Compressor::FmtPath(Block::BodyBase::RW& rw, Height h, const Height* pH0)
@@ -256,11 +257,15 @@ void Node::Compressor::StopCurrent()
 
 	m_Cond.notify_one();
 
-	if (m_Link.m_Thread.joinable())
-		m_Link.m_Thread.join();
+	if (m_pJob)
+	{
+		m_pJob->cancel(); // in case it didn't start yet
+		m_pJob->wait();
+		m_pJob.reset();
+	}
 
 	ZeroObject(m_hrNew);
-	m_Link.m_pEvt = NULL; // should prevent "spurious" calls
+	m_pEvt = NULL; // should prevent "spurious" calls
 }
 
 void Node::Compressor::Proceed()
@@ -275,7 +280,7 @@ void Node::Compressor::Proceed()
 		LOG_WARNING() << "History generation failed";
 
 	ZeroObject(m_hrInplaceRequest);
-	m_Link.m_pEvt->post();
+	// completion is signalled by the job
 }
 
 bool Node::Compressor::ProceedInternal()
@@ -296,7 +301,7 @@ bool Node::Compressor::ProceedInternal()
 			std::unique_lock<std::mutex> scope(m_Mutex);
 			m_hrInplaceRequest = hr;
 
-			m_Link.m_pEvt->post();
+			m_pEvt->post();
 
 			m_Cond.wait(scope);
 
@@ -18,6 +18,7 @@
 #include "../utility/serialize.h"
 #include "../utility/logger.h"
 #include "../utility/logger_checkpoints.h"
+#include "../utility/helpers.h"
 
 namespace beam {
 
@@ -34,11 +35,16 @@ NodeProcessor::Horizon::Horizon()
 {
 }
 
-void NodeProcessor::Initialize(const char* szPath, bool bResetCursor /* = false */)
+void NodeProcessor::Initialize(const char* szPath, bool bResetCursor /* = false */, NodeDB::IntegrityCheck::Enum eCheck /* = NodeDB::IntegrityCheck::Auto */)
 {
-	m_DB.Open(szPath);
+	m_Startup.Begin(StartupProfiler::Phase::OpenDB);
+
+	m_DB.Open(szPath, eCheck);
 	m_DbTx.Start(m_DB);
 
+	if (!m_DB.get_PrevShutdownClean())
+		LOG_WARNING() << "DB wasn't closed cleanly";
+
 	Merkle::Hash hv;
 	Blob blob(hv);
 
@@ -55,6 +61,8 @@ void NodeProcessor::Initialize(const char* szPath, bool bResetCursor /* = false
 			throw std::runtime_error(os.str());
 		}
 
+	m_Startup.End();
+
 	m_nSizeUtxoComission = 0;
 	ZeroObject(m_Extra);
 
@@ -63,13 +71,90 @@ void NodeProcessor::Initialize(const char* szPath, bool bResetCursor /* = false
 
 	InitCursor();
 
-	InitializeFromBlocks();
+	m_Startup.Begin(StartupProfiler::Phase::Replay);
+	m_Startup.End(InitializeFromBlocks());
 
 	m_Horizon.m_Schwarzschild = std::max(m_Horizon.m_Schwarzschild, m_Horizon.m_Branching);
 	m_Horizon.m_Schwarzschild = std::max(m_Horizon.m_Schwarzschild, (Height) Rules::get().Macroblock.MaxRollback);
 
 	if (!bResetCursor)
+	{
+		Height h0 = m_Cursor.m_ID.m_Height;
+
+		m_Startup.Begin(StartupProfiler::Phase::GoUp);
 		TryGoUp();
+		m_Startup.End((m_Cursor.m_ID.m_Height > h0) ? (m_Cursor.m_ID.m_Height - h0) : 0);
+	}
+}
+
+const char* NodeProcessor::StartupProfiler::Phase::get_Name(Enum e)
+{
+	switch (e)
+	{
+	case OpenDB: return "DB open";
+	case Replay: return "Blocks replay";
+	case GoUp: return "Go up";
+	case Treasury: return "Treasury";
+	case Peers: return "Peers load";
+	case Bbs: return "Bbs load";
+	default: // suppress warning
+		break;
+	}
+	return "";
+}
+
+void NodeProcessor::StartupProfiler::Begin(Phase::Enum e)
+{
+	m_Phase = e;
+	m_Start_ms = GetTime_ms();
+	m_Reported_ms = m_Start_ms;
+}
+
+void NodeProcessor::StartupProfiler::OnProgress(uint64_t nDone, uint64_t nTotal)
+{
+	if (GetTime_ms() - m_Reported_ms >= s_ReportPeriod_ms)
+		Report(nDone, nTotal, false);
+}
+
+void NodeProcessor::StartupProfiler::End(uint64_t nDone /* = 0 */)
+{
+	assert(m_Phase < Phase::count);
+
+	Stats& s = m_pStats[m_Phase];
+	s.m_Elapsed_ms = GetTime_ms() - m_Start_ms;
+	s.m_Done = nDone;
+	s.m_PeakRss_KB = get_peak_rss_kb();
+	s.m_Performed = true;
+
+	LOG_INFO() << "Startup phase " << Phase::get_Name(m_Phase) << ": " << s.m_Elapsed_ms << " ms, processed " << s.m_Done << ", peak RSS " << s.m_PeakRss_KB << " KB";
+
+	Report(nDone, nDone, true);
+	m_Phase = Phase::count;
+}
+
+void NodeProcessor::StartupProfiler::Report(uint64_t nDone, uint64_t nTotal, bool bFinished)
+{
+	uint32_t t_ms = GetTime_ms();
+	m_Reported_ms = t_ms;
+
+	Progress p;
+	p.m_Phase = m_Phase;
+	p.m_Done = nDone;
+	p.m_Total = nTotal;
+	p.m_Elapsed_ms = t_ms - m_Start_ms;
+	p.m_Eta_ms = 0;
+	p.m_Finished = bFinished;
+
+	if (!bFinished && nDone && (nTotal > nDone))
+	{
+		p.m_Eta_ms = static_cast<uint32_t>(std::min<uint64_t>(
+			uint64_t(p.m_Elapsed_ms) * (nTotal - nDone) / nDone,
+			std::numeric_limits<uint32_t>::max()));
+
+		LOG_INFO() << Phase::get_Name(m_Phase) << ": " << nDone << "/" << nTotal << ", ETA " << (p.m_Eta_ms / 1000) << " s";
+	}
+
+	get_ParentObj().OnStartupProgress(p);
 }
 
 NodeProcessor::~NodeProcessor()
@@ -733,6 +818,21 @@ bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, bool bFwd)
 		else
 			m_DB.DeleteEventsAbove(m_Cursor.m_ID.m_Height);
 
+		if (!m_TxPoolDelta.m_bAll)
+		{
+			if (bFwd)
+			{
+				for (size_t i = 0; i < block.m_vInputs.size(); i++)
+					m_TxPoolDelta.m_vUtxos.push_back(block.m_vInputs[i]->m_Commitment);
+			}
+			else
+			{
+				for (size_t i = 0; i < block.m_vOutputs.size(); i++)
+					m_TxPoolDelta.m_vUtxos.push_back(block.m_vOutputs[i]->m_Commitment);
+				m_TxPoolDelta.m_bHeightDown = true;
+			}
+		}
+
 		LOG_INFO() << id << " Block interpreted. Fwd=" << bFwd;
 	}
 
@@ -1005,6 +1105,100 @@ bool NodeProcessor::HandleBlockElement(const Output& v, Height h, const Height*
 	return true;
 }
 
+bool NodeProcessor::HandleValidatedTx(TxBase::IReader&& r, UtxoTree::Overlay& ovl, Height h, const Height* pHMax)
+{
+	size_t nCheckpoint = ovl.get_Checkpoint();
+	r.Reset();
+
+	bool bOk = true;
+	for (; bOk && r.m_pUtxoIn; r.NextUtxoIn())
+		bOk = HandleBlockElement(*r.m_pUtxoIn, ovl, h, pHMax);
+
+	for (; bOk && r.m_pUtxoOut; r.NextUtxoOut())
+		bOk = HandleBlockElement(*r.m_pUtxoOut, ovl, h, pHMax);
+
+	if (!bOk)
+		ovl.Rollback(nCheckpoint);
+
+	return bOk;
+}
+
+bool NodeProcessor::HandleBlockElement(const Input& v, UtxoTree::Overlay& ovl, Height h, const Height* pHMax)
+{
+	UtxoTree::Key::Data d;
+	d.m_Commitment = v.m_Commitment;
+
+	UtxoTree::Key kMin, kMax;
+
+	if (!pHMax)
+	{
+		d.m_Maturity = 0;
+		kMin = d;
+		d.m_Maturity = h - 1;
+		kMax = d;
+	}
+	else
+	{
+		if (v.m_Maturity >= *pHMax)
+			return false;
+
+		d.m_Maturity = v.m_Maturity;
+		kMin = d;
+		kMax = kMin;
+	}
+
+	struct Walker :public UtxoTree::Overlay::IWalker {
+		UtxoTree::Key m_Key;
+		Input::Count m_Count;
+
+		virtual bool OnUtxo(const UtxoTree::Key& key, Input::Count n) override {
+			m_Key = key;
+			m_Count = n;
+			return false; // stop iteration
+		}
+	} w;
+
+	if (ovl.Enum(w, kMin, kMax))
+		return false;
+
+	assert(w.m_Count); // we don't report zeroes
+	ovl.set_Count(w.m_Key, w.m_Count - 1);
+
+	if (!pHMax)
+	{
+		d = w.m_Key;
+		assert(d.m_Commitment == v.m_Commitment);
+		Cast::NotConst(v).m_Maturity = d.m_Maturity;
+	}
+
+	return true;
+}
+
+bool NodeProcessor::HandleBlockElement(const Output& v, UtxoTree::Overlay& ovl, Height h, const Height* pHMax)
+{
+	UtxoTree::Key::Data d;
+	d.m_Commitment = v.m_Commitment;
+	d.m_Maturity = v.get_MinMaturity(h);
+
+	if (pHMax)
+	{
+		if (v.m_Maturity < d.m_Maturity)
+			return false; // decrease not allowed
+
+		d.m_Maturity = v.m_Maturity;
+	}
+
+	UtxoTree::Key key;
+	key = d;
+
+	Input::Count nCountInc = ovl.get_Count(key) + 1;
+	if (!nCountInc)
+		return false; // overflow
+
+	ovl.set_Count(key, nCountInc);
+	return true;
+}
+
 bool NodeProcessor::GoForward(uint64_t row)
 {
 	NodeDB::StateID sid;
@@ -1305,6 +1499,12 @@ bool NodeProcessor::ValidateTxWrtHeight(const Transaction& tx) const
 }
 
 bool NodeProcessor::ValidateTxContext(const Transaction& tx)
+{
+	UtxoTree::Overlay ovl(m_Utxos); // empty
+	return ValidateTxContext(tx, ovl);
+}
+
+bool NodeProcessor::ValidateTxContext(const Transaction& tx, const UtxoTree::Overlay& ovl)
 {
 	if (!ValidateTxWrtHeight(tx))
 		return false;
@@ -1315,17 +1515,16 @@ bool NodeProcessor::ValidateTxContext(const Transaction& tx)
 	// Ensure input UTXOs are present
 	for (size_t i = 0; i < tx.m_vInputs.size(); i++)
 	{
-		struct Traveler :public UtxoTree::ITraveler
+		struct Walker :public UtxoTree::Overlay::IWalker
 		{
 			uint32_t m_Count;
-			virtual bool OnLeaf(const RadixTree::Leaf& x) override
+			virtual bool OnUtxo(const UtxoTree::Key&, Input::Count n) override
 			{
-				const UtxoTree::MyLeaf& n = Cast::Up<UtxoTree::MyLeaf>(x);
-				assert(m_Count && n.m_Value.m_Count);
-				if (m_Count <= n.m_Value.m_Count)
+				assert(m_Count && n);
+				if (m_Count <= n)
 					return false; // stop iteration
 
-				m_Count -= n.m_Value.m_Count;
+				m_Count -= n;
 				return true;
 			}
 		} t;
@@ -1345,31 +1544,218 @@ bool NodeProcessor::ValidateTxContext(const Transaction& tx)
 		d.m_Maturity = h;
 		kMax = d;
 
-		UtxoTree::Cursor cu;
-		t.m_pCu = &cu;
-		t.m_pBound[0] = kMin.m_pArr;
-		t.m_pBound[1] = kMax.m_pArr;
-
-		if (m_Utxos.Traverse(t))
+		if (ovl.Enum(t, kMin, kMax))
 			return false; // some input UTXOs are missing
 	}
 
 	return true;
 }
 
+void NodeProcessor::TxPoolDelta::Reset()
+{
+	m_vUtxos.clear();
+	m_bHeightDown = false;
+	m_bAll = false;
+}
+
 void NodeProcessor::DeleteOutdated(TxPool::Fluff& txp)
 {
-	for (TxPool::Fluff::ProfitSet::iterator it = txp.m_setProfit.begin(); txp.m_setProfit.end() != it; )
+	Height h = m_Cursor.m_Sid.m_Height + 1;
+	txp.DeleteOutOfBound(h);
+
+	if (m_TxPoolDelta.m_bAll)
 	{
-		TxPool::Fluff::Element& x = (it++)->get_ParentObj();
-		Transaction& tx = *x.m_pValue;
+		for (TxPool::Fluff::ProfitSet::iterator it = txp.m_setProfit.begin(); txp.m_setProfit.end() != it; )
+		{
+			TxPool::Fluff::Element& x = (it++)->get_ParentObj();
+			Transaction& tx = *x.m_pValue;
 
-		if (!ValidateTxContext(tx))
+			if (!ValidateTxContext(tx))
+				txp.Delete(x);
+		}
+
+		m_TxPoolDelta.Reset();
+		return;
+	}
+
+	if (m_TxPoolDelta.m_bHeightDown)
+	{
+		for (TxPool::Fluff::ProfitSet::iterator it = txp.m_setProfit.begin(); txp.m_setProfit.end() != it; )
+		{
+			TxPool::Fluff::Element& x = (it++)->get_ParentObj();
+			if (x.m_HeightMin > h)
+				txp.Delete(x);
+		}
+	}
+
+	// The UTXOs of the rest are only affected by the listed commitments. Maturity may only improve as the height grows.
+	std::vector<TxPool::Fluff::Element*> vAffected;
+
+	std::vector<ECC::Point>& v = m_TxPoolDelta.m_vUtxos;
+	std::sort(v.begin(), v.end());
+	v.erase(std::unique(v.begin(), v.end()), v.end());
+
+	TxPool::Fluff::Element::Input key;
+	for (size_t i = 0; i < v.size(); i++)
+	{
+		key.m_Commitment = v[i];
+
+		auto range = txp.m_setInputs.equal_range(key);
+		for (TxPool::Fluff::InputSet::iterator it = range.first; range.second != it; it++)
+			vAffected.push_back(it->m_pThis);
+	}
+
+	std::sort(vAffected.begin(), vAffected.end());
+	vAffected.erase(std::unique(vAffected.begin(), vAffected.end()), vAffected.end());
+
+	for (size_t i = 0; i < vAffected.size(); i++)
+	{
+		TxPool::Fluff::Element& x = *vAffected[i];
+		if (!ValidateTxContext(*x.m_pValue))
+			txp.Delete(x);
+	}
+
+	m_TxPoolDelta.Reset();
+}
+
+bool NodeProcessor::AddToTemplate(TxPool::Fluff& txp, TxPool::Fluff::Element& x)
+{
+	TxPool::Fluff::Template& t = txp.m_Template;
+
+	if (AmountBig::get_Hi(x.m_Profit.m_Fee))
+	{
+		// huge fees are unsupported
+		txp.Delete(x);
+		return true;
+	}
+
+	Amount fee = AmountBig::get_Lo(x.m_Profit.m_Fee);
+	Amount feesNext = t.m_Fees + fee;
+	if (feesNext < t.m_Fees)
+		return false; // huge fees are unsupported
+
+	size_t nSizeNext = t.m_Size + x.m_Profit.m_nSize;
+	if (!t.m_Fees && feesNext)
+		nSizeNext += m_nSizeUtxoComission;
+
+	if (nSizeNext > t.m_SizeMax)
+	{
+		if (x.m_Profit.m_nSize + (fee ? m_nSizeUtxoComission : 0) > t.m_SizeMax)
+		{
+			// won't fit in empty block
+			LOG_INFO() << "Tx is too big.";
 			txp.Delete(x);
+			return true;
+		}
+
+		t.m_bLeftOut = true;
+		return false;
+	}
+
+	Transaction& tx = *x.m_pValue;
+	Height h = m_Cursor.m_Sid.m_Height + 1;
+
+	if (!ValidateTxWrtHeight(tx) || !HandleValidatedTx(tx.get_Reader(), *t.m_pOvl, h))
+	{
+		txp.Delete(x); // isn't available in this context
+		return true;
+	}
+
+	t.m_pOvl->DropUndo();
+
+	x.m_Template.m_bSelected = true;
+	t.m_lstSelected.push_back(x.m_Template);
+
+	t.m_Fees = feesNext;
+	t.m_Size = nSizeNext;
+	t.m_Offset += ECC::Scalar::Native(tx.m_Offset);
+
+	if (!t.m_pWorst || (t.m_pWorst->m_Profit < x.m_Profit))
+		t.m_pWorst = &x;
+
+	return true;
+}
+
+void NodeProcessor::ReapplyTemplate(TxPool::Fluff& txp)
+{
+	TxPool::Fluff::Template& t = txp.m_Template;
+
+	// The UTXO set has changed, the selected txs are re-applied in the same order. Those that aren't valid anymore are dropped
+	TxPool::Fluff::TemplateList lst;
+	lst.swap(t.m_lstSelected);
+
+	t.m_pOvl->Clear();
+	t.m_Offset = Zero;
+	t.m_Fees = 0;
+	t.m_Size = 0;
+	t.m_pWorst = NULL;
+	t.m_bReapply = false;
+
+	while (!lst.empty())
+	{
+		TxPool::Fluff::Element& x = lst.front().get_ParentObj();
+		x.m_Template.m_bSelected = false;
+		lst.pop_front();
+
+		AddToTemplate(txp, x);
+	}
+}
+
+void NodeProcessor::UpdateTemplate(TxPool::Fluff& txp, size_t nSizeMax)
+{
+	TxPool::Fluff::Template& t = txp.m_Template;
+
+	if (!t.m_pOvl)
+		t.m_pOvl.reset(new UtxoTree::Overlay(m_Utxos));
+
+	if (t.m_SizeMax != nSizeMax)
+	{
+		t.m_SizeMax = nSizeMax;
+		t.m_bRebuild = true;
+	}
+
+	Merkle::Hash hvUtxos;
+	m_Utxos.get_Hash(hvUtxos); // cached normally
+
+	if ((t.m_Tip != m_Cursor.m_ID) || (t.m_hvUtxos != hvUtxos))
+	{
+		t.m_Tip = m_Cursor.m_ID;
+		t.m_hvUtxos = hvUtxos;
+		t.m_bReapply = true;
+	}
+
+	if (!t.m_bRebuild)
+	{
+		if (t.m_bReapply)
+		{
+			ReapplyTemplate(txp);
+			if (t.m_bLeftOut)
+				t.m_bRebuild = true; // some space may be freed
+		}
+
+		while (!t.m_bRebuild && !t.m_lstPending.empty())
+		{
+			TxPool::Fluff::Element& x = t.m_lstPending.front().get_ParentObj();
+			t.m_lstPending.pop_front();
+
+			if (!AddToTemplate(txp, x) && t.m_pWorst && (x.m_Profit < t.m_pWorst->m_Profit))
+				t.m_bRebuild = true; // doesn't fit, but is more profitable than some selected
+		}
+	}
+
+	if (t.m_bRebuild)
+	{
+		// from scratch, in the order of profitability
+		t.Reset();
+		t.m_bRebuild = false;
+		t.m_bReapply = false;
+
+		for (TxPool::Fluff::ProfitSet::iterator it = txp.m_setProfit.begin(); txp.m_setProfit.end() != it; )
+			AddToTemplate(txp, (it++)->get_ParentObj());
 	}
 }
 
-size_t NodeProcessor::GenerateNewBlockInternal(BlockContext& bc)
+size_t NodeProcessor::GenerateNewBlockInternal(BlockContext& bc, UtxoTree::Overlay& ovl, bool bTemplate)
 {
 	Height h = m_Cursor.m_Sid.m_Height + 1;
 
@@ -1391,18 +1777,6 @@ size_t NodeProcessor::GenerateNewBlockInternal(BlockContext& bc)
 
 	ECC::Scalar::Native offset = bc.m_Block.m_Offset;
 
-	if (BlockContext::Mode::Assemble != bc.m_Mode)
-	{
-		if (pOutp)
-		{
-			if (!HandleBlockElement(*pOutp, h, NULL, true))
-				return 0;
-
-			bc.m_Block.m_vOutputs.push_back(std::move(pOutp));
-		}
-		bc.m_Block.m_vKernels.push_back(std::move(pKrn));
-	}
-
 	// estimate the size of the fees UTXO
 	if (!m_nSizeUtxoComission)
 	{
@@ -1426,8 +1800,41 @@ size_t NodeProcessor::GenerateNewBlockInternal(BlockContext& bc)
 		return 0; //
 	}
 
+	if (bTemplate)
+	{
+		// start from the selected txs, the rest of the block is added on top
+		assert(!bc.m_Fees);
+		UpdateTemplate(bc.m_TxPool, nSizeMax - ssc.m_Counter.m_Value);
+		ovl = *bc.m_TxPool.m_Template.m_pOvl;
+	}
+
+	if (BlockContext::Mode::Assemble != bc.m_Mode)
+	{
+		if (pOutp)
+		{
+			if (!HandleBlockElement(*pOutp, ovl, h, NULL))
+				return 0;
+
+			bc.m_Block.m_vOutputs.push_back(std::move(pOutp));
+		}
+		bc.m_Block.m_vKernels.push_back(std::move(pKrn));
+	}
+
 	size_t nTxNum = 0;
 
+	if (bTemplate)
+	{
+		const TxPool::Fluff::Template& t = bc.m_TxPool.m_Template;
+
+		for (TxPool::Fluff::TemplateList::const_iterator it = t.m_lstSelected.begin(); t.m_lstSelected.end() != it; it++)
+			TxVectors::Writer(bc.m_Block, bc.m_Block).Dump(it->get_ParentObj().m_pValue->get_Reader());
+
+		bc.m_Fees = t.m_Fees;
+		ssc.m_Counter.m_Value += t.m_Size;
+		offset += t.m_Offset;
+		nTxNum = t.m_lstSelected.size();
+	}
+	else
 	for (TxPool::Fluff::ProfitSet::iterator it = bc.m_TxPool.m_setProfit.begin(); bc.m_TxPool.m_setProfit.end() != it; )
 	{
 		TxPool::Fluff::Element& x = (it++)->get_ParentObj();
@@ -1462,7 +1869,7 @@ size_t NodeProcessor::GenerateNewBlockInternal(BlockContext& bc)
 
 		Transaction& tx = *x.m_pValue;
 
-		if (ValidateTxWrtHeight(tx) && HandleValidatedTx(tx.get_Reader(), h, true))
+		if (ValidateTxWrtHeight(tx) && HandleValidatedTx(tx.get_Reader(), ovl, h))
 		{
 			TxVectors::Writer(bc.m_Block, bc.m_Block).Dump(tx.get_Reader());
 
@@ -1482,7 +1889,7 @@ size_t NodeProcessor::GenerateNewBlockInternal(BlockContext& bc)
 		if (bc.m_Fees)
 		{
 			bb.AddFees(bc.m_Fees, pOutp);
-			if (!HandleBlockElement(*pOutp, h, NULL, true))
+			if (!HandleBlockElement(*pOutp, ovl, h, NULL))
 				return 0;
 
 			bc.m_Block.m_vOutputs.push_back(std::move(pOutp));
@@ -1497,11 +1904,13 @@ size_t NodeProcessor::GenerateNewBlockInternal(BlockContext& bc)
 	return ssc.m_Counter.m_Value;
 }
 
-void NodeProcessor::GenerateNewHdr(BlockContext& bc)
+void NodeProcessor::GenerateNewHdr(BlockContext& bc, UtxoTree::Overlay& ovl)
 {
 	bc.m_Hdr.m_Prev = m_Cursor.m_ID.m_Hash;
 
-	get_Definition(bc.m_Hdr.m_Definition, true);
+	// same as get_Definition(), for the UTXO set with the block applied
+	ovl.get_Hash(bc.m_Hdr.m_Definition);
+	Merkle::Interpret(bc.m_Hdr.m_Definition, m_Cursor.m_HistoryNext, false);
 
 	bc.m_Block.NormalizeE();
 
@@ -1546,25 +1955,29 @@ bool NodeProcessor::GenerateNewBlock(BlockContext& bc)
 		bc.m_Block.m_vOutputs.empty() &&
 		bc.m_Block.m_vKernels.empty();
 
+	// All the changes go to the overlay, the live UTXO set isn't touched
+	UtxoTree::Overlay ovl(m_Utxos);
+
+	// The pool txs are maintained incrementally, unless the block is given
+	bool bTemplate = bEmpty && (BlockContext::Mode::Finalize != bc.m_Mode);
+
 	if (!bEmpty)
 	{
 		if ((BlockContext::Mode::Finalize != bc.m_Mode) && !VerifyBlock(bc.m_Block, bc.m_Block.get_Reader(), h))
 			return false;
 
-		if (!HandleValidatedTx(bc.m_Block.get_Reader(), h, true))
+		if (!HandleValidatedTx(bc.m_Block.get_Reader(), ovl, h))
 			return false;
 	}
 
 	size_t nSizeEstimated = 1;
 
 	if (BlockContext::Mode::Finalize != bc.m_Mode)
-		nSizeEstimated = GenerateNewBlockInternal(bc);
+		nSizeEstimated = GenerateNewBlockInternal(bc, ovl, bTemplate);
 
 	if (nSizeEstimated)
 		bc.m_Hdr.m_Height = h;
 
-	verify(HandleValidatedTx(bc.m_Block.get_Reader(), h, false)); // undo changes
-
 	// reset input maturities
 	for (size_t i = 0; i < bc.m_Block.m_vInputs.size(); i++)
 		bc.m_Block.m_vInputs[i]->m_Maturity = 0;
@@ -1576,17 +1989,20 @@ bool NodeProcessor::GenerateNewBlock(BlockContext& bc)
 		return true;
 
 	size_t nCutThrough = bc.m_Block.Normalize(); // right before serialization
-	nCutThrough; // remove "unused var" warning
 
 	// The effect of the cut-through block may be different than it was during block construction, because the consumed and created UTXOs (removed by cut-through) could have different maturities.
-	// Hence - we need to re-apply the block after the cut-throught, evaluate the definition, and undo the changes (once again).
-	if (!HandleValidatedTx(bc.m_Block.get_Reader(), h, true))
+	// Hence - we need to re-apply the block after the cut-throught (to a fresh overlay), and evaluate the definition.
+	// Without the cut-through the overlay already has exactly the block applied.
+	if (nCutThrough)
 	{
-		LOG_WARNING() << "couldn't apply block after cut-through!";
-		return false; // ?!
+		ovl.Clear();
+		if (!HandleValidatedTx(bc.m_Block.get_Reader(), ovl, h))
+		{
+			LOG_WARNING() << "couldn't apply block after cut-through!";
+			return false; // ?!
+		}
 	}
-	GenerateNewHdr(bc);
-	verify(HandleValidatedTx(bc.m_Block.get_Reader(), h, false)); // undo changes
+	GenerateNewHdr(bc, ovl);
 
 
 	Serializer ser;
@@ -1907,6 +2323,7 @@ bool NodeProcessor::ImportMacroBlockInternal(Block::BodyBase::IMacroReader& r)
 	m_DB.ParamSet(NodeDB::ParamID::FossilHeight, &id.m_Height, NULL);
 
 	InitCursor();
+	m_TxPoolDelta.m_bAll = true;
 
 	LOG_INFO() << "Macroblock import succeeded";
 
@@ -1985,16 +2402,21 @@ bool NodeProcessor::EnumBlocks(IBlockWalker& wlk)
 }
 
 
-void NodeProcessor::InitializeFromBlocks()
+Height NodeProcessor::InitializeFromBlocks()
 {
 	struct MyWalker
 		:public IBlockWalker
 	{
 		NodeProcessor* m_pThis;
 		bool m_bFirstBlock = true;
+		Height m_h0 = 0;
+		Height m_hDone = 0;
 
 		virtual bool OnBlock(const Block::BodyBase& body, TxBase::IReader&& r, uint64_t rowid, Height h, const Height* pHMax) override
 		{
+			if (!m_h0)
+				m_h0 = h;
+
 			if (pHMax)
 			{
 				LOG_INFO() << "Interpreting MB up to " << *pHMax << "...";
@@ -2008,16 +2430,20 @@ void NodeProcessor::InitializeFromBlocks()
 			if (!m_pThis->HandleValidatedBlock(std::move(r), body, h, true, pHMax))
 				OnCorrupted();
 
+			m_hDone = (pHMax ? *pHMax : h) - m_h0 + 1;
+
+			Height hTrg = m_pThis->m_Cursor.m_ID.m_Height;
+			m_pThis->m_Startup.OnProgress(m_hDone, (hTrg >= m_h0) ? (hTrg - m_h0 + 1) : 0);
+
 			return true;
 		}
 	};
 
+	MyWalker wlk;
+	wlk.m_pThis = this;
+
 	if (EnsureTreasuryHandled())
-	{
-		MyWalker wlk;
-		wlk.m_pThis = this;
 		EnumBlocks(wlk);
-	}
 
 	if (m_Cursor.m_ID.m_Height >= Rules::HeightGenesis)
 	{
@@ -2027,6 +2453,8 @@ void NodeProcessor::InitializeFromBlocks()
 		if (m_Cursor.m_Full.m_Definition != hv)
 			OnCorrupted();
 	}
+
+	return wlk.m_hDone;
 }
 
 bool NodeProcessor::IUtxoWalker::OnBlock(const Block::BodyBase&, TxBase::IReader&& r, uint64_t rowid, Height, const Height* pHMax)
@@ -36,12 +36,22 @@ class NodeProcessor
 
 	size_t m_nSizeUtxoComission;
 
+	// Changes since the last DeleteOutdated(), only the pooled txs affected by them are revalidated
+	struct TxPoolDelta
+	{
+		std::vector<ECC::Point> m_vUtxos; // spent by the applied blocks, or created by the reverted ones
+		bool m_bHeightDown = false; // blocks were reverted, the lower height bound of the txs must be rechecked
+		bool m_bAll = true; // no details (initial state, macroblock import), revalidate everything
+
+		void Reset();
+	} m_TxPoolDelta;
+
 	void TryGoUp();
 
 	bool GoForward(uint64_t);
 	void Rollback();
 	void PruneOld();
-	void InitializeFromBlocks();
+	Height InitializeFromBlocks(); // returns the number of blocks interpreted
 	void RequestDataInternal(const Block::SystemState::ID&, uint64_t row, bool bBlock, Height hTarget);
 
 	struct RollbackData;
@@ -55,6 +65,11 @@ class NodeProcessor
 	bool HandleBlockElement(const Input&, Height, const Height*, bool bFwd);
 	bool HandleBlockElement(const Output&, Height, const Height*, bool bFwd);
 
+	// forward only, the live UTXO set isn't touched. On failure the overlay is restored
+	bool HandleValidatedTx(TxBase::IReader&&, UtxoTree::Overlay&, Height, const Height* = NULL);
+	bool HandleBlockElement(const Input&, UtxoTree::Overlay&, Height, const Height*);
+	bool HandleBlockElement(const Output&, UtxoTree::Overlay&, Height, const Height*);
+
 	bool ImportMacroBlockInternal(Block::BodyBase::IMacroReader&);
 	void RecognizeUtxos(TxBase::IReader&&, Height hMax);
 
@@ -99,7 +114,7 @@ class NodeProcessor
 
 public:
 
-	void Initialize(const char* szPath, bool bResetCursor = false);
+	void Initialize(const char* szPath, bool bResetCursor = false, NodeDB::IntegrityCheck::Enum = NodeDB::IntegrityCheck::Auto);
 	virtual ~NodeProcessor();
 
 	struct Horizon {
@@ -130,6 +145,59 @@ public:
 
 	} m_Extra;
 
+	// Times the startup phases, so that it's visible (and testable) where the restart time goes
+	struct StartupProfiler
+	{
+		struct Phase {
+			enum Enum {
+				OpenDB, // incl. integrity check
+				Replay, // blocks interpreted to rebuild UtxoTree
+				GoUp, // moved to the best tip, old states pruned
+				Treasury,
+				Peers,
+				Bbs,
+
+				count
+			};
+
+			static const char* get_Name(Enum);
+		};
+
+		struct Stats {
+			uint32_t m_Elapsed_ms = 0;
+			uint64_t m_Done = 0; // blocks or rows, depending on the phase
+			uint64_t m_PeakRss_KB = 0;
+			bool m_Performed = false;
+		};
+
+		Stats m_pStats[Phase::count];
+
+		struct Progress {
+			Phase::Enum m_Phase;
+			uint64_t m_Done;
+			uint64_t m_Total; // 0 if unknown
+			uint32_t m_Elapsed_ms;
+			uint32_t m_Eta_ms; // 0 if unknown
+			bool m_Finished;
+		};
+
+		static const uint32_t s_ReportPeriod_ms = 5000;
+
+		void Begin(Phase::Enum);
+		void OnProgress(uint64_t nDone, uint64_t nTotal); // reported once in a period
+		void End(uint64_t nDone = 0);
+
+		IMPLEMENT_GET_PARENT_OBJ(NodeProcessor, m_Startup)
+
+	private:
+		Phase::Enum m_Phase = Phase::count;
+		uint32_t m_Start_ms = 0;
+		uint32_t m_Reported_ms = 0;
+
+		void Report(uint64_t nDone, uint64_t nTotal, bool bFinished);
+
+	} m_Startup;
+
 	// Export compressed history elements. Suitable only for "small" ranges, otherwise may be both time & memory consumng.
 	void ExtractBlockWithExtra(Block::Body&, const NodeDB::StateID&);
 	void ExportMacroBlock(Block::BodyBase::IMacroWriter&, const HeightRange&);
@@ -168,6 +236,7 @@ public:
 	virtual void AdjustFossilEnd(Height&) {}
 	virtual bool OpenMacroblock(Block::BodyBase::RW&, const NodeDB::StateID&) { return false; }
 	virtual void OnModified() {}
+	virtual void OnStartupProgress(const StartupProfiler::Progress&) {}
 
 	struct IKeyWalker {
 		virtual bool OnKey(Key::IPKdf&, Key::Index) = 0;
@@ -177,6 +246,7 @@ public:
 	uint64_t FindActiveAtStrict(Height);
 
 	bool ValidateTxContext(const Transaction&); // assuming context-free validation is already performed, but 
+	bool ValidateTxContext(const Transaction&, const UtxoTree::Overlay&); // same, against the modified UTXO set
 	bool ValidateTxWrtHeight(const Transaction&) const;
 
 	struct GeneratedBlock
@@ -210,8 +280,14 @@ public:
 	};
 
 	bool GenerateNewBlock(BlockContext&);
+
+	// Evict the txs invalidated by the tip change: expired, spending the UTXOs spent in the new blocks or created by the reverted ones
 	void DeleteOutdated(TxPool::Fluff&);
 
+	// Bring the pool's block template up to date. New txs are appended, on the tip change the selected ones are re-applied.
+	// Full re-selection is done only if the block is full, and the selection may be improved.
+	void UpdateTemplate(TxPool::Fluff&, size_t nSizeMax);
+
 	struct UtxoRecoverSimple
 		:public IUtxoWalker
 	{
@@ -268,8 +344,10 @@ public:
 	static bool IsDummy(const Key::IDV&);
 
 private:
-	size_t GenerateNewBlockInternal(BlockContext&);
-	void GenerateNewHdr(BlockContext&);
+	size_t GenerateNewBlockInternal(BlockContext&, UtxoTree::Overlay&, bool bTemplate);
+	bool AddToTemplate(TxPool::Fluff&, TxPool::Fluff::Element&); // returns false if didn't fit
+	void ReapplyTemplate(TxPool::Fluff&);
+	void GenerateNewHdr(BlockContext&, UtxoTree::Overlay&);
 	DataStatus::Enum OnStateInternal(const Block::SystemState::Full&, Block::SystemState::ID&);
 };
 
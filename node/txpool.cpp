@@ -48,6 +48,7 @@ TxPool::Fluff::Element* TxPool::Fluff::AddValidTx(Transaction::Ptr&& pValue, con
 
 	Element* p = new Element;
 	p->m_pValue = std::move(pValue);
+	p->m_HeightMin = ctx.m_Height.m_Min;
 	p->m_Threshold.m_Value	= ctx.m_Height.m_Max;
 	p->m_Profit.m_Fee = ctx.m_Fee;
 	p->m_Profit.SetSize(*p->m_pValue);
@@ -57,9 +58,22 @@ TxPool::Fluff::Element* TxPool::Fluff::AddValidTx(Transaction::Ptr&& pValue, con
 	m_setProfit.insert(p->m_Profit);
 	m_setTxs.insert(p->m_Tx);
 
+	const Transaction& tx = *p->m_pValue;
+	p->m_vInputs.resize(tx.m_vInputs.size());
+
+	for (size_t i = 0; i < p->m_vInputs.size(); i++)
+	{
+		Element::Input& n = p->m_vInputs[i];
+		n.m_Commitment = tx.m_vInputs[i]->m_Commitment;
+		n.m_pThis = p;
+		m_setInputs.insert(n);
+	}
+
 	p->m_Queue.m_Refs = 1;
 	m_Queue.push_back(p->m_Queue);
 
+	m_Template.m_lstPending.push_back(p->m_Template);
+
 	return p;
 }
 
@@ -72,9 +86,47 @@ void TxPool::Fluff::Delete(Element& x)
 	m_setProfit.erase(ProfitSet::s_iterator_to(x.m_Profit));
 	m_setTxs.erase(TxSet::s_iterator_to(x.m_Tx));
 
+	for (size_t i = 0; i < x.m_vInputs.size(); i++)
+		m_setInputs.erase(InputSet::s_iterator_to(x.m_vInputs[i]));
+	x.m_vInputs.clear();
+
+	if (x.m_Template.is_linked())
+	{
+		if (x.m_Template.m_bSelected)
+		{
+			m_Template.m_lstSelected.erase(TemplateList::s_iterator_to(x.m_Template));
+			m_Template.m_bReapply = true;
+		}
+		else
+			m_Template.m_lstPending.erase(TemplateList::s_iterator_to(x.m_Template));
+	}
+
+	if (m_Template.m_pWorst == &x)
+		m_Template.m_pWorst = NULL;
+
 	Release(x);
 }
 
+void TxPool::Fluff::Template::Reset()
+{
+	while (!m_lstSelected.empty())
+	{
+		m_lstSelected.front().m_bSelected = false;
+		m_lstSelected.pop_front();
+	}
+
+	m_lstPending.clear();
+
+	if (m_pOvl)
+		m_pOvl->Clear();
+
+	m_Offset = Zero;
+	m_Fees = 0;
+	m_Size = 0;
+	m_pWorst = NULL;
+	m_bLeftOut = false;
+}
+
 void TxPool::Fluff::Release(Element& x)
 {
 	assert(x.m_Queue.m_Refs);
@@ -17,6 +17,7 @@
 #include <boost/intrusive/set.hpp>
 #include <boost/intrusive/list.hpp>
 #include "../core/block_crypt.h"
+#include "../core/radixtree.h"
 #include "../utility/io/timer.h"
 
 namespace beam {
@@ -39,6 +40,7 @@ struct TxPool
 		struct Element
 		{
 			Transaction::Ptr m_pValue;
+			Height m_HeightMin; // the upper bound is in m_Threshold
 
 			struct Tx
 				:public boost::intrusive::set_base_hook<>
@@ -65,24 +67,66 @@ struct TxPool
 				IMPLEMENT_GET_PARENT_OBJ(Element, m_Threshold)
 			} m_Threshold;
 
+			struct Input
+				:public boost::intrusive::set_base_hook<>
+			{
+				Element* m_pThis;
+				ECC::Point m_Commitment;
+				bool operator < (const Input& t) const { return m_Commitment < t.m_Commitment; }
+			};
+
+			std::vector<Input> m_vInputs;
+
 			struct Queue
 				:public boost::intrusive::list_base_hook<>
 			{
 				uint32_t m_Refs = 0;
 				IMPLEMENT_GET_PARENT_OBJ(Element, m_Queue)
 			} m_Queue;
+
+			struct Template
+				:public boost::intrusive::list_base_hook<>
+			{
+				bool m_bSelected = false; // otherwise pending
+				IMPLEMENT_GET_PARENT_OBJ(Element, m_Template)
+			} m_Template;
 		};
 
 		typedef boost::intrusive::multiset<Element::Tx> TxSet;
 		typedef boost::intrusive::multiset<Element::Profit> ProfitSet;
 		typedef boost::intrusive::multiset<Element::Threshold> ThresholdSet;
+		typedef boost::intrusive::multiset<Element::Input> InputSet;
 		typedef boost::intrusive::list<Element::Queue> Queue;
+		typedef boost::intrusive::list<Element::Template> TemplateList;
 
 		TxSet m_setTxs;
 		ProfitSet m_setProfit;
 		ThresholdSet m_setThreshold;
+		InputSet m_setInputs; // to find the txs affected by the new blocks
 		Queue m_Queue;
 
+		// txs selected for the next block. Maintained incrementally by NodeProcessor
+		struct Template
+		{
+			TemplateList m_lstSelected; // in the order of selection
+			TemplateList m_lstPending; // new txs, not considered yet
+			std::unique_ptr<UtxoTree::Overlay> m_pOvl; // the selected txs applied
+
+			ECC::Scalar::Native m_Offset;
+			Amount m_Fees = 0;
+			size_t m_Size = 0;
+			size_t m_SizeMax = 0; // available for the txs
+			Block::SystemState::ID m_Tip;
+			Merkle::Hash m_hvUtxos; // the UTXO set it was built for
+			const Element* m_pWorst = NULL; // the least profitable selected
+
+			bool m_bLeftOut = false; // some txs didn't fit
+			bool m_bReapply = false; // a selected tx was removed, or the tip changed
+			bool m_bRebuild = true; // the selection isn't optimal anymore
+
+			void Reset();
+		} m_Template;
+
 		Element* AddValidTx(Transaction::Ptr&&, const Transaction::Context&, const Transaction::KeyType&);
 		void Delete(Element&);
 		void Release(Element&);
@@ -18,10 +18,10 @@
 #include "../db.h"
 #include "../processor.h"
 #include "../../core/fly_client.h"
-#include "../../core/serialization_adapters.h"
+#include "../../core/serialization_adapters.h"
 #include "../../core/treasury.h"
 #include "../../utility/test_helpers.h"
-#include "../../utility/serialize.h"
+#include "../../utility/serialize.h"
 #include "../../core/unittest/mini_blockchain.h"
 
 #ifndef LOG_VERBOSE_ENABLED
@@ -170,29 +170,29 @@ namespace beam
 		Key::IKdf::Ptr pKdf;
 		ECC::SetRandom(pKdf);
 
-		PeerID pid;
-		ECC::Scalar::Native sk;
-		Treasury::get_ID(*pKdf, pid, sk);
-
-		Treasury tres;
-		Treasury::Parameters pars;
-		pars.m_Bursts = 1;
-		Treasury::Entry* pE = tres.CreatePlan(pid, Rules::get().Emission.Value0 / 5, pars);
-
-		pE->m_pResponse.reset(new Treasury::Response);
-		uint64_t nIndex = 1;
-		verify_test(pE->m_pResponse->Create(pE->m_Request, *pKdf, nIndex));
-
-		Treasury::Data data;
-		data.m_sCustomMsg = "test treasury";
-		tres.Build(data);
-
-		beam::Serializer ser;
-		ser & data;
-
-		ser.swap_buf(g_Treasury);
-
-		ECC::Hash::Processor() << Blob(g_Treasury) >> Rules::get().TreasuryChecksum;
+		PeerID pid;
+		ECC::Scalar::Native sk;
+		Treasury::get_ID(*pKdf, pid, sk);
+
+		Treasury tres;
+		Treasury::Parameters pars;
+		pars.m_Bursts = 1;
+		Treasury::Entry* pE = tres.CreatePlan(pid, Rules::get().Emission.Value0 / 5, pars);
+
+		pE->m_pResponse.reset(new Treasury::Response);
+		uint64_t nIndex = 1;
+		verify_test(pE->m_pResponse->Create(pE->m_Request, *pKdf, nIndex));
+
+		Treasury::Data data;
+		data.m_sCustomMsg = "test treasury";
+		tres.Build(data);
+
+		beam::Serializer ser;
+		ser & data;
+
+		ser.swap_buf(g_Treasury);
+
+		ECC::Hash::Processor() << Blob(g_Treasury) >> Rules::get().TreasuryChecksum;
 	}
 
 	uint32_t CountTips(NodeDB& db, bool bFunctional, NodeDB::StateID* pLast = NULL)
@@ -215,6 +215,54 @@ namespace beam
 		return nTips;
 	}
 
+	void VerifyActiveStatesProofs(NodeDB& db)
+	{
+		std::vector<Merkle::Hash> vHashes;
+
+		NodeDB::StateID sid;
+		if (db.get_Cursor(sid))
+		{
+			do
+			{
+				vHashes.emplace_back();
+				db.get_StateHash(sid.m_Row, vHashes.back());
+			} while (db.get_Prev(sid));
+
+			std::reverse(vHashes.begin(), vHashes.end());
+			verify_test(db.get_Cursor(sid));
+		}
+
+		for (size_t n = vHashes.size(); n--; )
+		{
+			Merkle::CompactMmr cmmr;
+			for (size_t i = 0; i < n; i++)
+				cmmr.Append(vHashes[i]);
+
+			Merkle::Hash hvRoot, hv;
+			cmmr.get_Hash(hvRoot);
+
+			cmmr.Append(vHashes[n]);
+			cmmr.get_Hash(hv);
+
+			Merkle::Hash hvPredicted;
+			db.get_PredictedStatesHash(hvPredicted, sid);
+			verify_test(hvPredicted == hv);
+
+			for (size_t i = 0; i < n; i++)
+			{
+				Merkle::ProofBuilderStd bld;
+				db.get_Proof(bld, sid, i + Rules::HeightGenesis);
+
+				hv = vHashes[i];
+				Merkle::Interpret(hv, bld.m_Proof);
+				verify_test(hv == hvRoot);
+			}
+
+			if (n)
+				verify_test(db.get_Prev(sid));
+		}
+	}
+
 	void TestNodeDB(const char* sz)
 	{
 		NodeDB db;
@@ -398,6 +446,28 @@ namespace beam
 		tr.Commit();
 		tr.Start(db);
 
+		VerifyActiveStatesProofs(db);
+
+		// rollback past the fork, then switch to it
+		verify_test(db.get_Cursor(sid));
+		for (uint32_t i = 0; i < hMax - hFork0; i++)
+			db.MoveBack(sid);
+
+		verify_test(sid.m_Height == hFork0 - 1 + Rules::HeightGenesis);
+		VerifyActiveStatesProofs(db);
+
+		sid.m_Row = r0;
+		sid.m_Height++;
+		db.MoveFwd(sid);
+		sid.m_Row = rowLast1;
+		sid.m_Height++;
+		db.MoveFwd(sid);
+		VerifyActiveStatesProofs(db);
+
+		tr.Rollback(); // the states mmr must resync
+		tr.Start(db);
+		VerifyActiveStatesProofs(db);
+
 		while (sid.m_Row)
 			db.MoveBack(sid);
 
@@ -488,58 +558,116 @@ namespace beam
 				;
 		}
 
+		{
+			// memory-resident store, loaded from what's left in the DB
+			BbsStore bs;
+			bs.Load(db);
+			verify_test(bs.m_setSeq.size() == 33);
+			verify_test(bs.m_FlushedID == bs.m_LastID);
+			verify_test(bs.get_MaxTime() == 299);
+
+			dBbs.m_Key = 170U;
+			BbsStore::Element* pElem = bs.Find(dBbs.m_Key);
+			verify_test(pElem && (pElem->m_Time.m_Value == 270) && (pElem->m_Channel.m_Value == 170 % 7));
+			verify_test(pElem->m_Message.size() == 5);
+
+			verify_test(bs.FindCursor(270) == pElem->get_ID());
+			verify_test(bs.FindCursor(300) == bs.m_LastID + 1);
+
+			uint32_t nCount = 0;
+			BbsStore::Element::Channel key;
+			key.m_Value = 3;
+			key.m_ID = 0;
+			for (BbsStore::ChannelSet::iterator it = bs.m_setChannel.upper_bound(key); (bs.m_setChannel.end() != it) && (it->m_Value == key.m_Value); it++)
+				nCount++;
+			verify_test(nCount == 5); // 171, 178, 185, 192, 199
+
+			bs.DeleteOld(280);
+			verify_test(bs.m_setSeq.size() == 20);
+			verify_test(!bs.Find(dBbs.m_Key));
+
+			// new messages are saved on flush only
+			for (uint32_t i = 300; i < 310; i++)
+			{
+				dBbs.m_Key = i;
+				dBbs.m_Channel = i % 7;
+				dBbs.m_TimePosted = i + 100;
+				verify_test(!bs.Find(dBbs.m_Key));
+				bs.Insert(dBbs);
+			}
+
+			verify_test(!db.BbsFind(dBbs.m_Key));
+			bs.Flush(db);
+			verify_test(db.BbsFind(dBbs.m_Key));
+			verify_test(bs.m_FlushedID == bs.m_LastID);
+
+			// size limit: the oldest are dropped
+			bs.m_SizeMax = bs.m_TotalSize;
+			dBbs.m_Key = 310U;
+			dBbs.m_TimePosted = 410;
+			bs.Insert(dBbs);
+			verify_test(bs.m_TotalSize <= bs.m_SizeMax);
+			verify_test(bs.m_setSeq.size() == 30);
+			verify_test(bs.m_setTime.begin()->m_Value == 281);
+
+			BbsStore bs2;
+			bs2.Load(db);
+			verify_test(bs2.m_setSeq.size() == 43);
+			verify_test(bs2.get_MaxTime() == 409);
+		}
+
 		Key::ID kid(Zero);
 		kid.m_Idx = 345;
 
 		verify_test(db.GetDummyHeight(kid) == MaxHeight);
 
-		db.InsertDummy(176, kid);
-
-		kid.m_Idx = 346;
-		db.InsertDummy(568, kid);
+		db.InsertDummy(176, kid);
+
+		kid.m_Idx = 346;
+		db.InsertDummy(568, kid);
 
-		kid.m_Idx = 345;
+		kid.m_Idx = 345;
 		verify_test(db.GetDummyHeight(kid) == 176);
-
-		Height h1 = db.GetLowestDummy(kid);
-		verify_test(h1 == 176);
-		verify_test(kid.m_Idx == 345U);
-
-		db.SetDummyHeight(kid, 1055);
-
-		h1 = db.GetLowestDummy(kid);
-		verify_test(h1 == 568);
-		verify_test(kid.m_Idx == 346U);
-		
-		db.DeleteDummy(kid);
-
-		h1 = db.GetLowestDummy(kid);
-		verify_test(h1 == 1055);
-		verify_test(kid.m_Idx == 345U);
-
-		db.DeleteDummy(kid);
-
-		verify_test(MaxHeight == db.GetLowestDummy(kid));
-
-		// Kernels
-		db.InsertKernel(bBodyP, 5);
-		db.InsertKernel(bBodyP, 5); // duplicate
-		db.InsertKernel(bBodyP, 7);
-		db.InsertKernel(bBodyP, 2);
-
-		verify_test(db.FindKernel(bBodyP) == 7);
-		verify_test(db.FindKernel(bBodyE) == 0);
-
-		db.DeleteKernel(bBodyP, 7);
-		verify_test(db.FindKernel(bBodyP) == 5);
-		db.DeleteKernel(bBodyP, 5);
-		verify_test(db.FindKernel(bBodyP) == 5);
-		db.DeleteKernel(bBodyP, 2);
-		verify_test(db.FindKernel(bBodyP) == 5);
-		db.DeleteKernel(bBodyP, 5);
-		verify_test(db.FindKernel(bBodyP) == 0);
-
-
+
+		Height h1 = db.GetLowestDummy(kid);
+		verify_test(h1 == 176);
+		verify_test(kid.m_Idx == 345U);
+
+		db.SetDummyHeight(kid, 1055);
+
+		h1 = db.GetLowestDummy(kid);
+		verify_test(h1 == 568);
+		verify_test(kid.m_Idx == 346U);
+		
+		db.DeleteDummy(kid);
+
+		h1 = db.GetLowestDummy(kid);
+		verify_test(h1 == 1055);
+		verify_test(kid.m_Idx == 345U);
+
+		db.DeleteDummy(kid);
+
+		verify_test(MaxHeight == db.GetLowestDummy(kid));
+
+		// Kernels
+		db.InsertKernel(bBodyP, 5);
+		db.InsertKernel(bBodyP, 5); // duplicate
+		db.InsertKernel(bBodyP, 7);
+		db.InsertKernel(bBodyP, 2);
+
+		verify_test(db.FindKernel(bBodyP) == 7);
+		verify_test(db.FindKernel(bBodyE) == 0);
+
+		db.DeleteKernel(bBodyP, 7);
+		verify_test(db.FindKernel(bBodyP) == 5);
+		db.DeleteKernel(bBodyP, 5);
+		verify_test(db.FindKernel(bBodyP) == 5);
+		db.DeleteKernel(bBodyP, 2);
+		verify_test(db.FindKernel(bBodyP) == 5);
+		db.DeleteKernel(bBodyP, 5);
+		verify_test(db.FindKernel(bBodyP) == 0);
+
+
 		tr.Commit();
 	}
 
@@ -560,6 +688,50 @@ namespace beam
 		{
 			NodeDB db;
 			db.Open(g_sz); // test to open already-existing DB
+			verify_test(db.get_PrevShutdownClean());
+			verify_test(db.ParamIntGetDef(NodeDB::ParamID::IntegrityChecked));
+			verify_test(!db.ParamIntGetDef(NodeDB::ParamID::CleanShutdown));
+		}
+
+		{
+			// simulate a crash: the marker is reset on open
+			std::string sSql = "UPDATE Params SET ParamInt=0 WHERE ID=" + std::to_string(NodeDB::ParamID::CleanShutdown);
+
+			sqlite3* pDb = nullptr;
+			verify_test(SQLITE_OK == sqlite3_open(g_sz, &pDb));
+			verify_test(SQLITE_OK == sqlite3_exec(pDb, sSql.c_str(), nullptr, nullptr, nullptr));
+			sqlite3_close(pDb);
+		}
+
+		{
+			NodeDB db;
+			db.Open(g_sz, NodeDB::IntegrityCheck::Quick); // full check skipped, and is due
+			verify_test(!db.get_PrevShutdownClean());
+			verify_test(!db.ParamIntGetDef(NodeDB::ParamID::IntegrityChecked));
+		}
+
+		{
+			NodeDB db;
+			db.Open(g_sz); // closed cleanly, yet the full check is due
+			verify_test(db.get_PrevShutdownClean());
+			verify_test(db.ParamIntGetDef(NodeDB::ParamID::IntegrityChecked));
+
+			db.CheckIntegrity(false);
+		}
+
+		{
+			// the states mmr is persisted, and rebuilt if missing
+			NodeDB db;
+			db.Open(g_sz);
+			VerifyActiveStatesProofs(db);
+		}
+
+		DeleteFile((std::string(g_sz) + ".mmr").c_str());
+
+		{
+			NodeDB db;
+			db.Open(g_sz);
+			VerifyActiveStatesProofs(db);
 		}
 	}
 
@@ -797,6 +969,10 @@ namespace beam
 
 			np.OnBlock(id, bc.m_BodyP, bc.m_BodyE, PeerID());
 
+			// all the pooled txs are in the block now, their inputs are spent
+			np.DeleteOutdated(np.m_TxPool);
+			verify_test(np.m_TxPool.m_setProfit.empty() && np.m_TxPool.m_setInputs.empty());
+
 			np.m_Wallet.AddMyUtxo(Key::IDV(bc.m_Fees, h, Key::Type::Comission));
 			np.m_Wallet.AddMyUtxo(Key::IDV(Rules::get_Emission(h), h, Key::Type::Coinbase));
 
@@ -821,8 +997,8 @@ namespace beam
 				std::string m_sPathMB;
 				virtual bool OpenMacroblock(Block::BodyBase::RW& rw, const NodeDB::StateID&) override
 				{
-					rw.m_sPath = m_sPathMB;
-					rw.ROpen();
+					rw.m_sPath = m_sPathMB;
+					rw.ROpen();
 					return true;
 				}
 			};
@@ -849,11 +1025,11 @@ namespace beam
 			verify_test(np2.ImportMacroBlock(rwData));
 			rwData.Close();
 
-			np2.get_DB().MacroblockIns(np2.m_Cursor.m_Sid.m_Row);
-			np2.m_sPathMB = g_sz3;
-
-			// Although NodeProcessor can import macroblocks not from the beginning - currently this mode is not supported, it will consider only the most recent
-			// macroblock during initialization, and kernel retrieval.
+			np2.get_DB().MacroblockIns(np2.m_Cursor.m_Sid.m_Row);
+			np2.m_sPathMB = g_sz3;
+
+			// Although NodeProcessor can import macroblocks not from the beginning - currently this mode is not supported, it will consider only the most recent
+			// macroblock during initialization, and kernel retrieval.
 			// try kernel proofs. Must be retrieved from the macroblock. Because of the above this test is only for kernels which are mature enough
 			for (size_t i = 0; i < np.m_Wallet.m_MyKernels.size(); i++)
 			{
@@ -887,6 +1063,17 @@ namespace beam
 	public:
 		// NodeProcessor
 		virtual void AdjustFossilEnd(Height& h) override { h = 0; } // don't fossile anything, since we're not creating macroblocks
+
+		uint32_t m_nPhasesFinished = 0;
+
+		virtual void OnStartupProgress(const StartupProfiler::Progress& p) override
+		{
+			if (p.m_Finished)
+			{
+				verify_test(p.m_Done == p.m_Total);
+				m_nPhasesFinished++;
+			}
+		}
 	};
 
 
@@ -963,6 +1150,15 @@ namespace beam
 			PeerID peer;
 			ZeroObject(peer);
 
+			// the startup phases are accounted, the blocks up to the cursor are interpreted
+			typedef NodeProcessor::StartupProfiler::Phase Phase;
+			verify_test(np.m_Startup.m_pStats[Phase::OpenDB].m_Performed);
+			verify_test(np.m_Startup.m_pStats[Phase::Replay].m_Performed);
+			verify_test(np.m_Startup.m_pStats[Phase::Replay].m_Done == np.m_Cursor.m_ID.m_Height);
+			verify_test(np.m_Startup.m_pStats[Phase::GoUp].m_Performed);
+			verify_test(!np.m_Startup.m_pStats[Phase::Peers].m_Performed); // node-level phase
+			verify_test(np.m_nPhasesFinished == 3);
+
 			for (size_t i = nMid; i < blockChain.size(); i++)
 			{
 				Block::SystemState::ID id;
@@ -1006,6 +1202,7 @@ namespace beam
 		node2.m_Cfg.m_Treasury = g_Treasury;
 
 		node2.m_Cfg.m_BeaconPort = g_Port;
+		node2.m_Cfg.m_IoThreads = 2; // node2 serves its peers on the I/O shards, node - on its own reactor
 
 		ECC::SetRandom(node);
 		ECC::SetRandom(node2);
@@ -1143,6 +1340,7 @@ namespace beam
 
 			std::set<ECC::Point> m_UtxosConfirmed;
 			std::list<ECC::Point> m_queProofsExpected;
+			std::list<std::vector<ECC::Point> > m_queProofsMultiExpected;
 			std::list<uint32_t> m_queProofsStateExpected;
 			std::list<uint32_t> m_queProofsKrnExpected;
 			uint32_t m_nChainWorkProofsPending = 0;
@@ -1164,7 +1362,7 @@ namespace beam
 
 				proto::Login msg;
 				msg.m_CfgChecksum = Rules::get().Checksum;
-				msg.m_Flags = proto::LoginFlags::Extension1;
+				msg.m_Flags = proto::LoginFlags::Extension1;
 				Send(msg);
 
 				Send(proto::GetExternalAddr(Zero));
@@ -1209,6 +1407,7 @@ namespace beam
 			{
 				return
 					m_queProofsExpected.empty() &&
+					m_queProofsMultiExpected.empty() &&
 					m_queProofsKrnExpected.empty() &&
 					m_queProofsStateExpected.empty() &&
 					!m_nChainWorkProofsPending;
@@ -1292,6 +1491,20 @@ namespace beam
 					m_queProofsExpected.push_back(msgOut2.m_Utxo);
 				}
 
+				if (!m_Wallet.m_MyUtxos.empty())
+				{
+					// the same in a single batch, in reverse order, with a duplicate
+					proto::GetProofUtxoMulti msgOut2;
+					msgOut2.m_Utxos.assign(m_queProofsExpected.rbegin(), m_queProofsExpected.rend());
+					msgOut2.m_Utxos.push_back(msgOut2.m_Utxos.front());
+
+					if (msgOut2.m_Utxos.size() > proto::g_UtxoMultiMaxSize)
+						msgOut2.m_Utxos.resize(proto::g_UtxoMultiMaxSize);
+
+					Send(msgOut2);
+					m_queProofsMultiExpected.push_back(std::move(msgOut2.m_Utxos));
+				}
+
 				for (uint32_t i = 0; i < m_Wallet.m_MyKernels.size(); i++)
 				{
 					const MiniWallet::MyKernel mk = m_Wallet.m_MyKernels[i];
@@ -1378,7 +1591,7 @@ namespace beam
 					// switch offline/online mining modes
 					proto::Login msgLogin;
 					msgLogin.m_CfgChecksum = Rules::get().Checksum;
-					msgLogin.m_Flags = proto::LoginFlags::Extension1;
+					msgLogin.m_Flags = proto::LoginFlags::Extension1;
 					if (msg.m_Description.m_Height % 8)
 						msgLogin.m_Flags |= proto::LoginFlags::MiningFinalization;
 					Send(msgLogin);
@@ -1433,6 +1646,26 @@ namespace beam
 					fail_test("unexpected proof");
 			}
 
+			virtual void OnMsg(proto::ProofUtxoMulti&& msg) override
+			{
+				verify_test(!m_queProofsMultiExpected.empty());
+				const std::vector<ECC::Point>& vComm = m_queProofsMultiExpected.front();
+				verify_test(msg.m_Proofs.size() == vComm.size());
+
+				for (size_t i = 0; i < vComm.size(); i++)
+				{
+					const std::vector<Input::Proof>& v = msg.m_Proofs[i];
+
+					// individual requests for the same utxos were answered just before
+					verify_test(v.empty() == (m_UtxosConfirmed.end() == m_UtxosConfirmed.find(vComm[i])));
+
+					for (size_t j = 0; j < v.size(); j++)
+						verify_test(m_vStates.back().IsValidProofUtxo(vComm[i], v[j]));
+				}
+
+				m_queProofsMultiExpected.pop_front();
+			}
+
 			virtual void OnMsg(proto::ProofKernel2&& msg) override
 			{
 				if (!m_queProofsKrnExpected.empty())
@@ -1466,14 +1699,14 @@ namespace beam
 			{
 				if (!m_queProofsKrnExpected.empty())
 				{
-					const MiniWallet::MyKernel& mk = m_Wallet.m_MyKernels[m_queProofsKrnExpected.front()];
+					const MiniWallet::MyKernel& mk = m_Wallet.m_MyKernels[m_queProofsKrnExpected.front()];
 					m_queProofsKrnExpected.pop_front();
 
 					if (!msg.m_Proof.empty())
 					{
-						TxKernel krn;
-						mk.Export(krn);
-						verify_test(m_vStates.back().IsValidProofKernel(krn, msg.m_Proof));
+						TxKernel krn;
+						mk.Export(krn);
+						verify_test(m_vStates.back().IsValidProofKernel(krn, msg.m_Proof));
 					}
 				}
 				else
@@ -1650,6 +1883,18 @@ namespace beam
 		cwp.m_hvRootLive = cc.m_hvLive;
 		cwp.Create(cc.m_Source, sRoot);
 
+		// the states are verified in parallel, a single bad one must be detected
+		for (size_t i = 0; i < cwp.m_vArbitraryStates.size(); i += cwp.m_vArbitraryStates.size() / 4 + 1)
+		{
+			Block::SystemState::Full& s = cwp.m_vArbitraryStates[i];
+			Height h = s.m_Height;
+
+			s.m_Height = 0; // insane
+			verify_test(!cwp.IsValid());
+
+			s.m_Height = h;
+		}
+
 		uint32_t nStates = (uint32_t) cc.m_vStates.size();
 		for (size_t i0 = 0; ; i0++)
 		{
@@ -1673,6 +1918,11 @@ namespace beam
 			cwp2.m_LowerBound = cc.m_vStates[cc.m_vStates.size() - nStates].m_Hdr.m_ChainWork;
 			verify_test(cwp2.Crop(cwp));
 
+			Block::ChainWorkProof cwp3;
+			cwp3.m_LowerBound = cwp2.m_LowerBound;
+			verify_test(cwp3.Crop(cwp, true)); // same, without re-verifying the states
+			verify_test((cwp3.m_vArbitraryStates.size() == cwp2.m_vArbitraryStates.size()) && (cwp3.m_Proof.m_vData == cwp2.m_Proof.m_vData));
+
 			cwp.m_LowerBound = cwp2.m_LowerBound;
 			verify_test(cwp.Crop());
 
@@ -1936,6 +2186,8 @@ int main()
 
 	beam::DeleteFile(beam::g_sz);
 	beam::DeleteFile(beam::g_sz2);
+	beam::DeleteFile((std::string(beam::g_sz) + ".mmr").c_str());
+	beam::DeleteFile((std::string(beam::g_sz2) + ".mmr").c_str());
 
 	printf("NodeDB test...\n");
 	fflush(stdout);
@@ -27,6 +27,7 @@ public:
         std::string apiKeysFile;
         std::string certFile;
         std::string privKeyFile;
+        unsigned shareInterval_s = 10; // stratum: target time between the shares of a miner, 0 means shares at the block difficulty
     };
 
     // creates stratum server
@@ -40,7 +40,7 @@ private:
     {
         {
             std::lock_guard<std::mutex> lk(_mutex);
-            if (_currentJob.input == input) {
+            if (_currentJob.input == input && _currentJob.pow.m_Difficulty.m_Packed == pow.m_Difficulty.m_Packed) {
                 return;
             }
             _currentJob.jobID = jobID;
@@ -80,7 +80,13 @@ private:
 
         _changed = false;
         job = _currentJob;
-        job.pow.m_Nonce = ++_seed;
+        ++_seed;
+        if (job.pow.m_Nonce == Zero) {
+            job.pow.m_Nonce = _seed;
+        } else {
+            // the prefix assigned by the pool is kept, the rest is varied
+            job.pow.m_Nonce += uintBigFrom(static_cast<uint32_t>(_seed));
+        }
         return true;
     }
 
@@ -84,6 +84,14 @@ private:
         Block::PoW pow;
         pow.m_Difficulty.m_Packed = job.difficulty;
 
+        pow.m_Nonce = Zero;
+        if (!job.nonceprefix.empty()) {
+            bool ok = false;
+            std::vector<uint8_t> prefix = from_hex(job.nonceprefix, &ok);
+            if (!ok || prefix.size() >= Block::PoW::NonceType::nBytes) return false;
+            memcpy(pow.m_Nonce.m_pData, prefix.data(), prefix.size());
+        }
+
         LOG_INFO() << "new job here: id=" << job.id;
 
         if (!fill_job_info(job)) return false;
@@ -67,6 +67,7 @@ namespace {
     DEF_LABEL(nonce);
     DEF_LABEL(output);
     DEF_LABEL(height);
+    DEF_LABEL(nonceprefix);
 #undef DEF_LABEL
 
 ResultCode parse_json(const void* buf, size_t bufSize, json& o) {
@@ -112,6 +113,9 @@ template<> void parse(const json& o, Job& m) {
     m.input = o[l_input];
     m.difficulty = o[l_difficulty];
     m.height = o[l_height];
+
+    auto it = o.find(l_nonceprefix);
+    if (o.end() != it) m.nonceprefix = *it;
 }
 
 template<> void parse(const json& o, Solution& m) {
@@ -158,6 +162,7 @@ bool append_json_msg(io::FragmentWriter& packer, const Job& m) {
     o[l_input] = m.input;
     o[l_difficulty] = m.difficulty;
     o[l_height] = m.height;
+    if (!m.nonceprefix.empty()) o[l_nonceprefix] = m.nonceprefix;
     return serialize_json_msg(packer, o);
 }
 
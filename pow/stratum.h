@@ -93,8 +93,9 @@ struct Login : Message {
 /// Server posts a job
 struct Job : Message {
     std::string input;
-    uint32_t difficulty;
+    uint32_t difficulty; // the share difficulty, may be lower than the block's one
     Height height;
+    std::string nonceprefix; // optional, the leading bytes of the nonce reserved for this miner
 
     Job() = default;
 
@@ -36,9 +36,14 @@ namespace stratum {
 
 static const uint64_t SERVER_RESTART_TIMER = 1;
 static const uint64_t ACL_REFRESH_TIMER = 2;
+static const uint64_t RETARGET_TIMER = 3;
 static const unsigned SERVER_RESTART_INTERVAL = 1000;
 static const unsigned ACL_REFRESH_INTERVAL = 5000;
 
+// vardiff: retarget after this number of shares (or intervals), the difficulty changes by 16 times at most
+static const uint32_t RETARGET_SHARES = 8;
+static const uint32_t RETARGET_MAX_FACTOR = 16;
+
 static const char STS[] = "stratum server ";
 
 Server::Server(const IExternalPOW::Options& o, io::Reactor& reactor, io::Address listenTo) :
@@ -47,12 +52,27 @@ Server::Server(const IExternalPOW::Options& o, io::Reactor& reactor, io::Address
     _bindAddress(listenTo),
     _timers(reactor, 100),
     _fw(4096, 0, [this](io::SharedBuffer&& buf){ _currentMsg.push_back(buf); }),
-    _acl(o.apiKeysFile)
+    _acl(o.apiKeysFile),
+    _nextNoncePrefix(0)
 {
     _timers.set_timer(SERVER_RESTART_TIMER, 0, BIND_THIS_MEMFN(start_server));
     if (!o.apiKeysFile.empty()) {
         _timers.set_timer(ACL_REFRESH_TIMER, 0, BIND_THIS_MEMFN(refresh_acl));
     }
+    if (o.shareInterval_s) {
+        _timers.set_timer(RETARGET_TIMER, o.shareInterval_s * 1000, BIND_THIS_MEMFN(retarget_idle));
+    }
+
+    ECC::GenRandom(&_nextNoncePrefix, sizeof(_nextNoncePrefix));
+
+    _verifiedEvent = io::AsyncEvent::create(reactor, BIND_THIS_MEMFN(on_shares_verified));
+    _verifyJob = ThreadPool::Job::create(ThreadPool::Priority::Verification);
+}
+
+Server::~Server() {
+    // the pending tasks refer to this
+    _verifyJob->cancel();
+    _verifyJob->wait();
 }
 
 void Server::start_server() {
@@ -89,11 +109,21 @@ void Server::on_stream_accepted(io::TcpStream::Ptr&& newStream, io::ErrorCode er
     if (errorCode == 0) {
         auto peer = newStream->peer_address();
         LOG_DEBUG() << STS << "+peer " << peer;
-        _connections[peer.u64()] = std::make_unique<Connection>(
+        auto conn = std::make_unique<Connection>(
             *this,
             peer.u64(),
-            std::move(newStream)
+            std::move(newStream),
+            _nextNoncePrefix++
         );
+
+        // vardiff starts low and raises the difficulty quickly
+        conn->_shareDifficulty = _options.shareInterval_s ? Rules::get().DA.Difficulty0 : _recentJob.pow.m_Difficulty;
+        if (!_recentJob.id.empty()) {
+            conn->_shareDifficulty.m_Packed = std::min(conn->_shareDifficulty.m_Packed, _recentJob.pow.m_Difficulty.m_Packed);
+        }
+        conn->_prevShareDifficulty = conn->_shareDifficulty;
+        conn->_retargetStart_ms = local_timestamp_msec();
+        _connections[peer.u64()] = std::move(conn);
     } else {
         LOG_ERROR() << STS << io::error_str(errorCode) << ", restarting server in  " << SERVER_RESTART_INTERVAL << " msec";
         _timers.set_timer(SERVER_RESTART_TIMER, SERVER_RESTART_INTERVAL, BIND_THIS_MEMFN(start_server));
@@ -108,7 +138,7 @@ bool Server::on_login(uint64_t from, const Login& login) {
         conn->set_logged_in();
 
         // TODO send result first
-        return _connections[from]->send_msg(_recentJob.msg, true);
+        return _recentJob.id.empty() || send_job(*conn);
     } else {
         LOG_INFO() << STS << "peer login failed, key=" << login.api_key;
         Result res(login.id, login_failed);
@@ -123,17 +153,197 @@ bool Server::on_solution(uint64_t from, const Solution& sol) {
 
 	LOG_DEBUG() << TRACE(sol.nonce) << TRACE(sol.output);
 
-	_recentResult.id = sol.id;
-    sol.fill_pow(_recentResult.pow);
+    auto it = _connections.find(from);
+    assert(it != _connections.end());
+    Connection& conn = *it->second;
 
-    LOG_INFO() << STS << "solution to " << sol.id << " from " << io::Address::from_u64(from);
-	_recentResult.onBlockFound();
+    if (!conn.is_logged_in()) return false;
+
+    if (sol.id != _recentJob.id) {
+        send_result(conn, sol.id, solution_expired);
+        return true;
+    }
+
+    Share share;
+    share.from = from;
+    share.id = sol.id;
+    share.valid = false;
+
+    // cheap checks first, the solution itself is verified off-thread
+    if (!sol.fill_pow(share.pow) ||
+        memcmp(share.pow.m_Nonce.m_pData, conn._noncePrefix, Connection::NONCE_PREFIX_BYTES) ||
+        !conn._submitted.insert(sol.nonce).second)
+    {
+        LOG_INFO() << STS << "bad share to " << sol.id << " from " << io::Address::from_u64(from);
+        conn._stats.rejected++;
+        send_result(conn, sol.id, solution_rejected);
+        return true;
+    }
+
+    // a share sent before the miner got the retargeted job is still valid
+    share.shareDifficulty = std::min(conn._shareDifficulty.m_Packed, conn._prevShareDifficulty.m_Packed);
+    share.pow.m_Difficulty = share.shareDifficulty;
+
+    Merkle::Hash input = _recentJob.input;
+    ThreadPool::get().push(_verifyJob, [this, share, input]() mutable { verify_share(share, input); });
     return true;
 }
 
+void Server::verify_share(Share& share, const Merkle::Hash& input) {
+    share.valid = share.pow.IsValid(input.m_pData, Merkle::Hash::nBytes);
+
+    {
+        std::unique_lock<std::mutex> lock(_verifiedMutex);
+        _verified.push_back(std::move(share));
+    }
+    _verifiedEvent->post();
+}
+
+void Server::on_shares_verified() {
+    {
+        std::unique_lock<std::mutex> lock(_verifiedMutex);
+        _verifiedTmp.swap(_verified);
+    }
+
+    for (const Share& share : _verifiedTmp) {
+        on_share_verified(share);
+    }
+    _verifiedTmp.clear();
+}
+
+void Server::on_share_verified(const Share& share) {
+    auto it = _connections.find(share.from);
+    Connection* conn = (it == _connections.end()) ? nullptr : it->second.get();
+
+    if (!share.valid) {
+        LOG_INFO() << STS << "invalid share to " << share.id << " from " << io::Address::from_u64(share.from);
+        if (conn) {
+            conn->_stats.rejected++;
+            send_result(*conn, share.id, solution_rejected);
+        }
+        return;
+    }
+
+    // the block target is tested against the same hash as the share one
+    ECC::Hash::Value hv;
+    ECC::Hash::Processor() << Blob(share.pow.m_Indices.data(), Block::PoW::nSolutionBytes) >> hv;
+    bool isBlock = _recentJob.pow.m_Difficulty.IsTargetReached(hv) && (share.id == _recentJob.id);
+
+    if (conn) {
+        conn->_stats.accepted++;
+        if (isBlock) conn->_stats.blocks++;
+
+        conn->_shareWork += share.shareDifficulty;
+        conn->_lastShare_ms = local_timestamp_msec();
+        send_result(*conn, share.id, solution_accepted);
+        retarget(*conn, conn->_lastShare_ms);
+    }
+
+    if (isBlock) {
+        LOG_INFO() << STS << "solution to " << share.id << " from " << io::Address::from_u64(share.from);
+        _recentResult.id = share.id;
+        _recentResult.pow = share.pow;
+        _recentResult.pow.m_Difficulty = _recentJob.pow.m_Difficulty;
+        _recentResult.onBlockFound();
+    }
+}
+
+void Server::retarget(Connection& conn, uint64_t now_ms) {
+    if (!_options.shareInterval_s) return;
+
+    uint64_t window_ms = uint64_t(_options.shareInterval_s) * RETARGET_SHARES * 1000;
+    uint64_t elapsed_ms = now_ms - conn._retargetStart_ms;
+    if ((conn._stats.accepted % RETARGET_SHARES) && (elapsed_ms < window_ms)) return;
+
+    uint32_t elapsed_s = static_cast<uint32_t>(std::max<uint64_t>(elapsed_ms / 1000, 1));
+
+    Difficulty d;
+    if (conn._shareWork == Zero) {
+        // no shares at all, the difficulty is way too high
+        Difficulty::Raw cur;
+        conn._shareDifficulty.Unpack(cur);
+        d.Calculate(cur, 1, 1, RETARGET_MAX_FACTOR);
+    } else {
+        d.Calculate(conn._shareWork, 1, _options.shareInterval_s, elapsed_s);
+    }
+
+    // clamp
+    Difficulty::Raw lim;
+    conn._shareDifficulty.Unpack(lim);
+    Difficulty dMin, dMax;
+    dMin.Calculate(lim, 1, 1, RETARGET_MAX_FACTOR);
+    dMax.Calculate(lim, 1, RETARGET_MAX_FACTOR, 1);
+
+    d.m_Packed = std::max(d.m_Packed, dMin.m_Packed);
+    d.m_Packed = std::min(d.m_Packed, dMax.m_Packed);
+    d.m_Packed = std::max(d.m_Packed, Rules::get().DA.Difficulty0.m_Packed);
+    // shares above the block difficulty make no sense
+    d.m_Packed = std::min(d.m_Packed, _recentJob.pow.m_Difficulty.m_Packed);
+
+    conn._shareWork = Zero;
+    conn._retargetStart_ms = now_ms;
+
+    if (d.m_Packed == conn._shareDifficulty.m_Packed) return;
+
+    LOG_DEBUG() << STS << "share difficulty " << conn._shareDifficulty << " -> " << d << " for " << conn._stats.address;
+    conn._prevShareDifficulty = conn._shareDifficulty;
+    conn._shareDifficulty = d;
+
+    if (!_recentJob.id.empty() && conn.is_logged_in()) send_job(conn);
+}
+
+void Server::retarget_idle() {
+    uint64_t now_ms = local_timestamp_msec();
+    uint64_t window_ms = uint64_t(_options.shareInterval_s) * RETARGET_SHARES * 1000;
+
+    for (auto& p : _connections) {
+        if (_recentJob.id.empty()) break;
+
+        Connection& conn = *p.second;
+        if (now_ms - std::max(conn._lastShare_ms, conn._retargetStart_ms) >= window_ms) {
+            retarget(conn, now_ms);
+        }
+    }
+
+    _timers.set_timer(RETARGET_TIMER, _options.shareInterval_s * 1000, BIND_THIS_MEMFN(retarget_idle));
+}
+
+bool Server::send_job(Connection& conn) {
+    Job jobMsg(_recentJob.id, _recentJob.input, _recentJob.pow, _recentJob.height);
+    jobMsg.difficulty = conn._shareDifficulty.m_Packed;
+
+    char buf[Connection::NONCE_PREFIX_BYTES * 2 + 1];
+    jobMsg.nonceprefix = to_hex(buf, conn._noncePrefix, Connection::NONCE_PREFIX_BYTES);
+
+    append_json_msg(_fw, jobMsg);
+    bool ok = conn.send_msg(_currentMsg, true);
+    _currentMsg.clear();
+    return ok;
+}
+
+void Server::send_result(Connection& conn, const std::string& id, ResultCode code) {
+    Result res(id, code);
+    append_json_msg(_fw, res);
+    conn.send_msg(_currentMsg, true);
+    _currentMsg.clear();
+}
+
+void Server::get_miner_stats(std::vector<MinerStats>& out) const {
+    out.clear();
+    out.reserve(_connections.size());
+    for (const auto& p : _connections) {
+        out.push_back(p.second->_stats);
+        out.back().shareDifficulty = p.second->_shareDifficulty;
+    }
+}
+
 void Server::on_bad_peer(uint64_t from) {
-    LOG_INFO() << STS << "-peer " << io::Address::from_u64(from);
-    _connections.erase(from);
+    auto it = _connections.find(from);
+    if (it != _connections.end()) {
+        const MinerStats& s = it->second->_stats;
+        LOG_INFO() << STS << "-peer " << s.address << " accepted=" << s.accepted << " rejected=" << s.rejected << " blocks=" << s.blocks;
+        _connections.erase(it);
+    }
 }
 
 void Server::new_job(
@@ -145,17 +355,23 @@ void Server::new_job(
     const CancelCallback& /* cancelCallback */
 ) {
     _recentJob.id = id;
+    _recentJob.input = input;
+    _recentJob.pow = pow;
+    _recentJob.height = height;
     _recentResult.onBlockFound = callback;
 
     LOG_INFO() << STS << "new job " << id << " will be sent to " << _connections.size() << " connected peers";
 
-    Job jobMsg(id, input, pow, height);
-    append_json_msg(_fw, jobMsg);
-	_recentJob.msg.swap(_currentMsg);
-    _currentMsg.clear();
-
     for (auto& p : _connections) {
-        if (!p.second->send_msg(_recentJob.msg, true)) {
+        Connection& conn = *p.second;
+        conn._submitted.clear();
+        conn._prevShareDifficulty = conn._shareDifficulty;
+
+        if (!_options.shareInterval_s || (conn._shareDifficulty.m_Packed > pow.m_Difficulty.m_Packed)) {
+            conn._shareDifficulty = pow.m_Difficulty;
+        }
+
+        if (!send_job(conn)) {
             _deadConnections.push_back(p.first);
         }
     }
@@ -224,7 +440,7 @@ bool Server::AccessControl::check(const std::string& key) {
     return _keys.count(key) > 0;
 }
 
-Server::Connection::Connection(ConnectionToServer& owner, uint64_t id, io::TcpStream::Ptr&& newStream) :
+Server::Connection::Connection(ConnectionToServer& owner, uint64_t id, io::TcpStream::Ptr&& newStream, uint32_t noncePrefix) :
     _owner(owner),
     _id(id),
     _stream(std::move(newStream)),
@@ -233,6 +449,12 @@ Server::Connection::Connection(ConnectionToServer& owner, uint64_t id, io::TcpSt
 {
     _stream->enable_keepalive(2);
     _stream->enable_read(BIND_THIS_MEMFN(on_stream_data));
+
+    static_assert(sizeof(noncePrefix) == NONCE_PREFIX_BYTES, "");
+    memcpy(_noncePrefix, uintBigFrom(noncePrefix).m_pData, NONCE_PREFIX_BYTES);
+
+    _shareWork = Zero;
+    _stats.address = io::Address::from_u64(id);
 }
 
 bool Server::Connection::on_stream_data(io::ErrorCode errorCode, void* data, size_t size) {
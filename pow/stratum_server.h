@@ -18,8 +18,12 @@
 #include "p2p/line_protocol.h"
 #include "utility/io/tcpserver.h"
 #include "utility/io/coarsetimer.h"
+#include "utility/io/asyncevent.h"
+#include "utility/thread_pool.h"
 #include <set>
 #include <map>
+#include <mutex>
+#include <unordered_set>
 
 namespace beam { namespace stratum {
 
@@ -34,6 +38,17 @@ struct ConnectionToServer {
 class Server : public IExternalPOW, public ConnectionToServer {
 public:
     Server(const IExternalPOW::Options& o, io::Reactor& reactor, io::Address listenTo);
+    ~Server();
+
+    struct MinerStats {
+        io::Address address;
+        Difficulty shareDifficulty;
+        uint64_t accepted=0;
+        uint64_t rejected=0;
+        uint64_t blocks=0;
+    };
+
+    void get_miner_stats(std::vector<MinerStats>& out) const;
 
 private:
     class AccessControl {
@@ -52,12 +67,28 @@ private:
 
     class Connection : public ParserCallback {
     public:
-        Connection(ConnectionToServer& owner, uint64_t id, io::TcpStream::Ptr&& newStream);
+        Connection(ConnectionToServer& owner, uint64_t id, io::TcpStream::Ptr&& newStream, uint32_t noncePrefix);
 
         void set_logged_in() { _loggedIn = true; }
+        bool is_logged_in() const { return _loggedIn; }
 
         bool send_msg(const io::SerializedMsg& msg, bool onlyIfLoggedIn, bool shutdown=false);
 
+        // the leading bytes of the nonce, distinct per connection
+        static const uint32_t NONCE_PREFIX_BYTES = 4;
+        uint8_t _noncePrefix[NONCE_PREFIX_BYTES];
+
+        // vardiff. Shares at the previous difficulty are accepted till the next job
+        Difficulty _shareDifficulty;
+        Difficulty _prevShareDifficulty;
+        Difficulty::Raw _shareWork; // since the last retarget
+        uint64_t _retargetStart_ms=0;
+        uint64_t _lastShare_ms=0;
+
+        std::unordered_set<std::string> _submitted; // nonces of the current job
+
+        MinerStats _stats;
+
     private:
         bool on_message(const Login& login) override;
 
@@ -88,6 +119,25 @@ private:
     bool on_solution(uint64_t from, const Solution& solution) override;
     void on_bad_peer(uint64_t from) override;
 
+    // share verified in the thread pool
+    struct Share {
+        uint64_t from;
+        std::string id;
+        Block::PoW pow;
+        Difficulty shareDifficulty;
+        bool valid;
+    };
+
+    void verify_share(Share& share, const Merkle::Hash& input);
+    void on_shares_verified();
+    void on_share_verified(const Share& share);
+
+    bool send_job(Connection& conn);
+    void send_result(Connection& conn, const std::string& id, ResultCode code);
+
+    void retarget(Connection& conn, uint64_t now_ms);
+    void retarget_idle();
+
     void new_job(
         const std::string&,
         const Merkle::Hash& input, const Block::PoW& pow,
@@ -110,8 +160,10 @@ private:
     AccessControl _acl;
 
 	struct RecentJob {
-		io::SerializedMsg msg;
 		std::string id;
+		Merkle::Hash input;
+		Block::PoW pow;
+		Height height = 0;
 	} _recentJob;
 
 	struct RecentResult {
@@ -122,6 +174,13 @@ private:
 
     io::SerializedMsg _currentMsg;
     std::vector<uint64_t> _deadConnections;
+    uint32_t _nextNoncePrefix;
+
+    ThreadPool::Job::Ptr _verifyJob;
+    io::AsyncEvent::Ptr _verifiedEvent;
+    std::mutex _verifiedMutex;
+    std::vector<Share> _verified; // protected by _verifiedMutex
+    std::vector<Share> _verifiedTmp;
 };
 
 }} //namespaces
@@ -61,6 +61,51 @@ int json_creation_test() {
     return nErrors;
 }
 
+int job_nonceprefix_test() {
+    int nErrors = 0;
+
+    using namespace beam::stratum;
+
+    try {
+        io::SerializedMsg m;
+
+        LineProtocol lineProtocol(
+            [](void*, size_t) -> bool { return false; },
+            [&m](io::SharedBuffer&& fragment) { m.push_back(fragment); }
+        );
+
+        Block::PoW pow;
+        pow.m_Difficulty.m_Packed = 12345;
+        Merkle::Hash hash;
+        ECC::GenRandom(&hash.m_pData, 32);
+
+        Job jobOld("1", hash, pow, 100);
+        Job job("2", hash, pow, 100);
+        job.nonceprefix = "0a0b0c0d";
+
+        append_json_msg(lineProtocol, jobOld);
+        io::SharedBuffer buf = io::normalize(m);
+        Job x;
+        if (parse_json_msg(buf.data, buf.size, x) != 0 || !x.nonceprefix.empty() || x.difficulty != 12345) {
+            LOG_ERROR() << "job without nonce prefix mismatch";
+            ++nErrors;
+        }
+
+        m.clear();
+        append_json_msg(lineProtocol, job);
+        buf = io::normalize(m);
+        if (parse_json_msg(buf.data, buf.size, x) != 0 || x.nonceprefix != job.nonceprefix || x.id != job.id) {
+            LOG_ERROR() << "job with nonce prefix mismatch";
+            ++nErrors;
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR() << e.what();
+        nErrors = 255;
+    }
+
+    return nErrors;
+}
+
 void gen_examples() {
     using namespace beam::stratum;
 
@@ -115,6 +160,7 @@ int main() {
 #endif
     auto logger = Logger::create(logLevel, logLevel);
     auto res = json_creation_test();
+    res += job_nonceprefix_test();
     gen_examples();
     return res;
 }
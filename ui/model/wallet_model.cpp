@@ -95,6 +95,11 @@ void WalletModel::onAllUtxoChanged(const std::vector<beam::Coin>& utxos)
     emit allUtxoChanged(utxos);
 }
 
+void WalletModel::onUtxoChanged(beam::ChangeAction action, const std::vector<beam::Coin>& utxos)
+{
+    emit utxoChanged(action, utxos);
+}
+
 void WalletModel::onAddresses(bool own, const std::vector<beam::WalletAddress>& addrs)
 {
     emit adrresses(own, addrs);
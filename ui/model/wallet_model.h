@@ -38,6 +38,7 @@ signals:
     void syncProgressUpdated(int done, int total);
     void changeCalculated(beam::Amount change);
     void allUtxoChanged(const std::vector<beam::Coin>& utxos);
+    void utxoChanged(beam::ChangeAction, const std::vector<beam::Coin>& utxos);
     void adrresses(bool own, const std::vector<beam::WalletAddress>& addresses);
     void generatedNewAddress(const beam::WalletAddress& walletAddr);
     void changeCurrentWalletIDs(beam::WalletID senderID, beam::WalletID receiverID);
@@ -52,6 +53,7 @@ private:
     void onSyncProgressUpdated(int done, int total) override;
     void onChangeCalculated(beam::Amount change) override;
     void onAllUtxoChanged(const std::vector<beam::Coin>& utxos) override;
+    void onUtxoChanged(beam::ChangeAction, const std::vector<beam::Coin>& utxos) override;
     void onAddresses(bool own, const std::vector<beam::WalletAddress>& addrs) override;
     void onGeneratedNewAddress(const beam::WalletAddress& walletAddr) override;
     void onChangeCurrentWalletIDs(beam::WalletID senderID, beam::WalletID receiverID) override;
@@ -114,6 +114,8 @@ UtxoViewModel::UtxoViewModel()
 {
     connect(&_model, SIGNAL(allUtxoChanged(const std::vector<beam::Coin>&)),
         SLOT(onAllUtxoChanged(const std::vector<beam::Coin>&)));
+    connect(&_model, SIGNAL(utxoChanged(beam::ChangeAction, const std::vector<beam::Coin>&)),
+        SLOT(onUtxoChanged(beam::ChangeAction, const std::vector<beam::Coin>&)));
     connect(&_model, SIGNAL(walletStatus(const WalletStatus&)), SLOT(onStatus(const WalletStatus&)));
 
     _model.getAsync()->getUtxosStatus();
@@ -180,6 +182,44 @@ void UtxoViewModel::onAllUtxoChanged(const std::vector<beam::Coin>& utxos)
     sortUtxos();
 }
 
+void UtxoViewModel::onUtxoChanged(beam::ChangeAction action, const std::vector<beam::Coin>& utxos)
+{
+    if (action == beam::ChangeAction::Reset)
+    {
+        onAllUtxoChanged(utxos);
+        return;
+    }
+
+    // the replaced items are deleted after the list is re-read (see above)
+    QList<UtxoItem*> released;
+
+    for (const auto& utxo : utxos)
+    {
+        auto it = find_if(_allUtxos.begin(), _allUtxos.end(), [&utxo](const auto& item) {return item->get_ID() == utxo.m_ID; });
+
+        if (action == beam::ChangeAction::Removed)
+        {
+            if (it != _allUtxos.end())
+            {
+                released.push_back(*it);
+                _allUtxos.erase(it);
+            }
+        }
+        else if (it != _allUtxos.end())
+        {
+            released.push_back(*it);
+            *it = new UtxoItem(utxo);
+        }
+        else
+        {
+            _allUtxos.push_back(new UtxoItem(utxo));
+        }
+    }
+
+    sortUtxos();
+    qDeleteAll(released);
+}
+
 void UtxoViewModel::onStatus(const WalletStatus& status)
 {
     _currentHeight = QString::fromStdString(to_string(status.stateID.m_Height));
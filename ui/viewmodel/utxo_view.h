@@ -76,6 +76,7 @@ public:
     void setSortOrder(Qt::SortOrder);
 public slots:
     void onAllUtxoChanged(const std::vector<beam::Coin>& utxos);
+    void onUtxoChanged(beam::ChangeAction action, const std::vector<beam::Coin>& utxos);
     void onStatus(const WalletStatus& status);
 signals:
     void allUtxoChanged();
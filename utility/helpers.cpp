@@ -24,18 +24,21 @@
     #include <unistd.h>
     #include <termios.h>
     #include <sys/types.h>
+    #include <sys/resource.h>
     #include <sys/syscall.h>
     #include <sys/signal.h>
     #include <errno.h>
 #elif defined _WIN32
     #define WIN32_LEAN_AND_MEAN
     #include <windows.h>
+    #include <psapi.h>
 #else
     #include <signal.h>
     #include <pthread.h>
     #include <errno.h>
     #include <unistd.h>
     #include <termios.h>
+    #include <sys/resource.h>
 #endif
 
 using namespace std;
@@ -48,6 +51,22 @@ uint64_t local_timestamp_msec() {
     return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
 }
 
+uint64_t get_peak_rss_kb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+    return pmc.PeakWorkingSetSize >> 10;
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru)) return 0;
+#ifdef __APPLE__
+    return uint64_t(ru.ru_maxrss) >> 10; // in bytes on macOS
+#else
+    return uint64_t(ru.ru_maxrss);
+#endif
+#endif
+}
+
 size_t format_timestamp(char* buffer, size_t bufferCap, const char* formatStr, uint64_t timestamp, bool formatMsec) {
     time_t seconds = (time_t)(timestamp/1000);
     struct tm tm;
@@ -27,6 +27,9 @@ namespace beam {
 // returns local timestamp in millisecond since the Epoch
 uint64_t local_timestamp_msec();
 
+// returns peak resident set size of the process in KB, 0 if unavailable
+uint64_t get_peak_rss_kb();
+
 // formatStr as for strftime (e.g. "%Y-%m-%d.%T"), if decimals==true, then .### milliseconds added
 // returns bytes consumed
 size_t format_timestamp(char* buffer, size_t bufferCap, const char* formatStr, uint64_t timestamp, bool formatMsec=true);
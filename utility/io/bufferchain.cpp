@@ -84,6 +84,13 @@ void BufferChain::clear() {
     _index = 0;
 }
 
+void BufferChain::swap(BufferChain& other) {
+    _iovecs.swap(other._iovecs);
+    _guards.swap(other._guards);
+    std::swap(_totalSize, other._totalSize);
+    std::swap(_index, other._index);
+}
+
 void BufferChain::rebase() {
     assert(_index > 0);
 
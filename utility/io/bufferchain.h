@@ -55,6 +55,9 @@ public:
 
     void clear();
 
+    /// Exchanges the contents, along with the allocated capacity
+    void swap(BufferChain& other);
+
     bool empty() const {
         return _totalSize == 0;
     }
@@ -14,7 +14,11 @@
 
 #include "coarsetimer.h"
 #include "utility/helpers.h"
+#include <algorithm>
 #include <assert.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #ifndef LOG_VERBOSE_ENABLED
     #define LOG_VERBOSE_ENABLED 0
@@ -35,8 +39,12 @@ CoarseTimer::Ptr CoarseTimer::create(Reactor& reactor, unsigned resolutionMsec,
 CoarseTimer::CoarseTimer(unsigned resolutionMsec, const Callback& cb, Timer::Ptr&& timer) :
     _resolution(resolutionMsec),
     _callback(cb),
+    _index(16, NIL),
     _timer(std::move(timer))
 {
+    for (auto& s : _slots) s = NIL;
+    for (auto& b : _occupied) b = 0;
+
     auto result = _timer->start(unsigned(-1), false, BIND_THIS_MEMFN(on_timer));
     if (!result) IO_EXCEPTION(result.error());
 }
@@ -49,137 +57,345 @@ static inline uint64_t mono_clock() {
     return uv_hrtime() / 1000000; //nsec->msec, monotonic clock
 }
 
+static inline uint64_t hash_id(uint64_t x) {
+    // ids are often sequential or pointer-like, mix them (murmur3 finalizer)
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline uint64_t rotate_right(uint64_t x, unsigned n) {
+    n &= 63;
+    return n ? ((x >> n) | (x << (64 - n))) : x;
+}
+
+static inline unsigned lowest_bit(uint64_t x) {
+    assert(x);
+#ifdef _MSC_VER
+    unsigned long n;
+    _BitScanForward64(&n, x);
+    return unsigned(n);
+#else
+    return unsigned(__builtin_ctzll(x));
+#endif
+}
+
+// uv timers inaccurate intervals
+static constexpr unsigned TIMER_ACCURACY = 10;
+
 Result CoarseTimer::set_timer(unsigned intervalMsec, ID id) {
-    if (_validIds.count(id)) {
+    return set_timer_internal(intervalMsec, id, Timer::Callback());
+}
+
+Result CoarseTimer::set_timer(unsigned intervalMsec, ID id, Timer::Callback&& callback) {
+    if (!callback) return make_unexpected(EC_EINVAL);
+    return set_timer_internal(intervalMsec, id, std::move(callback));
+}
+
+Result CoarseTimer::set_timer_internal(unsigned intervalMsec, ID id, Timer::Callback&& callback) {
+    if (index_find(id) != NIL) {
         LOG_DEBUG() << "coarse timer: existing id " << std::hex << id << std::dec;
         return make_unexpected(EC_EINVAL);
     }
-    if (intervalMsec > 0 && intervalMsec < unsigned(-1) - _resolution) {
-        // if 0 then callback will fire on next event loop cycle, otherwise adjust to coarse resolution
-        intervalMsec -= ((intervalMsec + _resolution) % _resolution);
-    }
+
     Clock now = mono_clock();
-    Clock clock = now + intervalMsec;
-    _queue.insert({ clock, id });
-    _validIds.insert({ id, clock });
+    if (!_size && !_insideCallback) {
+        // the wheel is empty, no need to walk it from the old position
+        _current = now / _resolution;
+    }
+
+    uint32_t i = alloc_entry();
+    Entry& e = _entries[i];
+    e.id = id;
+    // round to the coarse resolution. If 0 then callback will fire on next event loop cycle
+    e.tick = (now + intervalMsec + _resolution / 2) / _resolution;
+    e.callback = std::move(callback);
+
+    Clock clock = e.tick * _resolution;
+
+    index_insert(i);
+    place(i);
+    _size++;
+
     if (!_insideCallback && _timerSetTo > clock) {
-        LOG_VERBOSE() << TRACE(intervalMsec);
-        _timerSetTo = clock;
-        return _timer->restart(intervalMsec, false);
+        return restart_timer(clock, now);
     }
     return Ok();
 }
 
 void CoarseTimer::cancel(ID id) {
-    _validIds.erase(id);
-    if (_validIds.empty()) cancel_all();
+    uint32_t i = index_find(id);
+    if (i == NIL) return;
+
+    unlink(i);
+    index_erase(id);
+    free_entry(i);
+    _size--;
+
+    if (!_size) cancel_all();
 }
 
 void CoarseTimer::cancel_all() {
-    _validIds.clear();
-    _queue.clear();
+    for (auto& s : _slots) s = NIL;
+    for (auto& b : _occupied) b = 0;
+
+    _entries.clear(); // keeps the capacity
+    _free = NIL;
+    _size = 0;
+    std::fill(_index.begin(), _index.end(), NIL);
+
     if (_timerSetTo != NEVER) {
         _timer->cancel();
         _timerSetTo = NEVER;
     }
 }
 
-// uv timers inaccurate intervals
-static constexpr unsigned TIMER_ACCURACY = 10;
+uint32_t CoarseTimer::alloc_entry() {
+    if (_free == NIL) {
+        _entries.emplace_back();
+        return uint32_t(_entries.size() - 1);
+    }
 
-void CoarseTimer::on_timer() {
-    LOG_VERBOSE() << TRACE(_queue.size());
+    uint32_t i = _free;
+    _free = _entries[i].next;
+    return i;
+}
 
-    if (_queue.empty()) return;
-    Clock now = mono_clock();
+void CoarseTimer::free_entry(uint32_t i) {
+    Entry& e = _entries[i];
+    e.callback = nullptr;
+    e.slot = NIL;
+    e.next = _free;
+    _free = i;
+}
 
-    _insideCallback = true;
+void CoarseTimer::link(uint32_t i, uint32_t slot) {
+    Entry& e = _entries[i];
+    e.slot = slot;
+    e.prev = NIL;
+    e.next = _slots[slot];
+
+    if (e.next != NIL) _entries[e.next].prev = i;
+    _slots[slot] = i;
+
+    if (slot < FIRING) _occupied[slot >> LEVEL_BITS] |= uint64_t(1) << (slot & (LEVEL_SIZE - 1));
+}
+
+void CoarseTimer::unlink(uint32_t i) {
+    Entry& e = _entries[i];
+
+    if (e.next != NIL) _entries[e.next].prev = e.prev;
+    if (e.prev != NIL) {
+        _entries[e.prev].next = e.next;
+    } else {
+        _slots[e.slot] = e.next;
+        if ((e.next == NIL) && (e.slot < FIRING)) _occupied[e.slot >> LEVEL_BITS] &= ~(uint64_t(1) << (e.slot & (LEVEL_SIZE - 1)));
+    }
+}
+
+void CoarseTimer::place(uint32_t i) {
+    // overdue ones fire at the next processed tick
+    Tick tick = std::max(_entries[i].tick, _current);
+    Tick diff = tick - _current;
+
+    unsigned level = 0;
+    while ((level + 1 < LEVELS) && (diff >> (LEVEL_BITS * (level + 1)))) level++;
+
+    if (level + 1 == LEVELS) {
+        // beyond the wheel range, will be re-placed when its slot is cascaded
+        Tick maxDiff = (Tick(1) << (LEVEL_BITS * LEVELS)) - 1;
+        if (diff > maxDiff) tick = _current + maxDiff;
+    }
+
+    unsigned idx = unsigned(tick >> (LEVEL_BITS * level)) & (LEVEL_SIZE - 1);
+    link(i, level * LEVEL_SIZE + idx);
+}
 
-    Clock clock = 0;
+void CoarseTimer::cascade(unsigned level, unsigned idx) {
+    uint32_t slot = level * LEVEL_SIZE + idx;
+    uint32_t i = _slots[slot];
 
-    while (!_queue.empty()) {
-        auto it = _queue.begin();
+    _slots[slot] = NIL;
+    _occupied[level] &= ~(uint64_t(1) << idx);
 
-        clock = it->first;
+    while (i != NIL) {
+        uint32_t next = _entries[i].next;
+        place(i);
+        i = next;
+    }
+}
 
-        LOG_VERBOSE() << TRACE(now) << TRACE(clock) << TRACE(_timerSetTo);
+CoarseTimer::Tick CoarseTimer::next_event() const {
+    Tick res = std::numeric_limits<Tick>::max();
 
-        if (clock > now + TIMER_ACCURACY) break;
-        ID id = it->second;
+    for (unsigned level = 0; level < LEVELS; level++) {
+        if (!_occupied[level]) continue;
+
+        // the slots of the higher levels are cascaded when the wheel reaches their start
+        unsigned shift = LEVEL_BITS * level;
+        Tick base = (_current + (Tick(1) << shift) - 1) >> shift;
+        unsigned d = lowest_bit(rotate_right(_occupied[level], unsigned(base) & (LEVEL_SIZE - 1)));
+
+        Tick tick = (base + d) << shift;
+        if (res > tick) res = tick;
+    }
+
+    return res;
+}
+
+void CoarseTimer::advance(Tick now) {
+    while (_size) {
+        // skip the empty slots
+        Tick tick = next_event();
+        if (tick > now) break;
+
+        _current = tick;
+        for (unsigned level = LEVELS - 1; level > 0; level--) {
+            unsigned shift = LEVEL_BITS * level;
+            if (!(tick & ((Tick(1) << shift) - 1))) cascade(level, unsigned(tick >> shift) & (LEVEL_SIZE - 1));
+        }
+
+        fire(tick);
+    }
+
+    if (_current <= now) _current = now + 1;
+}
+
+void CoarseTimer::fire(Tick tick) {
+    // move the due timers to the separate list, so that the callbacks may set or cancel any timer
+    uint32_t slot = unsigned(tick) & (LEVEL_SIZE - 1);
+    while (_slots[slot] != NIL) {
+        uint32_t i = _slots[slot];
+        unlink(i);
+        link(i, FIRING);
+    }
+
+    _current = tick + 1;
+
+    while (_slots[FIRING] != NIL) {
+        uint32_t i = _slots[FIRING];
+        ID id = _entries[i].id;
+        Timer::Callback callback = std::move(_entries[i].callback);
 
         LOG_VERBOSE() << TRACE(id);
 
-        // this helps calling set_timer(), cancel(), cancel_all() from inside callbacks
-        _queue.erase(it);
+        unlink(i);
+        index_erase(id);
+        free_entry(i);
+        _size--;
 
-        auto v = _validIds.find(id);
-        if (v != _validIds.end()) {
-            if (v->second == clock) {
-                _validIds.erase(v);
-                _callback(id);
-            }
+        if (callback) {
+            callback();
+        } else {
+            _callback(id);
         }
     }
+}
+
+Result CoarseTimer::rearm() {
+    if (!_size) {
+        cancel_all();
+        return Ok();
+    }
+
+    return restart_timer(next_event() * _resolution, mono_clock());
+}
+
+Result CoarseTimer::restart_timer(Clock clock, Clock now) {
+    unsigned intervalMsec = 0;
+    if (clock > now) intervalMsec = unsigned(std::min<Clock>(clock - now, unsigned(-1) - 1));
+    LOG_VERBOSE() << TRACE(intervalMsec);
+
+    // Timer::cancel() resets the callback, so set it again
+    Result res = _timer->start(intervalMsec, false, BIND_THIS_MEMFN(on_timer));
+    if (res) _timerSetTo = now + intervalMsec;
+    return res;
+}
+
+void CoarseTimer::on_timer() {
+    LOG_VERBOSE() << TRACE(_size);
 
+    _timerSetTo = NEVER;
+    if (!_size) return;
+
+    _insideCallback = true;
+    advance((mono_clock() + TIMER_ACCURACY) / _resolution);
     _insideCallback = false;
 
-    if (_queue.empty()) {
-        cancel_all();
-    } else {
-        now = mono_clock();
-        unsigned intervalMsec = 0;
-        if (clock > now) intervalMsec = unsigned(clock - now);
-        LOG_VERBOSE() << TRACE(intervalMsec);
-        Result res =_timer->restart(intervalMsec, false);
-        if (!res) {
-            LOG_ERROR() << "cannot restart timer, code=" << res.error();
-        } else {
-            _timerSetTo = now + intervalMsec;
+    Result res = rearm();
+    if (!res) {
+        LOG_ERROR() << "cannot restart timer, code=" << res.error();
+    }
+}
+
+uint32_t CoarseTimer::index_find(ID id) const {
+    size_t mask = _index.size() - 1;
+    for (size_t pos = hash_id(id) & mask; ; pos = (pos + 1) & mask) {
+        uint32_t i = _index[pos];
+        if ((i == NIL) || (_entries[i].id == id)) return i;
+    }
+}
+
+void CoarseTimer::index_insert(uint32_t i) {
+    if ((_size + 1) * 2 > _index.size()) index_grow();
+
+    size_t mask = _index.size() - 1;
+    size_t pos = hash_id(_entries[i].id) & mask;
+    while (_index[pos] != NIL) pos = (pos + 1) & mask;
+    _index[pos] = i;
+}
+
+void CoarseTimer::index_erase(ID id) {
+    size_t mask = _index.size() - 1;
+    size_t pos = hash_id(id) & mask;
+    while (_entries[_index[pos]].id != id) pos = (pos + 1) & mask;
+
+    // backward shift deletion, no tombstones
+    _index[pos] = NIL;
+    for (size_t j = (pos + 1) & mask; _index[j] != NIL; j = (j + 1) & mask) {
+        size_t home = hash_id(_entries[_index[j]].id) & mask;
+        bool bStays = (j > pos) ? ((home > pos) && (home <= j)) : ((home > pos) || (home <= j));
+        if (!bStays) {
+            _index[pos] = _index[j];
+            _index[j] = NIL;
+            pos = j;
         }
     }
 }
 
+void CoarseTimer::index_grow() {
+    std::vector<uint32_t> old(_index.size() * 2, NIL);
+    old.swap(_index);
+
+    size_t mask = _index.size() - 1;
+    for (uint32_t i : old) {
+        if (i == NIL) continue;
+        size_t pos = hash_id(_entries[i].id) & mask;
+        while (_index[pos] != NIL) pos = (pos + 1) & mask;
+        _index[pos] = i;
+    }
+}
+
 MultipleTimers::MultipleTimers(Reactor& reactor, unsigned resolutionMsec) :
-    _timer(CoarseTimer::create(reactor, resolutionMsec, BIND_THIS_MEMFN(on_timer)))
+    _timer(CoarseTimer::create(reactor, resolutionMsec, [](CoarseTimer::ID) {}))
 {}
 
 io::Result MultipleTimers::set_timer(CoarseTimer::ID id, unsigned intervalMsec, Timer::Callback&& callback) {
     if (!callback) return make_unexpected(io::EC_EINVAL);
 
-    auto it = _timerCallbacks.find(id);
-    if (it != _timerCallbacks.end()) {
-        _timer->cancel(id);
-        it->second = std::move(callback);
-    } else {
-        _timerCallbacks.insert( { id, std::move(callback) } );
-    }
-
-    io::Result res = _timer->set_timer(intervalMsec, id);
-    if (!res) {
-        _timerCallbacks.erase(id);
-    }
-
-    return res;
+    _timer->cancel(id);
+    return _timer->set_timer(intervalMsec, id, std::move(callback));
 }
 
 void MultipleTimers::cancel(CoarseTimer::ID id) {
-    if (_timerCallbacks.erase(id) != 0) {
-        _timer->cancel(id);
-    }
+    _timer->cancel(id);
 }
 
 void MultipleTimers::cancel_all() {
     _timer->cancel_all();
-    _timerCallbacks.clear();
-}
-
-void MultipleTimers::on_timer(CoarseTimer::ID id) {
-    auto it = _timerCallbacks.find(id);
-    if (it != _timerCallbacks.end()) {
-        Timer::Callback cb = std::move(it->second);
-        _timerCallbacks.erase(it);
-        cb();
-    }
 }
 
 }} //namespaces
@@ -20,7 +20,10 @@
 
 namespace beam { namespace io {
 
-/// Coarse timer helper, for connect/reconnect timers
+/// Coarse timer helper, for connect/reconnect timers.
+/// Hierarchical timer wheel: 4 levels of 64 slots, each level 64 times coarser than the previous one.
+/// Timers are kept in a slab and found by id via an open-addressing index, so set/cancel are O(1)
+/// and don't allocate once the capacity is reached
 class CoarseTimer {
 public:
     using ID = uint64_t;
@@ -33,12 +36,18 @@ public:
     /// Sets up timer callback for id, EC_EINVAL if id is already there or on timer setup failure
     Result set_timer(unsigned intervalMsec, ID id);
 
+    /// Same, the callback is called instead of the common one
+    Result set_timer(unsigned intervalMsec, ID id, Timer::Callback&& callback);
+
     /// Cancels callback for id
     void cancel(ID id);
 
     /// Cancels all callbacks
     void cancel_all();
 
+    /// Number of active timers
+    size_t size() const { return _size; }
+
     ~CoarseTimer();
 
 private:
@@ -51,6 +60,44 @@ private:
     using Clock = uint64_t;
     static constexpr Clock NEVER = std::numeric_limits<Clock>::max();
 
+    /// Wheel position, in resolution units
+    using Tick = uint64_t;
+
+    static constexpr unsigned LEVEL_BITS = 6;
+    static constexpr unsigned LEVEL_SIZE = 1 << LEVEL_BITS;
+    static constexpr unsigned LEVELS = 4;
+    /// The list of the timers being fired, kept as an extra slot so that they can be cancelled from the callbacks
+    static constexpr unsigned FIRING = LEVELS * LEVEL_SIZE;
+
+    static constexpr uint32_t NIL = std::numeric_limits<uint32_t>::max();
+
+    struct Entry {
+        ID id;
+        Tick tick;
+        uint32_t prev;
+        uint32_t next; // also links the free entries
+        uint32_t slot;
+        Timer::Callback callback;
+    };
+
+    Result set_timer_internal(unsigned intervalMsec, ID id, Timer::Callback&& callback);
+    uint32_t alloc_entry();
+    void free_entry(uint32_t i);
+    void link(uint32_t i, uint32_t slot);
+    void unlink(uint32_t i);
+    void place(uint32_t i);
+    void cascade(unsigned level, unsigned idx);
+    void fire(Tick tick);
+    Tick next_event() const;
+    void advance(Tick tick);
+    Result rearm();
+    Result restart_timer(Clock clock, Clock now);
+
+    uint32_t index_find(ID id) const;
+    void index_insert(uint32_t i);
+    void index_erase(ID id);
+    void index_grow();
+
     /// Flag that prevents from updating timer too often
     bool _insideCallback=false;
 
@@ -60,11 +107,20 @@ private:
     /// External callback
     Callback _callback;
 
-    /// Timers queue
-    std::multimap<Clock, ID> _queue;
+    /// Timers slab, and the head of the free list
+    std::vector<Entry> _entries;
+    uint32_t _free=NIL;
+    size_t _size=0;
 
-    /// Valid Ids
-    std::map<ID, Clock> _validIds;
+    /// Heads of the per-slot lists, and the non-empty slots bitmaps of each level
+    uint32_t _slots[FIRING + 1];
+    uint64_t _occupied[LEVELS];
+
+    /// Next tick to process (its cascades are pending)
+    Tick _current=0;
+
+    /// id -> entry, open addressing with linear probing. Size is a power of 2
+    std::vector<uint32_t> _index;
 
     /// Next time to wake
     Clock _timerSetTo=NEVER;
@@ -88,9 +144,6 @@ public:
     void cancel_all();
 
 private:
-    void on_timer(CoarseTimer::ID id);
-
-    std::map<CoarseTimer::ID, Timer::Callback> _timerCallbacks;
     io::CoarseTimer::Ptr _timer;
 };
 
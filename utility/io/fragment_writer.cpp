@@ -58,6 +58,15 @@ void* FragmentWriter::write(const void *ptr, size_t size) {
     return where;
 }
 
+char* FragmentWriter::reserve(size_t size) {
+    assert(size <= _fragmentSize);
+    if (size > _remaining) new_fragment();
+    char* where = _cursor;
+    _cursor += size;
+    _remaining -= size;
+    return where;
+}
+
 void FragmentWriter::finalize() {
     call();
     _msgBase = _cursor;
@@ -32,6 +32,10 @@ public:
     /// Writes new data into fragments. Invokes callback if current fragment gets full
     void* write(const void *ptr, size_t size);
 
+    /// Returns contiguous space for size bytes to be filled in place, starts a new fragment if needed.
+    /// size must not exceed the fragment size
+    char* reserve(size_t size);
+
     /// Finalizes current message: invokes callback
     void finalize();
 
@@ -0,0 +1,217 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "json_writer.h"
+#include "nlohmann/json.hpp"
+#include <charconv>
+#include <cmath>
+#include <string.h>
+
+namespace beam {
+
+namespace {
+
+    const char g_hexDigits[] = "0123456789abcdef";
+
+    /// Input bytes encoded per reserved chunk, small enough for any fragment size
+    const size_t HEX_CHUNK = 16;
+
+} //namespace
+
+void JsonWriter::separator() {
+    if (_needComma) put(',');
+    _needComma = true;
+}
+
+JsonWriter& JsonWriter::begin_object() {
+    separator();
+    put('{');
+    _needComma = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_object() {
+    put('}');
+    _needComma = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::begin_array() {
+    separator();
+    put('[');
+    _needComma = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_array() {
+    put(']');
+    _needComma = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(const char* k) {
+    separator();
+    size_t n = strlen(k);
+    char* p = _fw.reserve(n + 3);
+    *p++ = '"';
+    memcpy(p, k, n);
+    p += n;
+    *p++ = '"';
+    *p = ':';
+    _needComma = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::null() {
+    separator();
+    _fw.write("null", 4);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool b) {
+    separator();
+    if (b) _fw.write("true", 4);
+    else _fw.write("false", 5);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(double d) {
+    // same formatting as the DOM serializer
+    if (!std::isfinite(d)) return null();
+    separator();
+    char buf[64];
+    char* end = nlohmann::detail::to_chars(buf, buf + sizeof(buf), d);
+    _fw.write(buf, end - buf);
+    return *this;
+}
+
+JsonWriter& JsonWriter::write_int(int64_t v) {
+    separator();
+    char buf[24];
+    char* end = std::to_chars(buf, buf + sizeof(buf), v).ptr;
+    _fw.write(buf, end - buf);
+    return *this;
+}
+
+JsonWriter& JsonWriter::write_uint(uint64_t v) {
+    separator();
+    char buf[24];
+    char* end = std::to_chars(buf, buf + sizeof(buf), v).ptr;
+    _fw.write(buf, end - buf);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* s) {
+    return value(s, strlen(s));
+}
+
+JsonWriter& JsonWriter::value(const char* s, size_t size) {
+    separator();
+    put('"');
+
+    // plain runs are copied as is, only the special characters are escaped
+    const char* run = s;
+    const char* end = s + size;
+    for (const char* c = s; c != end; ++c) {
+        unsigned char ch = static_cast<unsigned char>(*c);
+        if (ch >= 0x20 && ch != '"' && ch != '\\') continue;
+
+        _fw.write(run, c - run);
+        run = c + 1;
+
+        char esc[7] = { '\\', 0 };
+        size_t n = 2;
+        switch (ch) {
+        case '"': esc[1] = '"'; break;
+        case '\\': esc[1] = '\\'; break;
+        case '\b': esc[1] = 'b'; break;
+        case '\f': esc[1] = 'f'; break;
+        case '\n': esc[1] = 'n'; break;
+        case '\r': esc[1] = 'r'; break;
+        case '\t': esc[1] = 't'; break;
+        default:
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = g_hexDigits[ch >> 4];
+            esc[5] = g_hexDigits[ch & 0xF];
+            n = 6;
+        }
+        _fw.write(esc, n);
+    }
+    _fw.write(run, end - run);
+
+    put('"');
+    return *this;
+}
+
+void JsonWriter::write_hex(const uint8_t* src, size_t size) {
+    while (size) {
+        size_t n = (size < HEX_CHUNK) ? size : HEX_CHUNK;
+        char* dst = _fw.reserve(2 * n);
+        for (size_t i = 0; i < n; i++) {
+            *dst++ = g_hexDigits[src[i] >> 4];
+            *dst++ = g_hexDigits[src[i] & 0xF];
+        }
+        src += n;
+        size -= n;
+    }
+}
+
+JsonWriter& JsonWriter::hex(const void* p, size_t size) {
+    separator();
+    put('"');
+    write_hex(static_cast<const uint8_t*>(p), size);
+    put('"');
+    return *this;
+}
+
+JsonWriter& JsonWriter::hex_number(const void* p, size_t size) {
+    const uint8_t* src = static_cast<const uint8_t*>(p);
+    while (size && !*src) {
+        ++src;
+        --size;
+    }
+
+    separator();
+    if (!size) {
+        _fw.write("\"0x0\"", 5);
+        return *this;
+    }
+
+    _fw.write("\"0x", 3);
+    if (!(*src >> 4)) {
+        // no leading zero nibble either
+        put(g_hexDigits[*src++]);
+        --size;
+    }
+    write_hex(src, size);
+    put('"');
+    return *this;
+}
+
+JsonWriter& JsonWriter::raw(const void* p, size_t size) {
+    separator();
+    _fw.write(p, size);
+    return *this;
+}
+
+void JsonWriter::finish() {
+    static const char eol = 10;
+    _fw.write(&eol, 1);
+    _fw.finalize();
+    _needComma = false;
+}
+
+} //namespace
@@ -0,0 +1,82 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "utility/io/fragment_writer.h"
+#include <string>
+#include <type_traits>
+
+namespace beam {
+
+/// Streaming (SAX-style) json writer, emits the text directly into fragments without building a DOM.
+/// Separators are placed automatically, the caller is responsible for the proper nesting
+class JsonWriter {
+public:
+    explicit JsonWriter(io::FragmentWriter& fw) : _fw(fw) {}
+
+    JsonWriter& begin_object();
+    JsonWriter& end_object();
+    JsonWriter& begin_array();
+    JsonWriter& end_array();
+
+    /// Keys are expected to be plain literals, they're not escaped
+    JsonWriter& key(const char* k);
+
+    JsonWriter& null();
+    JsonWriter& value(bool b);
+    JsonWriter& value(double d);
+    JsonWriter& value(const char* s);
+    JsonWriter& value(const char* s, size_t size);
+    JsonWriter& value(const std::string& s) { return value(s.data(), s.size()); }
+
+    /// Integers and enums (written as their numeric value)
+    template <typename T>
+    typename std::enable_if<(std::is_integral<T>::value || std::is_enum<T>::value) && !std::is_same<T, bool>::value, JsonWriter&>::type
+    value(T v) {
+        using U = typename std::conditional<std::is_enum<T>::value, std::underlying_type<T>, std::common_type<T>>::type::type;
+        return std::is_signed<U>::value ? write_int(static_cast<int64_t>(v)) : write_uint(static_cast<uint64_t>(v));
+    }
+
+    /// Blob as a hex string, encoded in place
+    JsonWriter& hex(const void* p, size_t size);
+
+    /// Big-endian number as a "0x..." string without leading zeros
+    JsonWriter& hex_number(const void* p, size_t size);
+
+    /// Already serialized json value
+    JsonWriter& raw(const void* p, size_t size);
+
+    template <typename T>
+    JsonWriter& field(const char* k, const T& v) {
+        key(k);
+        return value(v);
+    }
+
+    /// Terminates the message with eol (the line protocols rely on it) and flushes the fragments
+    void finish();
+
+private:
+    JsonWriter& write_int(int64_t v);
+    JsonWriter& write_uint(uint64_t v);
+    void separator();
+    void write_hex(const uint8_t* src, size_t size);
+    void put(char c) { _fw.write(&c, 1); }
+
+    io::FragmentWriter& _fw;
+
+    /// True if the next value or key is not the first in the current scope
+    bool _needComma=false;
+};
+
+} //namespace
@@ -22,6 +22,7 @@
 
 #ifndef WIN32
 #include <signal.h>
+#include <unistd.h>
 #endif // WIN32
 
 #ifndef LOG_VERBOSE_ENABLED
@@ -258,74 +259,158 @@ class PendingWrites {
 public:
     explicit PendingWrites(Reactor& r) :
         _reactor(r),
-        _writeRequestsPool(config().get_int("io.write_pool_size", 256, 0, 65536))
+        _chunkSize(config().get_int("io.write_pool_size", 256, 1, 65536))
     {}
 
     void cancel_all() {
-        for (uv_write_t* wr : _writeRequests) {
-            uv_handle_t* h = (uv_handle_t*)(wr->handle);
+        for (Request* x = _active; x; x = x->next) {
+            uv_handle_t* h = (uv_handle_t*)(x->req.handle);
             _reactor.async_close(h);
         }
     }
 
     ErrorCode async_write(Reactor::Object* o, BufferChain& unsent, const Reactor::OnDataWritten& cb) {
-        uv_write_t* req = _writeRequestsPool.alloc();
+        Request* x = alloc_request();
 
-        size_t nBytes = unsent.size();
-        auto p = _data.insert({ req, Ctx{ this, std::move(unsent), cb, nBytes } });
-
-        assert (p.second);
-        Ctx* ctx = &p.first->second;
-        req->data = ctx;
-
-        _writeRequests.insert(req);
+        // the buffers travel with the request, the stream gets the previously used (empty) chain back
+        x->unsent.swap(unsent);
+        x->cb = &cb;
+        x->nBytes = x->unsent.size();
 
         auto ec = (ErrorCode)uv_write(
-            req,
+            &x->req,
             (uv_stream_t*)o->_handle,
-            (uv_buf_t*)ctx->unsent.fragments(),
-            static_cast<unsigned>(ctx->unsent.num_fragments()),
+            (uv_buf_t*)x->unsent.fragments(),
+            static_cast<unsigned>(x->unsent.num_fragments()),
             [](uv_write_t* req, int errorCode) {
                 assert(req);
                 assert(req->data);
-                Ctx* ctx = reinterpret_cast<Ctx*>(req->data);
-                assert(ctx->self);
+                Request* x = reinterpret_cast<Request*>(req->data);
+                assert(x->self);
                 if (errorCode != UV_ECANCELED && req->handle != 0 && req->handle->data != 0) {
                     // object may be no longer alive if UV_CANCELED
-                    assert(ctx->cb);
-                    ctx->cb(ErrorCode(errorCode), errorCode == EC_OK ? ctx->nBytes : 0);
+                    assert(x->cb);
+                    (*x->cb)(ErrorCode(errorCode), errorCode == EC_OK ? x->nBytes : 0);
                 }
-                ctx->self->release_request(req);
+                x->self->release_request(x);
             }
         );
 
         if (ec != EC_OK) {
-            release_request(req);
-        } else {
-            unsent.clear();
+            unsent.swap(x->unsent);
+            release_request(x);
         }
 
         return ec;
     }
 
+    void schedule_flush(TcpStream* stream) {
+        if (_flushQueue.empty()) {
+            uv_prepare_start(&_reactor._flushBeforePoll, on_flush_before_poll);
+            uv_check_start(&_reactor._flushAfterPoll, on_flush_after_poll);
+        }
+        _flushQueue.push_back(stream);
+    }
+
+    void cancel_flush(TcpStream* stream) {
+        for (TcpStream*& s : _flushQueue) {
+            if (s == stream) s = 0;
+        }
+        for (TcpStream*& s : _flushing) {
+            if (s == stream) s = 0;
+        }
+    }
+
+    void flush_all() {
+        // streams may schedule more writes from within callbacks, they're handled on the next pass
+        _flushing.swap(_flushQueue);
+
+        Reactor::WriteStats& stats = _reactor._writeStats;
+        uint64_t nBytes0 = stats.bytes;
+        uint64_t nWrites0 = stats.writes;
+
+        for (size_t i = 0; i < _flushing.size(); i++) {
+            TcpStream* s = _flushing[i];
+            if (s) s->on_flush();
+        }
+        _flushing.clear();
+
+        if (stats.writes != nWrites0) {
+            stats.flushes++;
+            stats.lastWrites = static_cast<uint32_t>(stats.writes - nWrites0);
+            stats.lastBytes = stats.bytes - nBytes0;
+        }
+
+        if (_flushQueue.empty()) {
+            uv_prepare_stop(&_reactor._flushBeforePoll);
+            uv_check_stop(&_reactor._flushAfterPoll);
+        }
+    }
+
 private:
-    struct Ctx {
+    struct Request {
+        uv_write_t req;
         PendingWrites* self = 0;
         BufferChain unsent;
-        Reactor::OnDataWritten cb;
+        const Reactor::OnDataWritten* cb = 0;
         size_t nBytes = 0;
+        Request* prev = 0;
+        Request* next = 0;
     };
 
-    void release_request(uv_write_t* req) {
-        _data.erase(req);
-        _writeRequests.erase(req);
-        _writeRequestsPool.release(req);
+    static void on_flush_before_poll(uv_prepare_t* h) {
+        reinterpret_cast<Reactor*>(h->data)->_pendingWrites->flush_all();
+    }
+
+    static void on_flush_after_poll(uv_check_t* h) {
+        reinterpret_cast<Reactor*>(h->data)->_pendingWrites->flush_all();
+    }
+
+    Request* alloc_request() {
+        if (!_free) {
+            // requests are allocated in chunks and never freed till the reactor is destroyed
+            _chunks.emplace_back(new Request[_chunkSize]);
+            Request* pChunk = _chunks.back().get();
+            for (size_t i = 0; i < _chunkSize; i++) {
+                pChunk[i].next = _free;
+                _free = pChunk + i;
+            }
+        }
+
+        Request* x = _free;
+        _free = x->next;
+
+        x->self = this;
+        x->req.data = x;
+        x->prev = 0;
+        x->next = _active;
+        if (_active) _active->prev = x;
+        _active = x;
+
+        return x;
+    }
+
+    void release_request(Request* x) {
+        if (x->prev) x->prev->next = x->next;
+        else _active = x->next;
+        if (x->next) x->next->prev = x->prev;
+
+        // releases the buffers, but keeps the capacity for the next write
+        x->unsent.clear();
+        x->cb = 0;
+
+        x->prev = 0;
+        x->next = _free;
+        _free = x;
     }
 
     Reactor& _reactor;
-    MemPool<uv_write_t, sizeof(uv_write_t)> _writeRequestsPool;
-    std::unordered_set<uv_write_t*> _writeRequests;
-    std::unordered_map<uv_write_t*, Ctx> _data;
+    const size_t _chunkSize;
+    std::vector<std::unique_ptr<Request[]>> _chunks;
+    Request* _free = 0;
+    Request* _active = 0;
+    std::vector<TcpStream*> _flushQueue;
+    std::vector<TcpStream*> _flushing;
 };
 
 Reactor::Ptr Reactor::create() {
@@ -338,6 +423,8 @@ Reactor::Reactor() :
 {
     memset(&_loop,0,sizeof(uv_loop_t));
     memset(&_stopEvent, 0, sizeof(uv_async_t));
+    memset(&_flushBeforePoll, 0, sizeof(uv_prepare_t));
+    memset(&_flushAfterPoll, 0, sizeof(uv_check_t));
 
     _creatingInternalObjects=true;
 
@@ -357,6 +444,12 @@ Reactor::Reactor() :
     }
     _stopEvent.data = this;
 
+    // started only while there are streams to flush
+    uv_prepare_init(&_loop, &_flushBeforePoll);
+    _flushBeforePoll.data = this;
+    uv_check_init(&_loop, &_flushAfterPoll);
+    _flushAfterPoll.data = this;
+
     _pendingWrites = std::make_unique<PendingWrites>(*this);
     _tcpConnectors = std::make_unique<TcpConnectors>(*this);
     _tcpShutdowns = std::make_unique<TcpShutdowns>(*this);
@@ -381,6 +474,10 @@ Reactor::~Reactor() {
 
     if (_stopEvent.data)
         uv_close((uv_handle_t*)&_stopEvent, 0);
+    if (_flushBeforePoll.data)
+        uv_close((uv_handle_t*)&_flushBeforePoll, 0);
+    if (_flushAfterPoll.data)
+        uv_close((uv_handle_t*)&_flushAfterPoll, 0);
 
     // run one cycle to release all closing handles
     uv_run(&_loop, UV_RUN_NOWAIT);
@@ -518,6 +615,27 @@ ErrorCode Reactor::init_tcpstream(Object* o) {
     return init_object(errorCode, o, h);
 }
 
+Result Reactor::tcp_adopt(uv_os_sock_t sock, std::unique_ptr<TcpStream>& res) {
+    std::unique_ptr<TcpStream> stream(new TcpStream());
+
+    ErrorCode errorCode = init_tcpstream(stream.get());
+    if (!errorCode) {
+        errorCode = (ErrorCode)uv_tcp_open((uv_tcp_t*)stream->_handle, sock);
+        if (!errorCode) {
+            res = std::move(stream);
+            return Ok();
+        }
+        stream->async_close();
+    }
+
+#ifdef WIN32
+    closesocket(sock);
+#else // WIN32
+    close(sock);
+#endif // WIN32
+    return make_unexpected(errorCode);
+}
+
 TcpStream* Reactor::stream_connected(TcpStream* stream, uv_handle_t* h) {
     stream->_handle = h;
     stream->_handle->data = stream;
@@ -557,6 +675,14 @@ ErrorCode Reactor::async_write(Reactor::Object* o, BufferChain& unsent, const Re
     return _pendingWrites->async_write(o, unsent, cb);
 }
 
+void Reactor::schedule_flush(TcpStream* stream) {
+    _pendingWrites->schedule_flush(stream);
+}
+
+void Reactor::cancel_flush(TcpStream* stream) {
+    _pendingWrites->cancel_flush(stream);
+}
+
 Result Reactor::tcp_connect(
     Address address,
     uint64_t tag,
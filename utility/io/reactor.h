@@ -64,6 +64,9 @@ public:
 
     void cancel_tcp_connect(uint64_t tag);
 
+    /// Attaches the connected socket (see TcpStream::detach()) to this reactor. The socket is closed on failure
+    Result tcp_adopt(uv_os_sock_t sock, std::unique_ptr<TcpStream>& res);
+
 	class Scope
 	{
 		Reactor* m_pPrev;
@@ -75,6 +78,17 @@ public:
 	static Reactor& get_Current();
 	uv_loop_t& get_UvLoop() { return _loop; }
 
+    /// The stream writes requested during a loop iteration are coalesced, and issued at its end (one write per stream)
+    struct WriteStats {
+        uint64_t flushes=0; // passes that issued writes
+        uint64_t writes=0;
+        uint64_t bytes=0;
+        uint32_t lastWrites=0; // in the last pass
+        uint64_t lastBytes=0;
+    };
+
+    const WriteStats& write_stats() const { return _writeStats; }
+
 	class GracefulIntHandler
 	{
 		static Reactor* s_pAppReactor;
@@ -150,8 +164,14 @@ private:
     void shutdown_tcpstream(Object* o);
 
     using OnDataWritten = std::function<void(ErrorCode, size_t)>;
+
+    /// cb must outlive the request, unless the object is closed
     ErrorCode async_write(Reactor::Object* o, BufferChain& unsent, const OnDataWritten& cb);
 
+    /// Defers the stream write till the end of the current loop iteration
+    void schedule_flush(TcpStream* stream);
+    void cancel_flush(TcpStream* stream);
+
     ErrorCode init_object(ErrorCode errorCode, Object* o, uv_handle_t* h);
     void async_close(uv_handle_t*& handle);
 
@@ -163,6 +183,9 @@ private:
 
     uv_loop_t _loop;
     uv_async_t _stopEvent;
+    uv_prepare_t _flushBeforePoll;
+    uv_check_t _flushAfterPoll;
+    WriteStats _writeStats;
     MemPool<uv_handle_t, sizeof(Handles)> _handlePool;
     bool _creatingInternalObjects=false;
 
@@ -17,6 +17,11 @@
 #include "utility/helpers.h"
 #include <assert.h>
 
+#ifndef WIN32
+#include <errno.h>
+#include <unistd.h>
+#endif // WIN32
+
 #define LOG_DEBUG_ENABLED 0
 #include "utility/logger.h"
 
@@ -28,6 +33,8 @@ TcpStream::TcpStream() :
 
 TcpStream::~TcpStream() {
     disable_read();
+    // the data written before closing should not be lost
+    if (_flushPending) flush_now();
     if (_handle) _handle->data = 0;
 }
 
@@ -114,7 +121,7 @@ Result TcpStream::write(const BufferChain& fragments, bool flush) {
 void TcpStream::shutdown() {
     if (is_connected()) {
         disable_read();
-        do_write(true);
+        flush_now();
         _reactor->shutdown_tcpstream(this);
         assert(!_callback);
         assert(!is_connected());
@@ -127,20 +134,81 @@ void TcpStream::enable_keepalive(unsigned initialDelaySecs) {
     }
 }
 
+Result TcpStream::detach(uv_os_sock_t& sock) {
+    if (!is_connected()) return make_unexpected(EC_ENOTCONN);
+    assert(!_callback);
+
+#ifdef WIN32
+    (void) sock;
+    return make_unexpected(EC_ENOTSUP);
+#else // WIN32
+    uv_os_fd_t fd;
+    ErrorCode errorCode = (ErrorCode)uv_fileno((uv_handle_t*)_handle, &fd);
+    if (errorCode) return make_unexpected(errorCode);
+
+    int fd2 = dup(fd);
+    if (fd2 < 0) return make_unexpected(ErrorCode(uv_translate_sys_error(errno)));
+
+    // the original descriptor is closed with the handle, the duplicate keeps the connection alive
+    if (_flushPending) flush_now();
+    async_close();
+    sock = fd2;
+    return Ok();
+#endif // WIN32
+}
+
 Result TcpStream::do_write(bool flush) {
+    if (!flush) return Ok();
+
+    // writes of the same loop iteration are coalesced into a single request
     size_t nBytes = _writeBuffer.size();
-    if (flush && nBytes > 0) {
-        ErrorCode ec = _reactor->async_write(this, _writeBuffer, _onDataWritten);
-        if (ec != EC_OK) {
-            LOG_DEBUG() << __FUNCTION__ << " " << error_str(ec);
-            return make_unexpected(ec);
-        }
-        _state.unsent += nBytes;
+    assert(nBytes >= _unsentQueued);
+    _state.unsent += nBytes - _unsentQueued;
+    _unsentQueued = nBytes;
+
+    if (nBytes && !_flushPending) {
+        _flushPending = true;
+        _reactor->schedule_flush(this);
     }
-    if (flush) assert(_writeBuffer.empty());
     return Ok();
 }
 
+ErrorCode TcpStream::flush_now() {
+    if (_flushPending) {
+        _flushPending = false;
+        _reactor->cancel_flush(this);
+    }
+
+    size_t nBytes = _writeBuffer.size();
+    if (!nBytes) return EC_OK;
+    if (!is_connected()) return EC_ENOTCONN;
+
+    // not flushed explicitly
+    _state.unsent += nBytes - _unsentQueued;
+    _unsentQueued = 0;
+
+    ErrorCode ec = _reactor->async_write(this, _writeBuffer, _onDataWritten);
+    if (ec != EC_OK) {
+        LOG_DEBUG() << __FUNCTION__ << " " << error_str(ec);
+        assert(_state.unsent >= nBytes);
+        _state.unsent -= nBytes;
+        return ec;
+    }
+
+    assert(_writeBuffer.empty());
+    _reactor->_writeStats.writes++;
+    _reactor->_writeStats.bytes += nBytes;
+    return EC_OK;
+}
+
+void TcpStream::on_flush() {
+    _flushPending = false;
+    if (!is_connected()) return;
+
+    ErrorCode ec = flush_now();
+    if ((ec != EC_OK) && _callback) _callback(ec, 0, 0);
+}
+
 void TcpStream::on_data_written(ErrorCode errorCode, size_t n) {
     if (errorCode != EC_OK) {
         if (_callback) _callback(errorCode, 0, 0);
@@ -78,6 +78,10 @@ public:
     /// Enables tcp keep-alive
     void enable_keepalive(unsigned initialDelaySecs);
 
+    /// Hands the connection over to another reactor (see Reactor::tcp_adopt()): duplicates the socket and closes this stream.
+    /// Must be called before reading is enabled. Not supported on Windows
+    Result detach(uv_os_sock_t& sock);
+
 protected:
     TcpStream();
 
@@ -91,13 +95,20 @@ private:
     friend class SslServer;
     friend class Reactor;
     friend class TcpConnectors;
+    friend class PendingWrites;
 
     void alloc_read_buffer();
     void free_read_buffer();
 
-    // sends async write request if flush == true
+    // schedules the write request till the end of the loop iteration if flush == true
     Result do_write(bool flush);
 
+    // sends async write request immediately
+    ErrorCode flush_now();
+
+    // callback from reactor, at the end of the loop iteration
+    void on_flush();
+
     // callback from write request
     void on_data_written(ErrorCode errorCode, size_t n);
 
@@ -106,6 +117,8 @@ private:
     Callback _callback;
     State _state;
     Reactor::OnDataWritten _onDataWritten;
+    bool _flushPending=false;
+    size_t _unsentQueued=0; // already accounted in _state.unsent, but not sent to the socket yet
 };
 
 }} //namespaces
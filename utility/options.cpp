@@ -34,6 +34,7 @@ namespace beam
         const char* STRATUM_PORT = "stratum_port";
         const char* STRATUM_SECRETS_PATH = "stratum_secrets_path";
         const char* STRATUM_USE_TLS = "stratum_use_tls";
+        const char* STRATUM_SHARE_INTERVAL = "stratum_share_interval";
         const char* STORAGE = "storage";
         const char* WALLET_STORAGE = "wallet_path";
         const char* HISTORY = "history_dir";
@@ -41,6 +42,7 @@ namespace beam
         const char* IMPORT = "import";
         const char* MINING_THREADS = "mining_threads";
         const char* VERIFICATION_THREADS = "verification_threads";
+        const char* IO_THREADS = "io_threads";
         const char* NODE_PEER = "peer";
         const char* PASS = "pass";
         const char* AMOUNT = "amount";
@@ -54,6 +56,7 @@ namespace beam
         const char* TREASURY = "treasury";
         const char* TREASURY_BLOCK = "treasury_path";
         const char* RESYNC = "resync";
+        const char* DB_CHECK = "db_check";
         const char* CRASH = "crash";
         const char* INIT = "init";
         const char* RESTORE = "restore";
@@ -155,12 +158,15 @@ namespace beam
             (cli::MINER_TYPE, po::value<string>()->default_value("cpu"), "miner type [cpu|gpu]")
 #endif
             (cli::VERIFICATION_THREADS, po::value<int>()->default_value(-1), "number of threads for cryptographic verifications (0 = single thread, -1 = auto)")
+            (cli::IO_THREADS, po::value<uint32_t>()->default_value(0), "number of network I/O threads to spread the peer connections across (0 = serve them on the main thread)")
             (cli::NODE_PEER, po::value<vector<string>>()->multitoken(), "nodes to connect to")
             (cli::STRATUM_PORT, po::value<uint16_t>()->default_value(0), "port to start stratum server on")
             (cli::STRATUM_SECRETS_PATH, po::value<string>()->default_value("."), "path to stratum server api keys file, and tls certificate and private key")
             (cli::STRATUM_USE_TLS, po::value<bool>()->default_value(true), "enable TLS on startum server")
+            (cli::STRATUM_SHARE_INTERVAL, po::value<unsigned>()->default_value(10), "target time between the shares of a stratum miner, in seconds (0 = shares at the block difficulty)")
             (cli::IMPORT, po::value<Height>()->default_value(0), "Specify the blockchain height to import. The compressed history is asumed to be downloaded the the specified directory")
             (cli::RESYNC, po::value<bool>()->default_value(false), "Enforce re-synchronization (soft reset)")
+            (cli::DB_CHECK, po::value<string>()->default_value("auto"), "DB integrity check on startup [auto|quick|full|none] (auto = full only after an unclean shutdown)")
             (cli::BBS_ENABLE, po::value<bool>()->default_value(true), "Enable SBBS messaging")
             (cli::CRASH, po::value<int>()->default_value(0), "Induce crash (test proper handling)")
             (cli::KEY_OWNER, po::value<string>(), "Owner viewer key")
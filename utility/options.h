@@ -31,6 +31,7 @@ namespace beam
         extern const char* STRATUM_PORT;
         extern const char* STRATUM_SECRETS_PATH;
         extern const char* STRATUM_USE_TLS;
+        extern const char* STRATUM_SHARE_INTERVAL;
         extern const char* STORAGE;
         extern const char* WALLET_STORAGE;
         extern const char* HISTORY;
@@ -38,6 +39,7 @@ namespace beam
         extern const char* IMPORT;
         extern const char* MINING_THREADS;
         extern const char* VERIFICATION_THREADS;
+        extern const char* IO_THREADS;
         extern const char* NODE_PEER;
         extern const char* PASS;
         extern const char* AMOUNT;
@@ -53,6 +55,7 @@ namespace beam
         extern const char* TREASURY;
         extern const char* TREASURY_BLOCK;
         extern const char* RESYNC;
+        extern const char* DB_CHECK;
         extern const char* CRASH;
         extern const char* INIT;
         extern const char* RESTORE;
@@ -0,0 +1,235 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "thread_pool.h"
+#include <assert.h>
+
+namespace beam {
+
+namespace {
+
+struct CurrentWorker {
+    ThreadPool* _pool = nullptr;
+    size_t _index = 0;
+};
+
+thread_local CurrentWorker g_currentWorker;
+
+} // namespace
+
+ThreadPool::Job::Ptr ThreadPool::Job::create(Priority::Enum priority, const io::AsyncEvent::Ptr& onDone) {
+    return std::make_shared<Job>(priority, onDone);
+}
+
+ThreadPool::Job::Job(Priority::Enum priority, const io::AsyncEvent::Ptr& onDone) :
+    _priority(priority),
+    _onDone(onDone),
+    _pending(0),
+    _cancelled(false)
+{}
+
+void ThreadPool::Job::wait() {
+    while (_pending) {
+        Item item;
+        if (_pool && _pool->pop_job(item, *this)) {
+            execute(item);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cond.wait(lock, [this] { return !_pending; });
+    }
+}
+
+void ThreadPool::Job::on_task_done() {
+    assert(_pending);
+    if (--_pending) return;
+
+    {
+        // the waiter checks the counter under this lock, make sure it won't miss the notification
+        std::unique_lock<std::mutex> lock(_mutex);
+    }
+    _cond.notify_all();
+
+    if (_onDone) _onDone->post();
+}
+
+ThreadPool& ThreadPool::get() {
+    static ThreadPool s_pool;
+    return s_pool;
+}
+
+ThreadPool::ThreadPool(uint32_t nThreads) :
+    _nextWorker(0)
+{
+    if (!nThreads) {
+        nThreads = std::thread::hardware_concurrency();
+        if (!nThreads) nThreads = 1;
+    }
+
+    for (size_t i = 0; i < Priority::count; i++) {
+        _queued[i] = 0;
+    }
+
+    _workers.resize(nThreads);
+    for (auto& w : _workers) {
+        w.reset(new Worker);
+    }
+
+    for (size_t i = 0; i < _workers.size(); i++) {
+        _workers[i]->_thread = std::thread(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock(_idleMutex);
+        _stop = true;
+    }
+    _idleCond.notify_all();
+
+    for (auto& w : _workers) {
+        if (w->_thread.joinable()) w->_thread.join();
+    }
+}
+
+void ThreadPool::push(const Job::Ptr& job, Task&& task) {
+    push(Item{ std::move(task), job }, true);
+}
+
+void ThreadPool::yield(const Job::Ptr& job, Task&& task) {
+    push(Item{ std::move(task), job }, false);
+}
+
+void ThreadPool::push(Item&& item, bool bBack) {
+    assert(item._job);
+    Job& job = *item._job;
+    assert(!job._pool || (job._pool == this));
+    job._pool = this;
+    job._pending++;
+
+    size_t iPriority = job.get_priority();
+
+    size_t iWorker = (g_currentWorker._pool == this) ?
+        g_currentWorker._index :
+        (_nextWorker++ % _workers.size());
+
+    {
+        Worker& w = *_workers[iWorker];
+        std::unique_lock<std::mutex> lock(w._mutex);
+
+        // the owner takes the newest tasks (from the back), so the front is the last in line for it
+        if (bBack)
+            w._queues[iPriority].push_back(std::move(item));
+        else
+            w._queues[iPriority].push_front(std::move(item));
+
+        _queued[iPriority]++;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(_idleMutex);
+    }
+    _idleCond.notify_one();
+}
+
+bool ThreadPool::should_yield(Priority::Enum priority, bool bInclusive) const {
+    size_t n = bInclusive ? (priority + 1) : priority;
+    for (size_t i = 0; i < n; i++) {
+        if (_queued[i]) return true;
+    }
+    return false;
+}
+
+bool ThreadPool::has_queued() const {
+    return should_yield(Priority::Mining, true);
+}
+
+bool ThreadPool::pop_from(Item& item, Worker& w, size_t iPriority, bool bBack) {
+    std::unique_lock<std::mutex> lock(w._mutex);
+
+    std::deque<Item>& q = w._queues[iPriority];
+    if (q.empty()) return false;
+
+    if (bBack) {
+        item = std::move(q.back());
+        q.pop_back();
+    } else {
+        item = std::move(q.front());
+        q.pop_front();
+    }
+
+    _queued[iPriority]--;
+    return true;
+}
+
+bool ThreadPool::pop(Item& item, size_t iSelf) {
+    for (size_t iPriority = 0; iPriority < Priority::count; iPriority++) {
+        if (!_queued[iPriority]) continue;
+
+        if (pop_from(item, *_workers[iSelf], iPriority, true)) return true;
+
+        for (size_t i = 1; i < _workers.size(); i++) {
+            if (pop_from(item, *_workers[(iSelf + i) % _workers.size()], iPriority, false)) return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::pop_job(Item& item, const Job& job) {
+    size_t iPriority = job.get_priority();
+
+    for (auto& pW : _workers) {
+        std::unique_lock<std::mutex> lock(pW->_mutex);
+
+        std::deque<Item>& q = pW->_queues[iPriority];
+        for (auto it = q.begin(); q.end() != it; ++it) {
+            if (it->_job.get() == &job) {
+                item = std::move(*it);
+                q.erase(it);
+                _queued[iPriority]--;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(Item& item) {
+    Job::Ptr job = std::move(item._job);
+
+    if (!job->is_cancelled()) item._task();
+    item._task = nullptr; // release whatever the task holds before reporting
+
+    job->on_task_done();
+}
+
+void ThreadPool::run(size_t iSelf) {
+    g_currentWorker._pool = this;
+    g_currentWorker._index = iSelf;
+
+    while (true) {
+        Item item;
+        if (pop(item, iSelf)) {
+            execute(item);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_idleMutex);
+        if (_stop) break;
+        if (!has_queued()) _idleCond.wait(lock);
+    }
+}
+
+} // namespace beam
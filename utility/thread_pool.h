@@ -0,0 +1,127 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "io/asyncevent.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace beam {
+
+/// Process-wide pool of worker threads, shared by all the CPU-bound subsystems.
+/// Each worker owns a queue per priority. Tasks pushed by a worker go to its own queue and are taken newest-first,
+/// idle workers steal the oldest tasks from the others. Higher priority tasks are always taken first.
+/// Long-running tasks should poll should_yield() and re-schedule themselves via yield().
+class ThreadPool {
+public:
+    struct Priority {
+        enum Enum {
+            Verification,
+            Compression,
+            Mining,
+            count
+        };
+    };
+
+    using Task = std::function<void()>;
+
+    /// Group of tasks that can be waited for or cancelled as a whole
+    class Job {
+    public:
+        using Ptr = std::shared_ptr<Job>;
+
+        /// onDone (optional) is posted each time the last pending task of the job is finished
+        static Ptr create(Priority::Enum priority, const io::AsyncEvent::Ptr& onDone = io::AsyncEvent::Ptr());
+
+        Priority::Enum get_priority() const { return _priority; }
+
+        /// Tasks that haven't started yet are dropped. Running tasks may poll is_cancelled()
+        void cancel() { _cancelled = true; }
+        bool is_cancelled() const { return _cancelled; }
+
+        bool is_done() const { return !_pending; }
+
+        /// Blocks until all the tasks are finished. Meanwhile the calling thread executes the queued tasks of this job
+        void wait();
+
+        Job(Priority::Enum priority, const io::AsyncEvent::Ptr& onDone);
+
+    private:
+        friend class ThreadPool;
+
+        void on_task_done();
+
+        const Priority::Enum _priority;
+        io::AsyncEvent::Ptr _onDone;
+        ThreadPool* _pool = nullptr;
+        std::atomic<uint32_t> _pending;
+        std::atomic<bool> _cancelled;
+        std::mutex _mutex;
+        std::condition_variable _cond;
+    };
+
+    /// The shared instance, created on first use with hardware_concurrency workers
+    static ThreadPool& get();
+
+    /// nThreads == 0 means hardware concurrency
+    explicit ThreadPool(uint32_t nThreads = 0);
+    ~ThreadPool();
+
+    uint32_t get_threads() const { return static_cast<uint32_t>(_workers.size()); }
+
+    /// Schedules a task. If called from a worker of this pool - the task goes to its own queue
+    void push(const Job::Ptr& job, Task&& task);
+
+    /// Re-schedules a task behind all the others queued, for tasks that yield their worker
+    void yield(const Job::Ptr& job, Task&& task);
+
+    /// True if tasks of higher priority (or the same, if bInclusive) are waiting
+    bool should_yield(Priority::Enum priority, bool bInclusive = false) const;
+
+private:
+    struct Item {
+        Task _task;
+        Job::Ptr _job;
+    };
+
+    struct Worker {
+        std::mutex _mutex;
+        std::deque<Item> _queues[Priority::count];
+        std::thread _thread;
+    };
+
+    void push(Item&&, bool bBack);
+    bool pop(Item&, size_t iSelf);
+    bool pop_from(Item&, Worker&, size_t iPriority, bool bBack);
+    bool pop_job(Item&, const Job&);
+    bool has_queued() const;
+    void run(size_t iSelf);
+    static void execute(Item&);
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<uint32_t> _queued[Priority::count];
+    std::atomic<size_t> _nextWorker;
+
+    std::mutex _idleMutex;
+    std::condition_variable _idleCond;
+    bool _stop = false;
+};
+
+} // namespace beam
@@ -0,0 +1,136 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utility/io/json_writer.h"
+#include "utility/helpers.h"
+#include "nlohmann/json.hpp"
+#include <iostream>
+
+using namespace std;
+using namespace beam;
+using json = nlohmann::json;
+
+namespace {
+
+int g_failures = 0;
+
+void check(bool b, const char* sz) {
+    if (!b) {
+        cout << "Failed: " << sz << endl;
+        g_failures++;
+    }
+}
+
+#define CHECK(x) check(x, #x)
+
+/// Collects the fragments into a string
+struct Collector {
+    string _text;
+    size_t _fragments = 0;
+    io::FragmentWriter _fw;
+
+    explicit Collector(size_t fragmentSize) :
+        _fw(fragmentSize, 0, [this](io::SharedBuffer&& f) {
+            _text.append((const char*)f.data, f.size);
+            _fragments++;
+        })
+    {}
+};
+
+enum class Status { Pending = 3 };
+
+void test_same_as_dom() {
+    uint8_t hash[32];
+    for (size_t i = 0; i < sizeof(hash); i++) hash[i] = uint8_t(i * 37);
+
+    json dom = json{
+        { "found", true },
+        { "height", 1234567890123ULL },
+        { "delta", -42 },
+        { "difficulty", 1234.5678 },
+        { "comment", string("quote\" slash\\ tab\t nl\n ctl\x01 utf8 \xc3\xa9") },
+        { "status", 3 },
+        { "hash", to_hex(hash, sizeof(hash)) },
+        { "nothing", nullptr },
+        { "items", json::array({ json{ { "a", 1 } }, json{ { "a", 2 } } }) },
+        { "empty", json::array() },
+    };
+
+    // small fragments, so that many values are split between them
+    Collector c(40);
+    JsonWriter w(c._fw);
+    w.begin_object()
+        .field("found", true)
+        .field("height", 1234567890123ULL)
+        .field("delta", -42)
+        .field("difficulty", 1234.5678)
+        .field("comment", string("quote\" slash\\ tab\t nl\n ctl\x01 utf8 \xc3\xa9"))
+        .field("status", Status::Pending)
+        .key("hash").hex(hash, sizeof(hash))
+        .key("nothing").null()
+        .key("items").begin_array()
+            .begin_object().field("a", 1).end_object()
+            .begin_object().field("a", 2).end_object()
+        .end_array()
+        .key("empty").begin_array().end_array()
+        .end_object();
+    w.finish();
+
+    CHECK(c._fragments > 1);
+    CHECK(c._text.back() == '\n');
+    CHECK(json::parse(c._text) == dom);
+
+    // the DOM sorts the keys, so the text can be compared value by value only
+    CHECK(c._text.find("\"difficulty\":" + dom["difficulty"].dump() + ",") != string::npos);
+    CHECK(c._text.find("\"comment\":" + dom["comment"].dump() + ",") != string::npos);
+}
+
+void test_hex_number() {
+    auto f = [](const vector<uint8_t>& v) {
+        Collector c(4096);
+        JsonWriter w(c._fw);
+        w.hex_number(v.data(), v.size());
+        w.finish();
+        return c._text;
+    };
+
+    CHECK(f({ 0, 0, 0 }) == "\"0x0\"\n");
+    CHECK(f({ 0, 0x0a, 0xbc }) == "\"0xabc\"\n");
+    CHECK(f({ 0, 0x1a, 0x00 }) == "\"0x1a00\"\n");
+    CHECK(f(vector<uint8_t>(300, 0xff)) == "\"0x" + string(600, 'f') + "\"\n");
+}
+
+void test_messages() {
+    // a writer is reused for consecutive messages
+    Collector c(4096);
+    JsonWriter w(c._fw);
+
+    w.begin_object().field("id", 1).end_object();
+    w.finish();
+    w.begin_array().raw("{}", 2).value("x").end_array();
+    w.finish();
+
+    CHECK(c._text == "{\"id\":1}\n[{},\"x\"]\n");
+    CHECK(c._fragments == 2);
+}
+
+} // namespace
+
+int main() {
+    test_same_as_dom();
+    test_hex_number();
+    test_messages();
+
+    return g_failures ? -1 : 0;
+}
@@ -78,6 +78,78 @@ void tcpserver_test() {
     }
 }
 
+TcpStream::Ptr serverStream;
+TcpStream::Ptr clientStream;
+size_t bytesReceived=0;
+bool writesCoalesced=false;
+
+static const size_t MSG_SIZE=100;
+static const size_t MSG_COUNT=3;
+
+void tcpserver_coalescing_test() {
+    try {
+        reactor = Reactor::create();
+        TcpServer::Ptr server = TcpServer::create(
+            *reactor,
+            Address(serverIp, serverPort+1),
+            [](TcpStream::Ptr&& newStream, int errorCode) {
+                if (errorCode != 0) {
+                    LOG_ERROR() << "Error code=" << errorCode;
+                    reactor->stop();
+                    return;
+                }
+                serverStream = std::move(newStream);
+                serverStream->enable_read([](ErrorCode what, void*, size_t size) {
+                    if (what != EC_OK) {
+                        reactor->stop();
+                        return false;
+                    }
+                    bytesReceived += size;
+                    if (bytesReceived == MSG_SIZE * MSG_COUNT) reactor->stop();
+                    return true;
+                });
+            }
+        );
+
+        reactor->tcp_connect(
+            Address(serverIp, serverPort+1),
+            2,
+            [](uint64_t, TcpStream::Ptr&& newStream, ErrorCode errorCode) {
+                if (errorCode != EC_OK) {
+                    LOG_ERROR() << "Error code=" << errorCode;
+                    reactor->stop();
+                    return;
+                }
+                clientStream = std::move(newStream);
+
+                // flushed writes of the same loop iteration should go out as a single request
+                static const char msg[MSG_SIZE] = { 0 };
+                for (size_t i = 0; i < MSG_COUNT; i++) {
+                    clientStream->write(msg, MSG_SIZE);
+                }
+            },
+            1000,
+            false,
+            Address(clientIp, 0)
+        );
+
+        timer = Timer::create(*reactor);
+        timer->start(5000, false, []() { reactor->stop(); });
+
+        reactor->run();
+
+        const Reactor::WriteStats& stats = reactor->write_stats();
+        writesCoalesced = (stats.writes == 1) && (stats.bytes == MSG_SIZE * MSG_COUNT);
+        LOG_DEBUG() << TRACE(bytesReceived) << TRACE(stats.writes) << TRACE(stats.bytes);
+
+        clientStream.reset();
+        serverStream.reset();
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR() << e.what();
+    }
+}
+
 int main() {
     int logLevel = LOG_LEVEL_DEBUG;
 #if LOG_VERBOSE_ENABLED
@@ -85,7 +157,8 @@ int main() {
 #endif
     auto logger = Logger::create(logLevel, logLevel);
     tcpserver_test();
-    return wasAccepted ? 0 : 1;
+    tcpserver_coalescing_test();
+    return (wasAccepted && writesCoalesced && (bytesReceived == MSG_SIZE * MSG_COUNT)) ? 0 : 1;
 }
 
 
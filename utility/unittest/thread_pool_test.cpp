@@ -0,0 +1,199 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utility/thread_pool.h"
+#include <iostream>
+#include <assert.h>
+
+using namespace std;
+using namespace beam;
+
+namespace {
+
+int g_failures = 0;
+
+void check(bool b, const char* sz) {
+    if (!b) {
+        cout << "Failed: " << sz << endl;
+        g_failures++;
+    }
+}
+
+#define CHECK(x) check(x, #x)
+
+/// Occupies a worker until released
+struct Blocker {
+    mutex _mutex;
+    condition_variable _cond;
+    bool _started = false;
+    bool _released = false;
+
+    void run() {
+        unique_lock<mutex> lock(_mutex);
+        _started = true;
+        _cond.notify_all();
+        _cond.wait(lock, [this] { return _released; });
+    }
+
+    void wait_started() {
+        unique_lock<mutex> lock(_mutex);
+        _cond.wait(lock, [this] { return _started; });
+    }
+
+    void release() {
+        {
+            unique_lock<mutex> lock(_mutex);
+            _released = true;
+        }
+        _cond.notify_all();
+    }
+};
+
+void test_basic() {
+    ThreadPool pool(4);
+
+    atomic<uint32_t> n(0);
+    auto job = ThreadPool::Job::create(ThreadPool::Priority::Verification);
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        pool.push(job, [&n]() { n++; });
+    }
+
+    job->wait();
+    CHECK(job->is_done());
+    CHECK(n == 1000);
+}
+
+void test_nested() {
+    ThreadPool pool(4);
+
+    atomic<uint32_t> n(0);
+    auto job = ThreadPool::Job::create(ThreadPool::Priority::Verification);
+
+    // tasks spawn subtasks on their own worker, the idle ones should steal them
+    for (uint32_t i = 0; i < 10; i++) {
+        pool.push(job, [&pool, &n, job]() {
+            for (uint32_t j = 0; j < 100; j++) {
+                pool.push(job, [&n]() { n++; });
+            }
+        });
+    }
+
+    job->wait();
+    CHECK(n == 1000);
+}
+
+void test_cancel() {
+    ThreadPool pool(1);
+
+    Blocker blocker;
+    auto jobBlocker = ThreadPool::Job::create(ThreadPool::Priority::Verification);
+    pool.push(jobBlocker, [&blocker]() { blocker.run(); });
+    blocker.wait_started();
+
+    atomic<uint32_t> n(0);
+    auto job = ThreadPool::Job::create(ThreadPool::Priority::Verification);
+    for (uint32_t i = 0; i < 100; i++) {
+        pool.push(job, [&n]() { n++; });
+    }
+
+    job->cancel();
+    blocker.release();
+
+    job->wait();
+    jobBlocker->wait();
+    CHECK(n == 0);
+}
+
+void test_priority() {
+    ThreadPool pool(1);
+
+    Blocker blocker;
+    auto jobBlocker = ThreadPool::Job::create(ThreadPool::Priority::Mining);
+    pool.push(jobBlocker, [&blocker]() { blocker.run(); });
+    blocker.wait_started();
+
+    mutex mx;
+    vector<ThreadPool::Priority::Enum> vOrder;
+
+    ThreadPool::Job::Ptr pJobs[ThreadPool::Priority::count];
+    for (int i = ThreadPool::Priority::count; i--; ) {
+        pJobs[i] = ThreadPool::Job::create(static_cast<ThreadPool::Priority::Enum>(i));
+    }
+
+    CHECK(!pool.should_yield(ThreadPool::Priority::Mining, true));
+
+    // push in reverse order of priority
+    for (int i = ThreadPool::Priority::count; i--; ) {
+        for (uint32_t j = 0; j < 5; j++) {
+            ThreadPool::Priority::Enum p = static_cast<ThreadPool::Priority::Enum>(i);
+            pool.push(pJobs[i], [&mx, &vOrder, p]() {
+                unique_lock<mutex> lock(mx);
+                vOrder.push_back(p);
+            });
+        }
+    }
+
+    CHECK(pool.should_yield(ThreadPool::Priority::Mining));
+    CHECK(pool.should_yield(ThreadPool::Priority::Compression));
+    CHECK(!pool.should_yield(ThreadPool::Priority::Verification));
+    CHECK(pool.should_yield(ThreadPool::Priority::Verification, true));
+
+    blocker.release();
+    for (auto& pJob : pJobs) {
+        pJob->wait();
+    }
+    jobBlocker->wait();
+
+    CHECK(vOrder.size() == 15);
+    for (size_t i = 1; i < vOrder.size(); i++) {
+        CHECK(vOrder[i - 1] <= vOrder[i]);
+    }
+}
+
+void test_completion_event() {
+    io::Reactor::Ptr reactor = io::Reactor::create();
+    ThreadPool pool(2);
+
+    atomic<uint32_t> n(0);
+    bool bDone = false;
+
+    io::AsyncEvent::Ptr evt = io::AsyncEvent::create(*reactor, [&]() {
+        bDone = true;
+        reactor->stop();
+    });
+
+    auto job = ThreadPool::Job::create(ThreadPool::Priority::Compression, evt);
+    for (uint32_t i = 0; i < 50; i++) {
+        pool.push(job, [&n]() { n++; });
+    }
+
+    reactor->run();
+
+    CHECK(bDone);
+    CHECK(job->is_done());
+    CHECK(n == 50);
+}
+
+} // namespace
+
+int main() {
+    test_basic();
+    test_nested();
+    test_cancel();
+    test_priority();
+    test_completion_event();
+
+    return g_failures ? -1 : 0;
+}
@@ -14,6 +14,10 @@
 
 #include "utility/io/coarsetimer.h"
 #include <set>
+#include <map>
+#include <vector>
+#include <random>
+#include <chrono>
 
 #ifndef LOG_VERBOSE_ENABLED
     #define LOG_VERBOSE_ENABLED 1
@@ -99,6 +103,167 @@ void coarsetimer_test() {
     LOG_DEBUG() << "Stopping";
 }
 
+int g_failures = 0;
+
+void check(bool b, const char* sz) {
+    if (!b) {
+        LOG_ERROR() << "Failed: " << sz;
+        g_failures++;
+    }
+}
+
+#define CHECK(x) check(x, #x)
+
+using SteadyClock = chrono::steady_clock;
+
+uint64_t elapsed_msec(SteadyClock::time_point since) {
+    return uint64_t(chrono::duration_cast<chrono::milliseconds>(SteadyClock::now() - since).count());
+}
+
+void coarsetimer_wheel_test() {
+    reactor = Reactor::create();
+
+    const unsigned resolution = 2;
+    // uv timers are inaccurate, and intervals are rounded to the nearest tick
+    const unsigned tolerance = resolution / 2 + 10;
+
+    struct Expected {
+        unsigned interval;
+        SteadyClock::time_point set;
+        unsigned fired = 0;
+    };
+
+    map<uint64_t, Expected> expected;
+    set<uint64_t> cancelled;
+    size_t remaining = 0;
+
+    auto onTimer = [&](uint64_t id) {
+        if (cancelled.count(id)) {
+            CHECK(!"cancelled timer fired");
+            return;
+        }
+
+        auto it = expected.find(id);
+        CHECK(expected.end() != it);
+        if (expected.end() == it) return;
+
+        Expected& x = it->second;
+        CHECK(!x.fired);
+        x.fired++;
+
+        uint64_t elapsed = elapsed_msec(x.set);
+        CHECK(elapsed + tolerance >= x.interval);
+
+        if (!--remaining) reactor->stop();
+    };
+
+    CoarseTimer::Ptr wheel = CoarseTimer::create(*reactor, resolution, onTimer);
+
+    mt19937_64 rnd(17);
+    for (unsigned i = 0; i < 3000; i++) {
+        // spread over the 1st and 2nd levels, some of them share the id's hash bucket
+        uint64_t id = rnd() | 1;
+        unsigned interval = unsigned(rnd() % 400);
+
+        Expected& x = expected[id];
+        x.interval = interval;
+        x.set = SteadyClock::now();
+        CHECK(bool(wheel->set_timer(interval, id)));
+        CHECK(!bool(wheel->set_timer(interval, id))); // duplicate ids are rejected
+    }
+
+    // the 3rd level
+    expected[2].interval = 64 * 64 * resolution + 100;
+    expected[2].set = SteadyClock::now();
+    CHECK(bool(wheel->set_timer(expected[2].interval, 2)));
+
+    for (auto it = expected.begin(); expected.end() != it; ) {
+        if (!(rnd() % 4) && (it->first != 2)) {
+            cancelled.insert(it->first);
+            wheel->cancel(it->first);
+            it = expected.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    remaining = expected.size();
+    CHECK(wheel->size() == remaining);
+
+    MultipleTimers multiple(*reactor, resolution);
+    unsigned firedReplaced = 0, firedReplacing = 0, firedCancelled = 0;
+    CHECK(bool(multiple.set_timer(1, 50, [&] { firedReplaced++; })));
+    CHECK(bool(multiple.set_timer(1, 100, [&] { firedReplacing++; })));
+    CHECK(bool(multiple.set_timer(2, 30, [&] { firedCancelled++; })));
+    multiple.cancel(2);
+
+    Timer::Ptr guard = Timer::create(*reactor);
+    bool bTimeout = false;
+    guard->start(20000, false, [&] {
+        bTimeout = true;
+        reactor->stop();
+    });
+
+    reactor->run();
+
+    CHECK(!bTimeout);
+    CHECK(!remaining);
+    CHECK(!wheel->size());
+    CHECK(!firedReplaced);
+    CHECK(firedReplacing == 1);
+    CHECK(!firedCancelled);
+
+    for (const auto& v : expected) {
+        CHECK(v.second.fired == 1);
+    }
+}
+
+void coarsetimer_benchmark() {
+    reactor = Reactor::create();
+    CoarseTimer::Ptr wheel = CoarseTimer::create(*reactor, 10, [](uint64_t) {});
+
+    const unsigned count = 100000;
+
+    mt19937_64 rnd(3);
+    vector<pair<uint64_t, unsigned> > timers(count);
+    for (auto& t : timers) {
+        // all the levels, and beyond the wheel range
+        t.first = rnd();
+        t.second = unsigned(rnd() % 3000000000U);
+    }
+
+    auto report = [](const char* szOp, SteadyClock::time_point since) {
+        double sec = chrono::duration<double>(SteadyClock::now() - since).count();
+        LOG_INFO() << "coarse timer " << szOp << ": " << uint64_t(count / sec) << " ops/sec";
+    };
+
+    auto start = SteadyClock::now();
+    for (const auto& t : timers) {
+        wheel->set_timer(t.second, t.first);
+    }
+    report("set", start);
+    CHECK(wheel->size() == count);
+
+    shuffle(timers.begin(), timers.end(), rnd);
+
+    start = SteadyClock::now();
+    for (const auto& t : timers) {
+        wheel->cancel(t.first);
+        wheel->set_timer(t.second / 2, t.first);
+    }
+    report("re-arm", start);
+    CHECK(wheel->size() == count);
+
+    shuffle(timers.begin(), timers.end(), rnd);
+
+    start = SteadyClock::now();
+    for (const auto& t : timers) {
+        wheel->cancel(t.first);
+    }
+    report("cancel", start);
+    CHECK(!wheel->size());
+}
+
 int main() {
     int logLevel = LOG_LEVEL_DEBUG;
 #if LOG_VERBOSE_ENABLED
@@ -107,5 +272,9 @@ int main() {
     auto logger = Logger::create(logLevel, logLevel);
     timer_test();
     coarsetimer_test();
+    coarsetimer_wheel_test();
+    coarsetimer_benchmark();
+
+    return g_failures ? -1 : 0;
 }
 
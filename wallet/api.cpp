@@ -20,14 +20,6 @@ using json = nlohmann::json;
 
 namespace beam
 {
-    namespace
-    {
-        std::string txIDToString(const TxID& txId)
-        {
-            return to_hex(txId.data(), txId.size());
-        }
-    }
-
     struct jsonrpc_exception
     {
         int code;
@@ -145,6 +137,23 @@ namespace beam
         _handler.onMessage(id, send);
     }
 
+    void WalletApi::onSubscribeMessage(int id, const nlohmann::json& params)
+    {
+        Subscribe subscribe;
+
+        if (existsJsonParam(params, "tx_changes"))
+        {
+            subscribe.txChanges = params["tx_changes"];
+        }
+
+        if (existsJsonParam(params, "system_state"))
+        {
+            subscribe.systemState = params["system_state"];
+        }
+
+        _handler.onMessage(id, subscribe);
+    }
+
     void WalletApi::onReplaceMessage(int id, const nlohmann::json& params)
     {
         Replace replace;
@@ -248,6 +257,35 @@ namespace beam
             {
                 txList.filter.height = (Height)params["filter"]["height"];
             }
+
+            if (existsJsonParam(params["filter"], "peer"))
+            {
+                WalletID peer(Zero);
+                if (!peer.FromHex(params["filter"]["peer"]))
+                    throwInvalidJsonRpc(id);
+
+                txList.filter.peer = peer;
+            }
+        }
+
+        if (existsJsonParam(params, "count"))
+        {
+            if (!params["count"].is_number_unsigned() || params["count"] == 0)
+                throwInvalidJsonRpc(id);
+
+            txList.count = params["count"];
+        }
+
+        if (existsJsonParam(params, "after"))
+        {
+            auto txId = from_hex(params["after"]);
+
+            TxID after;
+            if (txId.size() != after.size())
+                throwInvalidJsonRpc(id);
+
+            std::copy_n(txId.begin(), after.size(), after.begin());
+            txList.after = after;
         }
 
         _handler.onMessage(id, txList);
@@ -259,179 +297,308 @@ namespace beam
         _handler.onMessage(id, walletStatus);
     }
 
-    void WalletApi::getResponse(int id, const CreateAddress::Response& res, json& msg)
+    namespace
     {
-        msg = json
+        // the streamed text is parsed back, only for those who need the DOM
+        template <typename Func>
+        void toJson(json& msg, Func&& func)
         {
-            {"jsonrpc", "2.0"},
-            {"id", id},
-            {"result", std::to_string(res.address)}
-        };
+            std::string text;
+            io::FragmentWriter fw(4096, 0, [&text](io::SharedBuffer&& fragment)
+            {
+                text.append((const char*)fragment.data, fragment.size);
+            });
+
+            JsonWriter w(fw);
+            func(w);
+            w.finish();
+
+            msg = json::parse(text);
+        }
+
+        void beginResponse(int id, JsonWriter& w)
+        {
+            w.begin_object()
+                .field("jsonrpc", "2.0")
+                .field("id", id)
+                .key("result");
+        }
+
+        void beginNotification(const char* method, JsonWriter& w)
+        {
+            w.begin_object()
+                .field("jsonrpc", "2.0")
+                .field("method", method)
+                .key("params");
+        }
+
+        void writeTxId(JsonWriter& w, const TxID& txId)
+        {
+            w.hex(txId.data(), txId.size());
+        }
     }
 
-    void WalletApi::getResponse(int id, const ValidateAddress::Response& res, json& msg)
+    void WalletApi::getResponse(int id, const CreateAddress::Response& res, JsonWriter& w)
     {
-        msg = json
-        {
-            {"jsonrpc", "2.0"},
-            {"id", id},
-            {"result", 
-                {
-                    {"is_valid",  res.isValid},
-                    {"is_mine",  res.isMine},
-                }
-            }
-        };
+        beginResponse(id, w);
+        w.value(std::to_string(res.address));
+        w.end_object();
     }
 
-    void WalletApi::getResponse(int id, const GetUtxo::Response& res, json& msg)
+    void WalletApi::getResponse(int id, const ValidateAddress::Response& res, JsonWriter& w)
     {
-        msg = json
-        {
-            {"jsonrpc", "2.0"},
-            {"id", id},
-            {"result", json::array()}
-        };
+        beginResponse(id, w);
+        w.begin_object()
+            .field("is_valid", res.isValid)
+            .field("is_mine", res.isMine)
+            .end_object();
+        w.end_object();
+    }
+
+    void WalletApi::getResponse(int id, const GetUtxo::Response& res, JsonWriter& w)
+    {
+        beginResponse(id, w);
+        w.begin_array();
 
         for (auto& utxo : res.utxos)
         {
-            std::string createTxId = utxo.m_createTxId.is_initialized() ? txIDToString(*utxo.m_createTxId) : "";
-            std::string spentTxId = utxo.m_spentTxId.is_initialized() ? txIDToString(*utxo.m_spentTxId) : "";
-
-            msg["result"].push_back(
-            { 
-                {"id", utxo.m_ID.m_Idx},
-                {"amount", utxo.m_ID.m_Value},
-                {"type", (const char*)FourCC::Text(utxo.m_ID.m_Type)},
-                {"maturity", utxo.get_Maturity()},
-                {"createTxId", createTxId},
-                {"spentTxId", spentTxId},
-                //{"sessionId", utxo.m_sessionId},
-            });
+            w.begin_object()
+                .field("id", utxo.m_ID.m_Idx)
+                .field("amount", utxo.m_ID.m_Value)
+                .field("type", (const char*)FourCC::Text(utxo.m_ID.m_Type))
+                .field("maturity", utxo.get_Maturity());
+
+            w.key("createTxId");
+            if (utxo.m_createTxId.is_initialized())
+                writeTxId(w, *utxo.m_createTxId);
+            else
+                w.value("");
+
+            w.key("spentTxId");
+            if (utxo.m_spentTxId.is_initialized())
+                writeTxId(w, *utxo.m_spentTxId);
+            else
+                w.value("");
+
+            w.end_object();
         }
+
+        w.end_array();
+        w.end_object();
     }
 
-    void WalletApi::getResponse(int id, const Send::Response& res, json& msg)
+    void WalletApi::getResponse(int id, const Send::Response& res, JsonWriter& w)
     {
-        msg = json
-        {
-            {"jsonrpc", "2.0"},
-            {"id", id},
-            {"result", 
-                {
-                    {"txId", txIDToString(res.txId)}
-                }
-            }
-        };
+        beginResponse(id, w);
+        w.begin_object().key("txId");
+        writeTxId(w, res.txId);
+        w.end_object();
+        w.end_object();
     }
 
-    static void getStatusResponseJson(const TxDescription& tx, json& msg, Height kernelProofHeight, Height systemHeight)
+    static void writeStatus(JsonWriter& w, const TxDescription& tx, Height kernelProofHeight, Height systemHeight)
     {
-        msg = json
-        {
-            {"txId", txIDToString(tx.m_txId)},
-            {"status", tx.m_status},
-            {"sender", std::to_string(tx.m_sender ? tx.m_myId : tx.m_peerId)},
-            {"receiver", std::to_string(tx.m_sender ? tx.m_peerId : tx.m_myId)},
-            {"fee", tx.m_fee},
-            {"value", tx.m_amount},
-            {"comment", std::string{ tx.m_message.begin(), tx.m_message.end() }},
-            {"kernel", to_hex(tx.m_kernelID.m_pData, tx.m_kernelID.nBytes)},
-        };
+        w.begin_object().key("txId");
+        writeTxId(w, tx.m_txId);
+        w.field("status", tx.m_status)
+            .field("sender", std::to_string(tx.m_sender ? tx.m_myId : tx.m_peerId))
+            .field("receiver", std::to_string(tx.m_sender ? tx.m_peerId : tx.m_myId))
+            .field("fee", tx.m_fee)
+            .field("value", tx.m_amount);
+        w.key("comment").value((const char*)tx.m_message.data(), tx.m_message.size());
+        w.key("kernel").hex(tx.m_kernelID.m_pData, tx.m_kernelID.nBytes);
 
         if (kernelProofHeight > 0)
         {
-            msg["height"] = kernelProofHeight;
+            w.field("height", kernelProofHeight);
 
             if (systemHeight >= kernelProofHeight)
             {
-                msg["confirmations"] = systemHeight - kernelProofHeight;
+                w.field("confirmations", systemHeight - kernelProofHeight);
             }
         }
+
+        w.end_object();
     }
 
-    void WalletApi::getResponse(int id, const Status::Response& res, json& msg)
+    void WalletApi::getResponse(int id, const Status::Response& res, JsonWriter& w)
     {
-        msg = json
-        {
-            {"jsonrpc", "2.0"},
-            {"id", id},
-            {"result", {}}
-        };
+        beginResponse(id, w);
+        writeStatus(w, res.tx, res.kernelProofHeight, res.systemHeight);
+        w.end_object();
+    }
 
-        getStatusResponseJson(res.tx, msg["result"], res.kernelProofHeight, res.systemHeight);
+    void WalletApi::getResponse(int id, const Split::Response& res, JsonWriter& w)
+    {
+        beginResponse(id, w);
+        w.begin_object().key("txId");
+        writeTxId(w, res.txId);
+        w.end_object();
+        w.end_object();
     }
 
-    void WalletApi::getResponse(int id, const Split::Response& res, json& msg)
+    void WalletApi::getResponse(int id, const TxCancel::Response& res, JsonWriter& w)
     {
-        msg = json
-        {
-            {"jsonrpc", "2.0"},
-            {"id", id},
-            {"result",
-                {
-                    {"txId", to_hex(res.txId.data(), res.txId.size())}
-                }
-            }
-        };
+        beginResponse(id, w);
+        w.value(res.result);
+        w.end_object();
     }
 
-    void WalletApi::getResponse(int id, const TxCancel::Response& res, json& msg)
+    void WalletApi::getResponse(int id, const TxList::Response& res, JsonWriter& w)
     {
-        msg = json
+        beginResponse(id, w);
+        w.begin_array();
+
+        for (const auto& resItem : res.resultList)
         {
-            {"jsonrpc", "2.0"},
-            {"id", id},
-            {"result", res.result}
-        };
+            writeStatus(w, resItem.tx, resItem.kernelProofHeight, resItem.systemHeight);
+        }
+
+        w.end_array();
+        w.end_object();
+    }
+
+    void WalletApi::getResponse(int id, const WalletStatus::Response& res, JsonWriter& w)
+    {
+        beginResponse(id, w);
+        w.begin_object()
+            .field("current_height", res.currentHeight);
+        w.key("current_state_hash").hex(res.currentStateHash.m_pData, res.currentStateHash.nBytes);
+        w.key("prev_state_hash").hex(res.prevStateHash.m_pData, res.prevStateHash.nBytes);
+        w.field("available", res.available)
+            .field("receiving", res.receiving)
+            .field("sending", res.sending)
+            .field("maturing", res.maturing)
+            .field("locked", res.locked)
+            .end_object();
+        w.end_object();
     }
 
-    void WalletApi::getResponse(int id, const TxList::Response& res, json& msg)
+    void WalletApi::getResponse(int id, const Subscribe::Response& res, JsonWriter& w)
     {
-        msg = json
+        beginResponse(id, w);
+        w.value(res.result);
+        w.end_object();
+    }
+
+    void WalletApi::getNotification(const TxChangedEvent& data, JsonWriter& w)
+    {
+        beginNotification("ev_txs_changed", w);
+        w.begin_object();
+
+        w.key("changed").begin_array();
+        for (const auto& item : data.changed)
         {
-            {"jsonrpc", "2.0"},
-            {"id", id},
-            {"result", json::array()}
-        };
+            writeStatus(w, item.tx, item.kernelProofHeight, item.systemHeight);
+        }
+        w.end_array();
 
-        for (const auto& resItem : res.resultList)
+        w.key("removed").begin_array();
+        for (const auto& txId : data.removed)
         {
-            json item = {};
-            getStatusResponseJson(resItem.tx, item, resItem.kernelProofHeight, resItem.systemHeight);
-            msg["result"].push_back(item);
+            writeTxId(w, txId);
         }
+        w.end_array();
+
+        w.field("reset", data.reset);
+        w.end_object();
+        w.end_object();
     }
 
-    void WalletApi::getResponse(int id, const WalletStatus::Response& res, json& msg)
+    void WalletApi::getNotification(const SystemStateEvent& data, JsonWriter& w)
     {
-        msg = json
-        {
-            {"jsonrpc", "2.0"},
-            {"id", id},
-            {"result",
-                {
-                    {"current_height", res.currentHeight},
-                    {"current_state_hash", to_hex(res.currentStateHash.m_pData, res.currentStateHash.nBytes)},
-                    {"prev_state_hash", to_hex(res.prevStateHash.m_pData, res.prevStateHash.nBytes)},
-                    {"available", res.available},
-                    {"receiving", res.receiving},
-                    {"sending", res.sending},
-                    {"maturing", res.maturing},
-                    {"locked", res.locked},
-                }
-            }
-        };
+        beginNotification("ev_system_state", w);
+        w.begin_object()
+            .field("current_height", data.stateID.m_Height);
+        w.key("current_state_hash").hex(data.stateID.m_Hash.m_pData, data.stateID.m_Hash.nBytes);
+        w.end_object();
+        w.end_object();
+    }
+
+#define DOM_FUNC(type) \
+    void WalletApi::getResponse(int id, const type::Response& res, json& msg) \
+    { \
+        toJson(msg, [&](JsonWriter& w) { getResponse(id, res, w); }); \
+    }
+
+    DOM_FUNC(CreateAddress)
+    DOM_FUNC(ValidateAddress)
+    DOM_FUNC(GetUtxo)
+    DOM_FUNC(Send)
+    DOM_FUNC(Status)
+    DOM_FUNC(Split)
+    DOM_FUNC(TxCancel)
+    DOM_FUNC(TxList)
+    DOM_FUNC(WalletStatus)
+    DOM_FUNC(Subscribe)
+
+#undef DOM_FUNC
+
+    void WalletApi::getNotification(const TxChangedEvent& data, json& msg)
+    {
+        toJson(msg, [&](JsonWriter& w) { getNotification(data, w); });
+    }
+
+    void WalletApi::getNotification(const SystemStateEvent& data, json& msg)
+    {
+        toJson(msg, [&](JsonWriter& w) { getNotification(data, w); });
     }
 
     bool WalletApi::parse(const char* data, size_t size)
     {
         if (size == 0) return false;
 
+        json msg;
+
         try
         {
-            json msg = json::parse(data, data + size);
+            msg = json::parse(data, data + size);
+        }
+        catch (const std::exception& e)
+        {
+            json msg
+            {
+                {"jsonrpc", "2.0"},
+                {"error",
+                    {
+                        {"code", INTERNAL_JSON_RPC_ERROR},
+                        {"message", e.what()},
+                    }
+                }
+            };
+
+            _handler.onInvalidJsonRpc(msg);
+            return true;
+        }
+
+        if (!msg.is_array())
+        {
+            parseRequest(std::move(msg));
+        }
+        else if (msg.empty())
+        {
+            parseRequest(json::object()); // invalid
+        }
+        else
+        {
+            _handler.onBatchBegin();
+
+            for (auto& request : msg)
+            {
+                parseRequest(std::move(request));
+            }
+
+            _handler.onBatchEnd();
+        }
 
+        return true;
+    }
+
+    void WalletApi::parseRequest(json msg)
+    {
+        try
+        {
+            if (!msg.is_object()) throwInvalidJsonRpc();
             if (msg["jsonrpc"] != "2.0") throwInvalidJsonRpc();
             if (msg["id"] <= 0) throwInvalidJsonRpc();
             if (msg["method"] == nullptr) throwInvalidJsonRpc();
@@ -443,7 +610,8 @@ namespace beam
             }
             catch (const nlohmann::detail::exception& e)
             {
-                LOG_ERROR() << "json parse: " << e.what() << "\n" << getJsonString(data, size);
+                std::string str = msg.dump();
+                LOG_ERROR() << "json parse: " << e.what() << "\n" << getJsonString(str.data(), str.size());
 
                 throwInvalidJsonRpc(msg["id"]);
             }
@@ -481,7 +649,5 @@ namespace beam
 
             _handler.onInvalidJsonRpc(msg);
         }
-
-        return true;
     }
 }
@@ -17,6 +17,7 @@
 #include <boost/optional.hpp>
 
 #include "wallet/wallet.h"
+#include "utility/io/json_writer.h"
 #include "nlohmann/json.hpp"
 
 #define INVALID_JSON_RPC -32600
@@ -41,7 +42,8 @@ namespace beam
     macro(Lock,             "lock") \
     macro(Unlock,           "unlock") \
     macro(TxList,           "tx_list") \
-    macro(WalletStatus,     "wallet_status")
+    macro(WalletStatus,     "wallet_status") \
+    macro(Subscribe,        "subscribe")
 
     struct CreateAddress
     {
@@ -153,8 +155,13 @@ namespace beam
         {
             boost::optional<TxStatus> status;
             boost::optional<Height> height;
+            boost::optional<WalletID> peer;
         } filter;
 
+        // paging: at most 'count' transactions older than 'after'
+        int count = std::numeric_limits<int>::max();
+        boost::optional<TxID> after;
+
         struct Response
         {
             std::vector<Status::Response> resultList;
@@ -176,11 +183,40 @@ namespace beam
         };
     };
 
+    // enables (or disables) the notifications pushed over the connection
+    struct Subscribe
+    {
+        bool txChanges = true;
+        bool systemState = true;
+
+        struct Response
+        {
+            bool result;
+        };
+    };
+
+    // notifications, sent without id
+    struct TxChangedEvent
+    {
+        std::vector<Status::Response> changed;
+        std::vector<TxID> removed;
+        bool reset = false; // the whole list should be requested again
+    };
+
+    struct SystemStateEvent
+    {
+        Block::SystemState::ID stateID;
+    };
+
     class IWalletApiHandler
     {
     public:
         virtual void onInvalidJsonRpc(const json& msg) = 0;
 
+        // the requests of a batch are handled in one pass, their responses should be sent as a single array
+        virtual void onBatchBegin() {}
+        virtual void onBatchEnd() {}
+
 #define MESSAGE_FUNC(api, name) \
         virtual void onMessage(int id, const api& data) = 0;
 
@@ -194,16 +230,25 @@ namespace beam
     public:
         WalletApi(IWalletApiHandler& handler);
 
+        // responses are streamed straight into the fragments, the DOM versions are for those who need to inspect them
 #define RESPONSE_FUNC(api, name) \
+        void getResponse(int id, const api::Response& data, JsonWriter& w); \
         void getResponse(int id, const api::Response& data, json& msg);
 
         WALLET_API_METHODS(RESPONSE_FUNC)
 
 #undef RESPONSE_FUNC
 
+        void getNotification(const TxChangedEvent& data, JsonWriter& w);
+        void getNotification(const TxChangedEvent& data, json& msg);
+        void getNotification(const SystemStateEvent& data, JsonWriter& w);
+        void getNotification(const SystemStateEvent& data, json& msg);
+
+        // accepts a single request or a batch array
         bool parse(const char* data, size_t size);
 
     private:
+        void parseRequest(json msg);
 
 #define MESSAGE_FUNC(api, name) \
         void on##api##Message(int id, const json& msg);
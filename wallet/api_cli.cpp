@@ -20,12 +20,12 @@
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 #include <map>
+#include <set>
 
 #include "utility/helpers.h"
 #include "utility/io/timer.h"
 #include "utility/io/tcpserver.h"
 #include "utility/options.h"
-#include "utility/io/json_serializer.h"
 
 #include "p2p/line_protocol.h"
 
@@ -38,6 +38,7 @@
 using json = nlohmann::json;
 
 static const unsigned LOG_ROTATION_PERIOD = 3 * 60 * 60 * 1000; // 3 hours
+static const unsigned NOTIFY_DELAY = 100; // ms, the DB changes within this period are sent as one notification
 
 namespace beam
 {
@@ -107,7 +108,7 @@ namespace beam
                 auto peer = newStream->peer_address();
                 LOG_DEBUG() << "+peer " << peer;
 
-                _connections[peer.u64()] = std::make_unique<Connection>(*this, _walletDB, _wallet, _wnet, peer.u64(), std::move(newStream));
+                _connections[peer.u64()] = std::make_unique<Connection>(*this, _walletDB, _wallet, _wnet, _reactor, peer.u64(), std::move(newStream));
             }
 
             LOG_DEBUG() << "on_stream_accepted";
@@ -117,15 +118,17 @@ namespace beam
         class Connection : IWalletApiHandler, IWalletDbObserver
         {
         public:
-            Connection(ConnectionToServer& owner, IWalletDB::Ptr walletDB, Wallet& wallet, WalletNetworkViaBbs& wnet, uint64_t id, io::TcpStream::Ptr&& newStream)
+            Connection(ConnectionToServer& owner, IWalletDB::Ptr walletDB, Wallet& wallet, WalletNetworkViaBbs& wnet, io::Reactor& reactor, uint64_t id, io::TcpStream::Ptr&& newStream)
                 : _owner(owner)
                 , _id(id)
                 , _stream(std::move(newStream))
                 , _lineProtocol(BIND_THIS_MEMFN(on_raw_message), BIND_THIS_MEMFN(on_write))
+                , _writer(_lineProtocol)
                 , _walletDB(walletDB)
                 , _wallet(wallet)
                 , _api(*this)
                 , _wnet(wnet)
+                , _notifyTimer(io::Timer::create(reactor))
             {
                 _stream->enable_keepalive(2);
                 _stream->enable_read(BIND_THIS_MEMFN(on_stream_data));
@@ -138,12 +141,45 @@ namespace beam
                 _walletDB->unsubscribe(this);
             }
 
-            void onCoinsChanged() override {}
-            void onTransactionChanged(ChangeAction action, std::vector<TxDescription>&& items) override {}
+            void onCoinsChanged(ChangeAction action, const std::vector<Coin>& items) override {}
+
+            void onTransactionChanged(ChangeAction action, std::vector<TxDescription>&& items) override
+            {
+                if (!_subscribedTxs) return;
+
+                switch (action)
+                {
+                case ChangeAction::Reset:
+                    _txsReset = true;
+                    _changedTxs.clear();
+                    _removedTxs.clear();
+                    break;
+
+                case ChangeAction::Removed:
+                    for (const auto& tx : items)
+                    {
+                        _changedTxs.erase(tx.m_txId);
+                        _removedTxs.insert(tx.m_txId);
+                    }
+                    break;
+
+                default:
+                    for (const auto& tx : items)
+                    {
+                        _removedTxs.erase(tx.m_txId);
+                        _changedTxs.insert(tx.m_txId);
+                    }
+                }
+
+                scheduleNotify();
+            }
 
             void onSystemStateChanged() override 
             {
-                
+                if (!_subscribedState) return;
+
+                _stateChanged = true;
+                scheduleNotify();
             }
 
             void onAddressChanged() override {}
@@ -153,12 +189,102 @@ namespace beam
                 _stream->write(msg);
             }
 
+            // the responses of a batch are streamed as the elements of one array
+            void endMessage()
+            {
+                if (!_inBatch)
+                    _writer.finish();
+            }
+
+            void sendJson(const json& msg)
+            {
+                std::string text;
+                try
+                {
+                    text = msg.dump();
+                }
+                catch (const std::exception& e)
+                {
+                    LOG_ERROR() << "dump json: " << e.what();
+                    return;
+                }
+
+                _writer.raw(text.data(), text.size());
+                endMessage();
+            }
+
+            void onBatchBegin() override
+            {
+                _inBatch = true;
+                _writer.begin_array();
+            }
+
+            void onBatchEnd() override
+            {
+                _inBatch = false;
+                _writer.end_array();
+                _writer.finish();
+            }
+
             template<typename T>
             void doResponse(int id, const T& response)
             {
-                json msg;
-                _api.getResponse(id, response, msg);
-                serialize_json_msg(_lineProtocol, msg);
+                _api.getResponse(id, response, _writer);
+                endMessage();
+            }
+
+            void scheduleNotify()
+            {
+                if (_notifyPending) return;
+
+                _notifyPending = true;
+                _notifyTimer->start(NOTIFY_DELAY, false, BIND_THIS_MEMFN(onNotify));
+            }
+
+            void onNotify()
+            {
+                _notifyPending = false;
+
+                Block::SystemState::ID stateID = {};
+                _walletDB->getSystemStateID(stateID);
+
+                if (_txsReset || !_changedTxs.empty() || !_removedTxs.empty())
+                {
+                    TxChangedEvent ev;
+                    ev.reset = _txsReset;
+                    ev.removed.assign(_removedTxs.begin(), _removedTxs.end());
+
+                    // the current state is sent, no matter how many times it has changed
+                    for (const auto& txId : _changedTxs)
+                    {
+                        auto tx = _walletDB->getTx(txId);
+                        if (!tx) continue;
+
+                        Status::Response item;
+                        item.tx = *tx;
+                        item.kernelProofHeight = 0;
+                        item.systemHeight = stateID.m_Height;
+                        item.confirmations = 0;
+
+                        wallet::getTxParameter(*_walletDB, txId, wallet::TxParameterID::KernelProofHeight, item.kernelProofHeight);
+                        ev.changed.push_back(item);
+                    }
+
+                    _txsReset = false;
+                    _changedTxs.clear();
+                    _removedTxs.clear();
+
+                    _api.getNotification(ev, _writer);
+                    _writer.finish();
+                }
+
+                if (_stateChanged)
+                {
+                    _stateChanged = false;
+
+                    _api.getNotification(SystemStateEvent{ stateID }, _writer);
+                    _writer.finish();
+                }
             }
 
             void doError(int id, int code, const std::string& info)
@@ -175,14 +301,14 @@ namespace beam
                     }
                 };
 
-                serialize_json_msg(_lineProtocol, msg);
+                sendJson(msg);
             }
 
             void onInvalidJsonRpc(const json& msg) override
             {
                 LOG_DEBUG() << "onInvalidJsonRpc: " << msg;
 
-                serialize_json_msg(_lineProtocol, msg);
+                sendJson(msg);
             }
 
             void onMessage(int id, const CreateAddress& data) override 
@@ -379,6 +505,26 @@ namespace beam
                 doResponse(id, response);
             }
 
+            void onMessage(int id, const Subscribe& data) override
+            {
+                LOG_DEBUG() << "Subscribe(tx_changes = " << data.txChanges << " system_state = " << data.systemState << ")";
+
+                _subscribedTxs = data.txChanges;
+                _subscribedState = data.systemState;
+
+                if (!_subscribedTxs)
+                {
+                    _txsReset = false;
+                    _changedTxs.clear();
+                    _removedTxs.clear();
+                }
+
+                if (!_subscribedState)
+                    _stateChanged = false;
+
+                doResponse(id, Subscribe::Response{ true });
+            }
+
             void onMessage(int id, const Lock& data) override
             {
                 methodNotImplementedYet(id);
@@ -396,7 +542,23 @@ namespace beam
                 TxList::Response res;
 
                 {
-                    auto txList = _walletDB->getTxHistory();
+                    // status and peer are served by the DB index, the height isn't a part of the tx summary
+                    TxHistoryFilter filter;
+                    filter.m_Status = data.filter.status;
+                    filter.m_PeerID = data.filter.peer;
+
+                    boost::optional<TxDescription> last;
+                    if (data.after)
+                    {
+                        last = _walletDB->getTx(*data.after);
+                        if (!last)
+                        {
+                            doError(id, INVALID_PARAMS_JSON_RPC, "Unknown transaction ID.");
+                            return;
+                        }
+                    }
+
+                    auto txList = _walletDB->getTxHistory(filter, last.get_ptr(), data.count);
 
                     Block::SystemState::ID stateID = {};
                     _walletDB->getSystemStateID(stateID);
@@ -414,18 +576,6 @@ namespace beam
                     }
                 }
 
-                // filter transactions by status if provided
-                if (data.filter.status)
-                {
-                    decltype(res.resultList) filteredList;
-
-                    for (const auto& it : res.resultList)
-                        if (it.tx.m_status == *data.filter.status)
-                            filteredList.push_back(it);
-
-                    res.resultList = filteredList;
-                }
-
                 // filter transactions by height if provided
                 if (data.filter.height)
                 {
@@ -477,10 +627,22 @@ namespace beam
             uint64_t _id;
             io::TcpStream::Ptr _stream;
             LineProtocol _lineProtocol;
+            JsonWriter _writer;
             IWalletDB::Ptr _walletDB;
             Wallet& _wallet;
             WalletApi _api;
             WalletNetworkViaBbs& _wnet;
+
+            bool _inBatch = false;
+
+            bool _subscribedTxs = false;
+            bool _subscribedState = false;
+            std::set<TxID> _changedTxs;
+            std::set<TxID> _removedTxs;
+            bool _txsReset = false;
+            bool _stateChanged = false;
+            bool _notifyPending = false;
+            io::Timer::Ptr _notifyTimer;
         };
 
         io::Reactor& _reactor;
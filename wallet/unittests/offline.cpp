@@ -23,8 +23,8 @@
 namespace beam {
 
 struct WalletDBObserver : IWalletDbObserver {
-    void onCoinsChanged() {
-        LOG_DEBUG() << _who << " " << __FUNCTION__;
+    void onCoinsChanged(ChangeAction action, const std::vector<Coin>& items) {
+        LOG_DEBUG() << _who << " " << __FUNCTION__ << " " << items.size();
     }
     void onTransactionChanged(ChangeAction, std::vector<TxDescription>&& )  {
         LOG_INFO() << _who << " QQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQQ " << __FUNCTION__;
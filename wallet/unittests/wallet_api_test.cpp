@@ -360,6 +360,140 @@ namespace
             WALLET_CHECK(res["id"] == 123);
         }
     }
+
+    void testTxListPagingJsonRpc(const std::string& msg)
+    {
+        class WalletApiHandler : public WalletApiHandlerBase
+        {
+        public:
+
+            void onInvalidJsonRpc(const json& msg) override
+            {
+                WALLET_CHECK(!"invalid list api json!!!");
+
+                cout << msg["error"]["message"] << endl;
+            }
+
+            void onMessage(int id, const TxList& data) override
+            {
+                WALLET_CHECK(id > 0);
+
+                WALLET_CHECK(!data.filter.status);
+                WALLET_CHECK(data.count == 20);
+                WALLET_CHECK(data.after.is_initialized());
+                WALLET_CHECK((*data.after)[0] == 0x10 && (*data.after)[15] == 0xab);
+            }
+        };
+
+        WalletApiHandler handler;
+        WalletApi api(handler);
+
+        WALLET_CHECK(api.parse(msg.data(), msg.size()));
+    }
+
+    void testBatchJsonRpc(const std::string& msg)
+    {
+        class WalletApiHandler : public WalletApiHandlerBase
+        {
+        public:
+            int batches = 0;
+            int statuses = 0;
+            int errors = 0;
+            bool inBatch = false;
+
+            void onBatchBegin() override
+            {
+                WALLET_CHECK(!inBatch);
+                inBatch = true;
+            }
+
+            void onBatchEnd() override
+            {
+                WALLET_CHECK(inBatch);
+                inBatch = false;
+                batches++;
+            }
+
+            void onInvalidJsonRpc(const json& msg) override
+            {
+                WALLET_CHECK(inBatch);
+                testErrorHeader(msg);
+                errors++;
+            }
+
+            void onMessage(int id, const Status& data) override
+            {
+                WALLET_CHECK(inBatch);
+                WALLET_CHECK(id == 1 || id == 2);
+                statuses++;
+            }
+        };
+
+        WalletApiHandler handler;
+        WalletApi api(handler);
+
+        WALLET_CHECK(api.parse(msg.data(), msg.size()));
+        WALLET_CHECK(handler.batches == 1);
+        WALLET_CHECK(handler.statuses == 2);
+        WALLET_CHECK(handler.errors == 1);
+    }
+
+    void testSubscribeJsonRpc(const std::string& msg)
+    {
+        class WalletApiHandler : public WalletApiHandlerBase
+        {
+        public:
+
+            void onInvalidJsonRpc(const json& msg) override
+            {
+                WALLET_CHECK(!"invalid subscribe api json!!!");
+
+                cout << msg["error"]["message"] << endl;
+            }
+
+            void onMessage(int id, const Subscribe& data) override
+            {
+                WALLET_CHECK(id > 0);
+                WALLET_CHECK(!data.txChanges);
+                WALLET_CHECK(data.systemState);
+            }
+        };
+
+        WalletApiHandler handler;
+        WalletApi api(handler);
+
+        WALLET_CHECK(api.parse(msg.data(), msg.size()));
+
+        {
+            TxChangedEvent ev;
+            ev.changed.resize(2);
+            ev.removed.resize(1);
+
+            json res;
+            api.getNotification(ev, res);
+
+            CHECK_JSON_FIELD(res, "jsonrpc");
+            CHECK_JSON_FIELD(res, "method");
+            WALLET_CHECK(res.find("id") == res.end());
+            WALLET_CHECK(res["method"] == "ev_txs_changed");
+            WALLET_CHECK(res["params"]["changed"].size() == 2);
+            WALLET_CHECK(res["params"]["removed"].size() == 1);
+            WALLET_CHECK(res["params"]["reset"] == false);
+        }
+
+        {
+            SystemStateEvent ev;
+            ev.stateID.m_Height = 123;
+            ev.stateID.m_Hash = Zero;
+
+            json res;
+            api.getNotification(ev, res);
+
+            WALLET_CHECK(res.find("id") == res.end());
+            WALLET_CHECK(res["method"] == "ev_system_state");
+            WALLET_CHECK(res["params"]["current_height"] == 123);
+        }
+    }
 }
 
 int main()
@@ -500,5 +634,62 @@ int main()
         }
     }));
 
+    testBatchJsonRpc(JSON_CODE(
+    [
+        {
+            "jsonrpc": "2.0",
+            "id" : 1,
+            "method" : "tx_status",
+            "params" :
+            {
+                "txId" : "10c4b760c842433cb58339a0fafef3db"
+            }
+        },
+        {
+            "jsonrpc": "2.0",
+            "id" : 2,
+            "method" : "tx_status",
+            "params" :
+            {
+                "txId" : "10c4b760c842433cb58339a0fafef3dc"
+            }
+        },
+        {
+            "jsonrpc": "2.0",
+            "method" : "tx_status"
+        }
+    ]));
+
+    testInvalidJsonRpc([](const json& msg)
+    {
+        testErrorHeader(msg);
+
+        WALLET_CHECK(msg["id"] == nullptr);
+        WALLET_CHECK(msg["error"]["code"] == INVALID_JSON_RPC);
+    }, JSON_CODE([]));
+
+    testSubscribeJsonRpc(JSON_CODE(
+    {
+        "jsonrpc": "2.0",
+        "id" : 12345,
+        "method" : "subscribe",
+        "params" :
+        {
+            "tx_changes" : false
+        }
+    }));
+
+    testTxListPagingJsonRpc(JSON_CODE(
+    {
+        "jsonrpc": "2.0",
+        "id" : 12345,
+        "method" : "tx_list",
+        "params" :
+        {
+            "count" : 20,
+            "after" : "100000000000000000000000000000ab"
+        }
+    }));
+
     return WALLET_CHECK_RESULT;
 }
@@ -320,6 +320,83 @@ void TestStoreTxRecord()
     WALLET_CHECK(t.size() == 0);
 }
 
+void TestTxHistoryPaging()
+{
+    cout << "\nWallet database transaction history paging test\n";
+    auto walletDB = createSqliteWalletDB();
+
+    TxDescription tr;
+    tr.m_amount = 34;
+    tr.m_myId.m_Pk = unsigned(42);
+    tr.m_myId.m_Channel = 0U;
+    tr.m_sender = true;
+
+    // 3 txs per timestamp, 2 peers, 2 statuses
+    for (uint8_t i = 0; i < 30; ++i)
+    {
+        tr.m_txId = {};
+        tr.m_txId[0] = i;
+        tr.m_createTime = 1000 + i / 3;
+        tr.m_peerId.m_Pk = unsigned(i % 2);
+        tr.m_peerId.m_Channel = 0U;
+        tr.m_status = (i % 3) ? TxStatus::Completed : TxStatus::Failed;
+        WALLET_CHECK_NO_THROW(walletDB->saveTx(tr));
+    }
+
+    auto all = walletDB->getTxHistory();
+    WALLET_CHECK(all.size() == 30);
+    for (size_t i = 1; i < all.size(); ++i)
+    {
+        const auto& a = all[i - 1];
+        const auto& b = all[i];
+        WALLET_CHECK(a.m_createTime > b.m_createTime || (a.m_createTime == b.m_createTime && a.m_txId < b.m_txId));
+    }
+
+    // walk the whole history by pages, the result must be the same as the single query
+    TxHistoryFilter filter;
+    vector<TxDescription> paged;
+    for (const TxDescription* pLast = nullptr; ; )
+    {
+        auto page = walletDB->getTxHistory(filter, pLast, 4);
+        WALLET_CHECK(page.size() <= 4);
+        if (page.empty())
+            break;
+        paged.insert(paged.end(), page.begin(), page.end());
+        pLast = &paged.back();
+    }
+    WALLET_CHECK(paged.size() == all.size());
+    for (size_t i = 0; i < paged.size() && i < all.size(); ++i)
+        WALLET_CHECK(paged[i].m_txId == all[i].m_txId);
+
+    // filters
+    filter.m_Status = TxStatus::Failed;
+    auto t = walletDB->getTxHistory(filter, nullptr, 100);
+    WALLET_CHECK(t.size() == 10);
+    for (const auto& tx : t)
+        WALLET_CHECK(tx.m_status == TxStatus::Failed);
+
+    filter.m_PeerID = tr.m_peerId; // odd txs
+    t = walletDB->getTxHistory(filter, nullptr, 100);
+    WALLET_CHECK(t.size() == 5);
+    for (const auto& tx : t)
+        WALLET_CHECK(tx.m_status == TxStatus::Failed && tx.m_peerId == tr.m_peerId && (tx.m_txId[0] % 2));
+
+    t = walletDB->getTxHistory(filter, &t[1], 100);
+    WALLET_CHECK(t.size() == 3);
+
+    // the summary follows the parameters
+    filter.m_Status.reset();
+    filter.m_PeerID.reset();
+    WALLET_CHECK(wallet::setTxParameter(*walletDB, all[5].m_txId, TxParameterID::Status, TxStatus::Cancelled, false));
+    filter.m_Status = TxStatus::Cancelled;
+    t = walletDB->getTxHistory(filter, nullptr, 100);
+    WALLET_CHECK(t.size() == 1 && t[0].m_txId == all[5].m_txId);
+
+    walletDB->deleteTx(all[5].m_txId);
+    WALLET_CHECK(walletDB->getTxHistory(filter, nullptr, 100).empty());
+    WALLET_CHECK(walletDB->getTxHistory().size() == 29);
+}
+
 void TestRollback()
 {
     cout << "\nWallet database rollback test\n";
@@ -999,6 +1076,49 @@ void TestTxParameters()
     WALLET_CHECK(p == pt2);
 }
 
+void TestTxParametersBatch()
+{
+    cout << "\nWallet database transaction parameters batch test\n";
+    TxID txID = { {2, 4, 6} };
+    {
+        auto db = createSqliteWalletDB();
+
+        db->beginBatch();
+        WALLET_CHECK(wallet::setTxParameter(*db, txID, TxParameterID::Status, TxStatus::InProgress, false));
+
+        // nested batch and transactions
+        db->beginBatch();
+        TxDescription tr;
+        tr.m_txId = txID;
+        tr.m_amount = 71;
+        tr.m_createTime = 1234564;
+        tr.m_status = TxStatus::Registering;
+        db->saveTx(tr);
+        db->commitBatch();
+
+        // the data is visible before the batch is committed
+        auto t = db->getTx(txID);
+        WALLET_CHECK(t.is_initialized());
+        WALLET_CHECK(t->m_amount == 71);
+        WALLET_CHECK(t->m_status == TxStatus::Registering);
+
+        WALLET_CHECK(wallet::setTxParameter(*db, txID, TxParameterID::KernelProofHeight, Height(43), false));
+        db->commitBatch();
+    }
+
+    // reopen, the cache is gone, everything must come from the DB
+    auto db = WalletDB::open("wallet.db", string("pass123"));
+    WALLET_CHECK(db);
+    auto t = db->getTx(txID);
+    WALLET_CHECK(t.is_initialized());
+    WALLET_CHECK(t->m_amount == 71);
+    WALLET_CHECK(t->m_createTime == 1234564);
+    WALLET_CHECK(t->m_status == TxStatus::Registering);
+    Height h = 0;
+    WALLET_CHECK(wallet::getTxParameter(*db, txID, TxParameterID::KernelProofHeight, h));
+    WALLET_CHECK(h == 43);
+}
+
 void TestSelect3()
 {
     cout << "\nWallet database coin selection 3 test\n";
@@ -1068,6 +1188,183 @@ void TestSelect5()
     SelectCoins(db, 45'678'910);
 }
 
+void TestSelectIndex()
+{
+    cout << "\nWallet database coin selection index test\n";
+    auto db = createSqliteWalletDB();
+
+    for (Amount i = 1; i <= 5; ++i)
+    {
+        Coin coin = CreateAvailCoin(i * 10);
+        db->store(coin);
+    }
+
+    auto coins = db->selectCoins(50);
+    WALLET_CHECK(coins.size() == 1 && coins[0].m_ID.m_Value == 50);
+
+    // added after the index is loaded
+    Coin coin = CreateAvailCoin(45);
+    db->store(coin);
+    coins = db->selectCoins(45);
+    WALLET_CHECK(coins.size() == 1 && coins[0].m_ID == coin.m_ID);
+
+    // maturing and unconfirmed coins are not selected
+    Coin maturing = CreateCoin(1000, 200, 10);
+    db->store(maturing);
+    Coin unconfirmed = CreateCoin(2000);
+    db->store(unconfirmed);
+    WALLET_CHECK(db->selectCoins(1000).empty());
+
+    // spent
+    coin.m_spentHeight = 100;
+    db->save(coin);
+    coins = db->selectCoins(45);
+    WALLET_CHECK(coins.size() == 1 && coins[0].m_ID.m_Value == 50);
+
+    // the spend is rolled back
+    db->rollbackConfirmedUtxo(90);
+    coins = db->selectCoins(45);
+    WALLET_CHECK(coins.size() == 1 && coins[0].m_ID == coin.m_ID);
+
+    db->remove(coin.m_ID);
+    coins = db->selectCoins(45);
+    WALLET_CHECK(coins.size() == 1 && coins[0].m_ID.m_Value == 50);
+
+    // the chain grows, the maturing coin becomes available
+    Block::SystemState::ID id = {};
+    id.m_Height = 200;
+    db->setSystemStateID(id);
+    coins = db->selectCoins(1000);
+    WALLET_CHECK(coins.size() == 1 && coins[0].m_ID == maturing.m_ID);
+    WALLET_CHECK(db->selectCoins(1151).empty());
+    WALLET_CHECK(db->selectCoins(1150).size() == 6);
+}
+
+// keeps the coins and the totals up to date by the notifications only
+struct CoinsObserver : IWalletDbObserver
+{
+    IWalletDB& m_DB;
+    map<Coin::ID, Coin> m_Coins;
+    wallet::Totals m_Totals;
+    size_t m_Resets = 0;
+
+    CoinsObserver(IWalletDB& db) : m_DB(db)
+    {
+        ZeroObject(m_Totals);
+    }
+
+    void onCoinsChanged(ChangeAction action, const vector<Coin>& items) override
+    {
+        if (ChangeAction::Reset == action)
+        {
+            m_Resets++;
+            m_Coins.clear();
+            ZeroObject(m_Totals);
+            m_DB.visit([this](const Coin& c)->bool
+            {
+                m_Coins[c.m_ID] = c;
+                m_Totals.Add(c);
+                return true;
+            });
+            return;
+        }
+
+        for (const auto& item : items)
+        {
+            auto it = m_Coins.find(item.m_ID);
+            if (m_Coins.end() != it)
+            {
+                m_Totals.Remove(it->second);
+                m_Coins.erase(it);
+            }
+
+            if (ChangeAction::Removed != action)
+            {
+                Coin c = item;
+                wallet::DeduceStatus(m_DB, c, m_DB.getCurrentHeight());
+                m_Coins[c.m_ID] = c;
+                m_Totals.Add(c);
+            }
+        }
+    }
+
+    void onTransactionChanged(ChangeAction, vector<TxDescription>&&) override {}
+    void onSystemStateChanged() override {}
+    void onAddressChanged() override {}
+
+    bool IsConsistent() const
+    {
+        wallet::Totals totals(m_DB);
+        size_t n = 0;
+        m_DB.visit([&n](const Coin&)->bool { n++; return true; });
+
+        return (n == m_Coins.size()) &&
+            (totals.Avail == m_Totals.Avail) &&
+            (totals.Maturing == m_Totals.Maturing) &&
+            (totals.Incoming == m_Totals.Incoming) &&
+            (totals.Outgoing == m_Totals.Outgoing) &&
+            (totals.Unavail == m_Totals.Unavail) &&
+            (totals.Unspent == m_Totals.Unspent) &&
+            (totals.Coinbase == m_Totals.Coinbase);
+    }
+};
+
+void TestCoinNotifications()
+{
+    cout << "\nWallet database coin notifications test\n";
+    auto db = createSqliteWalletDB();
+
+    Block::SystemState::ID id = {};
+    id.m_Height = 50;
+    db->setSystemStateID(id);
+
+    CoinsObserver obs(*db);
+    db->subscribe(&obs);
+
+    vector<Coin> coins;
+    for (Amount i = 1; i <= 5; ++i)
+    {
+        coins.push_back(CreateAvailCoin(i * 10));
+    }
+    coins.push_back(CreateCoin(100, 70, 20));
+    coins.back().m_ID.m_Type = Key::Type::Coinbase;
+    db->store(coins);
+    WALLET_CHECK(obs.m_Coins.size() == 6);
+    WALLET_CHECK(obs.IsConsistent());
+
+    // spent by an ongoing tx, and its change
+    TxID txID = { { 4, 5, 6 } };
+    wallet::setTxParameter(*db, txID, wallet::TxParameterID::Status, TxStatus::Registering, false);
+    coins[0].m_spentTxId = txID;
+    db->save(coins[0]);
+    Coin change = CreateCoin(5);
+    change.m_createTxId = txID;
+    db->store(change);
+    WALLET_CHECK(obs.m_Totals.Outgoing == 10);
+    WALLET_CHECK(obs.m_Totals.Incoming == 5);
+    WALLET_CHECK(obs.IsConsistent());
+
+    // only the tx coins are reported
+    db->rollbackTx(txID);
+    WALLET_CHECK(obs.m_Coins.size() == 6);
+    WALLET_CHECK(!obs.m_Totals.Outgoing && !obs.m_Totals.Incoming);
+    WALLET_CHECK(obs.IsConsistent());
+
+    db->remove(coins[1].m_ID);
+    db->remove(vector<Coin::ID>{ coins[2].m_ID, coins[3].m_ID });
+    WALLET_CHECK(obs.m_Coins.size() == 3);
+    WALLET_CHECK(obs.IsConsistent());
+    WALLET_CHECK(!obs.m_Resets);
+
+    coins[4].m_spentHeight = 40;
+    db->save(coins[4]);
+    db->rollbackConfirmedUtxo(30);
+    WALLET_CHECK(obs.m_Resets == 1);
+    WALLET_CHECK(obs.IsConsistent());
+
+    db->unsubscribe(&obs);
+}
+
 void TestSelect6()
 {
     cout << "\nWallet database coin selection 6 test\n";
@@ -1225,6 +1522,7 @@ int main()
    TestWalletDataBase();
     TestStoreCoins();
     TestStoreTxRecord();
+    TestTxHistoryPaging();
     TestTxRollback();
     TestRollback();
     TestBlockRollbackWithTx();
@@ -1233,10 +1531,13 @@ int main()
     TestSelect3();
     TestSelect4();
     TestSelect5();
+    TestSelectIndex();
+    TestCoinNotifications();
     TestSelect6();
     TestAddresses();
 
     TestTxParameters();
+    TestTxParametersBatch();
 
     TestTransferredByTx();
 
@@ -118,6 +118,7 @@ namespace
         void unsubscribe(IWalletDbObserver* observer) override {}
 
         std::vector<TxDescription> getTxHistory(uint64_t , int ) override { return {}; };
+        std::vector<TxDescription> getTxHistory(const TxHistoryFilter&, const TxDescription*, int) override { return {}; };
         boost::optional<TxDescription> getTx(const TxID& ) override { return boost::optional<TxDescription>{}; };
         void saveTx(const TxDescription& p) override
         {
@@ -755,6 +756,106 @@ void TestWalletNegotiation(IWalletDB::Ptr senderWalletDB, IWalletDB::Ptr receive
     WALLET_CHECK(count == 2);
 }
 
+struct TestUtxoEventsNetwork
+    :public TestNodeNetwork
+{
+    std::vector<proto::UtxoEvent> m_vEvents;
+
+    using TestNodeNetwork::TestNodeNetwork;
+
+    void PostProcess(Request& r) override
+    {
+        if (Request::Type::UtxoEvents != r.get_Type())
+        {
+            TestNodeNetwork::PostProcess(r);
+            return;
+        }
+
+        proto::FlyClient::RequestUtxoEvents& v = static_cast<proto::FlyClient::RequestUtxoEvents&>(r);
+        v.m_Res.m_Events.swap(m_vEvents);
+        io::Reactor::get_Current().stop();
+    }
+};
+
+void TestUtxoEvents()
+{
+    cout << "\nTesting utxo events...\n";
+
+    io::Reactor::Ptr mainReactor{ io::Reactor::create() };
+    io::Reactor::Scope scope(*mainReactor);
+
+    auto walletDB = createSqliteWalletDB("sender_wallet.db");
+
+    Wallet wallet(walletDB);
+    TestWalletNetwork twn;
+    TestNodeNetwork::Shared tnns;
+    TestUtxoEventsNetwork netNode(tnns, wallet);
+    wallet.set_Network(netNode, twn);
+
+    tnns.AddBlock();
+
+    Coin spent(7);
+    spent.m_confirmHeight = 1;
+    walletDB->store(spent);
+
+    auto fnAdd = [&](const Key::IDV& kidv, uint8_t nAdded, bool bValid)
+    {
+        proto::UtxoEvent evt;
+        evt.m_Kidv = kidv;
+        evt.m_AssetID = Zero;
+        evt.m_Height = 1;
+        evt.m_Maturity = 5;
+        evt.m_Added = nAdded;
+
+        ECC::Scalar::Native sk;
+        walletDB->calcCommitment(sk, evt.m_Commitment, kidv);
+        if (!bValid)
+            evt.m_Commitment.m_Y ^= 1;
+
+        netNode.m_vEvents.push_back(evt);
+    };
+
+    Key::IDV kidvNew(3, 200501, Key::Type::Regular);
+    Key::IDV kidvTransient(4, 200502, Key::Type::Regular);
+    Key::IDV kidvUnknown(5, 200503, Key::Type::Regular);
+
+    fnAdd(kidvNew, 1, true);
+    fnAdd(kidvTransient, 1, true);
+    fnAdd(spent.m_ID, 0, true);
+    fnAdd(kidvTransient, 0, true);
+    fnAdd(kidvUnknown, 0, true); // spend of a coin we don't have
+
+    // false positives, enough to split the page between threads
+    for (uint32_t i = 0; i < 40; i++)
+        fnAdd(Key::IDV(6, 200600 + i, Key::Type::Regular), 1, false);
+
+    static_cast<proto::FlyClient&>(wallet).OnOwnedNode(Zero, true);
+    mainReactor->run();
+
+    Coin c;
+    c.m_ID = kidvNew;
+    WALLET_CHECK(walletDB->find(c));
+    WALLET_CHECK(c.m_confirmHeight == 1);
+    WALLET_CHECK(c.m_spentHeight == MaxHeight);
+    WALLET_CHECK(c.m_maturity == 5);
+
+    c.m_ID = kidvTransient;
+    WALLET_CHECK(walletDB->find(c));
+    WALLET_CHECK(c.m_confirmHeight == 1);
+    WALLET_CHECK(c.m_spentHeight == 1);
+
+    c.m_ID = spent.m_ID;
+    WALLET_CHECK(walletDB->find(c));
+    WALLET_CHECK(c.m_spentHeight == 1);
+
+    c.m_ID = kidvUnknown;
+    WALLET_CHECK(!walletDB->find(c));
+
+    size_t nCoins = 0;
+    walletDB->visit([&nCoins](const Coin&) { nCoins++; return true; });
+    WALLET_CHECK(nCoins == 3);
+}
+
 class TestNode
 {
 public:
@@ -1605,6 +1706,8 @@ int main()
 
     TestTxToHimself();
 
+    TestUtxoEvents();
+
     TestExpiredTransaction();
 
     //TestRollback();
@@ -19,6 +19,7 @@
 #include "core/block_crypt.h"
 #include "utility/logger.h"
 #include "utility/helpers.h"
+#include "utility/thread_pool.h"
 #include "swap_transaction.h"
 #include <algorithm>
 #include <random>
@@ -348,6 +349,7 @@ namespace beam
                 }
             }
         }
+        DbBatch batch(m_WalletDB);
         auto t = m_Transactions;
         for (auto& p : t)
         {
@@ -633,19 +635,42 @@ namespace beam
     void Wallet::OnRequestComplete(MyRequestUtxoEvents& r)
     {
         const std::vector<proto::UtxoEvent>& v = r.m_Res.m_Events;
+
+		// filter-out false positives
+		std::vector<uint8_t> vValid;
+		FilterUtxoEvents(v, vValid);
+
+		// the whole page is saved at once, in the same DB transaction as the new events height
+		DbBatch batch(m_WalletDB);
+
+		std::vector<Coin> vCoins;
+		std::map<Coin::ID, size_t> mapCoins; // a coin may be both added and spent within the page
+
 		for (size_t i = 0; i < v.size(); i++)
 		{
-			const proto::UtxoEvent& evt = v[i];
+			if (!vValid[i])
+				continue;
 
-			// filter-out false positives
-			Scalar::Native sk;
-			Point comm;
-			m_WalletDB->calcCommitment(sk, comm, evt.m_Kidv);
+			const proto::UtxoEvent& evt = v[i];
 
-			if (comm == evt.m_Commitment)
-				ProcessUtxoEvent(evt);
+			auto it = mapCoins.find(evt.m_Kidv);
+			if (mapCoins.end() != it)
+			{
+				ApplyUtxoEvent(evt, vCoins[it->second], true);
+				continue;
+			}
+
+			Coin c;
+			c.m_ID = evt.m_Kidv;
+			if (ApplyUtxoEvent(evt, c, m_WalletDB->find(c)))
+			{
+				mapCoins[c.m_ID] = vCoins.size();
+				vCoins.push_back(c);
+			}
 		}
 
+		m_WalletDB->save(vCoins);
+
 		if (r.m_Res.m_Events.size() < proto::UtxoEvent::s_Max)
 		{
 			Block::SystemState::Full sTip;
@@ -678,12 +703,73 @@ namespace beam
         return h;
     }
 
+    void Wallet::FilterUtxoEvents(const std::vector<proto::UtxoEvent>& v, std::vector<uint8_t>& vValid)
+    {
+		// Each event costs a key derivation and a multiplication, for a page of events split them between several threads
+		const size_t nPerThreadMin = 16;
+
+		vValid.assign(v.size(), 0);
+
+		ThreadPool& tp = ThreadPool::get();
+
+		uint32_t nThreads = tp.get_threads() + 1; // this thread works as well
+		if (nThreads > v.size() / nPerThreadMin)
+			nThreads = static_cast<uint32_t>(v.size() / nPerThreadMin);
+
+		std::atomic<size_t> iNext(0);
+
+		auto fnWork = [&]()
+		{
+			// most of the coins share the same child kdf
+			Key::Index iKdf = 0;
+			Key::IKdf::Ptr pKdf = m_WalletDB->get_MasterKdf();
+
+			while (true)
+			{
+				size_t i = iNext++;
+				if (i >= v.size())
+					break;
+
+				const proto::UtxoEvent& evt = v[i];
+				if (evt.m_Kidv.m_SubIdx != iKdf)
+				{
+					iKdf = evt.m_Kidv.m_SubIdx;
+					pKdf = m_WalletDB->get_ChildKdf(iKdf);
+				}
+
+				Scalar::Native sk;
+				Point comm;
+				SwitchCommitment().Create(sk, comm, *pKdf, evt.m_Kidv);
+
+				vValid[i] = (comm == evt.m_Commitment);
+			}
+		};
+
+		if (nThreads <= 1)
+		{
+			fnWork();
+			return;
+		}
+
+		ThreadPool::Job::Ptr pJob = ThreadPool::Job::create(ThreadPool::Priority::Verification);
+		for (uint32_t i = 1; i < nThreads; i++)
+			tp.push(pJob, fnWork);
+
+		fnWork();
+		pJob->wait();
+    }
+
     void Wallet::ProcessUtxoEvent(const proto::UtxoEvent& evt)
     {
         Coin c;
         c.m_ID = evt.m_Kidv;
 
-        bool bExists = m_WalletDB->find(c);
+        if (ApplyUtxoEvent(evt, c, m_WalletDB->find(c)))
+            m_WalletDB->save(c);
+    }
+
+    bool Wallet::ApplyUtxoEvent(const proto::UtxoEvent& evt, Coin& c, bool bExists)
+    {
 		c.m_maturity = evt.m_Maturity;
 
         LOG_INFO() << "CoinID: " << evt.m_Kidv << " Maturity=" << evt.m_Maturity << (evt.m_Added ? " Confirmed" : " Spent");
@@ -693,12 +779,12 @@ namespace beam
         else
         {
             if (!bExists)
-                return; // should alert!
+                return false; // should alert!
 
 			c.m_spentHeight = std::min(c.m_spentHeight, evt.m_Height); // reported spend height may be bigger than it actuall was (in case of macroblocks)
 		}
 
-        m_WalletDB->save(c);
+        return true;
     }
 
     void Wallet::OnRolledBack()
@@ -749,6 +835,7 @@ namespace beam
 
         RequestUtxoEvents();
 
+        DbBatch batch(m_WalletDB);
         auto t = m_Transactions;
         for (auto& p : t)
         {
@@ -124,6 +124,8 @@ namespace beam
         void RequestUtxoEvents();
         void AbortUtxoEvents();
         void ProcessUtxoEvent(const proto::UtxoEvent&);
+        bool ApplyUtxoEvent(const proto::UtxoEvent&, Coin&, bool bExists);
+        void FilterUtxoEvents(const std::vector<proto::UtxoEvent>&, std::vector<uint8_t>& vValid);
         void SetUtxoEventsHeight(Height);
         Height GetUtxoEventsHeightNext();
 
@@ -194,6 +194,8 @@ WalletClient::WalletClient(IWalletDB::Ptr walletDB, const std::string& nodeAddr)
     , m_async{ make_shared<WalletModelBridge>(*(static_cast<IWalletModelAsync*>(this)), *m_reactor) }
     , m_isConnected(false)
     , m_nodeAddrStr(nodeAddr)
+    , m_coinsHeight(0)
+    , m_coinsLoaded(false)
     , m_isRunning(false)
 {
     
@@ -321,21 +323,72 @@ bool WalletClient::isRunning() const
     return m_isRunning;
 }
 
-void WalletClient::onCoinsChanged()
+void WalletClient::onCoinsChanged(ChangeAction action, const std::vector<Coin>& items)
 {
-    onAllUtxoChanged(getUtxos());
-    // TODO may be it needs to delete
+    if ((ChangeAction::Reset == action) || !m_coinsLoaded)
+    {
+        loadCoins();
+        onAllUtxoChanged(getUtxos());
+    }
+    else if (ChangeAction::Removed == action)
+    {
+        for (const auto& coin : items)
+        {
+            removeCoin(coin.m_ID);
+        }
+        onUtxoChanged(action, items);
+    }
+    else
+    {
+        vector<Coin> changed;
+        changed.reserve(items.size());
+        for (const auto& coin : items)
+        {
+            changed.push_back(coin);
+            wallet::DeduceStatus(*m_walletDB, changed.back(), m_coinsHeight);
+            updateCoin(changed.back());
+        }
+        onUtxoChanged(action, changed);
+    }
+
     onStatus(getStatus());
 }
 
 void WalletClient::onTransactionChanged(ChangeAction action, std::vector<TxDescription>&& items)
 {
+    if (m_coinsLoaded)
+    {
+        // the tx state defines whether its coins are incoming/outgoing
+        vector<Coin::ID> ids;
+        for (const auto& tx : items)
+        {
+            auto range = m_coinsByTx.equal_range(tx.m_txId);
+            for (auto it = range.first; it != range.second; )
+            {
+                auto itCoin = m_coins.find(it->second);
+                bool bStale = (m_coins.end() == itCoin) ||
+                    ((itCoin->second.m_createTxId != tx.m_txId) && (itCoin->second.m_spentTxId != tx.m_txId));
+
+                if (bStale)
+                {
+                    it = m_coinsByTx.erase(it);
+                    continue;
+                }
+
+                ids.push_back(it->second);
+                ++it;
+            }
+        }
+        rededuceCoins(ids);
+    }
+
     onTxStatus(action, move(items));
     onStatus(getStatus());
 }
 
 void WalletClient::onSystemStateChanged()
 {
+    onHeightChanged();
     onStatus(getStatus());
 }
 
@@ -434,6 +487,116 @@ void WalletClient::getUtxosStatus()
     onAllUtxoChanged(getUtxos());
 }
 
+void WalletClient::loadCoins()
+{
+    m_coins.clear();
+    m_coinsByTx.clear();
+    m_maturingCoins.clear();
+    ZeroObject(m_totals);
+
+    m_coinsHeight = m_walletDB->getCurrentHeight();
+    m_walletDB->visit([this](const Coin& c)->bool
+    {
+        updateCoin(c);
+        return true;
+    });
+
+    m_coinsLoaded = true;
+}
+
+void WalletClient::updateCoin(const Coin& coin)
+{
+    auto it = m_coins.find(coin.m_ID);
+    if (m_coins.end() == it)
+    {
+        m_coins.emplace(coin.m_ID, coin);
+    }
+    else
+    {
+        m_totals.Remove(it->second);
+        it->second = coin;
+    }
+    m_totals.Add(coin);
+
+    auto addTx = [this](const TxID& txID, const Coin::ID& cid)
+    {
+        auto range = m_coinsByTx.equal_range(txID);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second == cid)
+                return;
+        }
+        m_coinsByTx.emplace(txID, cid);
+    };
+
+    if (coin.m_createTxId)
+        addTx(*coin.m_createTxId, coin.m_ID);
+    if (coin.m_spentTxId)
+        addTx(*coin.m_spentTxId, coin.m_ID);
+
+    if (Coin::Status::Maturing == coin.m_status)
+        m_maturingCoins.emplace(coin.m_maturity, coin.m_ID);
+}
+
+void WalletClient::removeCoin(const Coin::ID& cid)
+{
+    auto it = m_coins.find(cid);
+    if (m_coins.end() != it)
+    {
+        m_totals.Remove(it->second);
+        m_coins.erase(it);
+    }
+}
+
+void WalletClient::rededuceCoins(const vector<Coin::ID>& ids)
+{
+    vector<Coin> changed;
+    for (const auto& cid : ids)
+    {
+        auto it = m_coins.find(cid);
+        if (m_coins.end() == it)
+            continue;
+
+        Coin coin = it->second;
+        wallet::DeduceStatus(*m_walletDB, coin, m_coinsHeight);
+        if (coin.m_status == it->second.m_status)
+            continue;
+
+        updateCoin(coin);
+        changed.push_back(coin);
+    }
+
+    if (!changed.empty())
+        onUtxoChanged(ChangeAction::Updated, changed);
+}
+
+void WalletClient::onHeightChanged()
+{
+    if (!m_coinsLoaded)
+        return;
+
+    Height h = m_walletDB->getCurrentHeight();
+    if (h < m_coinsHeight)
+    {
+        // reorg, the matured coins may become maturing again. Rare enough to re-read all of them
+        loadCoins();
+        onAllUtxoChanged(getUtxos());
+        return;
+    }
+
+    m_coinsHeight = h;
+
+    vector<Coin::ID> ids;
+    auto itEnd = m_maturingCoins.upper_bound(h);
+    for (auto it = m_maturingCoins.begin(); it != itEnd; ++it)
+    {
+        ids.push_back(it->second);
+    }
+    m_maturingCoins.erase(m_maturingCoins.begin(), itEnd);
+
+    rededuceCoins(ids);
+}
+
 void WalletClient::getAddresses(bool own)
 {
     onAddresses(own, m_walletDB->getAddresses(own));
@@ -634,15 +797,17 @@ void WalletClient::refresh()
     }
 }
 
-WalletStatus WalletClient::getStatus() const
+WalletStatus WalletClient::getStatus()
 {
+    if (!m_coinsLoaded)
+        loadCoins();
+
     WalletStatus status;
-	wallet::Totals totals(*m_walletDB);
 
-    status.available = totals.Avail;
-    status.receiving = totals.Incoming;
-    status.sending = totals.Outgoing;
-    status.maturing = totals.Maturing;
+    status.available = m_totals.Avail;
+    status.receiving = m_totals.Incoming;
+    status.sending = m_totals.Outgoing;
+    status.maturing = m_totals.Maturing;
 
     status.update.lastTime = m_walletDB->getLastUpdateTime();
 
@@ -652,14 +817,17 @@ WalletStatus WalletClient::getStatus() const
     return status;
 }
 
-vector<Coin> WalletClient::getUtxos() const
+vector<Coin> WalletClient::getUtxos()
 {
+    if (!m_coinsLoaded)
+        loadCoins();
+
     vector<Coin> utxos;
-    m_walletDB->visit([&utxos](const Coin& c)->bool
+    utxos.reserve(m_coins.size());
+    for (const auto& v : m_coins)
     {
-        utxos.push_back(c);
-        return true;
-    });
+        utxos.push_back(v.second);
+    }
     return utxos;
 }
 
@@ -22,6 +22,7 @@
 
 #include <thread>
 #include <atomic>
+#include <map>
 
 struct WalletStatus
 {
@@ -61,6 +62,7 @@ protected:
     virtual void onSyncProgressUpdated(int done, int total) = 0;
     virtual void onChangeCalculated(beam::Amount change) = 0;
     virtual void onAllUtxoChanged(const std::vector<beam::Coin>& utxos) = 0;
+    virtual void onUtxoChanged(beam::ChangeAction, const std::vector<beam::Coin>& utxos) = 0;
     virtual void onAddresses(bool own, const std::vector<beam::WalletAddress>& addresses) = 0;
     virtual void onGeneratedNewAddress(const beam::WalletAddress& walletAddr) = 0;
     virtual void onChangeCurrentWalletIDs(beam::WalletID senderID, beam::WalletID receiverID) = 0;
@@ -70,9 +72,12 @@ protected:
     virtual void onSendMoneyVerified() = 0;
     virtual void onCantSendToExpired() = 0;
 
+    // the cached coins, with the status deduced
+    std::vector<beam::Coin> getUtxos();
+
 private:
 
-    void onCoinsChanged() override;
+    void onCoinsChanged(beam::ChangeAction action, const std::vector<beam::Coin>& items) override;
     void onTransactionChanged(beam::ChangeAction action, std::vector<beam::TxDescription>&& items) override;
     void onSystemStateChanged() override;
     void onAddressChanged() override;
@@ -96,8 +101,13 @@ private:
     void getNetworkStatus() override;
     void refresh() override;
 
-    WalletStatus getStatus() const;
-    std::vector<beam::Coin> getUtxos() const;
+    WalletStatus getStatus();
+
+    void loadCoins();
+    void updateCoin(const beam::Coin&); // the status must be deduced
+    void removeCoin(const beam::Coin::ID&);
+    void rededuceCoins(const std::vector<beam::Coin::ID>&);
+    void onHeightChanged();
 
     void nodeConnectionFailed(const beam::proto::NodeConnection::DisconnectReason&);
     void nodeConnectedStatusChanged(bool isNodeConnected);
@@ -116,5 +126,17 @@ private:
 
     std::string m_nodeAddrStr;
 
+    // all the coins and their totals, kept up to date by the DB notifications, so that a change of N coins costs O(N).
+    // Loaded on first use
+    std::map<beam::Coin::ID, beam::Coin> m_coins;
+    beam::wallet::Totals m_totals;
+    beam::Height m_coinsHeight;
+    bool m_coinsLoaded;
+
+    // coins whose status depends on the tx state (created or spent by it), and the maturing ones by maturity.
+    // May contain stale entries, they're verified on use
+    std::multimap<beam::TxID, beam::Coin::ID> m_coinsByTx;
+    std::multimap<beam::Height, beam::Coin::ID> m_maturingCoins;
+
     std::atomic<bool> m_isRunning;
 };
\ No newline at end of file
@@ -87,6 +87,26 @@
 
 #define TX_PARAMS_FIELDS ENUM_TX_PARAMS_FIELDS(LIST, COMMA, )
 
+// denormalized TxDescription, maintained along with the tx parameters. Used for the history browsing
+#define ENUM_TX_SUMMARY_FIELDS(each, sep, obj) \
+    each(txID,           txId,           BLOB NOT NULL PRIMARY KEY, obj) sep \
+    each(createTime,     createTime,     INTEGER NOT NULL, obj) sep \
+    each(status,         status,         INTEGER NOT NULL, obj) sep \
+    each(peerID,         peerId,         BLOB NOT NULL, obj) sep \
+    each(myID,           myId,           BLOB NOT NULL, obj) sep \
+    each(amount,         amount,         INTEGER NOT NULL, obj) sep \
+    each(fee,            fee,            INTEGER NOT NULL, obj) sep \
+    each(change,         change,         INTEGER NOT NULL, obj) sep \
+    each(minHeight,      minHeight,      INTEGER NOT NULL, obj) sep \
+    each(message,        message,        BLOB, obj) sep \
+    each(modifyTime,     modifyTime,     INTEGER NOT NULL, obj) sep \
+    each(sender,         sender,         INTEGER NOT NULL, obj) sep \
+    each(kernelID,       kernelID,       BLOB NOT NULL, obj) sep \
+    each(failureReason,  failureReason,  INTEGER NOT NULL, obj)
+
+#define TX_SUMMARY_FIELDS ENUM_TX_SUMMARY_FIELDS(LIST, COMMA, )
+#define TX_SUMMARY_NAME "txsummary"
+
 #define TblStates            "States"
 #define TblStates_Height     "Height"
 #define TblStates_Hdr        "State"
@@ -137,7 +157,7 @@ namespace beam
 
         struct CoinSelector3
         {
-            typedef std::vector<Coin> Coins;
+            typedef std::vector<const Coin*> Coins;
             typedef std::vector<size_t> Indexes;
 
             using Result = pair<Amount, Indexes>;
@@ -244,7 +264,7 @@ namespace beam
                 part.m_Goal = goal;
 
                 for (size_t i = iEnd; i--; )
-                    part.AddItem(m_Coins[i].m_ID.m_Value, i);
+                    part.AddItem(m_Coins[i]->m_ID.m_Value, i);
             }
 
             Result Select(Amount amount)
@@ -311,7 +331,7 @@ namespace beam
                         res.second.push_back(link.m_iElement);
                         iEnd = link.m_iElement;
 
-                        Amount v = m_Coins[link.m_iElement].m_ID.m_Value;
+                        Amount v = m_Coins[link.m_iElement]->m_ID.m_Value;
                         res.first += v;
 
                         if (bShouldRetry && (amount <= res.first + nOvershoot*2))
@@ -558,7 +578,7 @@ namespace beam
         };
 
         template<typename T>
-        void deserialize(T& value, ByteBuffer& blob)
+        void deserialize(T& value, const ByteBuffer& blob)
         {
             if (!blob.empty())
             {
@@ -572,12 +592,49 @@ namespace beam
             }
         }
 
-        void deserialize(ByteBuffer& value, ByteBuffer& blob)
+        void deserialize(ByteBuffer& value, const ByteBuffer& blob)
         {
             value = blob;
         }
     }
 
+    namespace
+    {
+        // queries which are prepared once per connection and then reused
+        struct Query
+        {
+            enum Enum
+            {
+                CoinSelect,
+                CoinsCreatedByTx,
+                CoinGet,
+                CoinIns,
+                CoinUpd,
+                CoinDel,
+                CoinFind,
+                CoinEnum,
+                VarSet,
+                VarGet,
+                TxParamsGet,
+                TxParamSet,
+                TxParamsDel,
+                TxSummarySet,
+                TxSummaryDel,
+                TxHistory,
+                TxHistoryPage, // all the combinations of the filter and the cursor
+                TxHistoryPageLast = TxHistoryPage + 7,
+                TransferredByTx,
+                AddressGet,
+                StateEnum,
+                StateEnumBelow,
+                StateGet,
+                StateIns,
+
+                count
+            };
+        };
+    }
+
     namespace sqlite
     {
         struct Statement
@@ -585,11 +642,39 @@ namespace beam
             Statement(sqlite3* db, const char* sql)
                 : _db(db)
                 , _stm(nullptr)
+                , _cached(false)
             {
                 int ret = sqlite3_prepare_v2(_db, sql, -1, &_stm, nullptr);
                 throwIfError(ret, _db);
             }
 
+            Statement(const WalletDB& db, Query::Enum query, const char* sql)
+                : _db(db._db)
+                , _stm(nullptr)
+                , _cached(true)
+            {
+                vector<sqlite3_stmt*>& v = db.m_Statements;
+                if (v.empty())
+                    v.resize(Query::count, nullptr);
+
+                sqlite3_stmt*& stm = v[query];
+                if (!stm)
+                {
+                    int ret = sqlite3_prepare_v2(_db, sql, -1, &stm, nullptr);
+                    throwIfError(ret, _db);
+                }
+
+                if (sqlite3_stmt_busy(stm))
+                {
+                    // the cached one is in the middle of the enumeration (nested call), use a private copy
+                    _cached = false;
+                    int ret = sqlite3_prepare_v2(_db, sql, -1, &_stm, nullptr);
+                    throwIfError(ret, _db);
+                }
+                else
+                    _stm = stm;
+            }
+
             void Reset()
             {
                 sqlite3_clear_bindings(_stm);
@@ -696,6 +781,12 @@ namespace beam
                 throwIfError(ret, _db);
             }
 
+            void bind(int col, TxFailureReason val)
+            {
+                int ret = sqlite3_bind_int(_stm, col, static_cast<int>(val));
+                throwIfError(ret, _db);
+            }
+
             bool step()
             {
                 int ret = sqlite3_step(_stm);
@@ -729,6 +820,11 @@ namespace beam
                 status = static_cast<TxStatus>(sqlite3_column_int(_stm, col));
             }
 
+            void get(int col, TxFailureReason& reason)
+            {
+                reason = static_cast<TxFailureReason>(sqlite3_column_int(_stm, col));
+            }
+
             void get(int col, bool& val)
             {
                 val = sqlite3_column_int(_stm, col) == 0 ? false : true;
@@ -817,20 +913,26 @@ namespace beam
 
             ~Statement()
             {
-                sqlite3_finalize(_stm);
+                if (_cached)
+                    Reset();
+                else
+                    sqlite3_finalize(_stm);
             }
         private:
 
             sqlite3 * _db;
             sqlite3_stmt* _stm;
+            bool _cached;
         };
 
         struct Transaction
         {
-            Transaction(sqlite3* db)
-                : _db(db)
+            Transaction(WalletDB& db)
+                : _walletDB(db)
+                , _db(db._db)
                 , _commited(false)
                 , _rollbacked(false)
+                , _nested(!sqlite3_get_autocommit(_db))
             {
                 begin();
             }
@@ -843,13 +945,14 @@ namespace beam
 
             void begin()
             {
-                int ret = sqlite3_exec(_db, "BEGIN;", nullptr, nullptr, nullptr);
+                // inside of another transaction (i.e. a batch) only a savepoint is created
+                int ret = sqlite3_exec(_db, _nested ? "SAVEPOINT wtx;" : "BEGIN;", nullptr, nullptr, nullptr);
                 throwIfError(ret, _db);
             }
 
             bool commit()
             {
-                int ret = sqlite3_exec(_db, "COMMIT;", nullptr, nullptr, nullptr);
+                int ret = sqlite3_exec(_db, _nested ? "RELEASE wtx;" : "COMMIT;", nullptr, nullptr, nullptr);
 
                 _commited = (ret == SQLITE_OK);
                 return _commited;
@@ -857,15 +960,18 @@ namespace beam
 
             void rollback()
             {
-                int ret = sqlite3_exec(_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+                int ret = sqlite3_exec(_db, _nested ? "ROLLBACK TO wtx; RELEASE wtx;" : "ROLLBACK;", nullptr, nullptr, nullptr);
+                _walletDB.OnRolledBack();
                 throwIfError(ret, _db);
 
                 _rollbacked = true;
             }
         private:
+            WalletDB& _walletDB;
             sqlite3 * _db;
             bool _commited;
             bool _rollbacked;
+            bool _nested;
         };
     }
 
@@ -876,7 +982,8 @@ namespace beam
         const char* SystemStateIDName = "SystemStateID";
         const char* LastUpdateTimeName = "LastUpdateTime";
         const int BusyTimeoutMs = 1000;
-        const int DbVersion = 12;
+        const int DbVersion = 13;
+		const int DbVersion12 = 12;
 		const int DbVersion11 = 11;
 		const int DbVersion10 = 10;
 	}
@@ -980,6 +1087,16 @@ namespace beam
 	     int ret = sqlite3_exec(_db, req, nullptr, nullptr, nullptr);
 	     throwIfError(ret, _db);
 	}
+
+	void WalletDB::CreateTxSummaryTable()
+	{
+		const char* req = "CREATE TABLE " TX_SUMMARY_NAME " (" ENUM_TX_SUMMARY_FIELDS(LIST_WITH_TYPES, COMMA, ) ");"
+			"CREATE INDEX TxSummaryTimeIndex ON " TX_SUMMARY_NAME "(createTime DESC, txID);"
+			"CREATE INDEX TxSummaryStatusIndex ON " TX_SUMMARY_NAME "(status, createTime DESC, txID);"
+			"CREATE INDEX TxSummaryPeerIndex ON " TX_SUMMARY_NAME "(peerID, createTime DESC, txID);";
+		int ret = sqlite3_exec(_db, req, nullptr, nullptr, nullptr);
+		throwIfError(ret, _db);
+	}
 	
     IWalletDB::Ptr WalletDB::init(const string& path, const SecString& password, const ECC::NoLeak<ECC::uintBig>& secretKey)
     {
@@ -1014,6 +1131,8 @@ namespace beam
                 throwIfError(ret, walletDB->_db);
             }
 
+            walletDB->CreateTxSummaryTable();
+
             {
                 const char* req = "CREATE TABLE [" TblStates "] ("
                     "[" TblStates_Height    "] INTEGER NOT NULL PRIMARY KEY,"
@@ -1057,7 +1176,7 @@ namespace beam
                     int version = 0;
 					wallet::getVar(*walletDB, Version, version);
 
-					sqlite::Transaction trans(walletDB->_db);
+					sqlite::Transaction trans(*walletDB);
 
 					switch (version)
 					{
@@ -1126,6 +1245,26 @@ namespace beam
 							}
 						}
 
+						// no break;
+
+					case DbVersion12:
+						{
+							LOG_INFO() << "Converting DB from format 12";
+
+							// the tx history is moved to the summary table
+							walletDB->CreateTxSummaryTable();
+
+							vector<TxID> txIDs;
+							{
+								const char* req = "SELECT DISTINCT txID FROM " TX_PARAMS_NAME ";";
+								for (sqlite::Statement stm(walletDB->_db, req); stm.step(); )
+									stm.get(0, txIDs.emplace_back());
+							}
+
+							for (const auto& txID : txIDs)
+								walletDB->updateTxSummary(txID);
+						}
+
 						wallet::setVar(*walletDB, Version, DbVersion);
 
 						// no break;
@@ -1203,17 +1342,33 @@ namespace beam
 
     WalletDB::WalletDB()
         : _db(nullptr)
+        , m_BatchDepth(0)
+        , m_CoinIndexValid(false)
+        , m_CoinsRolledBack(false)
     {
     }
 
     WalletDB::WalletDB(const ECC::NoLeak<ECC::uintBig>& secretKey)
         : _db(nullptr)
+        , m_BatchDepth(0)
+        , m_CoinIndexValid(false)
+        , m_CoinsRolledBack(false)
     {
         ECC::HKdf::Create(m_pKdf, secretKey.V);
     }
 
     WalletDB::~WalletDB()
     {
+        if (m_pBatch)
+        {
+            m_pBatch->commit();
+            m_pBatch.reset();
+        }
+
+        for (sqlite3_stmt* pStmt : m_Statements)
+            if (pStmt)
+                sqlite3_finalize(pStmt); // don't care about retval
+
         if (_db)
         {
             sqlite3_close_v2(_db);
@@ -1244,29 +1399,20 @@ namespace beam
 
     vector<Coin> WalletDB::selectCoins(Amount amount)
     {
-        vector<Coin> coins, coinsSel;
-        Block::SystemState::ID stateID = {};
-        getSystemStateID(stateID);
+        vector<Coin> coinsSel;
+        Height h = getCurrentHeight();
 
+        // the index is ordered by value, same as the selector expects
+        CoinSelector3::Coins coins;
+        for (const auto& v : get_CoinIndex())
         {
-            sqlite::Statement stm(_db, "SELECT " STORAGE_FIELDS " FROM " STORAGE_NAME " WHERE maturity>=0 AND maturity<=?1 AND spentHeight<0 ORDER BY amount ASC");
-            stm.bind(1, stateID.m_Height);
+            const Coin& coin = v.second;
+            if ((coin.m_maturity > h) || (Coin::Status::Available != wallet::GetCoinStatus(*this, coin, h)))
+                continue;
 
-            while (stm.step())
-            {
-                auto& coin = coins.emplace_back();
-                int colIdx = 0;
-                ENUM_ALL_STORAGE_FIELDS(STM_GET_LIST, NOSEP, coin);
-
-				wallet::DeduceStatus(*this, coin, stateID.m_Height);
-				if (Coin::Status::Available != coin.m_status)
-					coins.pop_back();
-				else
-				{
-					if (coin.m_ID.m_Value >= amount)
-						break;
-				}
-            }
+            coins.push_back(&coin);
+            if (coin.m_ID.m_Value >= amount)
+                break;
         }
 
         CoinSelector3 csel(coins);
@@ -1277,17 +1423,53 @@ namespace beam
             coinsSel.reserve(res.second.size());
 
             for (size_t j = 0; j < res.second.size(); j++)
-                coinsSel.push_back(std::move(coins[res.second[j]]));
+            {
+                coinsSel.push_back(*coins[res.second[j]]);
+                coinsSel.back().m_status = Coin::Status::Available;
+            }
         }
 
 
         return coinsSel;
     }
 
+    WalletDB::CoinIndex& WalletDB::get_CoinIndex()
+    {
+        if (!m_CoinIndexValid)
+        {
+            m_CoinIndex.clear();
+
+            sqlite::Statement stm(*this, Query::CoinSelect, "SELECT " STORAGE_FIELDS " FROM " STORAGE_NAME " WHERE maturity>=0 AND spentHeight<0;");
+            while (stm.step())
+            {
+                Coin coin;
+                int colIdx = 0;
+                ENUM_ALL_STORAGE_FIELDS(STM_GET_LIST, NOSEP, coin);
+
+                m_CoinIndex.emplace(coin.m_ID, coin);
+            }
+
+            m_CoinIndexValid = true;
+        }
+
+        return m_CoinIndex;
+    }
+
+    void WalletDB::updateCoinIndex(const Coin& coin)
+    {
+        if (!m_CoinIndexValid)
+            return; // would be loaded with the actual data
+
+        if ((MaxHeight != coin.m_maturity) && (MaxHeight == coin.m_spentHeight))
+            m_CoinIndex[coin.m_ID] = coin;
+        else
+            m_CoinIndex.erase(coin.m_ID);
+    }
+
     std::vector<Coin> WalletDB::getCoinsCreatedByTx(const TxID& txId)
     {
         // select all coins for TxID
-        sqlite::Statement stm(_db, "SELECT " STORAGE_FIELDS " FROM " STORAGE_NAME " WHERE createTxID=?1 ORDER BY amount DESC;");
+        sqlite::Statement stm(*this, Query::CoinsCreatedByTx, "SELECT " STORAGE_FIELDS " FROM " STORAGE_NAME " WHERE createTxID=?1 ORDER BY amount DESC;");
         stm.bind(1, txId);
 
         vector<Coin> coins;
@@ -1316,7 +1498,7 @@ namespace beam
         for (const auto& cid : ids)
         {
             const char* req = "SELECT * FROM " STORAGE_NAME STORAGE_WHERE_ID;
-            sqlite::Statement stm(_db, req);
+            sqlite::Statement stm(*this, Query::CoinGet, req);
 
             static_assert(sizeof(DummyWrapper) == sizeof(cid), "");
             const DummyWrapper& wrp = reinterpret_cast<const DummyWrapper&>(cid);
@@ -1342,11 +1524,13 @@ namespace beam
 	void WalletDB::insertRaw(const Coin& coin)
 	{
 		const char* req = "INSERT INTO " STORAGE_NAME " (" ENUM_ALL_STORAGE_FIELDS(LIST, COMMA, ) ") VALUES(" ENUM_ALL_STORAGE_FIELDS(BIND_LIST, COMMA, ) ");";
-		sqlite::Statement stm(_db, req);
+		sqlite::Statement stm(*this, Query::CoinIns, req);
 
 		int colIdx = 0;
 		ENUM_ALL_STORAGE_FIELDS(STM_BIND_LIST, NOSEP, coin);
 		stm.step();
+
+		updateCoinIndex(coin);
 	}
 
 	void WalletDB::insertNew(Coin& coin)
@@ -1363,14 +1547,18 @@ namespace beam
 	bool WalletDB::updateRaw(const Coin& coin)
 	{
 		const char* req = "UPDATE " STORAGE_NAME " SET " ENUM_STORAGE_FIELDS(SET_LIST, COMMA, ) STORAGE_WHERE_ID  ";";
-		sqlite::Statement stm(_db, req);
+		sqlite::Statement stm(*this, Query::CoinUpd, req);
 
 		int colIdx = 0;
 		ENUM_STORAGE_FIELDS(STM_BIND_LIST, NOSEP, coin);
 		ENUM_STORAGE_ID(STM_BIND_LIST, NOSEP, coin);
 		stm.step();
 
-		return sqlite3_changes(_db) > 0;
+		if (sqlite3_changes(_db) <= 0)
+			return false;
+
+		updateCoinIndex(coin);
+		return true;
 	}
 
 	void WalletDB::saveRaw(const Coin& coin)
@@ -1381,13 +1569,13 @@ namespace beam
 
     void WalletDB::store(Coin& coin)
     {
-        sqlite::Transaction trans(_db);
+        sqlite::Transaction trans(*this);
 
         coin.m_ID.m_Idx = get_RandomID();
 		insertNew(coin);
 
         trans.commit();
-        notifyCoinsChanged();
+        notifyCoinsChanged(ChangeAction::Added, { coin });
     }
 
     void WalletDB::store(std::vector<Coin>& coins)
@@ -1395,7 +1583,7 @@ namespace beam
         if (coins.empty())
             return;
 
-        sqlite::Transaction trans(_db);
+        sqlite::Transaction trans(*this);
 
         uint64_t nKeyIndex = get_RandomID();
         for (auto& coin : coins)
@@ -1406,13 +1594,13 @@ namespace beam
         }
 
         trans.commit();
-        notifyCoinsChanged();
+        notifyCoinsChanged(ChangeAction::Added, coins);
     }
 
     void WalletDB::save(const Coin& coin)
     {
 		saveRaw(coin);
-        notifyCoinsChanged();
+        notifyCoinsChanged(ChangeAction::Updated, { coin });
     }
 
     void WalletDB::save(const vector<Coin>& coins)
@@ -1420,14 +1608,14 @@ namespace beam
         if (coins.empty())
             return;
 
-        sqlite::Transaction trans(_db);
+        sqlite::Transaction trans(*this);
         for (auto& coin : coins)
         {
 			saveRaw(coin);
         }
 
         trans.commit();
-        notifyCoinsChanged();
+        notifyCoinsChanged(ChangeAction::Updated, coins);
     }
 
 	uint64_t WalletDB::get_RandomID()
@@ -1468,20 +1656,24 @@ namespace beam
     {
         if (coins.size())
         {
-            sqlite::Transaction trans(_db);
+            sqlite::Transaction trans(*this);
 
-            for (const auto& cid : coins)
-                removeImpl(cid);
+            vector<Coin> items(coins.size());
+            for (size_t i = 0; i < coins.size(); i++)
+            {
+                removeImpl(coins[i]);
+                items[i].m_ID = coins[i];
+            }
 
             trans.commit();
-            notifyCoinsChanged();
+            notifyCoinsChanged(ChangeAction::Removed, items);
         }
     }
 
     void WalletDB::removeImpl(const Coin::ID& cid)
     {
         const char* req = "DELETE FROM " STORAGE_NAME STORAGE_WHERE_ID;
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*this, Query::CoinDel, req);
 
         struct DummyWrapper {
             Coin::ID m_ID;
@@ -1494,12 +1686,16 @@ namespace beam
         STORAGE_BIND_ID(wrp)
 
         stm.step();
+        m_CoinIndex.erase(cid);
     }
 
     void WalletDB::remove(const Coin::ID& cid)
     {
         removeImpl(cid);
-        notifyCoinsChanged();
+
+        Coin coin;
+        coin.m_ID = cid;
+        notifyCoinsChanged(ChangeAction::Removed, { coin });
     }
 
     void WalletDB::clear()
@@ -1507,14 +1703,15 @@ namespace beam
         {
             sqlite::Statement stm(_db, "DELETE FROM " STORAGE_NAME ";");
             stm.step();
-            notifyCoinsChanged();
+            m_CoinIndex.clear();
+            notifyCoinsChanged(ChangeAction::Reset, {});
         }
     }
 
     bool WalletDB::find(Coin& coin)
     {
         const char* req = "SELECT " ENUM_STORAGE_FIELDS(LIST, COMMA, ) " FROM " STORAGE_NAME STORAGE_WHERE_ID;
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*this, Query::CoinFind, req);
 
         int colIdx = 0;
         STORAGE_BIND_ID(coin)
@@ -1533,7 +1730,7 @@ namespace beam
     void WalletDB::visit(function<bool(const Coin& coin)> func)
     {
         const char* req = "SELECT " STORAGE_FIELDS " FROM " STORAGE_NAME " ORDER BY ROWID;";
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*this, Query::CoinEnum, req);
 
 		Height h = getCurrentHeight();
 
@@ -1555,7 +1752,7 @@ namespace beam
     {
         const char* req = "INSERT or REPLACE INTO " VARIABLES_NAME " (" VARIABLES_FIELDS ") VALUES(?1, ?2);";
 
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*this, Query::VarSet, req);
 
         stm.bind(1, name);
         stm.bind(2, data, size);
@@ -1567,7 +1764,7 @@ namespace beam
     {
         const char* req = "SELECT value FROM " VARIABLES_NAME " WHERE name=?1;";
 
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*this, Query::VarGet, req);
         stm.bind(1, name);
 
         return
@@ -1579,7 +1776,7 @@ namespace beam
     {
         const char* req = "SELECT value FROM " VARIABLES_NAME " WHERE name=?1;";
 
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*this, Query::VarGet, req);
         stm.bind(1, name);
         if (stm.step())
         {
@@ -1624,7 +1821,7 @@ namespace beam
 
     void WalletDB::rollbackConfirmedUtxo(Height minHeight)
     {
-        sqlite::Transaction trans(_db);
+        sqlite::Transaction trans(*this);
 
 		// Transactions
 		{
@@ -1669,41 +1866,73 @@ namespace beam
 			stm.step();
 		}
 
+        m_CoinIndexValid = false;
+
         trans.commit();
-        notifyCoinsChanged();
+        notifyCoinsChanged(ChangeAction::Reset, {});
     }
 
     vector<TxDescription> WalletDB::getTxHistory(uint64_t start, int count)
     {
-        // TODO this is temporary solution
-        int txCount = 0;
-        {
-            sqlite::Statement stm(_db, "SELECT COUNT(DISTINCT txID) FROM " TX_PARAMS_NAME " ;");
-            stm.step();
-            stm.get(0, txCount);
-        }
-        
+        const char* req = "SELECT " TX_SUMMARY_FIELDS " FROM " TX_SUMMARY_NAME " ORDER BY createTime DESC, txID LIMIT ?1 OFFSET ?2;";
+
+        sqlite::Statement stm(*this, Query::TxHistory, req);
+        stm.bind(1, count);
+        stm.bind(2, start);
+
         vector<TxDescription> res;
-        if (txCount > 0)
+        while (stm.step())
         {
-            res.reserve(static_cast<size_t>(min(txCount, count)));
-            const char* req = "SELECT DISTINCT txID FROM " TX_PARAMS_NAME " LIMIT ?1 OFFSET ?2 ;";
+            auto& tx = res.emplace_back();
+            int colIdx = 0;
+            ENUM_TX_SUMMARY_FIELDS(STM_GET_LIST, NOSEP, tx);
+        }
 
-            sqlite::Statement stm(_db, req);
-            stm.bind(1, count);
-            stm.bind(2, start);
+        return res;
+    }
 
-            while (stm.step())
-            {
-                TxID txID;
-                stm.get(0, txID);
-                auto t = getTx(txID);
-                if (t.is_initialized())
-                {
-                    res.emplace_back(*t);
-                }
-            }
-            sort(res.begin(), res.end(), [](const auto& left, const auto& right) {return left.m_createTime > right.m_createTime; });
+    vector<TxDescription> WalletDB::getTxHistory(const TxHistoryFilter& filter, const TxDescription* pLast, int count)
+    {
+        // The query depends on which conditions are present. Each combination is prepared once and cached.
+        // The cursor (createTime, txID) is served by the indexes, so the page cost doesn't depend on its position in the history
+        static const char* const s_pCond[] = {
+            " AND status=?1",
+            " AND peerID=?2",
+            " AND createTime<=?3 AND (createTime<?3 OR txID>?4)"
+        };
+
+        uint32_t nMask = 0;
+        if (filter.m_Status)
+            nMask |= 1;
+        if (filter.m_PeerID)
+            nMask |= 2;
+        if (pLast)
+            nMask |= 4;
+
+        std::string sReq = "SELECT " TX_SUMMARY_FIELDS " FROM " TX_SUMMARY_NAME " WHERE 1";
+        for (uint32_t i = 0; i < _countof(s_pCond); i++)
+            if (nMask & (1 << i))
+                sReq += s_pCond[i];
+        sReq += " ORDER BY createTime DESC, txID LIMIT ?5;";
+
+        sqlite::Statement stm(*this, static_cast<Query::Enum>(Query::TxHistoryPage + nMask), sReq.c_str());
+        if (filter.m_Status)
+            stm.bind(1, *filter.m_Status);
+        if (filter.m_PeerID)
+            stm.bind(2, *filter.m_PeerID);
+        if (pLast)
+        {
+            stm.bind(3, pLast->m_createTime);
+            stm.bind(4, pLast->m_txId);
+        }
+        stm.bind(5, count);
+
+        vector<TxDescription> res;
+        while (stm.step())
+        {
+            auto& tx = res.emplace_back();
+            int colIdx = 0;
+            ENUM_TX_SUMMARY_FIELDS(STM_GET_LIST, NOSEP, tx);
         }
 
         return res;
@@ -1711,9 +1940,7 @@ namespace beam
 
     boost::optional<TxDescription> WalletDB::getTx(const TxID& txId)
     {
-        const char* req = "SELECT * FROM " TX_PARAMS_NAME " WHERE txID=?1;";
-        sqlite::Statement stm(_db, req);
-        stm.bind(1, txId);
+        const TxParameters& params = get_TxParameters(txId);
 
         TxDescription txDescription;
         txDescription.m_txId = txId;
@@ -1724,54 +1951,50 @@ namespace beam
             wallet::TxParameterID::IsSender };
         std::set<wallet::TxParameterID> gottenParams;
 
-        while (stm.step())
+        for (const auto& parameter : params)
         {
-            TxParameter parameter = {};
-            int colIdx = 0;
-            ENUM_TX_PARAMS_FIELDS(STM_GET_LIST, NOSEP, parameter);
+            gottenParams.emplace(parameter.first);
 
-            gottenParams.emplace(static_cast<wallet::TxParameterID>(parameter.m_paramID));
-
-            switch (static_cast<wallet::TxParameterID>(parameter.m_paramID))
+            switch (parameter.first)
             {
             case wallet::TxParameterID::Amount:
-                deserialize(txDescription.m_amount, parameter.m_value);
+                deserialize(txDescription.m_amount, parameter.second);
                 break;
             case wallet::TxParameterID::Fee:
-                deserialize(txDescription.m_fee, parameter.m_value);
+                deserialize(txDescription.m_fee, parameter.second);
                 break;
             case wallet::TxParameterID::MinHeight:
-                deserialize(txDescription.m_minHeight, parameter.m_value);
+                deserialize(txDescription.m_minHeight, parameter.second);
                 break;
             case wallet::TxParameterID::PeerID:
-                deserialize(txDescription.m_peerId, parameter.m_value);
+                deserialize(txDescription.m_peerId, parameter.second);
                 break;
             case wallet::TxParameterID::MyID:
-                deserialize(txDescription.m_myId, parameter.m_value);
+                deserialize(txDescription.m_myId, parameter.second);
                 break;
             case wallet::TxParameterID::CreateTime:
-                deserialize(txDescription.m_createTime, parameter.m_value);
+                deserialize(txDescription.m_createTime, parameter.second);
                 break;
             case wallet::TxParameterID::IsSender:
-                deserialize(txDescription.m_sender, parameter.m_value);
+                deserialize(txDescription.m_sender, parameter.second);
                 break;
             case wallet::TxParameterID::Message:
-                deserialize(txDescription.m_message, parameter.m_value);
+                deserialize(txDescription.m_message, parameter.second);
                 break;
             case wallet::TxParameterID::Change:
-                deserialize(txDescription.m_change, parameter.m_value);
+                deserialize(txDescription.m_change, parameter.second);
                 break;
             case wallet::TxParameterID::ModifyTime:
-                deserialize(txDescription.m_modifyTime, parameter.m_value);
+                deserialize(txDescription.m_modifyTime, parameter.second);
                 break;
             case wallet::TxParameterID::Status:
-                deserialize(txDescription.m_status, parameter.m_value);
+                deserialize(txDescription.m_status, parameter.second);
                 break;
             case wallet::TxParameterID::KernelID:
-                deserialize(txDescription.m_kernelID, parameter.m_value);
+                deserialize(txDescription.m_kernelID, parameter.second);
                 break;
             case wallet::TxParameterID::FailureReason:
-                deserialize(txDescription.m_failureReason, parameter.m_value);
+                deserialize(txDescription.m_failureReason, parameter.second);
                 break;
 			default:
 				break; // suppress warning
@@ -1789,7 +2012,7 @@ namespace beam
     void WalletDB::saveTx(const TxDescription& p)
     {
         ChangeAction action = ChangeAction::Added;
-        sqlite::Transaction trans(_db);
+        sqlite::Transaction trans(*this);
 
         wallet::setTxParameter(*this, p.m_txId, wallet::TxParameterID::Amount, p.m_amount, false);
         wallet::setTxParameter(*this, p.m_txId, wallet::TxParameterID::Fee, p.m_fee, false);
@@ -1814,18 +2037,50 @@ namespace beam
         if (tx.is_initialized())
         {
             const char* req = "DELETE FROM " TX_PARAMS_NAME " WHERE txID=?1;";
-            sqlite::Statement stm(_db, req);
+            sqlite::Statement stm(*this, Query::TxParamsDel, req);
 
             stm.bind(1, txId);
 
             stm.step();
+            m_TxParameters.erase(txId);
+
+            {
+                sqlite::Statement stm2(*this, Query::TxSummaryDel, "DELETE FROM " TX_SUMMARY_NAME " WHERE txID=?1;");
+                stm2.bind(1, txId);
+                stm2.step();
+            }
+
             notifyTransactionChanged(ChangeAction::Removed, { *tx });
         }
     }
 
     void WalletDB::rollbackTx(const TxID& txId)
     {
-        sqlite::Transaction trans(_db);
+        sqlite::Transaction trans(*this);
+
+        // the coins to be affected, reported to the observers
+        vector<Coin> updated, removed;
+        {
+            const char* req = "SELECT " STORAGE_FIELDS " FROM " STORAGE_NAME " WHERE spentTxId=?1 OR (createTxId=?1 AND confirmHeight=?2);";
+            sqlite::Statement stm(_db, req);
+            stm.bind(1, txId);
+            stm.bind(2, MaxHeight);
+
+            while (stm.step())
+            {
+                Coin coin;
+                int colIdx = 0;
+                ENUM_ALL_STORAGE_FIELDS(STM_GET_LIST, NOSEP, coin);
+
+                if ((coin.m_createTxId == txId) && (MaxHeight == coin.m_confirmHeight))
+                    removed.push_back(coin);
+                else
+                {
+                    coin.m_spentTxId.reset();
+                    updated.push_back(coin);
+                }
+            }
+        }
 
         {
             const char* req = "UPDATE " STORAGE_NAME " SET spentTxId=NULL WHERE spentTxId=?1;";
@@ -1840,8 +2095,14 @@ namespace beam
 			stm.bind(2, MaxHeight);
 			stm.step();
         }
+        m_CoinIndexValid = false;
+
         trans.commit();
-        notifyCoinsChanged();
+
+        if (!updated.empty())
+            notifyCoinsChanged(ChangeAction::Updated, updated);
+        if (!removed.empty())
+            notifyCoinsChanged(ChangeAction::Removed, removed);
     }
 
     std::vector<WalletAddress> WalletDB::getAddresses(bool own) const
@@ -1865,7 +2126,7 @@ namespace beam
 
     void WalletDB::saveAddress(const WalletAddress& address)
     {
-        sqlite::Transaction trans(_db);
+        sqlite::Transaction trans(*this);
 
         {
             const char* selectReq = "SELECT * FROM " ADDRESSES_NAME " WHERE walletID=?1;";
@@ -1901,7 +2162,7 @@ namespace beam
 
     void WalletDB::setNeverExpirationForAll()
     {
-        sqlite::Transaction trans(_db);
+        sqlite::Transaction trans(*this);
 
         {
             const char* updateReq = "UPDATE " ADDRESSES_NAME " SET duration = ?1 WHERE OwnID != 0;";
@@ -1921,7 +2182,7 @@ namespace beam
     boost::optional<WalletAddress> WalletDB::getAddress(const WalletID& id)
     {
         const char* req = "SELECT * FROM " ADDRESSES_NAME " WHERE walletID=?1;";
-        sqlite::Statement stm(_db, req);
+        sqlite::Statement stm(*this, Query::AddressGet, req);
 
         stm.bind(1, id);
 
@@ -1972,77 +2233,158 @@ namespace beam
 
     bool WalletDB::setTxParameter(const TxID& txID, wallet::TxParameterID paramID, const ByteBuffer& blob, bool shouldNotifyAboutChanges)
     {
-        bool hasTx = getTx(txID).is_initialized();
+        ChangeAction action = ChangeAction::Updated;
         {
-            sqlite::Statement stm(_db, "SELECT * FROM " TX_PARAMS_NAME " WHERE txID=?1 AND paramID=?2;");
-
-            stm.bind(1, txID);
-            stm.bind(2, paramID);
-            if (stm.step())
+            const TxParameters& params = get_TxParameters(txID);
+            if (params.find(paramID) != params.end())
             {
                 // already set
                 if (paramID < wallet::TxParameterID::PrivateFirstParam)
                 {
                     return false;
                 }
-
-                sqlite::Statement stm2(_db, "UPDATE " TX_PARAMS_NAME  " SET value = ?3 WHERE txID = ?1 AND paramID = ?2;");
-                stm2.bind(1, txID);
-                stm2.bind(2, paramID);
-                stm2.bind(3, blob);
-                stm2.step();
-                if (shouldNotifyAboutChanges)
-                {
-                    auto tx = getTx(txID);
-                    if (tx.is_initialized())
-                    {
-                        notifyTransactionChanged(ChangeAction::Updated, { *tx });
-                    }
-                }
-                return true;
+            }
+            else if (shouldNotifyAboutChanges && !getTx(txID).is_initialized())
+            {
+                action = ChangeAction::Added;
             }
         }
-        
-        sqlite::Statement stm(_db, "INSERT INTO " TX_PARAMS_NAME " (" ENUM_TX_PARAMS_FIELDS(LIST, COMMA, ) ") VALUES(" ENUM_TX_PARAMS_FIELDS(BIND_LIST, COMMA, ) ");");
-        TxParameter parameter;
-        parameter.m_txID = txID;
-        parameter.m_paramID = static_cast<int>(paramID);
-        parameter.m_value = blob;
-        int colIdx = 0;
-        ENUM_TX_PARAMS_FIELDS(STM_BIND_LIST, NOSEP, parameter);
+
+        sqlite::Statement stm(*this, Query::TxParamSet, "INSERT OR REPLACE INTO " TX_PARAMS_NAME " (" ENUM_TX_PARAMS_FIELDS(LIST, COMMA, ) ") VALUES(" ENUM_TX_PARAMS_FIELDS(BIND_LIST, COMMA, ) ");");
+        stm.bind(1, txID);
+        stm.bind(2, paramID);
+        stm.bind(3, blob);
         stm.step();
+
+        // update the cache only after the DB accepted the value
+        get_TxParameters(txID)[paramID] = blob;
+
+        switch (paramID)
+        {
+        case wallet::TxParameterID::Amount:
+        case wallet::TxParameterID::Fee:
+        case wallet::TxParameterID::Change:
+        case wallet::TxParameterID::MinHeight:
+        case wallet::TxParameterID::PeerID:
+        case wallet::TxParameterID::MyID:
+        case wallet::TxParameterID::Message:
+        case wallet::TxParameterID::CreateTime:
+        case wallet::TxParameterID::ModifyTime:
+        case wallet::TxParameterID::IsSender:
+        case wallet::TxParameterID::Status:
+        case wallet::TxParameterID::KernelID:
+        case wallet::TxParameterID::FailureReason:
+            updateTxSummary(txID);
+            break;
+        default:
+            break; // not a part of the summary
+        }
+
         if (shouldNotifyAboutChanges)
         {
             auto tx = getTx(txID);
             if (tx.is_initialized())
             {
-                notifyTransactionChanged(hasTx ? ChangeAction::Updated : ChangeAction::Added, { *tx });
+                notifyTransactionChanged(action, { *tx });
             }
         }
         return true;
     }
 
+    void WalletDB::updateTxSummary(const TxID& txID)
+    {
+        auto pTx = getTx(txID);
+        if (!pTx)
+            return; // not complete yet
+
+        const TxDescription& tx = *pTx;
+        sqlite::Statement stm(*this, Query::TxSummarySet, "INSERT OR REPLACE INTO " TX_SUMMARY_NAME " (" TX_SUMMARY_FIELDS ") VALUES(" ENUM_TX_SUMMARY_FIELDS(BIND_LIST, COMMA, ) ");");
+        int colIdx = 0;
+        ENUM_TX_SUMMARY_FIELDS(STM_BIND_LIST, NOSEP, tx);
+        stm.step();
+    }
+
     bool WalletDB::getTxParameter(const TxID& txID, wallet::TxParameterID paramID, ByteBuffer& blob) const
     {
-        sqlite::Statement stm(_db, "SELECT * FROM " TX_PARAMS_NAME " WHERE txID=?1 AND paramID=?2;");
+        const TxParameters& params = get_TxParameters(txID);
+
+        auto it = params.find(paramID);
+        if (params.end() == it)
+            return false;
+
+        blob = it->second;
+        return true;
+    }
 
+    WalletDB::TxParameters& WalletDB::get_TxParameters(const TxID& txID) const
+    {
+        auto it = m_TxParameters.find(txID);
+        if (m_TxParameters.end() != it)
+            return it->second;
+
+        // Keep the cache bounded. Normally only the active transactions are there, the rest are brought by the history browsing
+        const size_t nMaxCached = 4096;
+        if (m_TxParameters.size() >= nMaxCached)
+            m_TxParameters.clear();
+
+        TxParameters& params = m_TxParameters[txID];
+
+        const char* req = "SELECT paramID, value FROM " TX_PARAMS_NAME " WHERE txID=?1;";
+        sqlite::Statement stm(*this, Query::TxParamsGet, req);
         stm.bind(1, txID);
-        stm.bind(2, paramID);
 
-        if (stm.step())
+        while (stm.step())
         {
-            TxParameter parameter = {};
-            int colIdx = 0;
-            ENUM_TX_PARAMS_FIELDS(STM_GET_LIST, NOSEP, parameter);
-            blob = move(parameter.m_value);
-            return true;
+            int paramID = 0;
+            stm.get(0, paramID);
+            stm.get(1, params[static_cast<wallet::TxParameterID>(paramID)]);
         }
-        return false;
+
+        return params;
+    }
+
+    void WalletDB::OnRolledBack()
+    {
+        // the cached parameters and coins may not correspond to the DB anymore
+        m_TxParameters.clear();
+        m_CoinIndexValid = false;
+
+        // the coin changes reported within the transaction haven't happened. Called on unwinding, so the observers
+        // are told later
+        m_CoinsRolledBack = true;
     }
 
-    void WalletDB::notifyCoinsChanged()
+    void WalletDB::beginBatch()
     {
-        for (auto sub : m_subscribers) sub->onCoinsChanged();
+        if (!m_BatchDepth++)
+            m_pBatch = make_unique<sqlite::Transaction>(*this);
+    }
+
+    void WalletDB::commitBatch()
+    {
+        assert(m_BatchDepth);
+        if (!--m_BatchDepth)
+        {
+            m_pBatch->commit();
+            m_pBatch.reset();
+
+            if (m_CoinsRolledBack)
+                notifyCoinsChanged(ChangeAction::Reset, {});
+        }
+    }
+
+    void WalletDB::notifyCoinsChanged(ChangeAction action, const vector<Coin>& items)
+    {
+        if (m_CoinsRolledBack)
+        {
+            m_CoinsRolledBack = false;
+            for (auto sub : m_subscribers) sub->onCoinsChanged(ChangeAction::Reset, {});
+
+            if (ChangeAction::Reset == action)
+                return;
+        }
+
+        for (auto sub : m_subscribers) sub->onCoinsChanged(action, items);
     }
 
     void WalletDB::notifyTransactionChanged(ChangeAction action, vector<TxDescription>&& items)
@@ -2088,26 +2430,18 @@ namespace beam
 
     Amount WalletDB::getTransferredByTx(TxStatus status, bool isSender) const
     {
-        const char* req = "SELECT value FROM " TX_PARAMS_NAME " WHERE paramID = ?5 AND txID IN (SELECT txID FROM " TX_PARAMS_NAME " WHERE paramID= ?1 AND value = ?2 AND txID IN (SELECT txID FROM " TX_PARAMS_NAME " WHERE paramID= ?3 AND value = ?4 ));";
-
-        sqlite::Statement stm(_db, req);
-        ByteBuffer blobStatus = wallet::toByteBuffer(status);
-        ByteBuffer blobIsSender = wallet::toByteBuffer(isSender);
+        const char* req = "SELECT amount FROM " TX_SUMMARY_NAME " WHERE status=?1 AND sender=?2;";
 
-        stm.bind(1, wallet::TxParameterID::Status);
-        stm.bind(2, blobStatus);
-        stm.bind(3, wallet::TxParameterID::IsSender);
-        stm.bind(4, blobIsSender);
-        stm.bind(5, wallet::TxParameterID::Amount);
+        sqlite::Statement stm(*this, Query::TransferredByTx, req);
+        stm.bind(1, status);
+        stm.bind(2, isSender);
 
         Amount totalAmount = 0;
 
         while (stm.step())
         {
-            ByteBuffer blob;
-            stm.get(0, blob);
             Amount amount = 0;
-            deserialize(amount, blob);
+            stm.get(0, amount);
             totalAmount += amount;
         }
 
@@ -2120,7 +2454,7 @@ namespace beam
             "SELECT " TblStates_Hdr " FROM " TblStates " WHERE " TblStates_Height "<? ORDER BY " TblStates_Height " DESC" :
             "SELECT " TblStates_Hdr " FROM " TblStates " ORDER BY " TblStates_Height " DESC";
 
-        sqlite::Statement stm(get_ParentObj()._db, req);
+        sqlite::Statement stm(get_ParentObj(), pBelow ? Query::StateEnumBelow : Query::StateEnum, req);
 
         if (pBelow)
             stm.bind(1, *pBelow);
@@ -2141,7 +2475,7 @@ namespace beam
     {
         const char* req = "SELECT " TblStates_Hdr " FROM " TblStates " WHERE " TblStates_Height "=?";
 
-        sqlite::Statement stm(get_ParentObj()._db, req);
+        sqlite::Statement stm(get_ParentObj(), Query::StateGet, req);
         stm.bind(1, h);
 
         if (!stm.step())
@@ -2153,10 +2487,10 @@ namespace beam
 
     void WalletDB::History::AddStates(const Block::SystemState::Full* pS, size_t nCount)
     {
-        sqlite::Transaction trans(get_ParentObj()._db);
+        sqlite::Transaction trans(get_ParentObj());
 
         const char* req = "INSERT OR REPLACE INTO " TblStates " (" TblStates_Height "," TblStates_Hdr ") VALUES(?,?)";
-        sqlite::Statement stm(get_ParentObj()._db, req);
+        sqlite::Statement stm(get_ParentObj(), Query::StateIns, req);
 
         for (size_t i = 0; i < nCount; i++)
         {
@@ -2281,46 +2615,51 @@ namespace beam
 
 			walletDB.visit([this](const Coin& c)->bool
 			{
-				const Amount& v = c.m_ID.m_Value; // alias
-				switch (c.m_status)
-				{
-				case Coin::Status::Available:
-					Avail += v;
-					Unspent += v;
-
-					switch (c.m_ID.m_Type)
-					{
-					case Key::Type::Coinbase: AvailCoinbase += v; break;
-					case Key::Type::Comission: AvailFee += v; break;
-					default: // suppress warning
-						break;
-					}
-
-					break;
-
-				case Coin::Status::Maturing:
-					Maturing += v;
-					Unspent += v;
-					break;
-
-				case Coin::Status::Incoming: Incoming += v; break;
-				case Coin::Status::Outgoing: Outgoing += v; break;
-				case Coin::Status::Unavailable: Unavail += v; break;
+				Add(c);
+				return true;
+			});
+		}
 
-				default: // suppress warning
-					break;
-				}
+		void Totals::Apply(const Coin& c, bool bAdd)
+		{
+			// the amounts are unsigned, the subtraction wraps around and cancels the previous addition
+			const Amount v = bAdd ? c.m_ID.m_Value : (Amount(0) - c.m_ID.m_Value);
+			switch (c.m_status)
+			{
+			case Coin::Status::Available:
+				Avail += v;
+				Unspent += v;
 
 				switch (c.m_ID.m_Type)
 				{
-				case Key::Type::Coinbase: Coinbase += v; break;
-				case Key::Type::Comission: Fee += v; break;
+				case Key::Type::Coinbase: AvailCoinbase += v; break;
+				case Key::Type::Comission: AvailFee += v; break;
 				default: // suppress warning
 					break;
 				}
 
-				return true;
-			});
+				break;
+
+			case Coin::Status::Maturing:
+				Maturing += v;
+				Unspent += v;
+				break;
+
+			case Coin::Status::Incoming: Incoming += v; break;
+			case Coin::Status::Outgoing: Outgoing += v; break;
+			case Coin::Status::Unavailable: Unavail += v; break;
+
+			default: // suppress warning
+				break;
+			}
+
+			switch (c.m_ID.m_Type)
+			{
+			case Key::Type::Coinbase: Coinbase += v; break;
+			case Key::Type::Comission: Fee += v; break;
+			default: // suppress warning
+				break;
+			}
 		}
 
         WalletAddress createAddress(IWalletDB& walletDB)
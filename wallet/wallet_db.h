@@ -32,9 +32,16 @@
 #include "secstring.h"
 
 struct sqlite3;
+struct sqlite3_stmt;
 
 namespace beam
 {
+    namespace sqlite
+    {
+        struct Statement;
+        struct Transaction;
+    }
+
     const uint32_t EmptyCoinSession = 0;
 
     struct Coin
@@ -120,6 +127,13 @@ namespace beam
         ByteBuffer m_value;
     };
 
+    // optional conditions of the transaction history page
+    struct TxHistoryFilter
+    {
+        boost::optional<TxStatus> m_Status;
+        boost::optional<WalletID> m_PeerID;
+    };
+
     enum class ChangeAction
     {
         Added,
@@ -130,7 +144,9 @@ namespace beam
 
     struct IWalletDbObserver
     {
-        virtual void onCoinsChanged() = 0;
+        // items are the coins as stored (the status isn't deduced), only their IDs are valid for Removed.
+        // Updated is also reported for the coins inserted by save(). Reset means the whole set should be re-read
+        virtual void onCoinsChanged(ChangeAction action, const std::vector<Coin>& items) = 0;
         virtual void onTransactionChanged(ChangeAction action, std::vector<TxDescription>&& items) = 0;
         virtual void onSystemStateChanged() = 0;
         virtual void onAddressChanged() = 0;
@@ -166,6 +182,8 @@ namespace beam
         virtual void rollbackConfirmedUtxo(Height minHeight) = 0;
 
         virtual std::vector<TxDescription> getTxHistory(uint64_t start = 0, int count = std::numeric_limits<int>::max()) = 0;
+        // newest first (ties by txID), the page starts right after pLast (the last tx of the previous page) if specified
+        virtual std::vector<TxDescription> getTxHistory(const TxHistoryFilter&, const TxDescription* pLast, int count) = 0;
         virtual boost::optional<TxDescription> getTx(const TxID& txId) = 0;
         virtual void saveTx(const TxDescription& p) = 0;
         virtual void deleteTx(const TxID& txId) = 0;
@@ -196,6 +214,10 @@ namespace beam
         virtual void ShrinkHistory() = 0;
 
         virtual Amount getTransferredByTx(TxStatus status, bool isSender) const = 0;
+
+        // Groups the writes up to the matching commitBatch() into a single DB transaction. Calls may nest
+        virtual void beginBatch() {}
+        virtual void commitBatch() {}
     };
 
     class WalletDB : public IWalletDB
@@ -232,6 +254,7 @@ namespace beam
         void rollbackConfirmedUtxo(Height minHeight) override;
 
         std::vector<TxDescription> getTxHistory(uint64_t start, int count) override;
+        std::vector<TxDescription> getTxHistory(const TxHistoryFilter&, const TxDescription* pLast, int count) override;
         boost::optional<TxDescription> getTx(const TxID& txId) override;
         void saveTx(const TxDescription& p) override;
         void deleteTx(const TxID& txId) override;
@@ -261,23 +284,55 @@ namespace beam
 
         Amount getTransferredByTx(TxStatus status, bool isSender) const override;
 
+        void beginBatch() override;
+        void commitBatch() override;
+
     private:
+        friend struct sqlite::Statement;
+        friend struct sqlite::Transaction;
+
+        using TxParameters = std::map<wallet::TxParameterID, ByteBuffer>;
+
+        struct CoinValueCmp {
+            bool operator()(const Coin::ID& a, const Coin::ID& b) const {
+                return (a.m_Value != b.m_Value) ? (a.m_Value < b.m_Value) : (a < b);
+            }
+        };
+        using CoinIndex = std::map<Coin::ID, Coin, CoinValueCmp>;
+
         void removeImpl(const Coin::ID& cid);
-        void notifyCoinsChanged();
+        void notifyCoinsChanged(ChangeAction action, const std::vector<Coin>& items);
         void notifyTransactionChanged(ChangeAction action, std::vector<TxDescription>&& items);
         void notifySystemStateChanged();
         void notifyAddressChanged();
 		void CreateStorageTable();
+		void CreateTxSummaryTable();
+		void updateTxSummary(const TxID&);
 		static uint64_t get_RandomID();
 		bool updateRaw(const Coin&);
 		void insertRaw(const Coin&);
 		void insertNew(Coin&);
 		void saveRaw(const Coin&);
+        TxParameters& get_TxParameters(const TxID&) const;
+        CoinIndex& get_CoinIndex();
+        void updateCoinIndex(const Coin&);
+        void OnRolledBack();
 	private:
 
         sqlite3* _db;
         Key::IKdf::Ptr m_pKdf;
 
+        mutable std::vector<sqlite3_stmt*> m_Statements; // prepared once per connection, indexed by the query
+        mutable std::map<TxID, TxParameters> m_TxParameters; // write-through cache of the tx parameters
+        std::unique_ptr<sqlite::Transaction> m_pBatch;
+        uint32_t m_BatchDepth;
+
+        // confirmed unspent coins by value, the candidates for the selection. Loaded on demand
+        CoinIndex m_CoinIndex;
+        bool m_CoinIndexValid;
+
+        bool m_CoinsRolledBack; // the observers should re-read the coins
+
         std::vector<IWalletDbObserver*> m_subscribers;
 
         struct History :public Block::SystemState::IHistory {
@@ -365,8 +420,23 @@ namespace beam
 			Totals() {}
 			Totals(IWalletDB& db) { Init(db); }
 			void Init(IWalletDB&);
+
+			// the coins must have their status deduced
+			void Add(const Coin& c) { Apply(c, true); }
+			void Remove(const Coin& c) { Apply(c, false); }
+		private:
+			void Apply(const Coin&, bool bAdd);
 		};
 
+        // Keeps the wallet DB writes made during its lifetime in a single transaction
+        class DbBatch
+        {
+            IWalletDB::Ptr m_pDB;
+        public:
+            DbBatch(const IWalletDB::Ptr& pDB) : m_pDB(pDB) { m_pDB->beginBatch(); }
+            ~DbBatch() { m_pDB->commitBatch(); }
+        };
+
         std::string ExportAddressesToJson(const IWalletDB& db);
         bool ImportAddressesFromJson(IWalletDB& db, const char* data, size_t size);
     }
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "wallet_network.h"
+#include <atomic>
 
 using namespace std;
 
@@ -225,27 +226,30 @@ namespace beam {
 		Addr::Channel key;
 		key.m_Value = msg.m_Channel;
 
-		for (ChannelSet::iterator it = m_Channels.lower_bound(key); ; it++)
-		{
-			if (m_Channels.end() == it)
-				break;
-			if (it->m_Value != msg.m_Channel)
-				break; // as well
+		std::vector<const Addr*> vAddrs;
+		for (ChannelSet::iterator it = m_Channels.lower_bound(key); (m_Channels.end() != it) && (it->m_Value == msg.m_Channel); it++)
+			vAddrs.push_back(&it->get_ParentObj());
 
-			ByteBuffer buf = msg.m_Message; // duplicate
+		proto::Bbs::Decryptor dec;
+		if (vAddrs.empty() || !dec.Init(&msg.m_Message.front(), static_cast<uint32_t>(msg.m_Message.size())))
+			return;
 
-			uint8_t* pMsg = &buf.front();
-			uint32_t nSize = static_cast<uint32_t>(buf.size());
+		ByteBuffer buf;
+		for (size_t i0 = 0; ; i0++)
+		{
+			size_t i = TrialDecrypt(dec, &vAddrs.front() + i0, vAddrs.size() - i0, buf);
+			if (i == vAddrs.size() - i0)
+				break;
 
-			if (!proto::Bbs::Decrypt(pMsg, nSize, it->get_ParentObj().m_sk))
-				continue;
+			i0 += i;
+			const Addr& addr = *vAddrs[i0];
 
 			wallet::SetTxParameter msgWallet;
 			bool bValid = false;
 
 			try {
 				Deserializer der;
-				der.reset(pMsg, nSize);
+				der.reset(buf);
 				der & msgWallet;
 				bValid = true;
 			}  catch (const std::exception&) {
@@ -255,14 +259,72 @@ namespace beam {
 			if (bValid)
 			{
 				WalletID wid;
-				wid.m_Pk = it->get_ParentObj().m_Pk;
-				wid.m_Channel = it->m_Value;
+				wid.m_Pk = addr.m_Pk;
+				wid.m_Channel = addr.m_Channel.m_Value;
 				m_Wallet.OnWalletMessage(wid, std::move(msgWallet));
 				break;
 			}
 		}
 	}
 
+	size_t WalletNetworkViaBbs::TrialDecrypt(const proto::Bbs::Decryptor& dec, const Addr* const* ppAddr, size_t nCount, ByteBuffer& res)
+	{
+		// Each candidate costs a DH. For a wallet with many addresses on the same channel split them between several threads
+		const size_t nPerThreadMin = 8;
+
+		ThreadPool& tp = ThreadPool::get();
+
+		uint32_t nThreads = tp.get_threads() + 1; // this thread works as well
+		if (nThreads > nCount / nPerThreadMin)
+			nThreads = static_cast<uint32_t>(nCount / nPerThreadMin);
+
+		if (nThreads <= 1)
+		{
+			for (size_t i = 0; i < nCount; i++)
+				if (dec.Decrypt(res, ppAddr[i]->m_sk, ppAddr[i]->m_Pk))
+					return i;
+
+			return nCount;
+		}
+
+		std::atomic<size_t> iNext(0);
+		size_t iFound = nCount;
+		std::mutex mx;
+
+		auto fnWork = [&]()
+		{
+			ByteBuffer buf;
+			while (true)
+			{
+				size_t i = iNext++;
+				if (i >= nCount)
+					break;
+
+				if (dec.Decrypt(buf, ppAddr[i]->m_sk, ppAddr[i]->m_Pk))
+				{
+					std::unique_lock<std::mutex> scope(mx);
+					if (i < iFound)
+					{
+						iFound = i;
+						res.swap(buf);
+					}
+
+					iNext = nCount; // stop the others
+					break;
+				}
+			}
+		};
+
+		ThreadPool::Job::Ptr pJob = ThreadPool::Job::create(ThreadPool::Priority::Verification);
+		for (uint32_t i = 1; i < nThreads; i++)
+			tp.push(pJob, fnWork);
+
+		fnWork();
+		pJob->wait();
+
+		return iFound;
+	}
+
 	void WalletNetworkViaBbs::Send(const WalletID& peerID, wallet::SetTxParameter&& msg)
 	{
 		Serializer ser;
@@ -287,22 +349,9 @@ namespace beam {
 				proto::Bbs::get_HashPartial(pTask->m_hpPartial, pTask->m_Msg);
 
 				if (!m_Miner.m_pEvt)
-				{
 					m_Miner.m_pEvt = io::AsyncEvent::create(io::Reactor::get_Current(), [this]() { OnMined(); });
-					m_Miner.m_Shutdown = false;
-
-					uint32_t nThreads = std::thread::hardware_concurrency();
-					nThreads = (nThreads > 1) ? (nThreads - 1) : 1; // leave at least 1 vacant core for other things
-					m_Miner.m_vThreads.resize(nThreads);
-
-					for (uint32_t i = 0; i < nThreads; i++)
-						m_Miner.m_vThreads[i] = std::thread(&Miner::Thread, &m_Miner, i);
-				}
-
-				std::unique_lock<std::mutex> scope(m_Miner.m_Mutex);
 
-				m_Miner.m_Pending.push_back(std::move(pTask));
-				m_Miner.m_NewTask.notify_all();
+				m_Miner.Start(std::move(pTask));
 			}
 			else
 			{
@@ -367,96 +416,84 @@ namespace beam {
         m_AddressExpirationTimer->start(AddressUpdateInterval_ms, false, [this] { OnAddressTimer(); });
     }
 
-	void WalletNetworkViaBbs::Miner::Stop()
+	void WalletNetworkViaBbs::Miner::Start(Task::Ptr&& pTask)
 	{
-		if (!m_vThreads.empty())
+		ThreadPool& tp = ThreadPool::get();
+
+		if (!m_pJob)
 		{
-			{
-				std::unique_lock<std::mutex> scope(m_Mutex);
-				m_Shutdown = true;
-				m_NewTask.notify_all();
-			}
+			m_pJob = ThreadPool::Job::create(ThreadPool::Priority::Mining);
+			m_nThreads = tp.get_threads();
+		}
 
-			for (size_t i = 0; i < m_vThreads.size(); i++)
-				if (m_vThreads[i].joinable())
-					m_vThreads[i].join();
+		for (uint32_t i = 0; i < m_nThreads; i++)
+			tp.push(m_pJob, [this, pTask, i]() { Mine(pTask, i); });
+	}
 
-			m_vThreads.clear();
-			m_pEvt.reset();
+	void WalletNetworkViaBbs::Miner::Stop()
+	{
+		if (m_pJob)
+		{
+			m_pJob->cancel();
+			m_pJob->wait();
+			m_pJob.reset();
 		}
+
+		m_pEvt.reset();
 	}
 
-	void WalletNetworkViaBbs::Miner::Thread(uint32_t iThread)
+	void WalletNetworkViaBbs::Miner::Mine(const Task::Ptr& pTask, proto::Bbs::NonceType nonce)
 	{
-		proto::Bbs::NonceType nStep = static_cast<uint32_t>(m_vThreads.size());
+		proto::Bbs::NonceType nStep = m_nThreads;
 
-		while (true)
+		Timestamp ts = 0;
+
+		for (uint32_t i = 0; ; i++)
 		{
-			Task::Ptr pTask;
+			if (pTask->m_Done || m_pJob->is_cancelled())
+				return;
 
-			for (std::unique_lock<std::mutex> scope(m_Mutex); ; m_NewTask.wait(scope))
-			{
-				if (m_Shutdown)
-					return;
+			if (!(i & 0xff))
+				ts = getTimestamp();
 
-				if (!m_Pending.empty())
+			if ((i & 0xfff) == 0xfff)
+			{
+				ThreadPool& tp = ThreadPool::get();
+				if (tp.should_yield(ThreadPool::Priority::Mining, true))
 				{
-					pTask = m_Pending.front();
-					break;
+					// let the others run, continue from the same nonce later
+					tp.yield(m_pJob, [this, pTask, nonce]() { Mine(pTask, nonce); });
+					return;
 				}
 			}
 
-			Timestamp ts = 0;
-			proto::Bbs::NonceType nonce = iThread;
-			bool bSuccess = false;
-
-			for (uint32_t i = 0; ; i++)
-			{
-				if (pTask->m_Done || m_Shutdown)
-					break;
-
-				if (!(i & 0xff))
-					ts = getTimestamp();
-
-				// attempt to mine it
-				ECC::Hash::Value hv;
-				ECC::Hash::Processor hp = pTask->m_hpPartial;
-				hp
-					<< ts
-					<< nonce
-					>> hv;
-
-				if (proto::Bbs::IsHashValid(hv))
-				{
-					bSuccess = true;
-					break;
-				}
+			// attempt to mine it
+			ECC::Hash::Value hv;
+			ECC::Hash::Processor hp = pTask->m_hpPartial;
+			hp
+				<< ts
+				<< nonce
+				>> hv;
 
-				nonce += nStep;
-			}
+			if (proto::Bbs::IsHashValid(hv))
+				break;
 
-			if (bSuccess)
-			{
-				std::unique_lock<std::mutex> scope(m_Mutex);
+			nonce += nStep;
+		}
 
-				if (pTask->m_Done)
-					bSuccess = false;
-				else
-				{
-					assert(m_Pending.front() == pTask);
+		{
+			std::unique_lock<std::mutex> scope(m_Mutex);
 
-					pTask->m_Msg.m_TimePosted = ts;
-					pTask->m_Msg.m_Nonce = nonce;
+			if (pTask->m_Done)
+				return; // the other one was faster
 
-					pTask->m_Done = true;
-					m_Pending.pop_front();
-					m_Done.push_back(std::move(pTask));
-				}
-			}
+			pTask->m_Msg.m_TimePosted = ts;
+			pTask->m_Msg.m_Nonce = nonce;
 
-			if (bSuccess)
-				m_pEvt->post();
+			pTask->m_Done = true;
+			m_Done.push_back(pTask);
 		}
 
+		m_pEvt->post();
 	}
 }
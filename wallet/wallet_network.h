@@ -21,6 +21,7 @@
 #include "utility/logger.h"
 #include "core/proto.h"
 #include "utility/io/timer.h"
+#include "utility/thread_pool.h"
 #include <boost/intrusive/set.hpp>
 #include <boost/intrusive/list.hpp>
 #include "wallet.h"
@@ -91,6 +92,7 @@ namespace beam
         } m_BbsSentEvt;
 
         void OnMsg(const proto::BbsMsg&);
+        static size_t TrialDecrypt(const proto::Bbs::Decryptor&, const Addr* const* ppAddr, size_t nCount, ByteBuffer& res);
 
         static BbsChannel channel_from_wallet_id(const WalletID& walletID);
 
@@ -101,12 +103,11 @@ namespace beam
 
 		struct Miner
 		{
-			// message mining
-			std::vector<std::thread> m_vThreads;
+			// message mining, in the shared thread pool. Each message is mined by several pool tasks with interleaved nonces
+			ThreadPool::Job::Ptr m_pJob;
+			uint32_t m_nThreads = 0;
 			std::mutex m_Mutex;
-			std::condition_variable m_NewTask;
 
-			volatile bool m_Shutdown;
 			io::AsyncEvent::Ptr m_pEvt;
 
 			struct Task
@@ -120,14 +121,13 @@ namespace beam
 
 			typedef std::deque<Task::Ptr> TaskQueue;
 
-			TaskQueue m_Pending;
 			TaskQueue m_Done;
 
-			Miner() :m_Shutdown(false) {}
 			~Miner() { Stop(); }
 
+			void Start(Task::Ptr&&);
 			void Stop();
-			void Thread(uint32_t);
+			void Mine(const Task::Ptr&, proto::Bbs::NonceType nonce);
 
 		} m_Miner;
 
@@ -108,6 +108,8 @@ namespace beam { namespace wallet
 
     void BaseTransaction::Update()
     {
+        DbBatch batch(m_WalletDB); // all the parameters changed during the update are committed at once
+
         try
         {
             if (CheckExternalFailures())